@@ -28,7 +28,9 @@
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/FrontendDiagnostic.h"
 #include "clang/Frontend/MultiplexConsumer.h"
+#include "clang/Frontend/PrecompiledPreamble.h"
 #include "clang/Frontend/TextDiagnosticPrinter.h"
+#include "clang/Lex/Lexer.h"
 #include "clang/Lex/PPCallbacks.h"
 #include "clang/Lex/Preprocessor.h"
 #include "clang/Lex/PreprocessorOptions.h"
@@ -39,8 +41,13 @@
 #include "clang/Tooling/Refactoring.h"
 #include "clang/Tooling/ReplacementsYaml.h"
 #include "clang/Tooling/Tooling.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/Process.h"
+#include "llvm/Support/ThreadPool.h"
 #include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <optional>
 #include <utility>
 
 #if CLANG_TIDY_ENABLE_STATIC_ANALYZER
@@ -524,13 +531,309 @@ getCheckOptions(const ClangTidyOptions &Options,
   return Factory.getCheckOptions();
 }
 
-std::vector<ClangTidyError>
-runClangTidy(clang::tidy::ClangTidyContext &Context,
+namespace {
+
+/// Returns whether \p Preamble only has #include and #import directives,
+/// which act the same in any file of the same directory.
+bool hasOnlyIncludes(StringRef Preamble, const LangOptions &LangOpts) {
+  // The lexer needs a null-terminated buffer.
+  std::string Text(Preamble);
+  Lexer Lex(SourceLocation(), LangOpts, Text.data(), Text.data(),
+            Text.data() + Text.size());
+  Token Tok;
+  Lex.LexFromRawLexer(Tok);
+  while (Tok.isNot(tok::eof)) {
+    if (Tok.isNot(tok::hash) || !Tok.isAtStartOfLine())
+      return false;
+    Lex.LexFromRawLexer(Tok);
+    if (Tok.isNot(tok::raw_identifier) ||
+        (Tok.getRawIdentifier() != "include" &&
+         Tok.getRawIdentifier() != "import"))
+      return false;
+    do
+      Lex.LexFromRawLexer(Tok);
+    while (Tok.isNot(tok::eof) && !Tok.isAtStartOfLine());
+  }
+  return true;
+}
+
+/// Returns what, besides the text of the preamble, determines how the main
+/// file of \p Invocation is parsed: the command without the names of the
+/// files, and the directories that includes are looked up from.
+std::string getCommandKey(const CompilerInvocation &Invocation,
+                          llvm::vfs::FileSystem &FS) {
+  std::string Key;
+  llvm::raw_string_ostream OS(Key);
+  if (llvm::ErrorOr<std::string> Dir = FS.getCurrentWorkingDirectory())
+    OS << *Dir;
+  OS << '\0'
+     << llvm::sys::path::parent_path(
+            Invocation.getFrontendOpts().Inputs[0].getFile())
+     << '\0';
+
+  CompilerInvocation Command(Invocation);
+  Command.getFrontendOpts().Inputs.clear();
+  Command.getFrontendOpts().OutputFile.clear();
+  Command.getCodeGenOpts().MainFileName.clear();
+  Command.getDependencyOutputOpts() = DependencyOutputOptions();
+  for (const std::string &Arg : Command.getCC1CommandLine())
+    OS << Arg << '\0';
+  return Key;
+}
+
+/// The precompiled preambles shared by the files of a run, see
+/// ClangTidyBatchOptions::SharePreambles. This class is thread-safe.
+class PreambleCache {
+public:
+  /// \param Capacity The number of preambles to keep. Files are usually
+  /// listed by directory, so the files that can share a preamble are close.
+  explicit PreambleCache(size_t Capacity) : Capacity(Capacity) {}
+
+  /// Returns the preamble to parse the main file of \p Invocation with, whose
+  /// contents are \p MainFile, building it if needed. Returns nothing if the
+  /// file must be parsed in full.
+  std::shared_ptr<const PrecompiledPreamble>
+  get(const CompilerInvocation &Invocation, StringRef CommandKey,
+      const llvm::MemoryBuffer &MainFile,
+      IntrusiveRefCntPtr<llvm::vfs::FileSystem> VFS,
+      std::shared_ptr<PCHContainerOperations> PCHContainerOps);
+
+  /// Returns whether the checks were seen to register preprocessor callbacks
+  /// for files with the configuration \p Config, or nothing if no such file
+  /// was parsed in full yet.
+  std::optional<bool> watchesPreprocessor(StringRef Config) {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    auto It = WatchesPreprocessor.find(Config);
+    if (It == WatchesPreprocessor.end())
+      return std::nullopt;
+    return It->second;
+  }
+
+  void noteWatchesPreprocessor(StringRef Config, bool Watches) {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    WatchesPreprocessor[Config] |= Watches;
+  }
+
+  /// Returns the numbers of preambles built and reused so far.
+  ClangTidyStats getStats() {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    return Stats;
+  }
+
+private:
+  struct Entry {
+    /// Held while the preamble is built, so that the files that need it wait
+    /// rather than build it again.
+    std::mutex BuildMutex;
+    bool Built = false;
+    /// Null if the preamble could not be built, or had diagnostics, which
+    /// would only be reported for the file that built it.
+    std::shared_ptr<const PrecompiledPreamble> Preamble;
+    uint64_t LastUse = 0;
+  };
+
+  const size_t Capacity;
+  std::mutex Mutex;
+  uint64_t Uses = 0;
+  llvm::StringMap<std::shared_ptr<Entry>> Entries;
+  llvm::StringMap<bool> WatchesPreprocessor;
+  ClangTidyStats Stats;
+};
+
+std::shared_ptr<const PrecompiledPreamble>
+PreambleCache::get(const CompilerInvocation &Invocation, StringRef CommandKey,
+                   const llvm::MemoryBuffer &MainFile,
+                   IntrusiveRefCntPtr<llvm::vfs::FileSystem> VFS,
+                   std::shared_ptr<PCHContainerOperations> PCHContainerOps) {
+  PreambleBounds Bounds =
+      ComputePreambleBounds(Invocation.getLangOpts(),
+                            MainFile.getMemBufferRef(), /*MaxLines=*/0);
+  StringRef Preamble = MainFile.getBuffer().take_front(Bounds.Size);
+  if (Preamble.empty() || !hasOnlyIncludes(Preamble, Invocation.getLangOpts()))
+    return nullptr;
+
+  std::string Key = CommandKey.str();
+  Key += Bounds.PreambleEndsAtStartOfLine ? '1' : '0';
+  Key += Preamble;
+
+  std::shared_ptr<Entry> E;
+  {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    std::shared_ptr<Entry> &Slot = Entries[Key];
+    if (!Slot)
+      Slot = std::make_shared<Entry>();
+    Slot->LastUse = ++Uses;
+    E = Slot;
+    if (Entries.size() > Capacity) {
+      auto Oldest = Entries.begin();
+      for (auto It = Entries.begin(); It != Entries.end(); ++It)
+        if (It->second->LastUse < Oldest->second->LastUse)
+          Oldest = It;
+      Entries.erase(Oldest);
+    }
+  }
+
+  std::lock_guard<std::mutex> Lock(E->BuildMutex);
+  if (E->Built) {
+    if (E->Preamble) {
+      std::lock_guard<std::mutex> StatsLock(Mutex);
+      ++Stats.PreamblesReused;
+    }
+    return E->Preamble;
+  }
+  E->Built = true;
+
+  DiagnosticConsumer Counter;
+  auto DiagOpts = llvm::makeIntrusiveRefCnt<DiagnosticOptions>(
+      Invocation.getDiagnosticOpts());
+  IntrusiveRefCntPtr<DiagnosticsEngine> Diags =
+      CompilerInstance::createDiagnostics(DiagOpts.get(), &Counter,
+                                          /*ShouldOwnClient=*/false);
+  PreambleCallbacks Callbacks;
+  llvm::ErrorOr<PrecompiledPreamble> Built = PrecompiledPreamble::Build(
+      Invocation, &MainFile, Bounds, *Diags, std::move(VFS),
+      std::move(PCHContainerOps), /*StoreInMemory=*/true,
+      /*StoragePath=*/"", Callbacks);
+  if (Built && !Counter.getNumWarnings() && !Counter.getNumErrors()) {
+    E->Preamble =
+        std::make_shared<const PrecompiledPreamble>(std::move(*Built));
+    std::lock_guard<std::mutex> StatsLock(Mutex);
+    ++Stats.PreamblesBuilt;
+  }
+  return E->Preamble;
+}
+
+class ActionFactory : public FrontendActionFactory {
+public:
+  ActionFactory(ClangTidyContext &Context,
+                IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem> BaseFS,
+                PreambleCache *Preambles)
+      : Context(Context), ConsumerFactory(Context, std::move(BaseFS)),
+        Preambles(Preambles) {}
+  std::unique_ptr<FrontendAction> create() override {
+    return std::make_unique<Action>(*this);
+  }
+
+  bool runInvocation(std::shared_ptr<CompilerInvocation> Invocation,
+                     FileManager *Files,
+                     std::shared_ptr<PCHContainerOperations> PCHContainerOps,
+                     DiagnosticConsumer *DiagConsumer) override {
+    // Explicitly ask to define __clang_analyzer__ macro.
+    Invocation->getPreprocessorOpts().SetUpStaticAnalyzer = true;
+    const FrontendOptions &FrontendOpts = Invocation->getFrontendOpts();
+    if (!Preambles || FrontendOpts.Inputs.size() != 1 ||
+        !FrontendOpts.Inputs[0].isFile())
+      return FrontendActionFactory::runInvocation(
+          Invocation, Files, PCHContainerOps, DiagConsumer);
+    return runWithPreamble(std::move(Invocation), Files,
+                           std::move(PCHContainerOps), DiagConsumer);
+  }
+
+private:
+  bool runWithPreamble(std::shared_ptr<CompilerInvocation> Invocation,
+                       FileManager *Files,
+                       std::shared_ptr<PCHContainerOperations> PCHContainerOps,
+                       DiagnosticConsumer *DiagConsumer);
+
+  class Action : public ASTFrontendAction {
+  public:
+    Action(ActionFactory &Owner) : Owner(Owner) {}
+    std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &Compiler,
+                                                   StringRef File) override {
+      PPCallbacks *Callbacks = Compiler.getPreprocessor().getPPCallbacks();
+      std::unique_ptr<ASTConsumer> Consumer =
+          Owner.ConsumerFactory.createASTConsumer(Compiler, File);
+      Owner.WatchedPreprocessor =
+          Compiler.getPreprocessor().getPPCallbacks() != Callbacks;
+      return Consumer;
+    }
+
+  private:
+    ActionFactory &Owner;
+  };
+
+  ClangTidyContext &Context;
+  ClangTidyASTConsumerFactory ConsumerFactory;
+  PreambleCache *Preambles;
+  /// Whether the checks of the current file registered preprocessor
+  /// callbacks, which would miss the directives of a preamble.
+  std::optional<bool> WatchedPreprocessor;
+};
+
+bool ActionFactory::runWithPreamble(
+    std::shared_ptr<CompilerInvocation> Invocation, FileManager *Files,
+    std::shared_ptr<PCHContainerOperations> PCHContainerOps,
+    DiagnosticConsumer *DiagConsumer) {
+  StringRef MainFilePath = Invocation->getFrontendOpts().Inputs[0].getFile();
+  std::string CommandKey =
+      getCommandKey(*Invocation, Files->getVirtualFileSystem());
+  // Which callbacks the checks register depends on their options and on the
+  // language, so learn it for each of them from a file parsed in full.
+  std::string Config =
+      configurationAsText(Context.getOptionsForFile(MainFilePath)) +
+      CommandKey;
+
+  WatchedPreprocessor.reset();
+  std::unique_ptr<llvm::MemoryBuffer> MainFile;
+  std::shared_ptr<const PrecompiledPreamble> Preamble;
+  if (Preambles->watchesPreprocessor(Config) == false) {
+    if (auto Buffer =
+            Files->getVirtualFileSystem().getBufferForFile(MainFilePath)) {
+      MainFile = std::move(*Buffer);
+      Preamble = Preambles->get(*Invocation, CommandKey, *MainFile,
+                                Files->getVirtualFileSystemPtr(),
+                                PCHContainerOps);
+    }
+  }
+  if (!Preamble) {
+    bool Success = FrontendActionFactory::runInvocation(
+        Invocation, Files, PCHContainerOps, DiagConsumer);
+    if (WatchedPreprocessor)
+      Preambles->noteWatchesPreprocessor(Config, *WatchedPreprocessor);
+    return Success;
+  }
+
+  IntrusiveRefCntPtr<llvm::vfs::FileSystem> VFS =
+      Files->getVirtualFileSystemPtr();
+  Invocation->getPreprocessorOpts().RetainRemappedFileBuffers = true;
+  Preamble->AddImplicitPreamble(*Invocation, VFS, MainFile.get());
+  // An in-memory preamble is read through a file system of its own.
+  auto PreambleFiles =
+      llvm::makeIntrusiveRefCnt<FileManager>(Files->getFileSystemOpts(), VFS);
+  bool Success = FrontendActionFactory::runInvocation(
+      Invocation, PreambleFiles.get(), PCHContainerOps, DiagConsumer);
+  if (WatchedPreprocessor)
+    Preambles->noteWatchesPreprocessor(Config, *WatchedPreprocessor);
+  return Success;
+}
+
+/// Gives the options of files from the context of the run to the contexts of
+/// the threads that check files in parallel.
+class SharedOptionsProvider : public ClangTidyOptionsProvider {
+public:
+  SharedOptionsProvider(const ClangTidyContext &Context, std::mutex &Mutex)
+      : Context(Context), Mutex(Mutex) {}
+
+  const ClangTidyGlobalOptions &getGlobalOptions() override {
+    return Context.getGlobalOptions();
+  }
+
+  std::vector<OptionsSource> getRawOptions(StringRef FileName) override {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    return {{Context.getOptionsForFile(FileName), "clang-tidy run"}};
+  }
+
+private:
+  const ClangTidyContext &Context;
+  std::mutex &Mutex;
+};
+
+/// Checks \p InputFiles one after the other.
+void runTool(ClangTidyContext &Context, DiagnosticConsumer &DiagConsumer,
              const CompilationDatabase &Compilations,
              ArrayRef<std::string> InputFiles,
-             llvm::IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem> BaseFS,
-             bool ApplyAnyFix, bool EnableCheckProfile,
-             llvm::StringRef StoreCheckProfile) {
+             IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem> BaseFS,
+             PreambleCache *Preambles) {
   ClangTool Tool(Compilations, InputFiles,
                  std::make_shared<PCHContainerOperations>(), BaseFS);
 
@@ -554,6 +857,22 @@ runClangTidy(clang::tidy::ClangTidyContext &Context,
 
   Tool.appendArgumentsAdjuster(PerFileExtraArgumentsInserter);
   Tool.appendArgumentsAdjuster(getStripPluginsAdjuster());
+  Tool.setDiagnosticConsumer(&DiagConsumer);
+
+  ActionFactory Factory(Context, std::move(BaseFS), Preambles);
+  Tool.run(&Factory);
+}
+
+} // namespace
+
+std::vector<ClangTidyError>
+runClangTidy(clang::tidy::ClangTidyContext &Context,
+             const CompilationDatabase &Compilations,
+             ArrayRef<std::string> InputFiles,
+             llvm::IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem> BaseFS,
+             bool ApplyAnyFix, bool EnableCheckProfile,
+             llvm::StringRef StoreCheckProfile,
+             const ClangTidyBatchOptions &Batch) {
   Context.setEnableProfiling(EnableCheckProfile);
   Context.setProfileStoragePrefix(StoreCheckProfile);
 
@@ -561,45 +880,60 @@ runClangTidy(clang::tidy::ClangTidyContext &Context,
   DiagnosticsEngine DE(new DiagnosticIDs(), new DiagnosticOptions(),
                        &DiagConsumer, /*ShouldOwnClient=*/false);
   Context.setDiagnosticsEngine(&DE);
-  Tool.setDiagnosticConsumer(&DiagConsumer);
-
-  class ActionFactory : public FrontendActionFactory {
-  public:
-    ActionFactory(ClangTidyContext &Context,
-                  IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem> BaseFS)
-        : ConsumerFactory(Context, std::move(BaseFS)) {}
-    std::unique_ptr<FrontendAction> create() override {
-      return std::make_unique<Action>(&ConsumerFactory);
-    }
 
-    bool runInvocation(std::shared_ptr<CompilerInvocation> Invocation,
-                       FileManager *Files,
-                       std::shared_ptr<PCHContainerOperations> PCHContainerOps,
-                       DiagnosticConsumer *DiagConsumer) override {
-      // Explicitly ask to define __clang_analyzer__ macro.
-      Invocation->getPreprocessorOpts().SetUpStaticAnalyzer = true;
-      return FrontendActionFactory::runInvocation(
-          Invocation, Files, PCHContainerOps, DiagConsumer);
-    }
+  unsigned Jobs = std::min<size_t>(Batch.Jobs, InputFiles.size());
+  std::optional<PreambleCache> Preambles;
+  if (Batch.SharePreambles)
+    Preambles.emplace(/*Capacity=*/4 * std::max(Jobs, 1u));
+
+  if (Jobs <= 1) {
+    runTool(Context, DiagConsumer, Compilations, InputFiles, std::move(BaseFS),
+            Preambles ? &*Preambles : nullptr);
+    if (Preambles)
+      Context.addStats(Preambles->getStats());
+    return DiagConsumer.take();
+  }
 
-  private:
-    class Action : public ASTFrontendAction {
-    public:
-      Action(ClangTidyASTConsumerFactory *Factory) : Factory(Factory) {}
-      std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &Compiler,
-                                                     StringRef File) override {
-        return Factory->createASTConsumer(Compiler, File);
+  // Each thread checks the next file that is not taken yet, and keeps the
+  // errors of each file apart, so that they are merged in the order of the
+  // files like when checking them one after the other.
+  assert(Batch.CreateFS && "Checking files in parallel needs CreateFS");
+  std::vector<std::vector<ClangTidyError>> FileErrors(InputFiles.size());
+  std::vector<ClangTidyStats> ThreadStats(Jobs);
+  std::atomic<size_t> NextFile(0);
+  std::mutex OptionsMutex;
+  DefaultThreadPool Pool(hardware_concurrency(Jobs));
+  for (unsigned I = 0; I < Jobs; ++I)
+    Pool.async([&, I] {
+      ClangTidyContext ThreadContext(
+          std::make_unique<SharedOptionsProvider>(Context, OptionsMutex),
+          Context.canEnableAnalyzerAlphaCheckers(),
+          Context.canEnableModuleHeadersParsing());
+      ThreadContext.setEnableProfiling(EnableCheckProfile);
+      ThreadContext.setProfileStoragePrefix(StoreCheckProfile);
+      ClangTidyDiagnosticConsumer ThreadConsumer(
+          ThreadContext, nullptr, /*RemoveIncompatibleErrors=*/false,
+          ApplyAnyFix);
+      DiagnosticsEngine ThreadDE(new DiagnosticIDs(), new DiagnosticOptions(),
+                                 &ThreadConsumer, /*ShouldOwnClient=*/false);
+      ThreadContext.setDiagnosticsEngine(&ThreadDE);
+      IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem> FS = Batch.CreateFS();
+
+      for (size_t File; (File = NextFile++) < InputFiles.size();) {
+        runTool(ThreadContext, ThreadConsumer, Compilations,
+                InputFiles[File], FS, Preambles ? &*Preambles : nullptr);
+        FileErrors[File] = ThreadConsumer.take();
       }
-
-    private:
-      ClangTidyASTConsumerFactory *Factory;
-    };
-
-    ClangTidyASTConsumerFactory ConsumerFactory;
-  };
-
-  ActionFactory Factory(Context, std::move(BaseFS));
-  Tool.run(&Factory);
+      ThreadStats[I] = ThreadContext.getStats();
+    });
+  Pool.wait();
+
+  for (std::vector<ClangTidyError> &Errors : FileErrors)
+    DiagConsumer.addErrors(std::move(Errors));
+  for (const ClangTidyStats &Stats : ThreadStats)
+    Context.addStats(Stats);
+  if (Preambles)
+    Context.addStats(Preambles->getStats());
   return DiagConsumer.take();
 }
 
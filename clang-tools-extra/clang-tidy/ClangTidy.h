@@ -12,6 +12,7 @@
 #include "ClangTidyDiagnosticConsumer.h"
 #include "ClangTidyOptions.h"
 #include "llvm/ADT/StringSet.h"
+#include <functional>
 #include <memory>
 #include <vector>
 
@@ -76,6 +77,27 @@ ClangTidyOptions::OptionMap
 getCheckOptions(const ClangTidyOptions &Options,
                 bool AllowEnablingAnalyzerAlphaCheckers);
 
+/// Controls how runClangTidy checks many files in one process.
+struct ClangTidyBatchOptions {
+  /// The number of files to check in parallel. Each thread has its own
+  /// context, which gets the options of files from the one passed to
+  /// runClangTidy.
+  unsigned Jobs = 1;
+
+  /// Creates the file system of each thread, which must not share its working
+  /// directory with the others, unlike the real file system. Required if
+  /// Jobs is more than 1.
+  std::function<llvm::IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem>()>
+      CreateFS;
+
+  /// If true, files that start with the same #include directives and that are
+  /// compiled the same way parse those includes once, into a precompiled
+  /// preamble that they share. Files whose checks watch the preprocessor, or
+  /// whose preamble has other directives or produces diagnostics, are always
+  /// parsed in full.
+  bool SharePreambles = false;
+};
+
 /// Run a set of clang-tidy checks on a set of files.
 ///
 /// \param EnableCheckProfile If provided, it enables check profile collection
@@ -83,13 +105,15 @@ getCheckOptions(const ClangTidyOptions &Options,
 /// \param StoreCheckProfile If provided, and EnableCheckProfile is true,
 /// the profile will not be output to stderr, but will instead be stored
 /// as a JSON file in the specified directory.
+/// \param Batch Controls parallelism and sharing between the files.
 std::vector<ClangTidyError>
 runClangTidy(clang::tidy::ClangTidyContext &Context,
              const tooling::CompilationDatabase &Compilations,
              ArrayRef<std::string> InputFiles,
              llvm::IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem> BaseFS,
              bool ApplyAnyFix, bool EnableCheckProfile = false,
-             llvm::StringRef StoreCheckProfile = StringRef());
+             llvm::StringRef StoreCheckProfile = StringRef(),
+             const ClangTidyBatchOptions &Batch = ClangTidyBatchOptions());
 
 /// Controls what kind of fixes clang-tidy is allowed to apply.
 enum FixBehaviour {
@@ -268,6 +268,16 @@ ClangTidyOptions ClangTidyContext::getOptionsForFile(StringRef File) const {
       OptionsProvider->getOptions(File), 0);
 }
 
+void ClangTidyContext::addStats(const ClangTidyStats &Other) {
+  Stats.ErrorsDisplayed += Other.ErrorsDisplayed;
+  Stats.ErrorsIgnoredCheckFilter += Other.ErrorsIgnoredCheckFilter;
+  Stats.ErrorsIgnoredNOLINT += Other.ErrorsIgnoredNOLINT;
+  Stats.ErrorsIgnoredNonUserCode += Other.ErrorsIgnoredNonUserCode;
+  Stats.ErrorsIgnoredLineFilter += Other.ErrorsIgnoredLineFilter;
+  Stats.PreamblesBuilt += Other.PreamblesBuilt;
+  Stats.PreamblesReused += Other.PreamblesReused;
+}
+
 void ClangTidyContext::setEnableProfiling(bool P) { Profile = P; }
 
 void ClangTidyContext::setProfileStoragePrefix(StringRef Prefix) {
@@ -752,6 +762,13 @@ std::vector<ClangTidyError> ClangTidyDiagnosticConsumer::take() {
   return std::move(Errors);
 }
 
+void ClangTidyDiagnosticConsumer::addErrors(
+    std::vector<ClangTidyError> NewErrors) {
+  finalizeLastError();
+  Errors.insert(Errors.end(), std::make_move_iterator(NewErrors.begin()),
+                std::make_move_iterator(NewErrors.end()));
+}
+
 namespace {
 struct LessClangTidyErrorWithoutDiagnosticName {
   bool operator()(const ClangTidyError *LHS, const ClangTidyError *RHS) const {
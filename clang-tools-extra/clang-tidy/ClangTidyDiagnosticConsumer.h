@@ -50,6 +50,11 @@ struct ClangTidyStats {
   unsigned ErrorsIgnoredNOLINT = 0;
   unsigned ErrorsIgnoredNonUserCode = 0;
   unsigned ErrorsIgnoredLineFilter = 0;
+  /// The preambles built to be shared between files, see
+  /// ClangTidyBatchOptions::SharePreambles, and the number of files that were
+  /// parsed with a preamble built for another file.
+  unsigned PreamblesBuilt = 0;
+  unsigned PreamblesReused = 0;
 
   unsigned errorsIgnored() const {
     return ErrorsIgnoredNOLINT + ErrorsIgnoredCheckFilter +
@@ -174,6 +179,10 @@ public:
   /// counters.
   const ClangTidyStats &getStats() const { return Stats; }
 
+  /// Adds the counters of \p Other, e.g. of a context that checked other
+  /// files in parallel.
+  void addStats(const ClangTidyStats &Other);
+
   /// Control profile collection in clang-tidy.
   void setEnableProfiling(bool Profile);
   bool getEnableProfiling() const { return Profile; }
@@ -290,6 +299,10 @@ public:
   // Retrieve the diagnostics that were captured.
   std::vector<ClangTidyError> take();
 
+  /// Adds errors captured by another consumer, e.g. one that checked other
+  /// files in parallel, so that take() returns them along with its own.
+  void addErrors(std::vector<ClangTidyError> NewErrors);
+
 private:
   void finalizeLastError();
   void removeIncompatibleErrors();
@@ -304,6 +304,23 @@ This option overrides the 'UseColor' option in
 )"),
                               cl::init(false), cl::cat(ClangTidyCategory));
 
+static cl::opt<unsigned> Jobs("j", desc(R"(
+Number of files to check in parallel, each
+thread with its own copy of the checks. Defaults
+to checking files one after the other.
+)"),
+                              cl::init(1), cl::cat(ClangTidyCategory));
+
+static cl::opt<bool> SharePreambles("share-preambles", desc(R"(
+Parse the #include directives that files start
+with once for all the files that start with the
+same ones and are compiled the same way. Files
+are parsed in full for checks that watch the
+preprocessor.
+)"),
+                                    cl::init(false),
+                                    cl::cat(ClangTidyCategory));
+
 static cl::opt<bool> VerifyConfig("verify-config", desc(R"(
 Check the config files to ensure each check and
 option is recognized.
@@ -338,6 +355,11 @@ static void printStats(const ClangTidyStats &Stats) {
                       "non-system headers. Use -system-headers to display "
                       "errors from system headers as well.\n";
   }
+  if (Stats.PreamblesBuilt)
+    llvm::errs() << "Shared " << Stats.PreamblesBuilt << " preamble"
+                 << (Stats.PreamblesBuilt == 1 ? "" : "s") << ", reused "
+                 << Stats.PreamblesReused << " time"
+                 << (Stats.PreamblesReused == 1 ? "" : "s") << ".\n";
 }
 
 static std::unique_ptr<ClangTidyOptionsProvider> createOptionsProvider(
@@ -511,9 +533,11 @@ static SmallString<256> makeAbsolute(llvm::StringRef Input) {
   return AbsolutePath;
 }
 
-static llvm::IntrusiveRefCntPtr<vfs::OverlayFileSystem> createBaseFS() {
+static llvm::IntrusiveRefCntPtr<vfs::OverlayFileSystem>
+createBaseFS(llvm::IntrusiveRefCntPtr<vfs::FileSystem> RealFS =
+                 vfs::getRealFileSystem()) {
   llvm::IntrusiveRefCntPtr<vfs::OverlayFileSystem> BaseFS(
-      new vfs::OverlayFileSystem(vfs::getRealFileSystem()));
+      new vfs::OverlayFileSystem(std::move(RealFS)));
 
   if (!VfsOverlay.empty()) {
     IntrusiveRefCntPtr<vfs::FileSystem> VfsFromFile =
@@ -652,9 +676,15 @@ int clangTidyMain(int argc, const char **argv) {
   ClangTidyContext Context(std::move(OwningOptionsProvider),
                            AllowEnablingAnalyzerAlphaCheckers,
                            EnableModuleHeadersParsing);
+  ClangTidyBatchOptions Batch;
+  Batch.Jobs = Jobs;
+  // Threads change the working directory of their file system, so they cannot
+  // share the real one, which is that of the process.
+  Batch.CreateFS = [] { return createBaseFS(vfs::createPhysicalFileSystem()); };
+  Batch.SharePreambles = SharePreambles;
   std::vector<ClangTidyError> Errors =
       runClangTidy(Context, OptionsParser->getCompilations(), PathList, BaseFS,
-                   FixNotes, EnableCheckProfile, ProfilePrefix);
+                   FixNotes, EnableCheckProfile, ProfilePrefix, Batch);
   bool FoundErrors = llvm::any_of(Errors, [](const ClangTidyError &E) {
     return E.DiagLevel == ClangTidyError::Error;
   });
@@ -445,6 +445,91 @@ readCompileCommand(Reader CmdReader, llvm::ArrayRef<llvm::StringRef> Strings) {
   return Cmd;
 }
 
+// POSTING LISTS ENCODING
+// The search structures of a Dex index over the symbols of the file, so that
+// loading the file does not compute them again:
+//  - format version: 4 bytes, as they depend on how dex generates tokens
+//  - ranking: number of symbols (varint), then the position of each symbol in
+//    the symbol section (varint), in DocID order
+//  - lists: number of lists (varint), then for each list the token kind (1
+//    byte), the token data (string table index) and the number of chunks
+//    (varint)
+//  - chunks: the compressed chunks of all the lists, in order, 32 bytes each
+// The chunks are used in place, so the file should be mapped into memory.
+
+constexpr static uint32_t PostingsVersion = 1;
+
+void writePostings(const dex::DexPostings &Postings,
+                   llvm::ArrayRef<llvm::StringRef> TokenData,
+                   const StringTableOut &Strings, llvm::raw_ostream &OS) {
+  write32(PostingsVersion, OS);
+  writeVar(Postings.Ranking.size(), OS);
+  for (uint32_t Position : Postings.Ranking)
+    writeVar(Position, OS);
+  writeVar(Postings.Lists.size(), OS);
+  for (unsigned I = 0; I < Postings.Lists.size(); ++I) {
+    OS.write(static_cast<uint8_t>(Postings.Lists[I].first.kind()));
+    writeVar(Strings.index(TokenData[I]), OS);
+    writeVar(Postings.Lists[I].second.size(), OS);
+  }
+  for (const auto &List : Postings.Lists)
+    OS << llvm::StringRef(reinterpret_cast<const char *>(List.second.data()),
+                          List.second.size() * sizeof(dex::Chunk));
+}
+
+llvm::Expected<dex::DexPostings>
+readPostings(Reader &Data, llvm::ArrayRef<llvm::StringRef> Strings,
+             size_t NumSymbols) {
+  dex::DexPostings Result;
+  if (!Data.consumeSize(Result.Ranking) || Result.Ranking.size() != NumSymbols)
+    return error("malformed or truncated symbol ranking");
+  std::vector<bool> Ranked(NumSymbols);
+  for (uint32_t &Position : Result.Ranking) {
+    Position = Data.consumeVar();
+    if (Position >= NumSymbols || Ranked[Position])
+      return error("malformed or truncated symbol ranking");
+    Ranked[Position] = true;
+  }
+
+  std::vector<uint32_t> NumChunks;
+  if (!Data.consumeSize(NumChunks))
+    return error("malformed or truncated posting lists");
+  Result.Lists.reserve(NumChunks.size());
+  uint64_t TotalChunks = 0;
+  for (uint32_t &Num : NumChunks) {
+    uint8_t Kind = Data.consume8();
+    llvm::StringRef TokenData = Data.consumeString(Strings);
+    Num = Data.consumeVar();
+    if (Kind > static_cast<uint8_t>(dex::Token::Kind::Sentinel) || !Num)
+      return error("malformed or truncated posting lists");
+    // The string table is freed once the file is read, so the token keeps a
+    // copy of its data.
+    Result.Lists.emplace_back(
+        dex::Token(static_cast<dex::Token::Kind>(Kind), TokenData),
+        llvm::ArrayRef<dex::Chunk>());
+    TotalChunks += Num;
+  }
+  if (Data.err() || Data.rest().size() != TotalChunks * sizeof(dex::Chunk))
+    return error("malformed or truncated posting lists");
+
+  // DocIDs index the ranking, so make sure that they are in range, and sorted
+  // as iterators expect.
+  const auto *Chunks = reinterpret_cast<const dex::Chunk *>(Data.rest().data());
+  for (unsigned I = 0; I < NumChunks.size(); ++I) {
+    llvm::ArrayRef<dex::Chunk> List(Chunks, NumChunks[I]);
+    Chunks += NumChunks[I];
+    int64_t Last = -1;
+    for (const dex::Chunk &C : List)
+      for (dex::DocID ID : C.decompress()) {
+        if (ID >= NumSymbols || ID <= Last)
+          return error("malformed posting list");
+        Last = ID;
+      }
+    Result.Lists[I].second = List;
+  }
+  return std::move(Result);
+}
+
 // FILE ENCODING
 // A file is a RIFF chunk with type 'CdIx'.
 // It contains the sections:
@@ -453,6 +538,7 @@ readCompileCommand(Reader CmdReader, llvm::ArrayRef<llvm::StringRef> Strings) {
 //   - stri: string table
 //   - symb: symbols
 //   - refs: references to symbols
+//   - post: posting lists of a Dex index over the symbols
 
 // The current versioning scheme is simple - non-current versions are rejected.
 // If you make a breaking change, bump this version number to invalidate stored
@@ -535,6 +621,17 @@ llvm::Expected<IndexFileIn> readRIFF(llvm::StringRef Data,
       return error("malformed or truncated relations");
     Result.Relations = std::move(Relations).build();
   }
+  if (Chunks.count("post") && Result.Symbols) {
+    Reader PostingsReader(Chunks.lookup("post"));
+    // Lists computed by another version of dex are ignored, and computed again.
+    if (PostingsReader.consume32() == PostingsVersion) {
+      auto Postings = readPostings(PostingsReader, Strings->Strings,
+                                   Result.Symbols->size());
+      if (!Postings)
+        return Postings.takeError();
+      Result.Postings = std::move(*Postings);
+    }
+  }
   if (Chunks.count("cmdl")) {
     Reader CmdReader(Chunks.lookup("cmdl"));
     InternedCompileCommand Cmd =
@@ -604,6 +701,19 @@ void writeRIFF(const IndexFileOut &Data, llvm::raw_ostream &OS) {
     }
   }
 
+  std::unique_ptr<dex::Dex> Index;
+  dex::DexPostings Postings;
+  std::vector<llvm::StringRef> TokenData;
+  if (Data.Postings) {
+    Index = std::make_unique<dex::Dex>(*Data.Symbols, RefSlab(),
+                                       RelationSlab());
+    Postings = Index->postings(*Data.Symbols);
+    for (const auto &List : Postings.Lists) {
+      TokenData.push_back(List.first.data());
+      Strings.intern(TokenData.back());
+    }
+  }
+
   InternedCompileCommand InternedCmd;
   if (Data.Cmd) {
     InternedCmd.CommandLine.reserve(Data.Cmd->CommandLine.size());
@@ -660,6 +770,15 @@ void writeRIFF(const IndexFileOut &Data, llvm::raw_ostream &OS) {
     RIFF.Chunks.push_back({riff::fourCC("srcs"), SrcsSection});
   }
 
+  std::string PostingsSection;
+  if (Data.Postings) {
+    {
+      llvm::raw_string_ostream PostingsOS(PostingsSection);
+      writePostings(Postings, TokenData, Strings, PostingsOS);
+    }
+    RIFF.Chunks.push_back({riff::fourCC("post"), PostingsSection});
+  }
+
   std::string CmdlSection;
   if (Data.Cmd) {
     {
@@ -715,6 +834,7 @@ std::unique_ptr<SymbolIndex> loadIndex(llvm::StringRef SymbolFilename,
   SymbolSlab Symbols;
   RefSlab Refs;
   RelationSlab Relations;
+  std::optional<dex::DexPostings> Postings;
   {
     trace::Span Tracer("ParseIndex");
     if (auto I = readIndexFile(Buffer->get()->getBuffer(), Origin)) {
@@ -724,6 +844,7 @@ std::unique_ptr<SymbolIndex> loadIndex(llvm::StringRef SymbolFilename,
         Refs = std::move(*I->Refs);
       if (I->Relations)
         Relations = std::move(*I->Relations);
+      Postings = std::move(I->Postings);
     } else {
       elog("Bad index file: {0}", I.takeError());
       return nullptr;
@@ -735,10 +856,19 @@ std::unique_ptr<SymbolIndex> loadIndex(llvm::StringRef SymbolFilename,
   size_t NumRelations = Relations.size();
 
   trace::Span Tracer("BuildIndex");
-  auto Index = UseDex ? dex::Dex::build(std::move(Symbols), std::move(Refs),
-                                        std::move(Relations))
-                      : MemIndex::build(std::move(Symbols), std::move(Refs),
-                                        std::move(Relations));
+  std::unique_ptr<SymbolIndex> Index;
+  if (!UseDex)
+    Index = MemIndex::build(std::move(Symbols), std::move(Refs),
+                            std::move(Relations));
+  else if (Postings)
+    // The posting lists point into the file, which the index keeps mapped.
+    Index = dex::Dex::build(
+        std::move(Symbols), std::move(Refs), std::move(Relations),
+        std::move(*Postings),
+        std::shared_ptr<llvm::MemoryBuffer>(std::move(*Buffer)));
+  else
+    Index = dex::Dex::build(std::move(Symbols), std::move(Refs),
+                            std::move(Relations));
   vlog("Loaded {0} from {1} with estimated memory usage {2} bytes\n"
        "  - number of symbols: {3}\n"
        "  - number of refs: {4}\n"
@@ -12,6 +12,7 @@
 //  - metadata such as version info
 //  - a string table (which is compressed)
 //  - lists of encoded symbols
+//  - optionally, the posting lists of a Dex index over the symbols
 //
 // The format has a simple versioning scheme: the format version number is
 // written in the file and non-current versions are rejected when reading.
@@ -27,6 +28,7 @@
 #include "Headers.h"
 #include "index/Index.h"
 #include "index/Symbol.h"
+#include "index/dex/Dex.h"
 #include "clang/Tooling/CompilationDatabase.h"
 #include "llvm/Support/Error.h"
 #include <optional>
@@ -48,6 +50,9 @@ struct IndexFileIn {
   std::optional<IncludeGraph> Sources;
   // This contains only the Directory and CommandLine.
   std::optional<tooling::CompileCommand> Cmd;
+  // Search structures of a Dex index over Symbols. Their chunks point into the
+  // data that was read, which must outlive them; their tokens do not.
+  std::optional<dex::DexPostings> Postings;
 };
 // Parse an index file. The input must be a RIFF or YAML file.
 llvm::Expected<IndexFileIn> readIndexFile(llvm::StringRef, SymbolOrigin);
@@ -59,7 +64,9 @@ struct IndexFileOut {
   const RelationSlab *Relations = nullptr;
   // Keys are URIs of the source files.
   const IncludeGraph *Sources = nullptr;
-  // TODO: Support serializing Dex posting lists.
+  // Whether to store the search structures of a Dex index over Symbols, so
+  // that loading the index is faster. Only for the RIFF format.
+  bool Postings = false;
   IndexFileFormat Format = IndexFileFormat::RIFF;
   const tooling::CompileCommand *Cmd = nullptr;
 
@@ -25,6 +25,7 @@
 #include <algorithm>
 #include <optional>
 #include <queue>
+#include <tuple>
 #include <utility>
 #include <vector>
 
@@ -42,6 +43,51 @@ std::unique_ptr<SymbolIndex> Dex::build(SymbolSlab Symbols, RefSlab Refs,
                                 Size);
 }
 
+std::unique_ptr<SymbolIndex> Dex::build(SymbolSlab Symbols, RefSlab Refs,
+                                        RelationSlab Rels, DexPostings Postings,
+                                        std::shared_ptr<void> Backing) {
+  assert(Postings.Ranking.size() == Symbols.size() && "Wrong ranking");
+  auto Size = Symbols.bytes() + Refs.bytes();
+  // Moving the slab keeps the symbols in place.
+  const Symbol *Base = Symbols.empty() ? nullptr : &*Symbols.begin();
+  auto Data = std::make_tuple(std::move(Symbols), std::move(Refs),
+                              std::move(Backing));
+  // Start from an index without symbols to skip buildIndex().
+  auto Index =
+      std::make_unique<Dex>(llvm::ArrayRef<Symbol>(), std::get<1>(Data), Rels,
+                            std::move(Data), Size);
+  Index->Corpus = dex::Corpus(Postings.Ranking.size());
+  Index->Symbols.reserve(Postings.Ranking.size());
+  Index->SymbolQuality.reserve(Postings.Ranking.size());
+  for (uint32_t Position : Postings.Ranking) {
+    const Symbol *Sym = Base + Position;
+    Index->Symbols.push_back(Sym);
+    Index->SymbolQuality.push_back(quality(*Sym));
+    Index->LookupTable[Sym->ID] = Sym;
+  }
+  Index->InvertedIndex.reserve(Postings.Lists.size());
+  for (auto &[Tok, Chunks] : Postings.Lists)
+    Index->InvertedIndex.try_emplace(std::move(Tok), Chunks);
+  return Index;
+}
+
+DexPostings Dex::postings(const SymbolSlab &Slab) const {
+  DexPostings Result;
+  Result.Ranking.reserve(Symbols.size());
+  for (const Symbol *Sym : Symbols)
+    Result.Ranking.push_back(Sym - &*Slab.begin());
+  Result.Lists.reserve(InvertedIndex.size());
+  for (const auto &TokenToPostingList : InvertedIndex)
+    Result.Lists.emplace_back(TokenToPostingList.first,
+                              TokenToPostingList.second.chunks());
+  // Keep the output deterministic.
+  llvm::sort(Result.Lists, [](const auto &L, const auto &R) {
+    return std::make_pair(L.first.kind(), L.first.data()) <
+           std::make_pair(R.first.kind(), R.first.data());
+  });
+  return Result;
+}
+
 namespace {
 
 // Mark symbols which are can be used for code completion.
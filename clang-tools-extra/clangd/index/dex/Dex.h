@@ -31,6 +31,18 @@ namespace clang {
 namespace clangd {
 namespace dex {
 
+/// The search structures of a Dex index over a SymbolSlab: the ranking of the
+/// symbols, which gives their DocIDs, and the posting list of each token. They
+/// can be stored next to the symbols in an index file, so that loading it does
+/// not need to rank the symbols and generate their tokens again.
+struct DexPostings {
+  /// Ranking[ID] is the position in the slab of the symbol with DocID ID.
+  std::vector<uint32_t> Ranking;
+  /// The tokens own their data. The chunks usually belong to the data of an
+  /// index file.
+  std::vector<std::pair<Token, llvm::ArrayRef<Chunk>>> Lists;
+};
+
 /// In-memory Dex trigram-based index implementation.
 class Dex : public SymbolIndex {
 public:
@@ -74,6 +86,16 @@ public:
 
   /// Builds an index from slabs. The index takes ownership of the slab.
   static std::unique_ptr<SymbolIndex> build(SymbolSlab, RefSlab, RelationSlab);
+  /// Builds an index from slabs and the search structures computed for the
+  /// symbols before, see postings(). The index takes ownership of the slabs
+  /// and of Backing, which must keep the chunks of the posting lists alive.
+  static std::unique_ptr<SymbolIndex> build(SymbolSlab, RefSlab, RelationSlab,
+                                            DexPostings,
+                                            std::shared_ptr<void> Backing);
+
+  /// Returns the search structures of this index, which must have been built
+  /// over the symbols of \p Symbols. They refer to the index.
+  DexPostings postings(const SymbolSlab &Symbols) const;
 
   bool
   fuzzyFind(const FuzzyFindRequest &Req,
@@ -9,6 +9,8 @@
 #include "PostingList.h"
 #include "index/dex/Iterator.h"
 #include "index/dex/Token.h"
+#include "llvm/ADT/bit.h"
+#include "llvm/Support/Endian.h"
 #include "llvm/Support/MathExtras.h"
 #include <optional>
 
@@ -168,7 +170,8 @@ std::vector<Chunk> encodeStream(llvm::ArrayRef<DocID> Documents) {
   assert(!Documents.empty() && "Can't encode empty sequence.");
   std::vector<Chunk> Result;
   Result.emplace_back();
-  DocID Last = Result.back().Head = Documents.front();
+  DocID Last = Documents.front();
+  Result.back().Head = Last;
   llvm::MutableArrayRef<uint8_t> RemainingPayload = Result.back().Payload;
   for (DocID Doc : Documents.drop_front()) {
     if (!encodeVByte(Doc - Last, RemainingPayload)) { // didn't fit, flush chunk
@@ -204,22 +207,42 @@ std::optional<DocID> readVByte(llvm::ArrayRef<uint8_t> &Bytes) {
 llvm::SmallVector<DocID, Chunk::PayloadSize + 1> Chunk::decompress() const {
   llvm::SmallVector<DocID, Chunk::PayloadSize + 1> Result{Head};
   llvm::ArrayRef<uint8_t> Bytes(Payload);
-  DocID Delta;
-  for (DocID Current = Head; !Bytes.empty(); Current += Delta) {
+  DocID Current = Head;
+  // Most deltas are below 128 and take a single byte. Look at eight bytes at a
+  // time, and while none of them continues an encoding, add up the bytes that
+  // come before the terminating zero without looking at them one by one.
+  constexpr uint64_t Low = 0x0101010101010101, High = 0x8080808080808080;
+  while (Bytes.size() >= sizeof(uint64_t)) {
+    uint64_t Word = llvm::support::endian::read64le(Bytes.data());
+    if (Word & High)
+      break;
+    // The lowest set bit is the top bit of the first zero byte, if any.
+    uint64_t Zeros = (Word - Low) & ~Word & High;
+    unsigned Count =
+        Zeros ? llvm::countr_zero(Zeros) / 8 : unsigned(sizeof(uint64_t));
+    for (unsigned I = 0; I != Count; ++I, Word >>= 8) {
+      Current += Word & 0xff;
+      Result.push_back(Current);
+    }
+    if (Count != sizeof(uint64_t))
+      return Result;
+    Bytes = Bytes.drop_front(sizeof(uint64_t));
+  }
+  while (!Bytes.empty()) {
     auto MaybeDelta = readVByte(Bytes);
     if (!MaybeDelta)
       break;
-    Delta = *MaybeDelta;
-    Result.push_back(Current + Delta);
+    Current += *MaybeDelta;
+    Result.push_back(Current);
   }
-  return llvm::SmallVector<DocID, Chunk::PayloadSize + 1>{Result};
+  return Result;
 }
 
 PostingList::PostingList(llvm::ArrayRef<DocID> Documents)
     : Chunks(encodeStream(Documents)) {}
 
 std::unique_ptr<Iterator> PostingList::iterator(const Token *Tok) const {
-  return std::make_unique<ChunkIterator>(Tok, Chunks);
+  return std::make_unique<ChunkIterator>(Tok, chunks());
 }
 
 } // namespace dex
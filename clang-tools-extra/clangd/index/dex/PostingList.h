@@ -18,6 +18,9 @@
 /// algorithm can be found in "Introduction to Information Retrieval" book:
 /// https://nlp.stanford.edu/IR-book/html/htmledition/variable-byte-codes-1.html
 ///
+/// The compressed chunks have the same layout in memory and in index files, so
+/// posting lists can also be used in place from a mapped file.
+///
 //===----------------------------------------------------------------------===//
 
 #ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_DEX_POSTINGLIST_H
@@ -26,6 +29,7 @@
 #include "Iterator.h"
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Endian.h"
 #include <cstdint>
 #include <vector>
 
@@ -38,7 +42,8 @@ class Token;
 ///
 /// Chunk is a fixed-width piece of PostingList which contains the first DocID
 /// in uncompressed format (Head) and delta-encoded Payload. It can be
-/// decompressed upon request.
+/// decompressed upon request. Chunks have no alignment requirement and a fixed
+/// byte order, so that they can be read from anywhere in an index file.
 struct Chunk {
   /// Keep sizeof(Chunk) == 32.
   static constexpr size_t PayloadSize = 32 - sizeof(DocID);
@@ -46,11 +51,12 @@ struct Chunk {
   llvm::SmallVector<DocID, PayloadSize + 1> decompress() const;
 
   /// The first element of decompressed Chunk.
-  DocID Head;
+  llvm::support::ulittle32_t Head;
   /// VByte-encoded deltas.
   std::array<uint8_t, PayloadSize> Payload;
 };
 static_assert(sizeof(Chunk) == 32, "Chunk should take 32 bytes of memory.");
+static_assert(alignof(Chunk) == 1, "Chunk should be readable at any address.");
 
 /// PostingList is the storage of DocIDs which can be inserted to the Query
 /// Tree as a leaf by constructing Iterator over the PostingList object. DocIDs
@@ -59,17 +65,27 @@ static_assert(sizeof(Chunk) == 32, "Chunk should take 32 bytes of memory.");
 class PostingList {
 public:
   explicit PostingList(llvm::ArrayRef<DocID> Documents);
+  /// Uses chunks stored elsewhere, e.g. in a mapped index file, which must
+  /// outlive the PostingList.
+  explicit PostingList(llvm::ArrayRef<Chunk> Chunks) : External(Chunks) {}
 
   /// Constructs DocumentIterator over given posting list. DocumentIterator will
   /// go through the chunks and decompress them on-the-fly when necessary.
   /// If given, Tok is only used for the string representation.
   std::unique_ptr<Iterator> iterator(const Token *Tok = nullptr) const;
 
+  /// Returns the compressed chunks, e.g. to write them to an index file.
+  llvm::ArrayRef<Chunk> chunks() const {
+    return Chunks.empty() ? External : llvm::ArrayRef<Chunk>(Chunks);
+  }
+
   /// Returns in-memory size of external storage.
   size_t bytes() const { return Chunks.capacity() * sizeof(Chunk); }
 
 private:
   const std::vector<Chunk> Chunks;
+  /// The chunks, if they are not owned by the PostingList.
+  const llvm::ArrayRef<Chunk> External;
 };
 
 } // namespace dex
@@ -38,6 +38,12 @@ static llvm::cl::opt<IndexFileFormat>
                                        "binary RIFF format")),
            llvm::cl::init(IndexFileFormat::RIFF));
 
+static llvm::cl::opt<bool> DexPostings(
+    "dex-posting-lists",
+    llvm::cl::desc("Store the posting lists of the symbol index, so that "
+                   "clangd loads it faster (binary format only)"),
+    llvm::cl::init(false));
+
 static llvm::cl::list<std::string> QueryDriverGlobs{
     "query-driver",
     llvm::cl::desc(
@@ -176,6 +182,7 @@ int main(int argc, const char **argv) {
   // Emit collected data.
   clang::clangd::IndexFileOut Out(Data);
   Out.Format = clang::clangd::Format;
+  Out.Postings = clang::clangd::DexPostings;
   llvm::outs() << Out;
   return 0;
 }
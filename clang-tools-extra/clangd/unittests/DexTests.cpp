@@ -65,6 +65,19 @@ TEST(DexIterators, DocumentIterator) {
   EXPECT_TRUE(DocIterator->reachedEnd());
 }
 
+TEST(DexIterators, ExternalChunks) {
+  // Mixes small and large deltas, so that some bytes of a chunk are
+  // continuations and others are not.
+  std::vector<DocID> Docs;
+  for (DocID ID = 0; ID < 5000000; ID += Docs.size() % 3 ? 3 : 70000)
+    Docs.push_back(ID);
+  const PostingList Owned(Docs);
+  std::vector<Chunk> Chunks(Owned.chunks().begin(), Owned.chunks().end());
+  const PostingList L(Chunks);
+  EXPECT_EQ(L.bytes(), 0U);
+  EXPECT_EQ(consumeIDs(*L.iterator()), Docs);
+}
+
 TEST(DexIterators, AndTwoLists) {
   Corpus C{10000};
   const PostingList L0({0, 5, 7, 10, 42, 320, 9000});
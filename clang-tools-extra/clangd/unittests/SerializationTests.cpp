@@ -14,6 +14,7 @@
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/Compression.h"
 #include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/ScopedPrinter.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -252,6 +253,91 @@ TEST(SerializationTest, BinaryConversions) {
               UnorderedElementsAreArray(yamlFromRelations(*In->Relations)));
 }
 
+TEST(SerializationTest, PostingsTest) {
+  auto In = readIndexFile(YAML);
+  ASSERT_TRUE(bool(In)) << In.takeError();
+
+  IndexFileOut Out(*In);
+  Out.Format = IndexFileFormat::RIFF;
+  Out.Postings = true;
+  std::string Serialized = llvm::to_string(Out);
+
+  auto In2 = readIndexFile(Serialized);
+  ASSERT_TRUE(bool(In2)) << In2.takeError();
+  ASSERT_TRUE(In2->Symbols);
+  ASSERT_TRUE(In2->Postings);
+  EXPECT_EQ(In2->Postings->Ranking.size(), In2->Symbols->size());
+  EXPECT_FALSE(In2->Postings->Lists.empty());
+
+  // An index built from the stored lists answers like one built from scratch.
+  auto Expected = dex::Dex::build(std::move(*In->Symbols), RefSlab(),
+                                  RelationSlab());
+  auto Actual =
+      dex::Dex::build(std::move(*In2->Symbols), RefSlab(), RelationSlab(),
+                      std::move(*In2->Postings), nullptr);
+  FuzzyFindRequest Req;
+  Req.AnyScope = true;
+  for (llvm::StringRef Query : {"", "Foo", "Fo", "Bar", "abc"}) {
+    Req.Query = Query.str();
+    std::vector<std::string> ExpectedNames, ActualNames;
+    Expected->fuzzyFind(Req, [&](const Symbol &S) {
+      ExpectedNames.push_back((S.Scope + S.Name).str());
+    });
+    Actual->fuzzyFind(Req, [&](const Symbol &S) {
+      ActualNames.push_back((S.Scope + S.Name).str());
+    });
+    EXPECT_EQ(ActualNames, ExpectedNames) << Query;
+  }
+
+  // Files without the lists are still read.
+  Out.Postings = false;
+  auto In3 = readIndexFile(llvm::to_string(Out));
+  ASSERT_TRUE(bool(In3)) << In3.takeError();
+  EXPECT_FALSE(In3->Postings);
+}
+
+// The posting lists are used after everything that read them, such as the
+// string table their tokens come from, is gone.
+TEST(SerializationTest, PostingsOfLoadedIndex) {
+  auto In = readIndexFile(YAML);
+  ASSERT_TRUE(bool(In)) << In.takeError();
+
+  IndexFileOut Out(*In);
+  Out.Format = IndexFileFormat::RIFF;
+  Out.Postings = true;
+  llvm::SmallString<128> Path;
+  int FD;
+  ASSERT_FALSE(llvm::sys::fs::createTemporaryFile("index", "idx", FD, Path));
+  {
+    llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS << Out;
+  }
+
+  auto Actual = loadIndex(Path, SymbolOrigin::Static, /*UseDex=*/true);
+  ASSERT_TRUE(Actual);
+  auto Expected = dex::Dex::build(std::move(*In->Symbols), RefSlab(),
+                                  RelationSlab());
+  FuzzyFindRequest Req;
+  for (std::vector<std::string> Scopes :
+       {std::vector<std::string>{}, {"clang::"}, {"llvm::"}}) {
+    Req.Scopes = Scopes;
+    Req.AnyScope = Scopes.empty();
+    for (llvm::StringRef Query : {"", "Foo", "Fo", "Bar"}) {
+      Req.Query = Query.str();
+      std::vector<std::string> ExpectedNames, ActualNames;
+      Expected->fuzzyFind(Req, [&](const Symbol &S) {
+        ExpectedNames.push_back((S.Scope + S.Name).str());
+      });
+      Actual->fuzzyFind(Req, [&](const Symbol &S) {
+        ActualNames.push_back((S.Scope + S.Name).str());
+      });
+      EXPECT_EQ(ActualNames, ExpectedNames) << Query;
+    }
+  }
+  Actual.reset();
+  llvm::sys::fs::remove(Path);
+}
+
 TEST(SerializationTest, SrcsTest) {
   auto In = readIndexFile(YAML);
   EXPECT_TRUE(bool(In)) << In.takeError();
@@ -0,0 +1,5 @@
+#include "header.h"
+
+struct C {
+  C(int);
+};
@@ -0,0 +1,4 @@
+#include "header.h"
+#include "header.h"
+
+struct E {};
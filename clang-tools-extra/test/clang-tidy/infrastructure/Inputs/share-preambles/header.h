@@ -0,0 +1,5 @@
+#pragma once
+
+struct A {
+  A(int);
+};
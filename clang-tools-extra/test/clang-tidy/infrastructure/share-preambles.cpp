@@ -0,0 +1,19 @@
+// RUN: clang-tidy -share-preambles -checks='-*,google-explicit-constructor' -header-filter='.*' %S/Inputs/share-preambles/a.cpp %S/Inputs/share-preambles/b.cpp %S/Inputs/share-preambles/c.cpp -- 2>&1 | FileCheck -check-prefixes=CHECK,CHECK-SEQ -implicit-check-not='{{warning:|error:}}' %s
+// RUN: clang-tidy -j=2 -share-preambles -checks='-*,google-explicit-constructor' -header-filter='.*' %S/Inputs/share-preambles/a.cpp %S/Inputs/share-preambles/b.cpp %S/Inputs/share-preambles/c.cpp -- 2>&1 | FileCheck -check-prefixes=CHECK,CHECK-PAR -implicit-check-not='{{warning:|error:}}' %s
+
+// The warning in the header is found in every file, and reported once.
+// CHECK-DAG: {{.*}}header.h:4:3: warning: single-argument constructors must be marked explicit
+// CHECK-DAG: {{.*}}a.cpp:4:3: warning: single-argument constructors must be marked explicit
+// CHECK-DAG: {{.*}}b.cpp:4:3: warning: single-argument constructors must be marked explicit
+// CHECK-DAG: {{.*}}c.cpp:4:3: warning: single-argument constructors must be marked explicit
+
+// a.cpp is parsed in full to learn which callbacks the checks register, b.cpp
+// builds the preamble and c.cpp reuses it. Files parsed concurrently with
+// a.cpp are parsed in full as well.
+// CHECK-SEQ-DAG: Shared 1 preamble, reused 1 time.
+// CHECK-PAR-DAG: Shared 1 preamble, reused {{[01]}} time
+
+// Checks that watch the preprocessor see the directives of every file.
+// RUN: clang-tidy -share-preambles -checks='-*,readability-duplicate-include' %S/Inputs/share-preambles/a.cpp %S/Inputs/share-preambles/dup.cpp -- 2>&1 | FileCheck -check-prefix=CHECK-PP -implicit-check-not='{{warning:|error:|Shared}}' %s
+
+// CHECK-PP: {{.*}}dup.cpp:2:1: warning: duplicate include [readability-duplicate-include]
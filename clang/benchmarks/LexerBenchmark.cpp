@@ -0,0 +1,149 @@
+//===--- LexerBenchmark.cpp - clang lexer benchmarks ------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Benchmarks for lexing in raw mode, which exercises the scanning of
+// identifiers, comments, whitespace and string literals. The synthetic
+// benchmarks need no input; the others lex the files given on the command
+// line, for example a large set of headers.
+//
+// Note: make sure to build the benchmark in Release mode.
+//
+// Usage:
+//   tools/clang/benchmarks/ClangLexerBenchmark \
+//      $(find /usr/include -name '*.h')
+//
+//===----------------------------------------------------------------------===//
+
+#include "benchmark/benchmark.h"
+#include "clang/Basic/LangOptions.h"
+#include "clang/Basic/SourceLocation.h"
+#include "clang/Lex/Lexer.h"
+#include "clang/Lex/Token.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace clang;
+
+static llvm::cl::list<std::string> InputFiles(llvm::cl::Positional,
+                                              llvm::cl::desc("<files>"));
+
+static std::vector<std::unique_ptr<llvm::MemoryBuffer>> Inputs;
+static uint64_t InputBytes = 0;
+
+static LangOptions getLangOpts() {
+  LangOptions LangOpts;
+  LangOpts.CPlusPlus = true;
+  LangOpts.CPlusPlus11 = true;
+  LangOpts.LineComment = true;
+  return LangOpts;
+}
+
+/// Lexes \p Text, which must be followed by a nul character, and returns the
+/// number of tokens.
+static unsigned lexRaw(llvm::StringRef Text, const LangOptions &LangOpts) {
+  Lexer L(SourceLocation(), LangOpts, Text.begin(), Text.begin(), Text.end());
+  Token Tok;
+  unsigned NumTokens = 0;
+  do {
+    L.LexFromRawLexer(Tok);
+    ++NumTokens;
+  } while (Tok.isNot(tok::eof));
+  return NumTokens;
+}
+
+static void lexText(benchmark::State &State, const std::string &Text) {
+  LangOptions LangOpts = getLangOpts();
+  for (auto _ : State)
+    benchmark::DoNotOptimize(lexRaw(Text, LangOpts));
+  State.SetBytesProcessed(static_cast<uint64_t>(State.iterations()) *
+                          Text.size());
+}
+
+/// Returns something like a header, with a license comment, documented
+/// declarations, long identifiers, string literals and deep indentation.
+static std::string makeHeader(unsigned NumDecls) {
+  std::string S;
+  llvm::raw_string_ostream OS(S);
+  OS << "/*\n";
+  for (unsigned I = 0; I != 20; ++I)
+    OS << " * Licensed under the terms of some license, whose text is long "
+          "enough to wrap.\n";
+  OS << " */\n\nnamespace some_library_namespace {\n";
+  for (unsigned I = 0; I != NumDecls; ++I) {
+    OS << "  /// Returns the value of the configuration entry number " << I
+       << ", or the default if it\n  /// has not been set.\n";
+    OS << "  static inline const char *getConfigurationEntryValue" << I
+       << "(const ConfigurationStorageType &Storage) {\n";
+    OS << "    if (const char *Value = Storage.lookupEntryByName(\"entry_" << I
+       << "_with_a_rather_long_name\"))\n";
+    OS << "      return Value;                         // explicitly set\n";
+    OS << "    return R\"(default value of the entry, which may contain "
+          "\"quotes\")\";\n  }\n\n";
+  }
+  OS << "} // namespace some_library_namespace\n";
+  return S;
+}
+
+static void BM_LexSynthetic(benchmark::State &State) {
+  lexText(State, makeHeader(State.range(0)));
+}
+BENCHMARK(BM_LexSynthetic)->Arg(1 << 8)->Arg(1 << 12);
+
+static void BM_LexBlockComment(benchmark::State &State) {
+  std::string Text = "/*";
+  for (int64_t I = 0; I != State.range(0); ++I)
+    Text += " * a line of a long block comment, with some punctuation.\n";
+  Text += "*/ int x;";
+  lexText(State, Text);
+}
+BENCHMARK(BM_LexBlockComment)->Arg(1 << 12);
+
+static void BM_LexIdentifiers(benchmark::State &State) {
+  std::string Text;
+  for (int64_t I = 0; I != State.range(0); ++I)
+    Text += "some_identifier SomeLongerCamelCaseIdentifierName x i42 ";
+  lexText(State, Text);
+}
+BENCHMARK(BM_LexIdentifiers)->Arg(1 << 12);
+
+static void BM_LexFiles(benchmark::State &State) {
+  if (Inputs.empty()) {
+    State.SkipWithError("no input files");
+    return;
+  }
+  LangOptions LangOpts = getLangOpts();
+  for (auto _ : State)
+    for (const auto &Input : Inputs)
+      benchmark::DoNotOptimize(lexRaw(Input->getBuffer(), LangOpts));
+  State.SetBytesProcessed(static_cast<uint64_t>(State.iterations()) *
+                          InputBytes);
+}
+BENCHMARK(BM_LexFiles);
+
+int main(int argc, char *argv[]) {
+  benchmark::Initialize(&argc, argv);
+  llvm::cl::ParseCommandLineOptions(argc, argv);
+  for (const std::string &Path : InputFiles) {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> BufferOrErr =
+        llvm::MemoryBuffer::getFile(Path);
+    if (std::error_code EC = BufferOrErr.getError()) {
+      llvm::errs() << "Error: can't read file '" << Path
+                   << "': " << EC.message() << "\n";
+      return 1;
+    }
+    InputBytes += (*BufferOrErr)->getBufferSize();
+    Inputs.push_back(std::move(*BufferOrErr));
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -652,6 +652,13 @@ public:
   /// Returns the clang bytecode interpreter context.
   interp::Context &getInterpContext();
 
+  /// Serializes the bytecode the interpreter compiled functions to, if any,
+  /// passing it along with the declarations it refers to to the callback.
+  void serializeInterpFunctions(
+      llvm::function_ref<void(const FunctionDecl *, StringRef,
+                              ArrayRef<const Decl *>)>
+          Callback);
+
   struct CUDAConstantEvalContext {
     /// Do not allow wrong-sided variables in constant expressions.
     bool NoWrongSidedVars = false;
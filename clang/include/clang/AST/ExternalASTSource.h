@@ -42,6 +42,7 @@ class CXXCtorInitializer;
 class CXXRecordDecl;
 class DeclarationName;
 class FieldDecl;
+class FunctionDecl;
 class IdentifierInfo;
 class NamedDecl;
 class ObjCInterfaceDecl;
@@ -192,6 +193,14 @@ public:
                                    unsigned Length,
                                    SmallVectorImpl<Decl *> &Decls);
 
+  /// Finds the bytecode of the constant interpreter stored for the given
+  /// function, along with the declarations it refers to.
+  ///
+  /// The default implementation of this method returns false.
+  virtual bool FindExternalInterpBytecode(const FunctionDecl *FD,
+                                          StringRef &Bytecode,
+                                          SmallVectorImpl<const Decl *> &Decls);
+
   /// Gives the external AST source an opportunity to complete
   /// the redeclaration chain for a declaration. Called each time we
   /// need the most recent declaration of a declaration after the
@@ -35,6 +35,12 @@
 #include <utility>
 #include <vector>
 
+namespace llvm {
+
+class UniqueStringSaver;
+
+} // namespace llvm
+
 namespace clang {
 
 class AnalysisDeclContext;
@@ -55,6 +61,7 @@ namespace ento {
 //===----------------------------------------------------------------------===//
 
 class PathDiagnostic;
+class PathDiagnosticSerializer;
 
 /// These options tweak the behavior of path diangostic consumers.
 /// Most of these options are currently supported by very few consumers.
@@ -139,6 +146,10 @@ public:
 
   void HandlePathDiagnostic(std::unique_ptr<PathDiagnostic> D);
 
+  /// Removes the diagnostics handled so far without flushing them, and
+  /// returns them.
+  std::vector<std::unique_ptr<PathDiagnostic>> takeDiagnostics();
+
   enum PathGenerationScheme {
     /// Only runs visitors, no output generated.
     None,
@@ -194,6 +205,8 @@ using LocationOrAnalysisDeclContext =
 
 class PathDiagnosticLocation {
 private:
+  friend class PathDiagnosticSerializer;
+
   enum Kind { RangeK, SingleLocK, StmtK, DeclK } K = SingleLocK;
 
   const Stmt *S = nullptr;
@@ -406,6 +419,8 @@ public:
   enum DisplayHint { Above, Below };
 
 private:
+  friend class PathDiagnosticSerializer;
+
   const std::string str;
   const Kind kind;
   const DisplayHint Hint;
@@ -560,6 +575,8 @@ public:
 };
 
 class PathDiagnosticCallPiece : public PathDiagnosticPiece {
+  friend class PathDiagnosticSerializer;
+
   const Decl *Caller;
   const Decl *Callee = nullptr;
 
@@ -761,6 +778,8 @@ using FilesToLineNumsMap = std::map<FileID, std::set<unsigned>>;
 ///  diagnostic.  It represents an ordered-collection of PathDiagnosticPieces,
 ///  each which represent the pieces of the path.
 class PathDiagnostic : public llvm::FoldingSetNode {
+  friend class PathDiagnosticSerializer;
+
   std::string CheckerName;
   const Decl *DeclWithIssue;
   std::string BugType;
@@ -904,6 +923,32 @@ public:
   void FullProfile(llvm::FoldingSetNodeID &ID) const;
 };
 
+/// Writes path diagnostics to a byte stream and reads them back, so that a
+/// process forked from the one that built the AST can hand the diagnostics it
+/// found to its parent. Declarations and source locations are written as they
+/// are, so they only make sense to a process sharing the AST and the
+/// SourceManager of the writer.
+class PathDiagnosticSerializer {
+  class Reader;
+
+  static void writeLocation(const PathDiagnosticLocation &L, raw_ostream &OS);
+  static void writePieces(const PathPieces &Pieces, raw_ostream &OS);
+  static PathDiagnosticLocation readLocation(Reader &R);
+  static bool readPieces(Reader &R, PathPieces &Pieces);
+
+public:
+  /// Writes \p PD, whose locations must have been flattened, to \p OS.
+  static void write(const PathDiagnostic &PD, const SourceManager &SM,
+                    raw_ostream &OS);
+
+  /// Reads a diagnostic written by write() from the front of \p Data, which
+  /// is advanced past it. Tags are saved in \p Saver. Returns null if
+  /// \p Data is malformed.
+  static std::unique_ptr<PathDiagnostic> read(StringRef &Data,
+                                              const SourceManager &SM,
+                                              llvm::UniqueStringSaver &Saver);
+};
+
 } // namespace ento
 } // namespace clang
 
@@ -0,0 +1,108 @@
+//===--- CompileServerFileCache.h - Files kept between compiles -*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Defines the cache of file contents and failed lookups that a compile server
+// keeps between the compilations it runs.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_FRONTEND_COMPILESERVERFILECACHE_H
+#define LLVM_CLANG_FRONTEND_COMPILESERVERFILECACHE_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/FileSystem/UniqueID.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace llvm {
+class MemoryBuffer;
+namespace vfs {
+class FileSystem;
+} // namespace vfs
+} // namespace llvm
+
+namespace clang {
+
+/// The contents of files read by earlier compilations, and the paths they
+/// found not to exist, for a process that runs many compilations one after
+/// another. Nothing is reused without checking that it is still current, but
+/// the checks are cheaper than the work they save:
+///
+/// - The contents of a file are reused if a stat of the file shows the same
+///   inode, size and modification time as when it was read.
+/// - A path is known not to exist while its parent directory has the same
+///   inode and modification time as when the lookup failed. Header search
+///   probes every include directory in turn, so most lookups fail, and each
+///   directory is only stat'ed once per compilation.
+///
+/// Nothing is recorded for a file or directory modified within the last couple
+/// of seconds, as a further change in the same timestamp tick would go
+/// unnoticed on file systems with coarse timestamps.
+///
+/// The cache is not thread-safe; compilations using it must not overlap.
+class CompileServerFileCache {
+public:
+  explicit CompileServerFileCache(uint64_t MaxContentsSize = 512 << 20)
+      : MaxContentsSize(MaxContentsSize) {}
+  ~CompileServerFileCache();
+
+  /// Creates the file system for one compilation, which uses and updates the
+  /// cache and forwards everything else to \p FS.
+  ///
+  /// Directories are only stat'ed once, so a file created during the
+  /// compilation may not be found in a directory that was already looked at.
+  /// Lookups in \p WrittenDirs and their subdirectories (the module cache
+  /// and the directories of the outputs) are therefore never answered from
+  /// the cache.
+  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem>
+  createFileSystem(llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS,
+                   llvm::ArrayRef<std::string> WrittenDirs = {});
+
+  /// The number of files whose contents are cached.
+  unsigned getNumFiles() const { return Files.size(); }
+
+  /// The number of paths known not to exist.
+  unsigned getNumMissing() const { return Missing.size(); }
+
+private:
+  class CachingFileSystem;
+
+  /// What a stat of a file or directory shows about its identity and
+  /// contents.
+  struct Stamp {
+    llvm::sys::fs::UniqueID ID;
+    llvm::sys::TimePoint<> ModTime;
+    uint64_t Size = 0;
+
+    bool operator==(const Stamp &RHS) const {
+      return ID == RHS.ID && ModTime == RHS.ModTime && Size == RHS.Size;
+    }
+  };
+
+  struct CachedFile {
+    Stamp FileStamp;
+    std::shared_ptr<const llvm::MemoryBuffer> Contents;
+  };
+
+  /// Cached files by absolute path.
+  llvm::StringMap<CachedFile> Files;
+  /// For each absolute path known not to exist, the stamp of its parent
+  /// directory at the time.
+  llvm::StringMap<Stamp> Missing;
+
+  uint64_t ContentsSize = 0;
+  uint64_t MaxContentsSize;
+};
+
+} // namespace clang
+
+#endif // LLVM_CLANG_FRONTEND_COMPILESERVERFILECACHE_H
@@ -117,6 +117,12 @@ public:
   void FindFileRegionDecls(FileID File, unsigned Offset,unsigned Length,
                            SmallVectorImpl<Decl *> &Decls) override;
 
+  /// Finds the bytecode of the constant interpreter stored for the given
+  /// function in any of the sources.
+  bool
+  FindExternalInterpBytecode(const FunctionDecl *FD, StringRef &Bytecode,
+                             SmallVectorImpl<const Decl *> &Decls) override;
+
   /// Gives the external AST source an opportunity to complete
   /// an incomplete type.
   void CompleteType(TagDecl *Tag) override;
@@ -691,6 +691,10 @@ enum ASTRecordTypes {
   /// Record code for lexical and visible block for delayed namespace in
   /// reduced BMI.
   DELAYED_NAMESPACE_LEXICAL_VISIBLE_RECORD = 68,
+
+  /// Record code for the bytecode of a function compiled by the constant
+  /// interpreter, along with the declarations it refers to.
+  INTERP_BYTECODE = 69,
 };
 
 /// Record types used within a source manager block.
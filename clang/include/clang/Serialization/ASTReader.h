@@ -529,6 +529,11 @@ private:
   /// namespace as if it is not delayed.
   DelayedNamespaceOffsetMapTy DelayedNamespaceOffsetMap;
 
+  /// The bytecode the constant interpreter compiled functions to, by the ID
+  /// of the function, along with the module file storing it.
+  llvm::DenseMap<GlobalDeclID, std::pair<ModuleFile *, StringRef>>
+      InterpBytecode;
+
   struct PendingUpdateRecord {
     Decl *D;
     GlobalDeclID ID;
@@ -2020,6 +2025,12 @@ public:
   void FindFileRegionDecls(FileID File, unsigned Offset, unsigned Length,
                            SmallVectorImpl<Decl *> &Decls) override;
 
+  /// Finds the bytecode of the constant interpreter stored for the given
+  /// function, along with the declarations it refers to.
+  bool
+  FindExternalInterpBytecode(const FunctionDecl *FD, StringRef &Bytecode,
+                             SmallVectorImpl<const Decl *> &Decls) override;
+
   /// Notify ASTReader that we started deserialization of
   /// a decl or type so until FinishedDeserializing is called there may be
   /// decls that are initializing. Must be paired with FinishedDeserializing.
@@ -152,7 +152,9 @@ public:
   /// \param Hits Will be populated with the set of module files that have
   /// information about this name.
   ///
-  /// \returns true if the identifier is known to the index, false otherwise.
+  /// \returns true if the index has information about identifiers, in which
+  /// case none of the module files known to the index that are not in \p Hits
+  /// have information about this name, false otherwise.
   bool lookupIdentifier(llvm::StringRef Name, HitSet &Hits);
 
   /// Note that the given module file has been loaded.
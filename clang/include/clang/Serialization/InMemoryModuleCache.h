@@ -10,6 +10,7 @@
 #define LLVM_CLANG_SERIALIZATION_INMEMORYMODULECACHE_H
 
 #include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include <memory>
@@ -99,6 +100,18 @@ public:
   ///
   /// \return true iff state is ToBuild.
   bool shouldBuildPCM(llvm::StringRef Filename) const;
+
+  /// Prepare the cache to be shared with a later, unrelated compilation, as
+  /// a compile server does. Drop every PCM that is not final, and every final
+  /// PCM for which \p IsStale returns true, e.g. because the file on disk has
+  /// been rebuilt since it was read.
+  ///
+  /// \pre no ModuleManager is using the cache.
+  /// \post every PCM is Final or Unknown.
+  void pruneForReuse(
+      llvm::function_ref<bool(llvm::StringRef Filename,
+                              const llvm::MemoryBuffer &Buffer)>
+          IsStale);
 };
 
 } // end namespace clang
@@ -81,6 +81,10 @@ class ModuleManager {
   /// The visitation order.
   SmallVector<ModuleFile *, 4> VisitOrder;
 
+  /// The position of each module file in the visitation order, indexed by
+  /// the index of the module file.
+  SmallVector<unsigned, 4> VisitOrderPosition;
+
   /// The list of module files that both we and the global module index
   /// know about.
   ///
@@ -91,6 +95,14 @@ class ModuleManager {
   /// known to the global index.
   SmallVector<ModuleFile *, 4> ModulesInCommonWithGlobalIndex;
 
+  /// The list of module files that the global module index does not know
+  /// about, and which must therefore always be visited.
+  SmallVector<ModuleFile *, 4> ModulesNotInGlobalIndex;
+
+  /// The set of module files that have been rectified with the global module
+  /// index, i.e., that are in one of the two lists above.
+  llvm::SmallPtrSet<ModuleFile *, 4> ModulesRectifiedWithGlobalIndex;
+
   /// The global module index, if one is attached.
   ///
   /// The global module index will actually be owned by the ASTReader; this is
@@ -280,7 +292,10 @@ public:
   /// \param ModuleFilesHit If non-NULL, contains the set of module files
   /// that we know we need to visit because the global module index told us to.
   /// Any module that is known to both the global module index and the module
-  /// manager that is *not* in this set can be skipped.
+  /// manager that is *not* in this set can be skipped. Once every loaded
+  /// module has been rectified with the global module index, only the modules
+  /// in this set and those unknown to the index are considered, so the cost of
+  /// the traversal does not depend on the number of loaded modules.
   void visit(llvm::function_ref<bool(ModuleFile &M)> Visitor,
              llvm::SmallPtrSetImpl<ModuleFile *> *ModuleFilesHit = nullptr);
 
@@ -0,0 +1,72 @@
+//===- DependencyDirectivesCache.h - On-disk directives cache ---*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLING_DEPENDENCYSCANNING_DEPENDENCYDIRECTIVESCACHE_H
+#define LLVM_CLANG_TOOLING_DEPENDENCYSCANNING_DEPENDENCYDIRECTIVESCACHE_H
+
+#include "clang/Basic/LLVM.h"
+#include "clang/Lex/DependencyDirectivesScanner.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/Caching.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace clang {
+namespace tooling {
+namespace dependencies {
+
+/// A cache of the dependency directives of source files kept on disk, so that
+/// it is shared by every scan using the same directory, in this process or
+/// another, now or later. Entries are keyed by a hash of the file contents and
+/// of the compiler version, so a file that changed is simply scanned again.
+/// They are stored with llvm::packCache, which maps its pack files into memory
+/// and finds entries without taking locks.
+///
+/// This class is thread-safe.
+class DependencyDirectivesCache {
+public:
+  /// Opens the cache in the directory \p Path, creating it if needed.
+  static llvm::Expected<std::unique_ptr<DependencyDirectivesCache>>
+  create(StringRef Path,
+         llvm::PackCachePolicy Policy = llvm::PackCachePolicy());
+
+  /// Scans \p Input like scanSourceForDependencyDirectives, unless the result
+  /// of scanning the same contents is in the cache. Each directive refers to
+  /// \p Tokens, which must not change afterwards.
+  ///
+  /// \returns false on success, true on error.
+  bool scan(StringRef Input,
+            SmallVectorImpl<dependency_directives_scan::Token> &Tokens,
+            SmallVectorImpl<dependency_directives_scan::Directive> &Directives);
+
+private:
+  DependencyDirectivesCache();
+
+  /// Takes the entry that the cache handed over for \p Task, if any.
+  std::unique_ptr<llvm::MemoryBuffer> takeEntry(unsigned Task);
+
+  llvm::FileCache Cache;
+  /// The version of the compiler, which is part of every key.
+  std::string Version;
+
+  /// The cache passes entries to a callback. As it does so before returning,
+  /// each lookup uses a unique task number to find its entry in this map.
+  std::atomic<unsigned> NextTask{0};
+  std::mutex EntriesLock;
+  llvm::DenseMap<unsigned, std::unique_ptr<llvm::MemoryBuffer>> Entries;
+};
+
+} // end namespace dependencies
+} // end namespace tooling
+} // end namespace clang
+
+#endif // LLVM_CLANG_TOOLING_DEPENDENCYSCANNING_DEPENDENCYDIRECTIVESCACHE_H
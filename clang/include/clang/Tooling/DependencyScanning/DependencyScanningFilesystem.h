@@ -23,6 +23,8 @@ namespace clang {
 namespace tooling {
 namespace dependencies {
 
+class DependencyDirectivesCache;
+
 using DependencyDirectivesTy =
     SmallVector<dependency_directives_scan::Directive, 20>;
 
@@ -220,9 +222,21 @@ public:
   CacheShard &getShardForFilename(StringRef Filename) const;
   CacheShard &getShardForUID(llvm::sys::fs::UniqueID UID) const;
 
+  /// Sets the on-disk cache consulted before scanning a file for directives.
+  /// Must be called before any worker uses this cache.
+  void setDirectivesCache(std::shared_ptr<DependencyDirectivesCache> Cache) {
+    DirectivesCache = std::move(Cache);
+  }
+
+  /// Returns the on-disk directives cache, or nullptr if there is none.
+  DependencyDirectivesCache *getDirectivesCache() const {
+    return DirectivesCache.get();
+  }
+
 private:
   std::unique_ptr<CacheShard[]> CacheShards;
   unsigned NumShards;
+  std::shared_ptr<DependencyDirectivesCache> DirectivesCache;
 };
 
 /// This class is a local cache, that caches the 'stat' and 'open' calls to the
@@ -848,6 +848,14 @@ interp::Context &ASTContext::getInterpContext() {
   return *InterpContext.get();
 }
 
+void ASTContext::serializeInterpFunctions(
+    llvm::function_ref<void(const FunctionDecl *, StringRef,
+                            ArrayRef<const Decl *>)>
+        Callback) {
+  if (InterpContext)
+    InterpContext->serializeFunctions(Callback);
+}
+
 ParentMapContext &ASTContext::getParentMapContext() {
   if (!ParentMapCtx)
     ParentMapCtx.reset(new ParentMapContext(*this));
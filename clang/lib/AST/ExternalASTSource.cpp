@@ -44,6 +44,12 @@ void ExternalASTSource::FindFileRegionDecls(FileID File, unsigned Offset,
                                             unsigned Length,
                                             SmallVectorImpl<Decl *> &Decls) {}
 
+bool ExternalASTSource::FindExternalInterpBytecode(
+    const FunctionDecl *FD, StringRef &Bytecode,
+    SmallVectorImpl<const Decl *> &Decls) {
+  return false;
+}
+
 void ExternalASTSource::CompleteRedeclChain(const Decl *D) {}
 
 void ExternalASTSource::CompleteType(TagDecl *Tag) {}
@@ -9,18 +9,28 @@
 #include "ByteCodeEmitter.h"
 #include "Context.h"
 #include "Floating.h"
+#include "FunctionSerializer.h"
 #include "IntegralAP.h"
 #include "Opcode.h"
 #include "Program.h"
 #include "clang/AST/ASTLambda.h"
 #include "clang/AST/Attr.h"
 #include "clang/AST/DeclCXX.h"
+#include "clang/AST/ExternalASTSource.h"
 #include "clang/Basic/Builtins.h"
+#include "llvm/ADT/Statistic.h"
 #include <type_traits>
 
 using namespace clang;
 using namespace clang::interp;
 
+#define DEBUG_TYPE "interp"
+
+ALWAYS_ENABLED_STATISTIC(NumFunctionsCompiled,
+                         "Number of functions compiled to bytecode.");
+ALWAYS_ENABLED_STATISTIC(NumFunctionsLoaded,
+                         "Number of functions loaded from AST files.");
+
 /// Unevaluated builtins don't get their arguments put on the stack
 /// automatically. They instead operate on the AST of their Call
 /// Expression.
@@ -162,11 +172,19 @@ Function *ByteCodeEmitter::compileFunc(const FunctionDecl *FuncDecl) {
     IsEligibleForCompilation =
         FuncDecl->isConstexpr() || FuncDecl->hasAttr<MSConstexprAttr>();
 
+  // Reuse the bytecode stored along with the declaration, if any.
+  if (IsEligibleForCompilation && loadFunc(Func)) {
+    ++NumFunctionsLoaded;
+    Func->setIsFullyCompiled(true);
+    return Func;
+  }
+
   // Compile the function body.
   if (!IsEligibleForCompilation || !visitFunc(FuncDecl)) {
     Func->setIsFullyCompiled(true);
     return Func;
   }
+  ++NumFunctionsCompiled;
 
   // Create scopes from descriptors.
   llvm::SmallVector<Scope, 2> Scopes;
@@ -181,6 +199,18 @@ Function *ByteCodeEmitter::compileFunc(const FunctionDecl *FuncDecl) {
   return Func;
 }
 
+bool ByteCodeEmitter::loadFunc(Function *Func) {
+  const FunctionDecl *FuncDecl = Func->getDecl();
+  ExternalASTSource *Source = FuncDecl->getASTContext().getExternalSource();
+  if (!Source || !FuncDecl->isFromASTFile())
+    return false;
+
+  StringRef Bytecode;
+  SmallVector<const Decl *, 16> Decls;
+  return Source->FindExternalInterpBytecode(FuncDecl, Bytecode, Decls) &&
+         FunctionSerializer::read(Ctx, P, *Func, Bytecode, Decls);
+}
+
 Scope::Local ByteCodeEmitter::createLocal(Descriptor *D) {
   NextLocalOffset += sizeof(Block);
   unsigned Location = NextLocalOffset;
@@ -87,6 +87,9 @@ private:
   /// Returns the offset for a jump or records a relocation.
   int32_t getOffset(LabelTy Label);
 
+  /// Sets the code of a function from the AST file it was declared in.
+  bool loadFunc(Function *Func);
+
   /// Emits an opcode.
   template <typename... Tys>
   bool emitOp(Opcode Op, const Tys &... Args, const SourceInfo &L);
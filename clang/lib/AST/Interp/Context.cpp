@@ -11,6 +11,7 @@
 #include "ByteCodeExprGen.h"
 #include "ByteCodeStmtGen.h"
 #include "EvalEmitter.h"
+#include "FunctionSerializer.h"
 #include "Interp.h"
 #include "InterpFrame.h"
 #include "InterpStack.h"
@@ -263,6 +264,13 @@ const Function *Context::getOrCreateFunction(const FunctionDecl *FD) {
   return Func;
 }
 
+void Context::serializeFunctions(
+    llvm::function_ref<void(const FunctionDecl *, StringRef,
+                            ArrayRef<const Decl *>)>
+        Callback) {
+  FunctionSerializer::writeAll(*P, Callback);
+}
+
 unsigned Context::collectBaseOffset(const RecordDecl *BaseDecl,
                                     const RecordDecl *DerivedDecl) const {
   assert(BaseDecl);
@@ -17,9 +17,11 @@
 #define LLVM_CLANG_AST_INTERP_CONTEXT_H
 
 #include "InterpStack.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
 
 namespace clang {
 class ASTContext;
+class Decl;
 class LangOptions;
 class FunctionDecl;
 class VarDecl;
@@ -92,6 +94,13 @@ public:
 
   const Function *getOrCreateFunction(const FunctionDecl *FD);
 
+  /// Serializes the bytecode of all compiled functions, passing it along with
+  /// the declarations it refers to to the callback.
+  void serializeFunctions(
+      llvm::function_ref<void(const FunctionDecl *, StringRef,
+                              ArrayRef<const Decl *>)>
+          Callback);
+
   /// Returns whether we should create a global variable for the
   /// given ValueDecl.
   static bool shouldBeGloballyIndexed(const ValueDecl *VD) {
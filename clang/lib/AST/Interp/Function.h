@@ -226,6 +226,7 @@ private:
 private:
   friend class Program;
   friend class ByteCodeEmitter;
+  friend class FunctionSerializer;
 
   /// Program reference.
   Program &P;
@@ -0,0 +1,953 @@
+//===--- FunctionSerializer.cpp - Bytecode serialization --------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Serialized bytecode is laid out as follows, with all fields being 32-bit
+// little-endian words:
+//
+//   Layout                    pointer size and byte order of the host
+//   NumStmts                  number of statements, see StmtNumbering
+//   ArgSize, FrameSize
+//   NumEntries, Entries...    objects the code refers to, see EntryKind
+//   CodeSize, Code...         code in host byte order
+//   NumSources, Sources...    source map, as (offset, entry) pairs
+//   NumScopes, Scopes...      NumLocals followed by (offset, entry) pairs
+//
+// Operands of the code which refer to the program, such as native pointers
+// and indices of globals, are replaced by the index of an entry. Entries
+// only refer to entries before them.
+//
+//===----------------------------------------------------------------------===//
+
+#include "FunctionSerializer.h"
+#include "Context.h"
+#include "Floating.h"
+#include "Function.h"
+#include "IntegralAP.h"
+#include "Opcode.h"
+#include "Program.h"
+#include "Record.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/ASTLambda.h"
+#include "clang/AST/DeclCXX.h"
+#include "clang/AST/ExprCXX.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace clang;
+using namespace clang::interp;
+
+namespace {
+
+/// Kinds of the objects which serialized code refers to.
+enum class EntryKind : uint32_t {
+  /// A null pointer.
+  Null,
+  /// Index of a declaration.
+  Decl,
+  /// Number and class of a statement.
+  Stmt,
+  /// Entry of a FunctionDecl.
+  Function,
+  /// Entry of a FieldDecl.
+  Field,
+  /// An llvm::APFloatBase::Semantics.
+  Semantics,
+  /// A ComparisonCategoryType.
+  CompCategory,
+  /// A DescriptorKind, the metadata size, flags and the entry of the source,
+  /// followed by fields depending on the kind.
+  Descriptor,
+  /// Entry of the StringLiteral of a global string.
+  GlobalString,
+  /// Entry of the expression of a global temporary.
+  GlobalTemporary,
+  /// Entry of the declaration of a global.
+  GlobalDecl,
+  /// Entry of the declaration of a dummy global.
+  GlobalDummy,
+};
+
+/// Kinds of descriptors, after which the fields of their entry are named.
+enum class DescriptorKind : uint32_t {
+  /// The PrimType.
+  Primitive,
+  /// The PrimType and the number of elements.
+  PrimitiveArray,
+  /// Entry of the element descriptor and the number of elements.
+  CompositeArray,
+  /// Entry of the element descriptor.
+  UnknownCompositeArray,
+  /// Entry of the RecordDecl.
+  Record,
+  Dummy,
+  UnknownDummy,
+};
+
+enum DescriptorFlags : uint32_t {
+  IsConstFlag = 1 << 0,
+  IsTemporaryFlag = 1 << 1,
+  IsMutableFlag = 1 << 2,
+};
+
+/// Tag of operands which are indices of globals.
+struct GlobalIndex {};
+
+} // namespace
+
+/// Code depends on the layout of values in the host.
+static uint32_t getHostLayout() {
+  return sizeof(void *) << 1 |
+         (llvm::endianness::native == llvm::endianness::little);
+}
+
+/// Lambda static invokers share their Function with the call operator of
+/// generic lambdas and get custom code, so they are always compiled afresh.
+static bool isCompiledSpecially(const FunctionDecl *FD) {
+  if (const auto *MD = dyn_cast<CXXMethodDecl>(FD);
+      MD && MD->isLambdaStaticInvoker())
+    return true;
+  return isGenericLambdaCallOperatorOrStaticInvokerSpecialization(FD);
+}
+
+namespace {
+
+/// Numbers the statements a function is compiled from in an order which only
+/// depends on the declaration: the member initializers and the body of its
+/// definition, along with the expressions the compiler visits in place of
+/// default arguments, default member initializers and opaque values.
+class StmtNumbering {
+public:
+  explicit StmtNumbering(const FunctionDecl *FD) {
+    const FunctionDecl *Def = nullptr;
+    const Stmt *Body = FD->getBody(Def);
+    if (const auto *Ctor = dyn_cast_if_present<CXXConstructorDecl>(Def)) {
+      for (const CXXCtorInitializer *Init : Ctor->inits())
+        walk(Init->getInit());
+    }
+    walk(Body);
+  }
+
+  unsigned size() const { return Stmts.size(); }
+
+  std::optional<unsigned> getNumber(const Stmt *S) const {
+    if (auto It = Numbers.find(S); It != Numbers.end())
+      return It->second;
+    return std::nullopt;
+  }
+
+  const Stmt *getStmt(unsigned N) const {
+    return N < Stmts.size() ? Stmts[N] : nullptr;
+  }
+
+private:
+  void walk(const Stmt *Root) {
+    SmallVector<const Stmt *, 32> Worklist{Root};
+    while (!Worklist.empty()) {
+      const Stmt *S = Worklist.pop_back_val();
+      if (!S || !Numbers.try_emplace(S, Stmts.size()).second)
+        continue;
+      Stmts.push_back(S);
+
+      SmallVector<const Stmt *, 8> Next(S->child_begin(), S->child_end());
+      if (const auto *E = dyn_cast<CXXDefaultArgExpr>(S))
+        Next.push_back(E->getExpr());
+      else if (const auto *E = dyn_cast<CXXDefaultInitExpr>(S))
+        Next.push_back(E->getExpr());
+      else if (const auto *E = dyn_cast<OpaqueValueExpr>(S))
+        Next.push_back(E->getSourceExpr());
+      Worklist.append(Next.rbegin(), Next.rend());
+    }
+  }
+
+  std::vector<const Stmt *> Stmts;
+  llvm::DenseMap<const Stmt *, unsigned> Numbers;
+};
+
+/// Reads little-endian words, failing at the end of the data.
+class WordReader {
+public:
+  explicit WordReader(StringRef Data) : Data(Data) {}
+
+  bool read(uint32_t &Value) {
+    if (Data.size() < sizeof(uint32_t))
+      return false;
+    Value = llvm::support::endian::read32le(Data.data());
+    Data = Data.drop_front(sizeof(uint32_t));
+    return true;
+  }
+
+  bool readBytes(size_t Size, StringRef &Bytes) {
+    if (Data.size() < Size)
+      return false;
+    Bytes = Data.take_front(Size);
+    Data = Data.drop_front(Size);
+    return true;
+  }
+
+  bool atEnd() const { return Data.empty(); }
+
+private:
+  StringRef Data;
+};
+
+/// Walks the operands of instructions, checking that they lie within the
+/// code, and lets a rewriter replace those which refer to the program.
+template <typename RewriterT> class OperandVisitor {
+public:
+  explicit OperandVisitor(RewriterT &Rewrite) : Rewrite(Rewrite) {}
+
+  template <typename T>
+  bool visit(MutableArrayRef<std::byte> Code, size_t &Offset) {
+    if constexpr (std::is_pointer_v<T> || std::is_same_v<T, GlobalIndex>) {
+      if (!fits(Code, Offset, sizeof(uint32_t)))
+        return false;
+      uint32_t ID;
+      std::memcpy(&ID, Code.data() + Offset, sizeof(uint32_t));
+      bool Success;
+      if constexpr (std::is_same_v<T, GlobalIndex>)
+        Success = Rewrite.global(ID);
+      else
+        Success = Rewrite.template pointer<T>(ID);
+      std::memcpy(Code.data() + Offset, &ID, sizeof(uint32_t));
+      Offset += align(sizeof(uint32_t));
+      return Success;
+    } else if constexpr (std::is_same_v<T, Floating>) {
+      // Floating-point values start with a pointer to their semantics.
+      if (!fits(Code, Offset, sizeof(void *)))
+        return false;
+      const llvm::fltSemantics *Sem = Rewrite.semantics(Code.data() + Offset);
+      return Sem && skip(Code, Offset,
+                         sizeof(void *) +
+                             llvm::APFloat::semanticsSizeInBits(*Sem) / 8);
+    } else if constexpr (std::is_same_v<T, IntegralAP<false>> ||
+                         std::is_same_v<T, IntegralAP<true>>) {
+      // Arbitrary-precision integers start with their bit width.
+      if (!fits(Code, Offset, sizeof(uint32_t)))
+        return false;
+      uint32_t BitWidth;
+      std::memcpy(&BitWidth, Code.data() + Offset, sizeof(uint32_t));
+      return skip(Code, Offset, sizeof(uint32_t) + BitWidth / CHAR_BIT);
+    } else {
+      return skip(Code, Offset, sizeof(T));
+    }
+  }
+
+private:
+  static bool fits(ArrayRef<std::byte> Code, size_t Offset, size_t Size) {
+    return Offset <= Code.size() && align(Size) <= Code.size() - Offset;
+  }
+
+  static bool skip(ArrayRef<std::byte> Code, size_t &Offset, size_t Size) {
+    if (!fits(Code, Offset, Size))
+      return false;
+    Offset += align(Size);
+    return true;
+  }
+
+  RewriterT &Rewrite;
+};
+
+} // namespace
+
+template <typename... Tys, typename VisitorT>
+static bool visitOperands(MutableArrayRef<std::byte> Code, size_t &Offset,
+                          VisitorT &Visit) {
+  return (... && Visit.template visit<Tys>(Code, Offset));
+}
+
+/// Visits the operands of the instruction Op, which start at Offset.
+template <typename VisitorT>
+static bool visitInstruction(Opcode Op, MutableArrayRef<std::byte> Code,
+                             size_t &Offset, VisitorT &Visit) {
+  switch (Op) {
+#define GET_OPERANDS
+#include "Opcodes.inc"
+#undef GET_OPERANDS
+  }
+  return false;
+}
+
+/// Rewrites the operands of all instructions in Code.
+template <typename RewriterT>
+static bool rewriteCode(MutableArrayRef<std::byte> Code, RewriterT &Rewrite) {
+  OperandVisitor<RewriterT> Visit(Rewrite);
+  for (size_t Offset = 0; Offset != Code.size();) {
+    if (Code.size() - Offset < align(sizeof(Opcode)))
+      return false;
+    uint32_t Op;
+    std::memcpy(&Op, Code.data() + Offset, sizeof(uint32_t));
+    Offset += align(sizeof(Opcode));
+    if (!visitInstruction(static_cast<Opcode>(Op), Code, Offset, Visit))
+      return false;
+  }
+  return true;
+}
+
+//===----------------------------------------------------------------------===//
+// Writer
+//===----------------------------------------------------------------------===//
+
+class FunctionSerializer::Writer {
+public:
+  Writer(Program &P, const Function &Func, SmallVectorImpl<const Decl *> &Decls)
+      : P(P), Func(Func), Decls(Decls), Stmts(Func.getDecl()) {}
+
+  bool write(SmallVectorImpl<char> &Data);
+
+  template <typename T> bool pointer(uint32_t &ID) {
+    if (ID >= P.NativePointers.size())
+      return false;
+    std::optional<uint32_t> Entry = add(static_cast<T>(P.NativePointers[ID]));
+    if (!Entry)
+      return false;
+    ID = *Entry;
+    return true;
+  }
+
+  bool global(uint32_t &Index) {
+    std::optional<uint32_t> Entry = addGlobal(Index);
+    if (!Entry)
+      return false;
+    Index = *Entry;
+    return true;
+  }
+
+  const llvm::fltSemantics *semantics(std::byte *Slot) {
+    const llvm::fltSemantics *Sem;
+    std::memcpy(&Sem, Slot, sizeof(void *));
+    std::optional<uint32_t> Entry = add(Sem);
+    if (!Sem || !Entry)
+      return nullptr;
+    std::memset(Slot, 0, sizeof(void *));
+    std::memcpy(Slot, &*Entry, sizeof(uint32_t));
+    return Sem;
+  }
+
+private:
+  /// Adds an entry unless one exists for the same object.
+  uint32_t addEntry(EntryKind Kind, const void *Key,
+                    ArrayRef<uint32_t> Fields) {
+    auto [It, Inserted] =
+        Entries.try_emplace({static_cast<uint32_t>(Kind), Key}, NumEntries);
+    if (Inserted) {
+      ++NumEntries;
+      EntryData.push_back(static_cast<uint32_t>(Kind));
+      EntryData.append(Fields.begin(), Fields.end());
+    }
+    return It->second;
+  }
+
+  uint32_t addNull() { return addEntry(EntryKind::Null, nullptr, {}); }
+
+  std::optional<uint32_t> add(const Decl *D) {
+    if (!D)
+      return addNull();
+    auto [It, Inserted] = DeclIndices.try_emplace(D, Decls.size());
+    if (Inserted)
+      Decls.push_back(D);
+    return addEntry(EntryKind::Decl, D, {It->second});
+  }
+
+  std::optional<uint32_t> add(const Stmt *S) {
+    if (!S)
+      return addNull();
+    std::optional<unsigned> Number = Stmts.getNumber(S);
+    if (!Number)
+      return std::nullopt;
+    return addEntry(EntryKind::Stmt, S,
+                    {*Number, static_cast<uint32_t>(S->getStmtClass())});
+  }
+
+  std::optional<uint32_t> add(const Function *F) {
+    if (!F)
+      return addNull();
+    const FunctionDecl *FD = F->getDecl();
+    if (!FD || isCompiledSpecially(FD))
+      return std::nullopt;
+    std::optional<uint32_t> DeclEntry = add(static_cast<const Decl *>(FD));
+    return addEntry(EntryKind::Function, F, {*DeclEntry});
+  }
+
+  std::optional<uint32_t> add(const Record::Field *F) {
+    if (!F)
+      return addNull();
+    std::optional<uint32_t> DeclEntry = add(static_cast<const Decl *>(F->Decl));
+    return addEntry(EntryKind::Field, F, {*DeclEntry});
+  }
+
+  std::optional<uint32_t> add(const llvm::fltSemantics *Sem) {
+    if (!Sem)
+      return addNull();
+    return addEntry(EntryKind::Semantics, Sem,
+                    {llvm::APFloatBase::SemanticsToEnum(*Sem)});
+  }
+
+  std::optional<uint32_t> add(const ComparisonCategoryInfo *CCI) {
+    if (!CCI)
+      return addNull();
+    return addEntry(EntryKind::CompCategory, CCI,
+                    {static_cast<uint32_t>(CCI->Kind)});
+  }
+
+  std::optional<uint32_t> add(const Descriptor *D);
+  std::optional<uint32_t> addGlobal(unsigned Index);
+
+  Program &P;
+  const Function &Func;
+  SmallVectorImpl<const Decl *> &Decls;
+  StmtNumbering Stmts;
+
+  llvm::DenseMap<const Decl *, uint32_t> DeclIndices;
+  /// Entries by their kind and object.
+  llvm::DenseMap<std::pair<uint32_t, const void *>, uint32_t> Entries;
+  llvm::DenseMap<unsigned, uint32_t> GlobalEntries;
+  uint32_t NumEntries = 0;
+  SmallVector<uint32_t, 64> EntryData;
+};
+
+std::optional<uint32_t> FunctionSerializer::Writer::add(const Descriptor *D) {
+  if (!D)
+    return addNull();
+  if (auto It = Entries.find({static_cast<uint32_t>(EntryKind::Descriptor), D});
+      It != Entries.end())
+    return It->second;
+
+  std::optional<uint32_t> Source;
+  if (const Expr *E = D->asExpr())
+    Source = add(static_cast<const Stmt *>(E));
+  else
+    Source = add(D->asDecl());
+  if (!Source)
+    return std::nullopt;
+
+  uint32_t Flags = (D->IsConst ? IsConstFlag : 0) |
+                   (D->IsTemporary ? IsTemporaryFlag : 0) |
+                   (D->IsMutable ? IsMutableFlag : 0);
+  SmallVector<uint32_t, 6> Fields{0, D->getMetadataSize(), Flags, *Source};
+  DescriptorKind Kind;
+  if (D->isDummy()) {
+    Kind = D->isUnknownSizeArray() ? DescriptorKind::UnknownDummy
+                                   : DescriptorKind::Dummy;
+  } else if (D->isPrimitive()) {
+    Kind = DescriptorKind::Primitive;
+    Fields.push_back(D->getPrimType());
+  } else if (D->isPrimitiveArray()) {
+    // The primitive type of these is not recorded.
+    if (D->isUnknownSizeArray())
+      return std::nullopt;
+    Kind = DescriptorKind::PrimitiveArray;
+    Fields.push_back(D->getPrimType());
+    Fields.push_back(D->getNumElems());
+  } else if (D->isCompositeArray()) {
+    std::optional<uint32_t> Elem = add(D->ElemDesc);
+    if (!Elem)
+      return std::nullopt;
+    Fields.push_back(*Elem);
+    if (D->isUnknownSizeArray()) {
+      Kind = DescriptorKind::UnknownCompositeArray;
+    } else {
+      Kind = DescriptorKind::CompositeArray;
+      Fields.push_back(D->getNumElems());
+    }
+  } else {
+    assert(D->isRecord());
+    Kind = DescriptorKind::Record;
+    Fields.push_back(
+        *add(static_cast<const Decl *>(D->ElemRecord->getDecl())));
+  }
+  Fields[0] = static_cast<uint32_t>(Kind);
+  return addEntry(EntryKind::Descriptor, D, Fields);
+}
+
+std::optional<uint32_t>
+FunctionSerializer::Writer::addGlobal(unsigned Index) {
+  if (auto It = GlobalEntries.find(Index); It != GlobalEntries.end())
+    return It->second;
+  if (Index >= P.Globals.size())
+    return std::nullopt;
+
+  const Descriptor *Desc = P.Globals[Index]->block()->getDescriptor();
+  EntryKind Kind = EntryKind::Null;
+  std::optional<uint32_t> Source;
+  if (Desc->isDummy()) {
+    Kind = EntryKind::GlobalDummy;
+    if (const ValueDecl *VD = Desc->asValueDecl())
+      Source = add(static_cast<const Decl *>(VD));
+  } else if (const Expr *E = Desc->asExpr()) {
+    Kind = isa<StringLiteral>(E) ? EntryKind::GlobalString
+                                 : EntryKind::GlobalTemporary;
+    Source = add(static_cast<const Stmt *>(E));
+  } else if (const ValueDecl *VD = Desc->asValueDecl();
+             isa_and_nonnull<VarDecl, UnnamedGlobalConstantDecl, MSGuidDecl,
+                             TemplateParamObjectDecl>(VD)) {
+    Kind = EntryKind::GlobalDecl;
+    Source = add(static_cast<const Decl *>(VD));
+  }
+  if (!Source)
+    return std::nullopt;
+
+  uint32_t Entry = NumEntries++;
+  EntryData.push_back(static_cast<uint32_t>(Kind));
+  EntryData.push_back(*Source);
+  GlobalEntries[Index] = Entry;
+  return Entry;
+}
+
+bool FunctionSerializer::Writer::write(SmallVectorImpl<char> &Data) {
+  std::vector<std::byte> Code = Func.Code;
+  if (!rewriteCode(MutableArrayRef<std::byte>(Code), *this))
+    return false;
+
+  SmallVector<std::pair<uint32_t, uint32_t>, 32> Sources;
+  for (const auto &[Offset, SI] : Func.SrcMap) {
+    std::optional<uint32_t> Entry;
+    if (const Stmt *S = SI.asStmt())
+      Entry = add(S);
+    else
+      Entry = add(SI.asDecl());
+    if (!Entry)
+      return false;
+    Sources.emplace_back(Offset, *Entry);
+  }
+
+  SmallVector<SmallVector<std::pair<uint32_t, uint32_t>, 8>, 2> Scopes;
+  for (const Scope &S : Func.Scopes) {
+    auto &Locals = Scopes.emplace_back();
+    for (const Scope::Local &L : S.locals()) {
+      std::optional<uint32_t> Entry = add(L.Desc);
+      if (!Entry)
+        return false;
+      Locals.emplace_back(L.Offset, *Entry);
+    }
+  }
+
+  llvm::raw_svector_ostream OS(Data);
+  llvm::support::endian::Writer W(OS, llvm::endianness::little);
+  W.write<uint32_t>(getHostLayout());
+  W.write<uint32_t>(Stmts.size());
+  W.write<uint32_t>(Func.getArgSize());
+  W.write<uint32_t>(Func.getFrameSize());
+  W.write<uint32_t>(NumEntries);
+  for (uint32_t Word : EntryData)
+    W.write<uint32_t>(Word);
+  W.write<uint32_t>(Code.size());
+  OS.write(reinterpret_cast<const char *>(Code.data()), Code.size());
+  W.write<uint32_t>(Sources.size());
+  for (const auto &[Offset, Entry] : Sources) {
+    W.write<uint32_t>(Offset);
+    W.write<uint32_t>(Entry);
+  }
+  W.write<uint32_t>(Scopes.size());
+  for (const auto &Locals : Scopes) {
+    W.write<uint32_t>(Locals.size());
+    for (const auto &[Offset, Entry] : Locals) {
+      W.write<uint32_t>(Offset);
+      W.write<uint32_t>(Entry);
+    }
+  }
+  return true;
+}
+
+//===----------------------------------------------------------------------===//
+// Reader
+//===----------------------------------------------------------------------===//
+
+class FunctionSerializer::Reader {
+public:
+  Reader(Context &Ctx, Program &P, Function &Func, ArrayRef<const Decl *> Decls)
+      : Ctx(Ctx), P(P), Func(Func), Decls(Decls), Stmts(Func.getDecl()) {}
+
+  bool read(StringRef Data);
+
+  template <typename T> bool pointer(uint32_t &ID) {
+    T Ptr = nullptr;
+    if (!get(ID, Ptr))
+      return false;
+    ID = P.getOrCreateNativePointer(Ptr);
+    return true;
+  }
+
+  bool global(uint32_t &Index) {
+    if (Index >= Entries.size() || !Entries[Index].IsGlobal)
+      return false;
+    Index = Entries[Index].Global;
+    return true;
+  }
+
+  const llvm::fltSemantics *semantics(std::byte *Slot) {
+    uint32_t ID;
+    std::memcpy(&ID, Slot, sizeof(uint32_t));
+    const llvm::fltSemantics *Sem = nullptr;
+    if (!get(ID, Sem) || !Sem)
+      return nullptr;
+    std::memcpy(Slot, &Sem, sizeof(void *));
+    return Sem;
+  }
+
+private:
+  /// A resolved entry. Ptr holds an object of the type of its kind.
+  struct Entry {
+    EntryKind Kind;
+    const void *Ptr = nullptr;
+    bool IsGlobal = false;
+    unsigned Global = 0;
+  };
+
+  static EntryKind getKind(const Function *) { return EntryKind::Function; }
+  static EntryKind getKind(const Record::Field *) { return EntryKind::Field; }
+  static EntryKind getKind(const llvm::fltSemantics *) {
+    return EntryKind::Semantics;
+  }
+  static EntryKind getKind(const ComparisonCategoryInfo *) {
+    return EntryKind::CompCategory;
+  }
+  static EntryKind getKind(const Descriptor *) {
+    return EntryKind::Descriptor;
+  }
+
+  /// Retrieves the object of an entry, which may be null.
+  template <typename T> bool get(uint32_t ID, const T *&Out) {
+    if (ID >= Entries.size())
+      return false;
+    const Entry &E = Entries[ID];
+    if (E.Kind == EntryKind::Null) {
+      Out = nullptr;
+      return true;
+    }
+    if constexpr (std::is_base_of_v<Decl, T>) {
+      if (E.Kind != EntryKind::Decl)
+        return false;
+      Out = dyn_cast<T>(static_cast<const Decl *>(E.Ptr));
+    } else if constexpr (std::is_base_of_v<Stmt, T>) {
+      if (E.Kind != EntryKind::Stmt)
+        return false;
+      Out = dyn_cast<T>(static_cast<const Stmt *>(E.Ptr));
+    } else {
+      if (E.Kind != getKind(Out))
+        return false;
+      Out = static_cast<const T *>(E.Ptr);
+    }
+    return Out;
+  }
+
+  /// Reads the index of an entry and retrieves its object, which must not be
+  /// null.
+  template <typename T> const T *readRef(WordReader &R) {
+    uint32_t ID;
+    const T *Out = nullptr;
+    if (!R.read(ID) || !get(ID, Out))
+      return nullptr;
+    return Out;
+  }
+
+  bool readEntry(WordReader &R);
+  const Descriptor *readDescriptor(WordReader &R);
+  std::optional<unsigned> readGlobal(EntryKind Kind, WordReader &R);
+
+  Context &Ctx;
+  Program &P;
+  Function &Func;
+  ArrayRef<const Decl *> Decls;
+  StmtNumbering Stmts;
+  SmallVector<Entry, 64> Entries;
+};
+
+bool FunctionSerializer::Reader::readEntry(WordReader &R) {
+  uint32_t Kind;
+  if (!R.read(Kind))
+    return false;
+
+  Entry E{static_cast<EntryKind>(Kind)};
+  switch (E.Kind) {
+  case EntryKind::Null:
+    break;
+  case EntryKind::Decl: {
+    uint32_t Index;
+    if (!R.read(Index) || Index >= Decls.size() || !Decls[Index])
+      return false;
+    E.Ptr = Decls[Index];
+    break;
+  }
+  case EntryKind::Stmt: {
+    uint32_t Number, Class;
+    if (!R.read(Number) || !R.read(Class))
+      return false;
+    const Stmt *S = Stmts.getStmt(Number);
+    if (!S || S->getStmtClass() != Class)
+      return false;
+    E.Ptr = S;
+    break;
+  }
+  case EntryKind::Function: {
+    const auto *FD = readRef<FunctionDecl>(R);
+    if (!FD || isCompiledSpecially(FD))
+      return false;
+    E.Ptr = Ctx.getOrCreateFunction(FD);
+    break;
+  }
+  case EntryKind::Field: {
+    const auto *FD = readRef<FieldDecl>(R);
+    if (!FD)
+      return false;
+    if (const Record *Rec = P.getOrCreateRecord(FD->getParent()))
+      E.Ptr = Rec->getField(FD);
+    break;
+  }
+  case EntryKind::Semantics: {
+    uint32_t Sem;
+    if (!R.read(Sem) || Sem > llvm::APFloatBase::S_MaxSemantics)
+      return false;
+    E.Ptr = &llvm::APFloatBase::EnumToSemantics(
+        static_cast<llvm::APFloatBase::Semantics>(Sem));
+    break;
+  }
+  case EntryKind::CompCategory: {
+    uint32_t Type;
+    if (!R.read(Type) ||
+        Type > static_cast<uint32_t>(ComparisonCategoryType::Last))
+      return false;
+    E.Ptr = Ctx.getASTContext().CompCategories.lookupInfo(
+        static_cast<ComparisonCategoryType>(Type));
+    break;
+  }
+  case EntryKind::Descriptor:
+    E.Ptr = readDescriptor(R);
+    break;
+  case EntryKind::GlobalString:
+  case EntryKind::GlobalTemporary:
+  case EntryKind::GlobalDecl:
+  case EntryKind::GlobalDummy:
+    if (std::optional<unsigned> Index = readGlobal(E.Kind, R)) {
+      E.IsGlobal = true;
+      E.Global = *Index;
+    }
+    break;
+  default:
+    return false;
+  }
+  if (E.Kind != EntryKind::Null && !E.Ptr && !E.IsGlobal)
+    return false;
+
+  Entries.push_back(E);
+  return true;
+}
+
+const Descriptor *FunctionSerializer::Reader::readDescriptor(WordReader &R) {
+  uint32_t Kind, MDSize, Flags, SourceID;
+  if (!R.read(Kind) || !R.read(MDSize) || !R.read(Flags) || !R.read(SourceID))
+    return nullptr;
+
+  DeclTy Source;
+  const Stmt *S = nullptr;
+  if (get(SourceID, S) && S)
+    Source = dyn_cast<Expr>(S);
+  else if (const Decl *D = nullptr; get(SourceID, D))
+    Source = D;
+  if (!Source)
+    return nullptr;
+
+  bool IsConst = Flags & IsConstFlag;
+  bool IsTemporary = Flags & IsTemporaryFlag;
+  bool IsMutable = Flags & IsMutableFlag;
+  switch (static_cast<DescriptorKind>(Kind)) {
+  case DescriptorKind::Primitive: {
+    uint32_t Type;
+    if (!R.read(Type) || Type > PT_FnPtr)
+      return nullptr;
+    return P.allocateDescriptor(Source, static_cast<PrimType>(Type), MDSize,
+                                IsConst, IsTemporary, IsMutable);
+  }
+  case DescriptorKind::PrimitiveArray: {
+    uint32_t Type, NumElems;
+    if (!R.read(Type) || Type > PT_FnPtr || !R.read(NumElems) ||
+        std::numeric_limits<unsigned>::max() /
+                primSize(static_cast<PrimType>(Type)) <=
+            NumElems)
+      return nullptr;
+    return P.allocateDescriptor(Source, static_cast<PrimType>(Type), MDSize,
+                                static_cast<size_t>(NumElems), IsConst,
+                                IsTemporary, IsMutable);
+  }
+  case DescriptorKind::CompositeArray: {
+    const Descriptor *Elem = readRef<Descriptor>(R);
+    uint32_t NumElems;
+    if (!Elem || !R.read(NumElems) ||
+        std::numeric_limits<unsigned>::max() /
+                (Elem->getAllocSize() + sizeof(InlineDescriptor)) <=
+            NumElems)
+      return nullptr;
+    return P.allocateDescriptor(Source, Elem, MDSize, NumElems, IsConst,
+                                IsTemporary, IsMutable);
+  }
+  case DescriptorKind::UnknownCompositeArray: {
+    const Descriptor *Elem = readRef<Descriptor>(R);
+    if (!Elem)
+      return nullptr;
+    return P.allocateDescriptor(Source, Elem, MDSize, IsTemporary,
+                                Descriptor::UnknownSize{});
+  }
+  case DescriptorKind::Record: {
+    const auto *RD = readRef<RecordDecl>(R);
+    const Record *Rec = RD ? P.getOrCreateRecord(RD) : nullptr;
+    if (!Rec)
+      return nullptr;
+    return P.allocateDescriptor(Source, Rec, MDSize, IsConst, IsTemporary,
+                                IsMutable);
+  }
+  case DescriptorKind::Dummy:
+    return P.allocateDescriptor(Source);
+  case DescriptorKind::UnknownDummy:
+    return P.allocateDescriptor(Source, Descriptor::UnknownSize{});
+  }
+  return nullptr;
+}
+
+std::optional<unsigned>
+FunctionSerializer::Reader::readGlobal(EntryKind Kind, WordReader &R) {
+  switch (Kind) {
+  case EntryKind::GlobalString:
+    if (const auto *S = readRef<StringLiteral>(R))
+      return P.createGlobalString(S);
+    return std::nullopt;
+  case EntryKind::GlobalTemporary:
+    // The code creates and initializes these itself.
+    if (const auto *E = readRef<Expr>(R))
+      return P.createGlobal(E);
+    return std::nullopt;
+  case EntryKind::GlobalDecl: {
+    const auto *VD = readRef<ValueDecl>(R);
+    // Variables are initialized by whoever creates them first. Only reuse
+    // those which exist already, as the code would otherwise be compiled to
+    // create them.
+    if (isa_and_nonnull<VarDecl>(VD))
+      return P.getGlobal(VD);
+    if (isa_and_nonnull<UnnamedGlobalConstantDecl, MSGuidDecl,
+                        TemplateParamObjectDecl>(VD))
+      return P.getOrCreateGlobal(VD);
+    return std::nullopt;
+  }
+  case EntryKind::GlobalDummy: {
+    // A fresh compile refers to the declaration if it exists by now.
+    const auto *VD = readRef<ValueDecl>(R);
+    if (!VD || P.getGlobal(VD))
+      return std::nullopt;
+    return P.getOrCreateDummy(VD);
+  }
+  default:
+    llvm_unreachable("not a global");
+  }
+}
+
+bool FunctionSerializer::Reader::read(StringRef Data) {
+  WordReader R(Data);
+  uint32_t Layout, NumStmts, ArgSize, FrameSize, NumEntries;
+  if (!R.read(Layout) || Layout != getHostLayout() || !R.read(NumStmts) ||
+      NumStmts != Stmts.size() || !R.read(ArgSize) ||
+      ArgSize != Func.getArgSize() || !R.read(FrameSize) ||
+      !R.read(NumEntries))
+    return false;
+
+  for (uint32_t I = 0; I != NumEntries; ++I) {
+    if (!readEntry(R))
+      return false;
+  }
+
+  uint32_t CodeSize;
+  StringRef Bytes;
+  if (!R.read(CodeSize) || !aligned(CodeSize) || !R.readBytes(CodeSize, Bytes))
+    return false;
+  std::vector<std::byte> Code(CodeSize);
+  std::memcpy(Code.data(), Bytes.data(), CodeSize);
+  if (!rewriteCode(MutableArrayRef<std::byte>(Code), *this))
+    return false;
+
+  uint32_t NumSources;
+  if (!R.read(NumSources))
+    return false;
+  SourceMap SrcMap;
+  for (uint32_t I = 0; I != NumSources; ++I) {
+    uint32_t Offset, ID;
+    if (!R.read(Offset) || Offset > CodeSize || !R.read(ID))
+      return false;
+    const Stmt *S = nullptr;
+    const Decl *D = nullptr;
+    if (get(ID, S) && S)
+      SrcMap.emplace_back(Offset, S);
+    else if (get(ID, D) && D)
+      SrcMap.emplace_back(Offset, D);
+    else
+      return false;
+  }
+
+  uint32_t NumScopes;
+  if (!R.read(NumScopes))
+    return false;
+  llvm::SmallVector<Scope, 2> Scopes;
+  for (uint32_t I = 0; I != NumScopes; ++I) {
+    uint32_t NumLocals;
+    if (!R.read(NumLocals))
+      return false;
+    Scope::LocalVectorTy Locals;
+    for (uint32_t J = 0; J != NumLocals; ++J) {
+      uint32_t Offset;
+      const Descriptor *Desc;
+      if (!R.read(Offset) || Offset >= FrameSize ||
+          !(Desc = readRef<Descriptor>(R)))
+        return false;
+      // Descriptors of locals are created by the program, as we did above.
+      Locals.push_back({Offset, const_cast<Descriptor *>(Desc)});
+    }
+    Scopes.emplace_back(std::move(Locals));
+  }
+  if (!R.atEnd())
+    return false;
+
+  const FunctionDecl *FD = Func.getDecl();
+  Func.setCode(FrameSize, std::move(Code), std::move(SrcMap),
+               std::move(Scopes), FD->hasBody());
+  return true;
+}
+
+//===----------------------------------------------------------------------===//
+// FunctionSerializer
+//===----------------------------------------------------------------------===//
+
+void FunctionSerializer::writeAll(Program &P, WriteCallback Callback) {
+  SmallVector<char, 0> Data;
+  SmallVector<const Decl *, 16> Decls;
+  for (const auto &[FD, Func] : P.Funcs) {
+    Data.clear();
+    Decls.clear();
+    if (write(P, *Func, Data, Decls))
+      Callback(FD, StringRef(Data.data(), Data.size()), Decls);
+  }
+}
+
+bool FunctionSerializer::write(Program &P, const Function &Func,
+                               SmallVectorImpl<char> &Data,
+                               SmallVectorImpl<const Decl *> &Decls) {
+  const FunctionDecl *FD = Func.getDecl();
+  if (!FD || !Func.isFullyCompiled() || !Func.IsValid ||
+      isCompiledSpecially(FD))
+    return false;
+
+  size_t NumData = Data.size(), NumDecls = Decls.size();
+  if (Writer(P, Func, Decls).write(Data))
+    return true;
+  Data.truncate(NumData);
+  Decls.truncate(NumDecls);
+  return false;
+}
+
+bool FunctionSerializer::read(Context &Ctx, Program &P, Function &Func,
+                              StringRef Data, ArrayRef<const Decl *> Decls) {
+  if (isCompiledSpecially(Func.getDecl()))
+    return false;
+  return Reader(Ctx, P, Func, Decls).read(Data);
+}
@@ -0,0 +1,68 @@
+//===--- FunctionSerializer.h - Bytecode function serialization -*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Defines the serializer which stores the bytecode of functions in AST files,
+// so that translation units using them need not compile them again.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_AST_INTERP_FUNCTIONSERIALIZER_H
+#define LLVM_CLANG_AST_INTERP_FUNCTIONSERIALIZER_H
+
+#include "clang/Basic/LLVM.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace clang {
+class Decl;
+class FunctionDecl;
+
+namespace interp {
+class Context;
+class Function;
+class Program;
+
+/// Converts the bytecode of functions to and from a form independent of the
+/// program it was compiled in.
+///
+/// The code refers to declarations by their index in a list which is stored
+/// alongside it, and to statements by their position in the body. Everything
+/// else, such as globals and descriptors, is recreated in the program which
+/// loads the code. Code which cannot be recreated exactly as a fresh compile
+/// would produce it is not loaded, and the function is compiled as usual.
+class FunctionSerializer final {
+public:
+  using WriteCallback = llvm::function_ref<void(
+      const FunctionDecl *, StringRef, ArrayRef<const Decl *>)>;
+
+  /// Serializes every fully compiled function of the program.
+  static void writeAll(Program &P, WriteCallback Callback);
+
+  /// Serializes the bytecode of a function to Data, appending the
+  /// declarations it refers to to Decls.
+  ///
+  /// Returns false if the function cannot be serialized.
+  static bool write(Program &P, const Function &Func,
+                    SmallVectorImpl<char> &Data,
+                    SmallVectorImpl<const Decl *> &Decls);
+
+  /// Sets the code of a function from serialized bytecode.
+  ///
+  /// Returns false if the bytecode cannot be used in this program.
+  static bool read(Context &Ctx, Program &P, Function &Func, StringRef Data,
+                   ArrayRef<const Decl *> Decls);
+
+private:
+  class Reader;
+  class Writer;
+};
+
+} // namespace interp
+} // namespace clang
+
+#endif
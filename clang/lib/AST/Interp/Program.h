@@ -148,6 +148,7 @@ public:
 
 private:
   friend class DeclScope;
+  friend class FunctionSerializer;
 
   std::optional<unsigned> createGlobal(const DeclTy &D, QualType Ty,
                                        bool IsStatic, bool IsExtern,
@@ -38,7 +38,9 @@
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/EndianStream.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/StringSaver.h"
 #include "llvm/Support/raw_ostream.h"
 #include <cassert>
 #include <cstring>
@@ -223,6 +225,15 @@ void PathDiagnosticConsumer::HandlePathDiagnostic(
   Diags.InsertNode(D.release());
 }
 
+std::vector<std::unique_ptr<PathDiagnostic>>
+PathDiagnosticConsumer::takeDiagnostics() {
+  std::vector<std::unique_ptr<PathDiagnostic>> Result;
+  for (PathDiagnostic &PD : Diags)
+    Result.emplace_back(&PD);
+  Diags.clear();
+  return Result;
+}
+
 static std::optional<bool> comparePath(const PathPieces &X,
                                        const PathPieces &Y);
 
@@ -1080,6 +1091,343 @@ unsigned PathDiagnostic::full_size() {
   return size;
 }
 
+//===----------------------------------------------------------------------===//
+// Serialization of PathDiagnostics.
+//===----------------------------------------------------------------------===//
+
+static void writeInt(raw_ostream &OS, uint64_t Value) {
+  llvm::support::endian::write<uint64_t>(OS, Value, llvm::endianness::little);
+}
+
+static void writeString(raw_ostream &OS, StringRef S) {
+  writeInt(OS, S.size());
+  OS << S;
+}
+
+static void writeLoc(raw_ostream &OS, SourceLocation L) {
+  writeInt(OS, L.getRawEncoding());
+}
+
+static void writeRange(raw_ostream &OS, SourceRange R) {
+  writeLoc(OS, R.getBegin());
+  writeLoc(OS, R.getEnd());
+}
+
+static void writeDecl(raw_ostream &OS, const Decl *D) {
+  writeInt(OS, reinterpret_cast<uintptr_t>(D));
+}
+
+class PathDiagnosticSerializer::Reader {
+  StringRef &Data;
+  bool Failed = false;
+
+public:
+  const SourceManager &SM;
+  llvm::UniqueStringSaver &Saver;
+
+  Reader(StringRef &Data, const SourceManager &SM,
+         llvm::UniqueStringSaver &Saver)
+      : Data(Data), SM(SM), Saver(Saver) {}
+
+  /// Whether everything read so far was in the data.
+  bool ok() const { return !Failed; }
+
+  uint64_t readInt() {
+    if (Failed || Data.size() < sizeof(uint64_t)) {
+      Failed = true;
+      return 0;
+    }
+    uint64_t Value = llvm::support::endian::read64le(Data.data());
+    Data = Data.drop_front(sizeof(uint64_t));
+    return Value;
+  }
+
+  bool readBool() { return readInt() != 0; }
+
+  StringRef readString() {
+    uint64_t Size = readInt();
+    if (Failed || Data.size() < Size) {
+      Failed = true;
+      return StringRef();
+    }
+    StringRef S = Data.take_front(Size);
+    Data = Data.drop_front(Size);
+    return S;
+  }
+
+  SourceLocation readLoc() {
+    return SourceLocation::getFromRawEncoding(
+        static_cast<SourceLocation::UIntTy>(readInt()));
+  }
+
+  SourceRange readRange() {
+    SourceLocation Begin = readLoc();
+    return SourceRange(Begin, readLoc());
+  }
+
+  const Decl *readDecl() {
+    return reinterpret_cast<const Decl *>(static_cast<uintptr_t>(readInt()));
+  }
+};
+
+void PathDiagnosticSerializer::writeLocation(const PathDiagnosticLocation &L,
+                                             raw_ostream &OS) {
+  writeInt(OS, L.isValid());
+  if (!L.isValid())
+    return;
+  // Write the location as if it was flattened: call pieces do not flatten
+  // callEnterWithin.
+  bool IsRange = L.K == PathDiagnosticLocation::RangeK ||
+                 L.K == PathDiagnosticLocation::StmtK;
+  writeInt(OS, IsRange);
+  writeLoc(OS, L.Loc);
+  writeRange(OS, L.Range);
+  writeInt(OS, L.Range.isPoint);
+}
+
+PathDiagnosticLocation PathDiagnosticSerializer::readLocation(Reader &R) {
+  PathDiagnosticLocation L;
+  if (!R.readBool())
+    return L;
+  L.K = R.readBool() ? PathDiagnosticLocation::RangeK
+                     : PathDiagnosticLocation::SingleLocK;
+  L.SM = &R.SM;
+  L.Loc = FullSourceLoc(R.readLoc(), R.SM);
+  L.Range = R.readRange();
+  L.Range.isPoint = R.readBool();
+  return L;
+}
+
+void PathDiagnosticSerializer::writePieces(const PathPieces &Pieces,
+                                           raw_ostream &OS) {
+  writeInt(OS, Pieces.size());
+  for (const PathDiagnosticPieceRef &Piece : Pieces) {
+    writeInt(OS, Piece->getKind());
+    writeString(OS, Piece->getString());
+    writeInt(OS, Piece->LastInMainSourceFile);
+    writeInt(OS, Piece->Tag.data() != nullptr);
+    writeString(OS, Piece->Tag);
+    writeInt(OS, Piece->ranges.size());
+    for (SourceRange Range : Piece->ranges)
+      writeRange(OS, Range);
+    writeInt(OS, Piece->fixits.size());
+    for (const FixItHint &Fixit : Piece->fixits) {
+      writeRange(OS, Fixit.RemoveRange.getAsRange());
+      writeInt(OS, Fixit.RemoveRange.isTokenRange());
+      writeRange(OS, Fixit.InsertFromRange.getAsRange());
+      writeInt(OS, Fixit.InsertFromRange.isTokenRange());
+      writeString(OS, Fixit.CodeToInsert);
+      writeInt(OS, Fixit.BeforePreviousInsertions);
+    }
+
+    switch (Piece->getKind()) {
+    case PathDiagnosticPiece::ControlFlow: {
+      const auto &CF = cast<PathDiagnosticControlFlowPiece>(*Piece);
+      writeInt(OS, std::distance(CF.begin(), CF.end()));
+      for (const PathDiagnosticLocationPair &Pair : CF) {
+        writeLocation(Pair.getStart(), OS);
+        writeLocation(Pair.getEnd(), OS);
+      }
+      break;
+    }
+    case PathDiagnosticPiece::Call: {
+      const auto &Call = cast<PathDiagnosticCallPiece>(*Piece);
+      writeDecl(OS, Call.Caller);
+      writeDecl(OS, Call.Callee);
+      writeInt(OS, Call.NoExit);
+      writeInt(OS, Call.IsCalleeAnAutosynthesizedPropertyAccessor);
+      writeString(OS, Call.CallStackMessage);
+      writeLocation(Call.callEnter, OS);
+      writeLocation(Call.callEnterWithin, OS);
+      writeLocation(Call.callReturn, OS);
+      writePieces(Call.path, OS);
+      break;
+    }
+    case PathDiagnosticPiece::Event:
+    case PathDiagnosticPiece::Macro:
+    case PathDiagnosticPiece::Note:
+    case PathDiagnosticPiece::PopUp:
+      writeLocation(Piece->getLocation(), OS);
+      if (const auto *Event = dyn_cast<PathDiagnosticEventPiece>(Piece.get()))
+        writeInt(OS, Event->isPrunable());
+      else if (const auto *Macro =
+                   dyn_cast<PathDiagnosticMacroPiece>(Piece.get()))
+        writePieces(Macro->subPieces, OS);
+      break;
+    }
+  }
+}
+
+bool PathDiagnosticSerializer::readPieces(Reader &R, PathPieces &Pieces) {
+  for (uint64_t I = 0, E = R.readInt(); I != E && R.ok(); ++I) {
+    uint64_t Kind = R.readInt();
+    StringRef Str = R.readString();
+    bool LastInMainSourceFile = R.readBool();
+    bool HasTag = R.readBool();
+    StringRef Tag = R.readString();
+    std::vector<SourceRange> Ranges;
+    for (uint64_t J = 0, N = R.readInt(); J != N && R.ok(); ++J)
+      Ranges.push_back(R.readRange());
+    std::vector<FixItHint> Fixits;
+    for (uint64_t J = 0, N = R.readInt(); J != N && R.ok(); ++J) {
+      FixItHint Fixit;
+      SourceRange RemoveRange = R.readRange();
+      Fixit.RemoveRange = CharSourceRange(RemoveRange, R.readBool());
+      SourceRange InsertFromRange = R.readRange();
+      Fixit.InsertFromRange = CharSourceRange(InsertFromRange, R.readBool());
+      Fixit.CodeToInsert = std::string(R.readString());
+      Fixit.BeforePreviousInsertions = R.readBool();
+      Fixits.push_back(std::move(Fixit));
+    }
+
+    PathDiagnosticPieceRef Piece;
+    switch (Kind) {
+    case PathDiagnosticPiece::ControlFlow: {
+      std::shared_ptr<PathDiagnosticControlFlowPiece> CF;
+      for (uint64_t J = 0, N = R.readInt(); J != N && R.ok(); ++J) {
+        PathDiagnosticLocation Start = readLocation(R);
+        PathDiagnosticLocation End = readLocation(R);
+        if (CF)
+          CF->push_back(PathDiagnosticLocationPair(Start, End));
+        else
+          CF = std::make_shared<PathDiagnosticControlFlowPiece>(Start, End,
+                                                                Str);
+      }
+      Piece = std::move(CF);
+      break;
+    }
+    case PathDiagnosticPiece::Call: {
+      const Decl *Caller = R.readDecl();
+      std::shared_ptr<PathDiagnosticCallPiece> Call(
+          new PathDiagnosticCallPiece(Caller, PathDiagnosticLocation()));
+      Call->Callee = R.readDecl();
+      Call->NoExit = R.readBool();
+      Call->IsCalleeAnAutosynthesizedPropertyAccessor = R.readBool();
+      Call->CallStackMessage = std::string(R.readString());
+      Call->callEnter = readLocation(R);
+      Call->callEnterWithin = readLocation(R);
+      Call->callReturn = readLocation(R);
+      if (!readPieces(R, Call->path))
+        return false;
+      Piece = std::move(Call);
+      break;
+    }
+    case PathDiagnosticPiece::Event:
+    case PathDiagnosticPiece::Macro:
+    case PathDiagnosticPiece::Note:
+    case PathDiagnosticPiece::PopUp: {
+      PathDiagnosticLocation Pos = readLocation(R);
+      if (!R.ok() || !Pos.isValid() || !Pos.hasValidLocation())
+        return false;
+      if (Kind == PathDiagnosticPiece::Event) {
+        auto Event = std::make_shared<PathDiagnosticEventPiece>(
+            Pos, Str, /*addPosRange=*/false);
+        Event->setPrunable(R.readBool());
+        Piece = std::move(Event);
+      } else if (Kind == PathDiagnosticPiece::Macro) {
+        auto Macro = std::make_shared<PathDiagnosticMacroPiece>(Pos);
+        if (!readPieces(R, Macro->subPieces))
+          return false;
+        Piece = std::move(Macro);
+      } else if (Kind == PathDiagnosticPiece::Note) {
+        Piece = std::make_shared<PathDiagnosticNotePiece>(
+            Pos, Str, /*AddPosRange=*/false);
+      } else {
+        Piece = std::make_shared<PathDiagnosticPopUpPiece>(
+            Pos, Str, /*AddPosRange=*/false);
+      }
+      break;
+    }
+    }
+
+    if (!Piece)
+      return false;
+    Piece->LastInMainSourceFile = LastInMainSourceFile;
+    if (HasTag)
+      Piece->Tag = R.Saver.save(Tag);
+    Piece->ranges = std::move(Ranges);
+    Piece->fixits = std::move(Fixits);
+    Pieces.push_back(std::move(Piece));
+  }
+  return R.ok();
+}
+
+void PathDiagnosticSerializer::write(const PathDiagnostic &PD,
+                                     const SourceManager &SM,
+                                     raw_ostream &OS) {
+  writeString(OS, PD.CheckerName);
+  writeDecl(OS, PD.DeclWithIssue);
+  writeString(OS, PD.BugType);
+  writeString(OS, PD.VerboseDesc);
+  writeString(OS, PD.ShortDesc);
+  writeString(OS, PD.Category);
+  writeInt(OS, PD.OtherDesc.size());
+  for (const std::string &Meta : PD.OtherDesc)
+    writeString(OS, Meta);
+  writeLocation(PD.Loc, OS);
+  writePieces(PD.pathImpl, OS);
+  writeLocation(PD.UniqueingLoc, OS);
+  writeDecl(OS, PD.UniqueingDecl);
+  writeDecl(OS, PD.AnalysisEntryPoint);
+  if (!PD.ExecutedLines) {
+    writeInt(OS, 0);
+    return;
+  }
+  writeInt(OS, PD.ExecutedLines->size());
+  for (const auto &[FID, Lines] : *PD.ExecutedLines) {
+    writeLoc(OS, SM.getLocForStartOfFile(FID));
+    writeInt(OS, Lines.size());
+    for (unsigned Line : Lines)
+      writeInt(OS, Line);
+  }
+}
+
+std::unique_ptr<PathDiagnostic>
+PathDiagnosticSerializer::read(StringRef &Data, const SourceManager &SM,
+                               llvm::UniqueStringSaver &Saver) {
+  Reader R(Data, SM, Saver);
+  StringRef CheckerName = R.readString();
+  const Decl *DeclWithIssue = R.readDecl();
+  StringRef BugType = R.readString();
+  StringRef VerboseDesc = R.readString();
+  StringRef ShortDesc = R.readString();
+  StringRef Category = R.readString();
+  std::deque<std::string> OtherDesc;
+  for (uint64_t I = 0, E = R.readInt(); I != E && R.ok(); ++I)
+    OtherDesc.push_back(std::string(R.readString()));
+  PathDiagnosticLocation Loc = readLocation(R);
+  PathPieces Path;
+  if (!readPieces(R, Path))
+    return nullptr;
+  PathDiagnosticLocation UniqueingLoc = readLocation(R);
+  const Decl *UniqueingDecl = R.readDecl();
+  const Decl *AnalysisEntryPoint = R.readDecl();
+  auto ExecutedLines = std::make_unique<FilesToLineNumsMap>();
+  for (uint64_t I = 0, E = R.readInt(); I != E && R.ok(); ++I) {
+    SourceLocation Start = R.readLoc();
+    if (!R.ok())
+      break;
+    std::set<unsigned> &Lines = (*ExecutedLines)[SM.getFileID(Start)];
+    for (uint64_t J = 0, N = R.readInt(); J != N && R.ok(); ++J)
+      Lines.insert(R.readInt());
+  }
+  if (!R.ok() || !AnalysisEntryPoint)
+    return nullptr;
+
+  auto PD = std::make_unique<PathDiagnostic>(
+      CheckerName, DeclWithIssue, BugType, VerboseDesc, ShortDesc, Category,
+      UniqueingLoc, UniqueingDecl, AnalysisEntryPoint,
+      std::move(ExecutedLines));
+  // The constructor strips trailing dots, which the writer may have appended
+  // to the descriptions since.
+  PD->VerboseDesc = std::string(VerboseDesc);
+  PD->ShortDesc = std::string(ShortDesc);
+  PD->OtherDesc = std::move(OtherDesc);
+  PD->Loc = Loc;
+  PD->pathImpl = std::move(Path);
+  return PD;
+}
+
 //===----------------------------------------------------------------------===//
 // FoldingSet profiling methods.
 //===----------------------------------------------------------------------===//
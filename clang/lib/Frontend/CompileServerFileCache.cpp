@@ -0,0 +1,250 @@
+//===--- CompileServerFileCache.cpp - Files kept between compiles ---------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Frontend/CompileServerFileCache.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include <chrono>
+#include <optional>
+#include <vector>
+
+using namespace clang;
+
+#define DEBUG_TYPE "compile-server-file-cache"
+
+STATISTIC(NumFileHits, "Number of files whose cached contents were reused");
+STATISTIC(NumMissingHits, "Number of lookups known to fail from the cache");
+
+namespace {
+
+/// How long after it was last modified a file or directory is trusted not to
+/// change again without its modification time changing.
+constexpr std::chrono::seconds SettleTime(2);
+
+bool isSettled(const llvm::vfs::Status &S) {
+  return std::chrono::system_clock::now() - S.getLastModificationTime() >=
+         SettleTime;
+}
+
+/// Refers to the contents of a cached file and keeps them alive, as they may
+/// be dropped from the cache while the compilation still uses them.
+class SharedBuffer final : public llvm::MemoryBuffer {
+  std::shared_ptr<const llvm::MemoryBuffer> Contents;
+  std::string Name;
+
+public:
+  SharedBuffer(std::shared_ptr<const llvm::MemoryBuffer> Contents,
+               const llvm::Twine &Name)
+      : Contents(std::move(Contents)), Name(Name.str()) {
+    init(this->Contents->getBufferStart(), this->Contents->getBufferEnd(),
+         /*RequiresNullTerminator=*/true);
+  }
+
+  llvm::StringRef getBufferIdentifier() const override { return Name; }
+
+  BufferKind getBufferKind() const override { return MemoryBuffer_Malloc; }
+};
+
+class CachedFileRef final : public llvm::vfs::File {
+  std::shared_ptr<const llvm::MemoryBuffer> Contents;
+  llvm::vfs::Status Stat;
+
+public:
+  CachedFileRef(std::shared_ptr<const llvm::MemoryBuffer> Contents,
+                llvm::vfs::Status Stat)
+      : Contents(std::move(Contents)), Stat(std::move(Stat)) {}
+
+  llvm::ErrorOr<llvm::vfs::Status> status() override { return Stat; }
+
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>>
+  getBuffer(const llvm::Twine &Name, int64_t FileSize,
+            bool RequiresNullTerminator, bool IsVolatile) override {
+    return std::make_unique<SharedBuffer>(Contents, Name);
+  }
+
+  std::error_code close() override { return {}; }
+};
+
+} // namespace
+
+class CompileServerFileCache::CachingFileSystem
+    : public llvm::RTTIExtends<CachingFileSystem,
+                               llvm::vfs::ProxyFileSystem> {
+public:
+  static const char ID;
+
+  CachingFileSystem(CompileServerFileCache &Cache,
+                    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS,
+                    llvm::ArrayRef<std::string> Dirs)
+      : RTTIExtends(std::move(FS)), Cache(Cache) {
+    for (const std::string &Dir : Dirs) {
+      llvm::SmallString<256> Abs(Dir);
+      if (!getUnderlyingFS().makeAbsolute(Abs))
+        WrittenDirs.push_back(std::string(Abs));
+    }
+  }
+
+  llvm::ErrorOr<llvm::vfs::Status> status(const llvm::Twine &Path) override;
+  llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+  openFileForRead(const llvm::Twine &Path) override;
+  bool exists(const llvm::Twine &Path) override { return bool(status(Path)); }
+
+private:
+  static Stamp getStamp(const llvm::vfs::Status &S) {
+    return {S.getUniqueID(), S.getLastModificationTime(), S.getSize()};
+  }
+
+  /// Makes \p Path absolute in \p Abs. Returns false if the cache must not
+  /// be used for it.
+  bool getCacheablePath(const llvm::Twine &Path, llvm::SmallString<256> &Abs);
+  /// Returns the stamp of \p Dir, or nothing if it is not a directory or may
+  /// still change unnoticed.
+  std::optional<Stamp> getDirStamp(llvm::StringRef Dir);
+  /// Returns whether \p Abs, in the directory with stamp \p Dir, is known not
+  /// to exist.
+  bool isKnownMissing(llvm::StringRef Abs, const std::optional<Stamp> &Dir);
+  /// Records the result of a lookup of \p Abs, made after the stamp \p Dir of
+  /// its directory was taken.
+  void noteLookup(llvm::StringRef Abs, const std::optional<Stamp> &Dir,
+                  std::error_code EC);
+
+  CompileServerFileCache &Cache;
+  std::vector<std::string> WrittenDirs;
+  /// The directories stat'ed by this compilation.
+  llvm::StringMap<std::optional<Stamp>> DirStamps;
+};
+
+const char CompileServerFileCache::CachingFileSystem::ID = 0;
+
+bool CompileServerFileCache::CachingFileSystem::getCacheablePath(
+    const llvm::Twine &Path, llvm::SmallString<256> &Abs) {
+  Path.toVector(Abs);
+  if (getUnderlyingFS().makeAbsolute(Abs))
+    return false;
+  for (llvm::StringRef Dir : WrittenDirs)
+    if (Abs.starts_with(Dir) &&
+        (Abs.size() == Dir.size() ||
+         llvm::sys::path::is_separator(Abs[Dir.size()])))
+      return false;
+  return true;
+}
+
+std::optional<CompileServerFileCache::Stamp>
+CompileServerFileCache::CachingFileSystem::getDirStamp(llvm::StringRef Dir) {
+  auto [It, Inserted] = DirStamps.try_emplace(Dir);
+  if (Inserted) {
+    llvm::ErrorOr<llvm::vfs::Status> S = getUnderlyingFS().status(Dir);
+    if (S && S->isDirectory() && isSettled(*S))
+      It->second = getStamp(*S);
+  }
+  return It->second;
+}
+
+bool CompileServerFileCache::CachingFileSystem::isKnownMissing(
+    llvm::StringRef Abs, const std::optional<Stamp> &Dir) {
+  auto It = Cache.Missing.find(Abs);
+  if (It == Cache.Missing.end())
+    return false;
+  if (Dir && *Dir == It->second) {
+    ++NumMissingHits;
+    return true;
+  }
+  Cache.Missing.erase(It);
+  return false;
+}
+
+void CompileServerFileCache::CachingFileSystem::noteLookup(
+    llvm::StringRef Abs, const std::optional<Stamp> &Dir, std::error_code EC) {
+  // The stamp was taken before the lookup, so a file created since then will
+  // have changed the directory.
+  if (Dir && EC == std::errc::no_such_file_or_directory)
+    Cache.Missing[Abs] = *Dir;
+}
+
+llvm::ErrorOr<llvm::vfs::Status>
+CompileServerFileCache::CachingFileSystem::status(const llvm::Twine &Path) {
+  llvm::SmallString<256> Abs;
+  if (!getCacheablePath(Path, Abs))
+    return ProxyFileSystem::status(Path);
+
+  std::optional<Stamp> Dir = getDirStamp(llvm::sys::path::parent_path(Abs));
+  if (isKnownMissing(Abs, Dir))
+    return std::make_error_code(std::errc::no_such_file_or_directory);
+  llvm::ErrorOr<llvm::vfs::Status> S = ProxyFileSystem::status(Path);
+  noteLookup(Abs, Dir, S.getError());
+  return S;
+}
+
+llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+CompileServerFileCache::CachingFileSystem::openFileForRead(
+    const llvm::Twine &Path) {
+  llvm::SmallString<256> Abs;
+  if (!getCacheablePath(Path, Abs))
+    return ProxyFileSystem::openFileForRead(Path);
+
+  std::optional<Stamp> Dir = getDirStamp(llvm::sys::path::parent_path(Abs));
+  if (isKnownMissing(Abs, Dir))
+    return std::make_error_code(std::errc::no_such_file_or_directory);
+
+  // A stat is enough to tell whether the cached contents are current.
+  auto Cached = Cache.Files.find(Abs);
+  if (Cached != Cache.Files.end()) {
+    llvm::ErrorOr<llvm::vfs::Status> S = ProxyFileSystem::status(Path);
+    if (S && getStamp(*S) == Cached->second.FileStamp) {
+      ++NumFileHits;
+      return std::make_unique<CachedFileRef>(Cached->second.Contents, *S);
+    }
+    Cache.ContentsSize -= Cached->second.Contents->getBufferSize();
+    Cache.Files.erase(Cached);
+  }
+
+  llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>> F =
+      ProxyFileSystem::openFileForRead(Path);
+  noteLookup(Abs, Dir, F.getError());
+  if (!F)
+    return F;
+  llvm::ErrorOr<llvm::vfs::Status> S = (*F)->status();
+  if (!S || !S->isRegularFile() || !isSettled(*S) ||
+      S->getSize() > Cache.MaxContentsSize / 8)
+    return F;
+
+  // Read the file into memory rather than mapping it, so that the cached
+  // contents cannot change under a later compilation.
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Buffer =
+      (*F)->getBuffer(Path, S->getSize(), /*RequiresNullTerminator=*/true,
+                      /*IsVolatile=*/true);
+  if (!Buffer)
+    return Buffer.getError();
+  std::shared_ptr<const llvm::MemoryBuffer> Contents = std::move(*Buffer);
+
+  // Only keep the contents if the file did not change while it was read.
+  llvm::ErrorOr<llvm::vfs::Status> After = (*F)->status();
+  if (After && getStamp(*After) == getStamp(*S) &&
+      Contents->getBufferSize() == S->getSize()) {
+    if (Cache.ContentsSize + S->getSize() > Cache.MaxContentsSize) {
+      Cache.Files.clear();
+      Cache.ContentsSize = 0;
+    }
+    Cache.ContentsSize += S->getSize();
+    Cache.Files[Abs] = {getStamp(*S), Contents};
+  }
+  return std::make_unique<CachedFileRef>(std::move(Contents), std::move(*S));
+}
+
+CompileServerFileCache::~CompileServerFileCache() = default;
+
+llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem>
+CompileServerFileCache::createFileSystem(
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS,
+    llvm::ArrayRef<std::string> WrittenDirs) {
+  return llvm::makeIntrusiveRefCnt<CachingFileSystem>(*this, std::move(FS),
+                                                      WrittenDirs);
+}
@@ -2351,7 +2351,8 @@ CompilerInstance::lookupMissingImports(StringRef Name,
       // Find the modules that reference the identifier.
       // Note that this only finds top-level modules.
       // We'll let diagnoseTypo find the actual declaration module.
-      if (GlobalIndex->lookupIdentifier(Name, FoundModules))
+      if (GlobalIndex->lookupIdentifier(Name, FoundModules) &&
+          !FoundModules.empty())
         return true;
     }
   }
@@ -28,6 +28,7 @@
 #include "clang/Lex/Token.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/StringSwitch.h"
 #include "llvm/Support/Compiler.h"
@@ -37,6 +38,7 @@
 #include "llvm/Support/NativeFormatting.h"
 #include "llvm/Support/Unicode.h"
 #include "llvm/Support/UnicodeCharRanges.h"
+#include "llvm/TargetParser/Host.h"
 #include <algorithm>
 #include <cassert>
 #include <cstddef>
@@ -47,8 +49,23 @@
 #include <tuple>
 #include <utility>
 
-#ifdef __SSE4_2__
-#include <nmmintrin.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Stock x86-64 builds can't assume AVX2, so the 32-byte scanning kernels are
+// compiled for it separately and only used if the host supports it.
+#if defined(__AVX2__)
+#define LEXER_TARGET_AVX2
+#elif defined(__SSE2__) && defined(__x86_64__) && defined(__GNUC__)
+#define LEXER_TARGET_AVX2 __attribute__((target("avx2")))
+#define LEXER_DISPATCH_AVX2
+#endif
+
+#ifdef LEXER_TARGET_AVX2
+#include <immintrin.h>
 #endif
 
 using namespace clang;
@@ -1901,28 +1918,171 @@ bool Lexer::LexUnicodeIdentifierStart(Token &Result, uint32_t C,
   return true;
 }
 
+//===----------------------------------------------------------------------===//
+// Vectorized scanning
+//===----------------------------------------------------------------------===//
+//
+// Identifiers, comments, string literals and runs of whitespace are scanned a
+// vector at a time. SSE2 and NEON are part of the x86-64 and AArch64 baselines;
+// AVX2 is used when LEXER_TARGET_AVX2 is defined above.
+
+namespace {
+
+/// The bytes at which a scan stops: the bytes in \p Chars or, if \p Negate,
+/// the bytes not in \p Chars. If \p StopAtNonASCII, any byte outside of ASCII
+/// stops the scan as well. Each match function returns a mask of the bytes of
+/// a vector that stop the scan.
+template <bool Negate, bool StopAtNonASCII, char... Chars> struct ScanStops {
+#ifdef __SSE2__
+  static unsigned match(__m128i V) {
+    __m128i Eq = _mm_setzero_si128();
+    ((Eq = _mm_or_si128(Eq, _mm_cmpeq_epi8(V, _mm_set1_epi8(Chars)))), ...);
+    unsigned Mask = _mm_movemask_epi8(Eq);
+    if (Negate)
+      Mask = ~Mask & 0xFFFF;
+    if (StopAtNonASCII)
+      Mask |= _mm_movemask_epi8(V);
+    return Mask;
+  }
+#endif
+
+#ifdef LEXER_TARGET_AVX2
+  LEXER_TARGET_AVX2 static unsigned match(__m256i V) {
+    __m256i Eq = _mm256_setzero_si256();
+    ((Eq = _mm256_or_si256(Eq, _mm256_cmpeq_epi8(V, _mm256_set1_epi8(Chars)))),
+     ...);
+    unsigned Mask = _mm256_movemask_epi8(Eq);
+    if (Negate)
+      Mask = ~Mask;
+    if (StopAtNonASCII)
+      Mask |= _mm256_movemask_epi8(V);
+    return Mask;
+  }
+#endif
+
+#if !defined(__SSE2__) && defined(__ARM_NEON) && defined(__aarch64__)
+  /// NEON has no movemask, so this returns four bits per byte.
+  static uint64_t match(uint8x16_t V) {
+    uint8x16_t Eq = vdupq_n_u8(0);
+    ((Eq = vorrq_u8(Eq, vceqq_u8(V, vdupq_n_u8(Chars)))), ...);
+    if (Negate)
+      Eq = vmvnq_u8(Eq);
+    if (StopAtNonASCII)
+      Eq = vorrq_u8(Eq, vcgeq_u8(V, vdupq_n_u8(0x80)));
+    return vget_lane_u64(
+        vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(Eq), 4)), 0);
+  }
+#endif
+};
+
+} // end anonymous namespace
+
+template <typename Stops>
+static const char *scanVector16(const char *Ptr, const char *End) {
+#ifdef __SSE2__
+  while (End - Ptr >= 16) {
+    if (unsigned Mask = Stops::match(_mm_loadu_si128((const __m128i *)Ptr)))
+      return Ptr + llvm::countr_zero(Mask);
+    Ptr += 16;
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  while (End - Ptr >= 16) {
+    if (uint64_t Mask = Stops::match(vld1q_u8((const uint8_t *)Ptr)))
+      return Ptr + llvm::countr_zero(Mask) / 4;
+    Ptr += 16;
+  }
+#endif
+  return Ptr;
+}
+
+#ifdef LEXER_TARGET_AVX2
+template <typename Stops>
+LEXER_TARGET_AVX2 static const char *scanVector32(const char *Ptr,
+                                                  const char *End) {
+  while (End - Ptr >= 32) {
+    if (unsigned Mask =
+            Stops::match(_mm256_loadu_si256((const __m256i *)Ptr)))
+      return Ptr + llvm::countr_zero(Mask);
+    Ptr += 32;
+  }
+  return Ptr;
+}
+#endif
+
+#ifdef LEXER_DISPATCH_AVX2
+static bool hostHasAVX2() {
+  static const bool HasAVX2 = [] {
+    llvm::StringMap<bool> Features;
+    return llvm::sys::getHostCPUFeatures(Features) && Features.lookup("avx2");
+  }();
+  return HasAVX2;
+}
+#endif
+
+/// Skip the bytes before the first one matching \p Stops. This returns either
+/// that byte or a byte less than 16 bytes before \p End, from which the caller
+/// continues scanning one byte at a time. Without vector support, this returns
+/// \p Ptr unchanged. \p End must not be past the buffer.
+template <typename Stops>
+static const char *scanFast(const char *Ptr, const char *End) {
+#if defined(LEXER_DISPATCH_AVX2)
+  if (End - Ptr >= 32 && hostHasAVX2())
+    Ptr = scanVector32<Stops>(Ptr, End);
+#elif defined(LEXER_TARGET_AVX2)
+  Ptr = scanVector32<Stops>(Ptr, End);
+#endif
+  return scanVector16<Stops>(Ptr, End);
+}
+
+// Identifiers are mostly shorter than 16 bytes, so they are only scanned with
+// the narrower vectors.
 static const char *
 fastParseASCIIIdentifier(const char *CurPtr,
                          [[maybe_unused]] const char *BufferEnd) {
-#ifdef __SSE4_2__
-  alignas(16) static constexpr char AsciiIdentifierRange[16] = {
-      '_', '_', 'A', 'Z', 'a', 'z', '0', '9',
-  };
+#ifdef __SSE2__
   constexpr ssize_t BytesPerRegister = 16;
 
-  __m128i AsciiIdentifierRangeV =
-      _mm_load_si128((const __m128i *)AsciiIdentifierRange);
-
   while (LLVM_LIKELY(BufferEnd - CurPtr >= BytesPerRegister)) {
     __m128i Cv = _mm_loadu_si128((const __m128i *)(CurPtr));
+    // Setting bit 5 maps the letters, and only them, to 'a'...'z'. An
+    // unsigned X is at most N if and only if min(X, N) is X.
+    __m128i Letter =
+        _mm_sub_epi8(_mm_or_si128(Cv, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    __m128i Digit = _mm_sub_epi8(Cv, _mm_set1_epi8('0'));
+    __m128i IsIdentifier = _mm_or_si128(
+        _mm_or_si128(
+            _mm_cmpeq_epi8(_mm_min_epu8(Letter, _mm_set1_epi8(25)), Letter),
+            _mm_cmpeq_epi8(_mm_min_epu8(Digit, _mm_set1_epi8(9)), Digit)),
+        _mm_cmpeq_epi8(Cv, _mm_set1_epi8('_')));
+    unsigned Mask = ~_mm_movemask_epi8(IsIdentifier) & 0xFFFF;
+    if (Mask == 0) {
+      CurPtr += BytesPerRegister;
+      continue;
+    }
+    return CurPtr + llvm::countr_zero(Mask);
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  constexpr ssize_t BytesPerRegister = 16;
 
-    int Consumed = _mm_cmpistri(AsciiIdentifierRangeV, Cv,
-                                _SIDD_LEAST_SIGNIFICANT | _SIDD_CMP_RANGES |
-                                    _SIDD_UBYTE_OPS | _SIDD_NEGATIVE_POLARITY);
-    CurPtr += Consumed;
-    if (Consumed == BytesPerRegister)
+  while (LLVM_LIKELY(BufferEnd - CurPtr >= BytesPerRegister)) {
+    uint8x16_t Cv = vld1q_u8((const uint8_t *)CurPtr);
+    uint8x16_t Letter =
+        vsubq_u8(vorrq_u8(Cv, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+    uint8x16_t Digit = vsubq_u8(Cv, vdupq_n_u8('0'));
+    uint8x16_t IsIdentifier =
+        vorrq_u8(vorrq_u8(vcleq_u8(Letter, vdupq_n_u8(25)),
+                          vcleq_u8(Digit, vdupq_n_u8(9))),
+                 vceqq_u8(Cv, vdupq_n_u8('_')));
+    // Four bits per byte.
+    uint64_t Mask = ~vget_lane_u64(
+        vreinterpret_u64_u8(
+            vshrn_n_u16(vreinterpretq_u16_u8(IsIdentifier), 4)),
+        0);
+    if (Mask == 0) {
+      CurPtr += BytesPerRegister;
       continue;
-    return CurPtr;
+    }
+    return CurPtr + llvm::countr_zero(Mask) / 4;
   }
 #endif
 
@@ -2201,6 +2361,11 @@ bool Lexer::LexStringLiteral(Token &Result, const char *CurPtr,
     Diag(BufferPtr, LangOpts.CPlusPlus ? diag::warn_cxx98_compat_unicode_literal
                                        : diag::warn_c99_compat_unicode_literal);
 
+  // Characters that getAndAdvanceChar returns as they are and that don't end
+  // the literal can be skipped in bulk.
+  using Stops = ScanStops</*Negate=*/false, /*StopAtNonASCII=*/false, '"',
+                          '\\', '\n', '\r', '\0', '?'>;
+  CurPtr = scanFast<Stops>(CurPtr, BufferEnd);
   char C = getAndAdvanceChar(CurPtr, Result);
   while (C != '"') {
     // Skip escaped characters.  Escaped newlines will already be processed by
@@ -2229,6 +2394,7 @@ bool Lexer::LexStringLiteral(Token &Result, const char *CurPtr,
 
       NulCharacter = CurPtr-1;
     }
+    CurPtr = scanFast<Stops>(CurPtr, BufferEnd);
     C = getAndAdvanceChar(CurPtr, Result);
   }
 
@@ -2301,6 +2467,8 @@ bool Lexer::LexRawStringLiteral(Token &Result, const char *CurPtr,
   CurPtr += PrefixLen + 1; // skip over prefix and '('
 
   while (true) {
+    CurPtr = scanFast<ScanStops</*Negate=*/false, /*StopAtNonASCII=*/false,
+                                ')', '\0'>>(CurPtr, BufferEnd);
     char C = *CurPtr++;
 
     if (C == ')') {
@@ -2494,6 +2662,11 @@ bool Lexer::SkipWhitespace(Token &Result, const char *CurPtr,
   // Skip consecutive spaces efficiently.
   while (true) {
     // Skip horizontal whitespace very aggressively.
+    if (isHorizontalWhitespace(Char)) {
+      CurPtr = scanFast<ScanStops</*Negate=*/true, /*StopAtNonASCII=*/false,
+                                  ' ', '\t', '\f', '\v'>>(CurPtr, BufferEnd);
+      Char = *CurPtr;
+    }
     while (isHorizontalWhitespace(Char))
       Char = *++CurPtr;
 
@@ -2579,6 +2752,13 @@ bool Lexer::SkipLineComment(Token &Result, const char *CurPtr,
 
   char C;
   while (true) {
+    const char *ASCIIEnd =
+        scanFast<ScanStops</*Negate=*/false, /*StopAtNonASCII=*/true, '\0',
+                           '\n', '\r'>>(CurPtr, BufferEnd);
+    if (ASCIIEnd != CurPtr) {
+      CurPtr = ASCIIEnd;
+      UnicodeDecodingAlreadyDiagnosed = false;
+    }
     C = *CurPtr;
     // Skip over characters in the fast loop.
     while (isASCII(C) && C != 0 &&   // Potentially EOF.
@@ -2817,9 +2997,7 @@ static bool isEndOfBlockCommentWithEscapedNewLine(const char *CurPtr, Lexer *L,
   return true;
 }
 
-#ifdef __SSE2__
-#include <emmintrin.h>
-#elif __ALTIVEC__
+#if defined(__ALTIVEC__) && !defined(__SSE2__)
 #include <altivec.h>
 #undef bool
 #endif
@@ -2888,24 +3066,19 @@ bool Lexer::SkipBlockComment(Token &Result, const char *CurPtr,
       }
       if (C == '/') goto FoundSlash;
 
-#ifdef __SSE2__
-      __m128i Slashes = _mm_set1_epi8('/');
-      while (CurPtr + 16 < BufferEnd) {
-        int Mask = _mm_movemask_epi8(*(const __m128i *)CurPtr);
-        if (LLVM_UNLIKELY(Mask != 0)) {
-          goto MultiByteUTF8;
-        }
-        // look for slashes
-        int cmp = _mm_movemask_epi8(_mm_cmpeq_epi8(*(const __m128i*)CurPtr,
-                                    Slashes));
-        if (cmp != 0) {
-          // Adjust the pointer to point directly after the first slash. It's
-          // not necessary to set C here, it will be overwritten at the end of
-          // the outer loop.
-          CurPtr += llvm::countr_zero<unsigned>(cmp) + 1;
-          goto FoundSlash;
-        }
-        CurPtr += 16;
+#if defined(__SSE2__) || (defined(__ARM_NEON) && defined(__aarch64__))
+      CurPtr = scanFast<ScanStops</*Negate=*/false, /*StopAtNonASCII=*/true,
+                                  '/'>>(CurPtr, BufferEnd);
+      if (*CurPtr == '/') {
+        // Point directly after the slash. It's not necessary to set C here, it
+        // will be overwritten at the end of the outer loop.
+        ++CurPtr;
+        goto FoundSlash;
+      }
+      if (LLVM_UNLIKELY(!isASCII(*CurPtr))) {
+        // MultiByteUTF8 expects CurPtr to be one past the first code unit.
+        ++CurPtr;
+        goto MultiByteUTF8;
       }
 #elif __ALTIVEC__
       __vector unsigned char LongUTF = {0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
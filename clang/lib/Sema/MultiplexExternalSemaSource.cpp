@@ -135,6 +135,15 @@ void MultiplexExternalSemaSource::FindFileRegionDecls(FileID File,
     Sources[i]->FindFileRegionDecls(File, Offset, Length, Decls);
 }
 
+bool MultiplexExternalSemaSource::FindExternalInterpBytecode(
+    const FunctionDecl *FD, StringRef &Bytecode,
+    SmallVectorImpl<const Decl *> &Decls) {
+  for (size_t i = 0; i < Sources.size(); ++i)
+    if (Sources[i]->FindExternalInterpBytecode(FD, Bytecode, Decls))
+      return true;
+  return false;
+}
+
 void MultiplexExternalSemaSource::CompleteType(TagDecl *Tag) {
   for(size_t i = 0; i < Sources.size(); ++i)
     Sources[i]->CompleteType(Tag);
@@ -4039,6 +4039,14 @@ llvm::Error ASTReader::ReadASTBlock(ModuleFile &F,
         DeclsToCheckForDeferredDiags.insert(
             getGlobalDeclID(F, LocalDeclID(Record[I])));
       break;
+
+    case INTERP_BYTECODE:
+      if (Record.empty())
+        return llvm::createStringError(std::errc::illegal_byte_sequence,
+                                       "invalid INTERP_BYTECODE record");
+      InterpBytecode.try_emplace(getGlobalDeclID(F, LocalDeclID(Record[0])),
+                                 &F, Blob);
+      break;
     }
   }
 }
@@ -7964,6 +7972,39 @@ void ASTReader::FindFileRegionDecls(FileID File,
     Decls.push_back(GetDecl(getGlobalDeclID(*DInfo.Mod, *DIt)));
 }
 
+bool ASTReader::FindExternalInterpBytecode(
+    const FunctionDecl *FD, StringRef &Bytecode,
+    SmallVectorImpl<const Decl *> &Decls) {
+  using namespace llvm::support;
+
+  for (const FunctionDecl *Redecl : FD->redecls()) {
+    if (!Redecl->isFromASTFile())
+      continue;
+    auto It = InterpBytecode.find(Redecl->getGlobalID());
+    if (It == InterpBytecode.end())
+      continue;
+
+    // The bytecode follows the IDs of the declarations it refers to.
+    auto [M, Blob] = It->second;
+    if (Blob.size() < sizeof(uint32_t))
+      return false;
+    uint32_t NumDecls = endian::read32le(Blob.data());
+    Blob = Blob.drop_front(sizeof(uint32_t));
+    if (Blob.size() / sizeof(uint32_t) < NumDecls)
+      return false;
+    for (uint32_t I = 0; I != NumDecls; ++I) {
+      LocalDeclID ID(endian::read32le(Blob.data() + I * sizeof(uint32_t)));
+      Decl *D = GetDecl(getGlobalDeclID(*M, ID));
+      if (!D)
+        return false;
+      Decls.push_back(D);
+    }
+    Bytecode = Blob.drop_front(NumDecls * sizeof(uint32_t));
+    return true;
+  }
+  return false;
+}
+
 bool
 ASTReader::FindExternalVisibleDeclsByName(const DeclContext *DC,
                                           DeclarationName Name) {
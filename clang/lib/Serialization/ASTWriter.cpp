@@ -896,6 +896,7 @@ void ASTWriter::WriteBlockInfoBlock() {
   RECORD(PENDING_IMPLICIT_INSTANTIATIONS);
   RECORD(UPDATE_VISIBLE);
   RECORD(DELAYED_NAMESPACE_LEXICAL_VISIBLE_RECORD);
+  RECORD(INTERP_BYTECODE);
   RECORD(DECL_UPDATE_OFFSETS);
   RECORD(DECL_UPDATES);
   RECORD(CUDA_SPECIAL_DECL_REFS);
@@ -5130,6 +5131,52 @@ void ASTWriter::PrepareWritingSpecialDecls(Sema &SemaRef) {
     GetDeclRef(D);
 }
 
+/// Write the bytecode the constant interpreter compiled functions to, so
+/// that users of the AST file need not compile them again.
+void ASTWriter::WriteInterpBytecode(ASTContext &Context) {
+  // The bodies of functions are omitted from reduced BMIs.
+  if (GeneratingReducedBMI)
+    return;
+
+  auto IsEmitted = [this](const Decl *D) {
+    return D->isFromASTFile() || DeclIDs.contains(D);
+  };
+
+  // Each function is stored with the IDs of the declarations its bytecode
+  // refers to in front of it.
+  SmallVector<std::pair<LocalDeclID, SmallString<256>>, 16> Functions;
+  Context.serializeInterpFunctions(
+      [&](const FunctionDecl *FD, StringRef Bytecode,
+          ArrayRef<const Decl *> Decls) {
+        if (!IsEmitted(FD) || !llvm::all_of(Decls, IsEmitted))
+          return;
+        SmallString<256> Blob;
+        llvm::raw_svector_ostream OS(Blob);
+        llvm::support::endian::Writer W(OS, llvm::endianness::little);
+        W.write<uint32_t>(Decls.size());
+        for (const Decl *D : Decls)
+          W.write<uint32_t>(getDeclID(D).get());
+        OS << Bytecode;
+        Functions.emplace_back(getDeclID(FD), std::move(Blob));
+      });
+  if (Functions.empty())
+    return;
+
+  llvm::sort(Functions, [](const auto &LHS, const auto &RHS) {
+    return LHS.first < RHS.first;
+  });
+
+  auto Abv = std::make_shared<BitCodeAbbrev>();
+  Abv->Add(BitCodeAbbrevOp(INTERP_BYTECODE));
+  Abv->Add(BitCodeAbbrevOp(BitCodeAbbrevOp::VBR, 6));
+  Abv->Add(BitCodeAbbrevOp(BitCodeAbbrevOp::Blob));
+  unsigned Abbrev = Stream.EmitAbbrev(std::move(Abv));
+  for (const auto &[ID, Blob] : Functions) {
+    RecordData::value_type Record[] = {INTERP_BYTECODE, ID.get()};
+    Stream.EmitRecordWithBlob(Abbrev, Record, Blob);
+  }
+}
+
 void ASTWriter::WriteSpecialDeclRecords(Sema &SemaRef) {
   ASTContext &Context = SemaRef.Context;
 
@@ -5446,6 +5493,7 @@ ASTFileSignature ASTWriter::WriteASTCore(Sema &SemaRef, StringRef isysroot,
   Stream.EmitRecord(SPECIAL_TYPES, SpecialTypes);
 
   WriteSpecialDeclRecords(SemaRef);
+  WriteInterpBytecode(Context);
 
   // Write the record containing weak undeclared identifiers.
   if (!WeakUndeclaredIdentifiers.empty())
@@ -311,7 +311,9 @@ bool GlobalModuleIndex::lookupIdentifier(StringRef Name, HitSet &Hits) {
     = *static_cast<IdentifierIndexTable *>(IdentifierIndex);
   IdentifierIndexTable::iterator Known = Table.find(Name);
   if (Known == Table.end()) {
-    return false;
+    // The index records every identifier of every module file it knows
+    // about, so none of them has any information about this name.
+    return true;
   }
 
   SmallVector<unsigned, 2> ModuleIDs = *Known;
@@ -78,3 +78,15 @@ void InMemoryModuleCache::finalizePCM(llvm::StringRef Filename) {
   assert(PCM.Buffer && "Trying to finalize a dropped PCM...");
   PCM.IsFinal = true;
 }
+
+void InMemoryModuleCache::pruneForReuse(
+    llvm::function_ref<bool(llvm::StringRef Filename,
+                            const llvm::MemoryBuffer &Buffer)>
+        IsStale) {
+  for (auto I = PCMs.begin(), E = PCMs.end(); I != E;) {
+    auto Current = I++;
+    const PCM &Entry = Current->second;
+    if (!Entry.IsFinal || IsStale(Current->first(), *Entry.Buffer))
+      PCMs.erase(Current);
+  }
+}
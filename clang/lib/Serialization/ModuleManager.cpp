@@ -304,23 +304,26 @@ void ModuleManager::returnVisitState(std::unique_ptr<VisitState> State) {
 
 void ModuleManager::setGlobalIndex(GlobalModuleIndex *Index) {
   GlobalIndex = Index;
-  if (!GlobalIndex) {
-    ModulesInCommonWithGlobalIndex.clear();
+  ModulesInCommonWithGlobalIndex.clear();
+  ModulesNotInGlobalIndex.clear();
+  ModulesRectifiedWithGlobalIndex.clear();
+  if (!GlobalIndex)
     return;
-  }
 
   // Notify the global module index about all of the modules we've already
   // loaded.
   for (ModuleFile &M : *this)
-    if (!GlobalIndex->loadedModuleFile(&M))
-      ModulesInCommonWithGlobalIndex.push_back(&M);
+    moduleFileAccepted(&M);
 }
 
 void ModuleManager::moduleFileAccepted(ModuleFile *MF) {
-  if (!GlobalIndex || GlobalIndex->loadedModuleFile(MF))
+  if (!GlobalIndex || !ModulesRectifiedWithGlobalIndex.insert(MF).second)
     return;
 
-  ModulesInCommonWithGlobalIndex.push_back(MF);
+  if (GlobalIndex->loadedModuleFile(MF))
+    ModulesNotInGlobalIndex.push_back(MF);
+  else
+    ModulesInCommonWithGlobalIndex.push_back(MF);
 }
 
 ModuleManager::ModuleManager(FileManager &FileMgr,
@@ -373,6 +376,10 @@ void ModuleManager::visit(llvm::function_ref<bool(ModuleFile &M)> Visitor,
 
     assert(VisitOrder.size() == N && "Visitation order is wrong?");
 
+    VisitOrderPosition.resize(N);
+    for (unsigned I = 0; I != N; ++I)
+      VisitOrderPosition[VisitOrder[I]->Index] = I;
+
     FirstVisitState = nullptr;
   }
 
@@ -380,9 +387,25 @@ void ModuleManager::visit(llvm::function_ref<bool(ModuleFile &M)> Visitor,
   unsigned VisitNumber = State->NextVisitNumber++;
 
   // If the caller has provided us with a hit-set that came from the global
-  // module index, mark every module file in common with the global module
-  // index that is *not* in that set as 'visited'.
-  if (ModuleFilesHit && !ModulesInCommonWithGlobalIndex.empty()) {
+  // module index and every module file has been rectified with the index,
+  // the only module files which may need to be visited are the hits and the
+  // module files the index does not know about. Visit just those, in the
+  // usual order.
+  SmallVector<ModuleFile *, 4> Candidates;
+  ArrayRef<ModuleFile *> Order = VisitOrder;
+  if (ModuleFilesHit && GlobalIndex &&
+      ModulesRectifiedWithGlobalIndex.size() == VisitOrder.size()) {
+    Candidates.reserve(ModuleFilesHit->size() + ModulesNotInGlobalIndex.size());
+    Candidates.append(ModuleFilesHit->begin(), ModuleFilesHit->end());
+    Candidates.append(ModulesNotInGlobalIndex.begin(),
+                      ModulesNotInGlobalIndex.end());
+    llvm::sort(Candidates, [&](ModuleFile *LHS, ModuleFile *RHS) {
+      return VisitOrderPosition[LHS->Index] < VisitOrderPosition[RHS->Index];
+    });
+    Order = Candidates;
+  } else if (ModuleFilesHit && !ModulesInCommonWithGlobalIndex.empty()) {
+    // Otherwise, mark every module file in common with the global module
+    // index that is *not* in the hit-set as 'visited'.
     for (unsigned I = 0, N = ModulesInCommonWithGlobalIndex.size(); I != N; ++I)
     {
       ModuleFile *M = ModulesInCommonWithGlobalIndex[I];
@@ -391,14 +414,14 @@ void ModuleManager::visit(llvm::function_ref<bool(ModuleFile &M)> Visitor,
     }
   }
 
-  for (unsigned I = 0, N = VisitOrder.size(); I != N; ++I) {
-    ModuleFile *CurrentModule = VisitOrder[I];
+  for (ModuleFile *CurrentModule : Order) {
     // Should we skip this module file?
     if (State->VisitNumber[CurrentModule->Index] == VisitNumber)
       continue;
 
-    // Visit the module.
-    assert(State->VisitNumber[CurrentModule->Index] == VisitNumber - 1);
+    // Visit the module. Module files skipped by earlier traversals may still
+    // carry an older visit number.
+    assert(State->VisitNumber[CurrentModule->Index] < VisitNumber);
     State->VisitNumber[CurrentModule->Index] = VisitNumber;
     if (!Visitor(*CurrentModule))
       continue;
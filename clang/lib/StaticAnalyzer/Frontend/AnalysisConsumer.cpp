@@ -33,18 +33,39 @@
 #include "clang/StaticAnalyzer/Core/PathDiagnosticConsumers.h"
 #include "clang/StaticAnalyzer/Core/PathSensitive/AnalysisManager.h"
 #include "clang/StaticAnalyzer/Core/PathSensitive/ExprEngine.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/IntEqClasses.h"
 #include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SetVector.h"
 #include "llvm/ADT/ScopeExit.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/Errno.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/Program.h"
+#include "llvm/Support/StringSaver.h"
 #include "llvm/Support/Timer.h"
 #include "llvm/Support/raw_ostream.h"
+#include <array>
 #include <memory>
+#include <numeric>
+#include <optional>
 #include <queue>
 #include <utility>
 
+#if LLVM_ON_UNIX
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#ifdef __APPLE__
+#include <mach/mach.h>
+#endif
+
 using namespace clang;
 using namespace ento;
 
@@ -120,6 +141,15 @@ public:
   /// translation unit.
   FunctionSummariesTy FunctionSummaries;
 
+  /// The numbers of basic blocks in the functions analyzed by the workers, and
+  /// of those they visited.
+  unsigned WorkerBasicBlocks = 0;
+  unsigned WorkerVisitedBasicBlocks = 0;
+
+  /// Holds the tags of the path pieces handed over by the workers.
+  llvm::BumpPtrAllocator WorkerTagAllocator;
+  llvm::UniqueStringSaver WorkerTags{WorkerTagAllocator};
+
   AnalysisConsumer(CompilerInstance &CI, const std::string &outdir,
                    AnalyzerOptions &opts, ArrayRef<std::string> plugins,
                    CodeInjector *injector)
@@ -247,6 +277,21 @@ public:
   /// use it to define the order in which the functions should be visited.
   void HandleDeclsCallGraph(const unsigned LocalTUDeclsSize);
 
+  /// Analyzes \p D as a top-level function, unless it was analyzed or inlined
+  /// before according to \p Visited and \p VisitedAsTopLevel, which are
+  /// updated. The functions inlined into \p D are added to \p VisitedCallees.
+  void HandleTopLevelFunction(Decl *D, SetOfConstDecls &Visited,
+                              SetOfConstDecls &VisitedAsTopLevel,
+                              SetOfConstDecls &VisitedCallees);
+
+  /// Analyzes the functions of \p Order, which are the nodes of \p CG in
+  /// topological order, in several processes, and hands their reports and
+  /// statistics over to this one. Returns the functions that are left for this
+  /// process to analyze: all of them if it cannot fork, or those of the
+  /// workers that failed or inlined a function of another worker.
+  llvm::BitVector HandleDeclsInWorkers(const CallGraph &CG,
+                                       ArrayRef<Decl *> Order);
+
   /// Run analyzes(syntax or path sensitive) on the given function.
   /// \param Mode - determines if we are requesting syntax only or path
   /// sensitive only analysis.
@@ -451,49 +496,408 @@ void AnalysisConsumer::HandleDeclsCallGraph(const unsigned LocalTUDeclsSize) {
   // inlined functions. The topological order allows the "do not reanalyze
   // previously inlined function" performance heuristic to be triggered more
   // often.
-  SetOfConstDecls Visited;
-  SetOfConstDecls VisitedAsTopLevel;
+  std::vector<Decl *> Order;
   llvm::ReversePostOrderTraversal<clang::CallGraph*> RPOT(&CG);
   for (auto &N : RPOT) {
     NumFunctionTopLevel++;
 
-    Decl *D = N->getDecl();
-
     // Skip the abstract root node.
-    if (!D)
-      continue;
+    if (Decl *D = N->getDecl())
+      Order.push_back(D);
+  }
 
-    // Skip the functions which have been processed already or previously
-    // inlined.
-    if (shouldSkipFunction(D, Visited, VisitedAsTopLevel))
-      continue;
+  llvm::BitVector Analyze(Order.size(), true);
+  if (Opts.AnalysisJobs > 1 && !Opts.IsNaiveCTUEnabled &&
+      Opts.AnalyzeSpecificFunction.empty())
+    Analyze = HandleDeclsInWorkers(CG, Order);
+
+  SetOfConstDecls Visited;
+  SetOfConstDecls VisitedAsTopLevel;
+  for (unsigned I : Analyze.set_bits()) {
+    SetOfConstDecls VisitedCallees;
+    HandleTopLevelFunction(Order[I], Visited, VisitedAsTopLevel,
+                           VisitedCallees);
+  }
+}
+
+void AnalysisConsumer::HandleTopLevelFunction(
+    Decl *D, SetOfConstDecls &Visited, SetOfConstDecls &VisitedAsTopLevel,
+    SetOfConstDecls &VisitedCallees) {
+  // Skip the functions which have been processed already or previously
+  // inlined.
+  if (shouldSkipFunction(D, Visited, VisitedAsTopLevel))
+    return;
+
+  // The CallGraph might have declarations as callees. However, during CTU
+  // the declaration might form a declaration chain with the newly imported
+  // definition from another TU. In this case we don't want to analyze the
+  // function definition as toplevel.
+  if (const auto *FD = dyn_cast<FunctionDecl>(D)) {
+    // Calling 'hasBody' replaces 'FD' in place with the FunctionDecl
+    // that has the body.
+    FD->hasBody(FD);
+    if (CTU.isImportedAsNew(FD))
+      return;
+  }
+
+  // Analyze the function.
+  SetOfConstDecls Callees;
+
+  HandleCode(D, AM_Path, getInliningModeForFunction(D, Visited),
+             (Mgr->options.InliningMode == All ? nullptr : &Callees));
+
+  // Add the visited callees to the global visited set.
+  for (const Decl *Callee : Callees) {
+    // Decls from CallGraph are already canonical. But Decls coming from
+    // CallExprs may be not. We should canonicalize them manually.
+    const Decl *Canonical =
+        isa<ObjCMethodDecl>(Callee) ? Callee : Callee->getCanonicalDecl();
+    Visited.insert(Canonical);
+    VisitedCallees.insert(Canonical);
+  }
+  VisitedAsTopLevel.insert(D);
+}
+
+/// Returns whether threads other than the calling one run in this process.
+/// fork() only duplicates the calling thread, so any lock held by another one,
+/// e.g. in the allocator, would never be released in the child.
+static bool hasOtherThreads() {
+#if defined(__linux__)
+  std::error_code EC;
+  unsigned NumThreads = 0;
+  for (llvm::sys::fs::directory_iterator It("/proc/self/task", EC), End;
+       !EC && It != End; It.increment(EC))
+    ++NumThreads;
+  return EC || NumThreads != 1;
+#elif defined(__APPLE__)
+  thread_act_array_t Threads;
+  mach_msg_type_number_t NumThreads;
+  if (task_threads(mach_task_self(), &Threads, &NumThreads) != KERN_SUCCESS)
+    return true;
+  for (mach_msg_type_number_t I = 0; I != NumThreads; ++I)
+    mach_port_deallocate(mach_task_self(), Threads[I]);
+  vm_deallocate(mach_task_self(), reinterpret_cast<vm_address_t>(Threads),
+                NumThreads * sizeof(*Threads));
+  return NumThreads != 1;
+#else
+  return true;
+#endif
+}
+
+/// Returns the number of characters in the body of \p D, an estimate of the
+/// cost of analyzing it.
+static uint64_t getBodySize(const Decl *D, const SourceManager &SM) {
+  const Stmt *Body = D->getBody();
+  if (!Body)
+    return 1;
+  SourceRange Range = SM.getExpansionRange(Body->getSourceRange()).getAsRange();
+  std::pair<FileID, unsigned> Begin = SM.getDecomposedLoc(Range.getBegin());
+  std::pair<FileID, unsigned> End = SM.getDecomposedLoc(Range.getEnd());
+  if (Begin.first != End.first || End.second < Begin.second)
+    return 1;
+  return End.second - Begin.second + 1;
+}
+
+llvm::BitVector
+AnalysisConsumer::HandleDeclsInWorkers(const CallGraph &CG,
+                                       ArrayRef<Decl *> Order) {
+  llvm::BitVector Analyze(Order.size(), true);
+#if LLVM_ON_UNIX
+  if (Order.size() < 2)
+    return Analyze;
+
+  // The workers hand back declarations and source locations as they are,
+  // which is only right if they neither deserialize nor inject any.
+  if (Ctx->getExternalSource() || Injector)
+    return Analyze;
+
+  if (hasOtherThreads()) {
+    reportAnalyzerProgress("Not forking analysis workers: the process runs "
+                           "other threads\n");
+    return Analyze;
+  }
+
+  // Give each connected component of the call graph to a worker. Inlining
+  // only follows calls, so the functions of a component are skipped as top
+  // level, or not, as in a sequential run when the worker analyzes them in the
+  // same order. A call that is not in the call graph, e.g. through a function
+  // pointer, may still be inlined across components; the workers report those
+  // components, which are then analyzed again here.
+  const SourceManager &SM = Ctx->getSourceManager();
+  llvm::DenseMap<const Decl *, unsigned> Positions;
+  std::vector<uint64_t> Sizes(Order.size());
+  for (unsigned I = 0; I != Order.size(); ++I) {
+    Positions[Order[I]] = I;
+    Sizes[I] = getBodySize(Order[I], SM);
+  }
+  llvm::IntEqClasses Components(Order.size());
+  std::vector<uint64_t> Costs(Sizes);
+  for (unsigned I = 0; I != Order.size(); ++I) {
+    for (const CallGraphNode *Callee : *CG.getNode(Order[I])) {
+      auto It = Positions.find(Callee->getDecl());
+      if (It == Positions.end())
+        continue;
+      Components.join(I, It->second);
+      Costs[I] += Sizes[It->second];
+    }
+  }
+  Components.compress();
+
+  unsigned NumComponents = Components.getNumClasses();
+  unsigned NumJobs = std::min<unsigned>(Opts.AnalysisJobs, NumComponents);
+  if (NumJobs < 2)
+    return Analyze;
+  std::vector<uint64_t> ComponentCosts(NumComponents);
+  for (unsigned I = 0; I != Order.size(); ++I)
+    ComponentCosts[Components[I]] += Costs[I];
+
+  // Give the most costly components first to the least loaded worker.
+  std::vector<unsigned> SortedComponents(NumComponents);
+  std::iota(SortedComponents.begin(), SortedComponents.end(), 0);
+  llvm::stable_sort(SortedComponents, [&](unsigned A, unsigned B) {
+    return ComponentCosts[A] > ComponentCosts[B];
+  });
+  std::vector<unsigned> ComponentJobs(NumComponents);
+  std::vector<uint64_t> JobCosts(NumJobs);
+  for (unsigned C : SortedComponents) {
+    unsigned Job = llvm::min_element(JobCosts) - JobCosts.begin();
+    ComponentJobs[C] = Job;
+    JobCosts[Job] += ComponentCosts[C];
+  }
+
+  auto WriteInt = [](raw_ostream &OS, uint64_t Value) {
+    llvm::support::endian::write<uint64_t>(OS, Value,
+                                           llvm::endianness::little);
+  };
+  auto ReadInt = [](StringRef &Data, uint64_t &Value) {
+    if (Data.size() < sizeof(uint64_t))
+      return false;
+    Value = llvm::support::endian::read64le(Data.data());
+    Data = Data.drop_front(sizeof(uint64_t));
+    return true;
+  };
 
-    // The CallGraph might have declarations as callees. However, during CTU
-    // the declaration might form a declaration chain with the newly imported
-    // definition from another TU. In this case we don't want to analyze the
-    // function definition as toplevel.
-    if (const auto *FD = dyn_cast<FunctionDecl>(D)) {
-      // Calling 'hasBody' replaces 'FD' in place with the FunctionDecl
-      // that has the body.
-      FD->hasBody(FD);
-      if (CTU.isImportedAsNew(FD))
+  // Analyzes the functions of a worker, and writes to FD the reports of each
+  // consumer, the statistics, the basic blocks the worker visited, and the
+  // components it inlined functions across.
+  auto RunWorker = [&](unsigned Job, int FD) {
+    // Only hand over the reports of this worker.
+    for (PathDiagnosticConsumer *Consumer : PathConsumers)
+      Consumer->takeDiagnostics();
+    llvm::DenseMap<const llvm::TrackingStatistic *, uint64_t> StatsBefore;
+    for (const llvm::TrackingStatistic *Stat : llvm::GetTrackedStatistics())
+      StatsBefore[Stat] = Stat->getValue();
+
+    SetOfConstDecls Visited;
+    SetOfConstDecls VisitedAsTopLevel;
+    llvm::SmallSetVector<unsigned, 4> Crossed;
+    for (unsigned I = 0; I != Order.size(); ++I) {
+      if (ComponentJobs[Components[I]] != Job)
         continue;
+      SetOfConstDecls VisitedCallees;
+      HandleTopLevelFunction(Order[I], Visited, VisitedAsTopLevel,
+                             VisitedCallees);
+      for (const Decl *Callee : VisitedCallees) {
+        auto It = Positions.find(Callee);
+        if (It != Positions.end() &&
+            Components[It->second] != Components[I]) {
+          Crossed.insert(Components[I]);
+          Crossed.insert(Components[It->second]);
+        }
+      }
     }
 
-    // Analyze the function.
-    SetOfConstDecls VisitedCallees;
+    std::string Result;
+    llvm::raw_string_ostream OS(Result);
+    for (PathDiagnosticConsumer *Consumer : PathConsumers) {
+      std::vector<std::unique_ptr<PathDiagnostic>> Diags =
+          Consumer->takeDiagnostics();
+      WriteInt(OS, Diags.size());
+      for (const std::unique_ptr<PathDiagnostic> &PD : Diags)
+        PathDiagnosticSerializer::write(*PD, SM, OS);
+    }
+    std::vector<llvm::TrackingStatistic *> Stats =
+        llvm::GetTrackedStatistics();
+    WriteInt(OS, Stats.size());
+    for (const llvm::TrackingStatistic *Stat : Stats) {
+      WriteInt(OS, reinterpret_cast<uintptr_t>(Stat));
+      WriteInt(OS, StatsBefore.lookup(Stat));
+      WriteInt(OS, Stat->getValue());
+    }
+    WriteInt(OS, FunctionSummaries.getTotalNumBasicBlocks());
+    WriteInt(OS, FunctionSummaries.getTotalNumVisitedBasicBlocks());
+    WriteInt(OS, Crossed.size());
+    for (unsigned C : Crossed)
+      WriteInt(OS, C);
+    OS.flush();
+
+    const char *Data = Result.data();
+    size_t Size = Result.size();
+    while (Size) {
+      ssize_t Written =
+          llvm::sys::RetryAfterSignal(-1, ::write, FD, Data, Size);
+      if (Written < 0)
+        _exit(1);
+      Data += Written;
+      Size -= Written;
+    }
+    // Leave without running destructors, which would flush the diagnostics.
+    _exit(0);
+  };
+
+  struct WorkerResult {
+    SmallVector<std::vector<std::unique_ptr<PathDiagnostic>>, 2> Diags;
+    std::vector<std::array<uint64_t, 3>> Stats;
+    uint64_t BasicBlocks = 0;
+    uint64_t VisitedBasicBlocks = 0;
+    std::vector<uint64_t> Crossed;
+  };
+
+  // Reads the result of a worker. Returns false if it is malformed.
+  auto ReadResult = [&](StringRef Data, WorkerResult &Result) {
+    Result.Diags.resize(PathConsumers.size());
+    for (unsigned I = 0; I != PathConsumers.size(); ++I) {
+      uint64_t NumDiags;
+      if (!ReadInt(Data, NumDiags))
+        return false;
+      for (uint64_t J = 0; J != NumDiags; ++J) {
+        std::unique_ptr<PathDiagnostic> PD =
+            PathDiagnosticSerializer::read(Data, SM, WorkerTags);
+        if (!PD)
+          return false;
+        Result.Diags[I].push_back(std::move(PD));
+      }
+    }
+    uint64_t NumStats;
+    if (!ReadInt(Data, NumStats) ||
+        Data.size() / (3 * sizeof(uint64_t)) < NumStats)
+      return false;
+    Result.Stats.resize(NumStats);
+    for (std::array<uint64_t, 3> &Stat : Result.Stats)
+      for (uint64_t &Value : Stat)
+        ReadInt(Data, Value);
+    uint64_t NumCrossed;
+    if (!ReadInt(Data, Result.BasicBlocks) ||
+        !ReadInt(Data, Result.VisitedBasicBlocks) ||
+        !ReadInt(Data, NumCrossed) ||
+        Data.size() / sizeof(uint64_t) < NumCrossed)
+      return false;
+    Result.Crossed.resize(NumCrossed);
+    for (uint64_t &C : Result.Crossed)
+      if (!ReadInt(Data, C) || C >= NumComponents)
+        return false;
+    return Data.empty();
+  };
 
-    HandleCode(D, AM_Path, getInliningModeForFunction(D, Visited),
-               (Mgr->options.InliningMode == All ? nullptr : &VisitedCallees));
+  // Hands the result of a worker over to this process.
+  auto ApplyResult = [&](WorkerResult &Result) {
+    for (unsigned I = 0; I != PathConsumers.size(); ++I)
+      for (std::unique_ptr<PathDiagnostic> &PD : Result.Diags[I])
+        PathConsumers[I]->HandlePathDiagnostic(std::move(PD));
+    // The worker is a copy of this process, so the statistics are at the same
+    // addresses. By convention, those named Max* hold maximums.
+    for (const std::array<uint64_t, 3> &Values : Result.Stats) {
+      auto *Stat = reinterpret_cast<llvm::TrackingStatistic *>(
+          static_cast<uintptr_t>(Values[0]));
+      if (StringRef(Stat->getName()).starts_with("Max"))
+        Stat->updateMax(Values[2]);
+      else
+        *Stat += Values[2] - Values[1];
+    }
+    WorkerBasicBlocks += Result.BasicBlocks;
+    WorkerVisitedBasicBlocks += Result.VisitedBasicBlocks;
+  };
 
-    // Add the visited callees to the global visited set.
-    for (const Decl *Callee : VisitedCallees)
-      // Decls from CallGraph are already canonical. But Decls coming from
-      // CallExprs may be not. We should canonicalize them manually.
-      Visited.insert(isa<ObjCMethodDecl>(Callee) ? Callee
-                                                 : Callee->getCanonicalDecl());
-    VisitedAsTopLevel.insert(D);
+  struct Worker {
+    unsigned Job;
+    pid_t PID;
+    int FD;
+    std::string ErrorPath;
+    std::optional<WorkerResult> Result;
+  };
+  SmallVector<Worker, 16> Workers;
+  llvm::outs().flush();
+  llvm::errs().flush();
+  for (unsigned Job = 0; Job != NumJobs; ++Job) {
+    // The output of the workers, e.g. their progress, goes to a file that is
+    // printed once they are done, so that they do not interleave.
+    int ErrorFD;
+    SmallString<128> ErrorPath;
+    if (llvm::sys::fs::createTemporaryFile("analysis-worker", "txt", ErrorFD,
+                                           ErrorPath))
+      continue;
+    int FDs[2];
+    if (pipe(FDs) != 0) {
+      close(ErrorFD);
+      llvm::sys::fs::remove(ErrorPath);
+      continue;
+    }
+    pid_t PID = fork();
+    if (PID == 0) {
+      close(FDs[0]);
+      dup2(ErrorFD, STDERR_FILENO);
+      close(ErrorFD);
+      RunWorker(Job, FDs[1]);
+    }
+    close(FDs[1]);
+    close(ErrorFD);
+    if (PID < 0) {
+      close(FDs[0]);
+      llvm::sys::fs::remove(ErrorPath);
+      continue;
+    }
+    Workers.push_back({Job, PID, FDs[0], std::string(ErrorPath)});
   }
+
+  // The components that a worker inlined functions across are analyzed again
+  // here, in the usual order, along with the other components of the workers
+  // which analyzed them. If a worker failed or crashed, it is unknown which
+  // components it inlined functions across, so all of them are.
+  llvm::BitVector Redo(NumComponents);
+  for (Worker &W : Workers) {
+    std::string Data;
+    std::array<char, 4096> Buffer;
+    ssize_t Read;
+    while ((Read = llvm::sys::RetryAfterSignal(-1, ::read, W.FD, Buffer.data(),
+                                               Buffer.size())) > 0)
+      Data.append(Buffer.data(), Read);
+    close(W.FD);
+    int Status;
+    WorkerResult Result;
+    if (llvm::sys::RetryAfterSignal(-1, waitpid, W.PID, &Status, 0) >= 0 &&
+        WIFEXITED(Status) && WEXITSTATUS(Status) == 0 && Read == 0 &&
+        ReadResult(Data, Result)) {
+      for (uint64_t C : Result.Crossed)
+        Redo.set(C);
+      W.Result = std::move(Result);
+    }
+  }
+  llvm::BitVector Done(NumJobs);
+  for (const Worker &W : Workers)
+    Done[W.Job] = W.Result.has_value();
+  if (!Done.all())
+    Done.reset();
+  for (unsigned C = 0; C != NumComponents; ++C)
+    if (Redo[C])
+      Done.reset(ComponentJobs[C]);
+
+  for (Worker &W : Workers) {
+    // The output of the workers whose functions are analyzed again is not
+    // printed, as it is printed again here.
+    if (Done[W.Job]) {
+      ApplyResult(*W.Result);
+      if (llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Output =
+              llvm::MemoryBuffer::getFile(W.ErrorPath))
+        llvm::errs() << (*Output)->getBuffer();
+    }
+    llvm::sys::fs::remove(W.ErrorPath);
+  }
+
+  for (unsigned I = 0; I != Order.size(); ++I)
+    if (Done[ComponentJobs[Components[I]]])
+      Analyze.reset(I);
+#endif
+  return Analyze;
 }
 
 static bool fileContainsString(StringRef Substring, ASTContext &C) {
@@ -613,12 +1017,14 @@ void AnalysisConsumer::HandleTranslationUnit(ASTContext &C) {
   runAnalysisOnTranslationUnit(C);
 
   // Count how many basic blocks we have not covered.
-  NumBlocksInAnalyzedFunctions = FunctionSummaries.getTotalNumBasicBlocks();
+  NumBlocksInAnalyzedFunctions =
+      FunctionSummaries.getTotalNumBasicBlocks() + WorkerBasicBlocks;
   NumVisitedBlocksInAnalyzedFunctions =
-      FunctionSummaries.getTotalNumVisitedBasicBlocks();
+      FunctionSummaries.getTotalNumVisitedBasicBlocks() +
+      WorkerVisitedBasicBlocks;
   if (NumBlocksInAnalyzedFunctions > 0)
     PercentReachableBlocks =
-        (FunctionSummaries.getTotalNumVisitedBasicBlocks() * 100) /
+        (NumVisitedBlocksInAnalyzedFunctions * 100) /
         NumBlocksInAnalyzedFunctions;
 }
 
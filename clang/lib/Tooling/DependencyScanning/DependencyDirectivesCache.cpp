@@ -0,0 +1,179 @@
+//===- DependencyDirectivesCache.cpp - On-disk directives cache -----------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Tooling/DependencyScanning/DependencyDirectivesCache.h"
+#include "clang/Basic/TokenKinds.h"
+#include "clang/Basic/Version.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/BLAKE3.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <optional>
+
+using namespace clang;
+using namespace tooling;
+using namespace dependencies;
+using namespace dependency_directives_scan;
+
+// An entry holds the result of one scan, with all fields little-endian:
+//
+//   uint32_t FormatVersion, Failed, NumTokens, NumDirectives
+//   NumTokens times: uint32_t Offset, Length; uint16_t Kind, Flags
+//   NumDirectives times: uint32_t Kind, NumTokens
+//
+// The tokens of each directive follow those of the one before it, as in the
+// output of the scanner.
+static constexpr uint32_t FormatVersion = 1;
+static constexpr size_t HeaderSize = 16;
+static constexpr size_t TokenSize = 12;
+static constexpr size_t DirectiveSize = 8;
+
+static void writeEntry(raw_ostream &OS, bool Failed, ArrayRef<Token> Tokens,
+                       ArrayRef<Directive> Directives) {
+  llvm::support::endian::Writer W(OS, llvm::endianness::little);
+  W.write<uint32_t>(FormatVersion);
+  W.write<uint32_t>(Failed);
+  W.write<uint32_t>(Tokens.size());
+  W.write<uint32_t>(Directives.size());
+  for (const Token &Tok : Tokens) {
+    W.write<uint32_t>(Tok.Offset);
+    W.write<uint32_t>(Tok.Length);
+    W.write<uint16_t>(Tok.Kind);
+    W.write<uint16_t>(Tok.Flags);
+  }
+  for (const Directive &D : Directives) {
+    W.write<uint32_t>(D.Kind);
+    W.write<uint32_t>(D.Tokens.size());
+  }
+}
+
+/// Reads the entry \p Data for \p Input, appending to \p Tokens and \p
+/// Directives. Returns nothing if the entry is malformed.
+static std::optional<bool> readEntry(StringRef Data, StringRef Input,
+                                     SmallVectorImpl<Token> &Tokens,
+                                     SmallVectorImpl<Directive> &Directives) {
+  using namespace llvm::support::endian;
+  const char *P = Data.data();
+  if (Data.size() < HeaderSize || read32le(P) != FormatVersion)
+    return std::nullopt;
+  bool Failed = read32le(P + 4);
+  uint64_t NumTokens = read32le(P + 8);
+  uint64_t NumDirectives = read32le(P + 12);
+  if (Data.size() !=
+      HeaderSize + NumTokens * TokenSize + NumDirectives * DirectiveSize)
+    return std::nullopt;
+  if (Failed)
+    return true;
+
+  size_t Begin = Tokens.size();
+  P += HeaderSize;
+  Tokens.reserve(Begin + NumTokens);
+  for (uint64_t I = 0; I != NumTokens; ++I, P += TokenSize) {
+    uint64_t Offset = read32le(P), Length = read32le(P + 4);
+    uint16_t Kind = read16le(P + 8);
+    if (Offset + Length > Input.size() || Kind >= tok::NUM_TOKENS)
+      return std::nullopt;
+    Tokens.emplace_back(Offset, Length, tok::TokenKind(Kind), read16le(P + 10));
+  }
+  ArrayRef<Token> Remaining = ArrayRef(Tokens).drop_front(Begin);
+  Directives.reserve(Directives.size() + NumDirectives);
+  for (uint64_t I = 0; I != NumDirectives; ++I, P += DirectiveSize) {
+    uint32_t Kind = read32le(P), Count = read32le(P + 4);
+    if (Kind > pp_eof || Count > Remaining.size())
+      return std::nullopt;
+    Directives.emplace_back(DirectiveKind(Kind), Remaining.take_front(Count));
+    Remaining = Remaining.drop_front(Count);
+  }
+  if (!Remaining.empty())
+    return std::nullopt;
+  return false;
+}
+
+DependencyDirectivesCache::DependencyDirectivesCache()
+    : Version(getClangFullRepositoryVersion()) {}
+
+llvm::Expected<std::unique_ptr<DependencyDirectivesCache>>
+DependencyDirectivesCache::create(StringRef Path,
+                                  llvm::PackCachePolicy Policy) {
+  std::unique_ptr<DependencyDirectivesCache> Result(
+      new DependencyDirectivesCache());
+  DependencyDirectivesCache *Self = Result.get();
+  llvm::Expected<llvm::FileCache> CacheOrErr = llvm::packCache(
+      "DependencyDirectives", Path,
+      [Self](unsigned Task, const Twine &,
+             std::unique_ptr<llvm::MemoryBuffer> Entry) {
+        std::lock_guard<std::mutex> Lock(Self->EntriesLock);
+        Self->Entries[Task] = std::move(Entry);
+      },
+      Policy);
+  if (!CacheOrErr)
+    return CacheOrErr.takeError();
+  Result->Cache = std::move(*CacheOrErr);
+  return std::move(Result);
+}
+
+std::unique_ptr<llvm::MemoryBuffer>
+DependencyDirectivesCache::takeEntry(unsigned Task) {
+  std::lock_guard<std::mutex> Lock(EntriesLock);
+  auto It = Entries.find(Task);
+  if (It == Entries.end())
+    return nullptr;
+  std::unique_ptr<llvm::MemoryBuffer> Entry = std::move(It->second);
+  Entries.erase(It);
+  return Entry;
+}
+
+bool DependencyDirectivesCache::scan(StringRef Input,
+                                     SmallVectorImpl<Token> &Tokens,
+                                     SmallVectorImpl<Directive> &Directives) {
+  llvm::BLAKE3 Hasher;
+  Hasher.update(Version);
+  Hasher.update(StringRef("\0", 1));
+  Hasher.update(Input);
+  std::string Key = llvm::toHex(Hasher.final<16>());
+
+  unsigned Task = NextTask++;
+  llvm::Expected<llvm::AddStreamFn> AddStreamOrErr = Cache(Task, Key, "");
+  if (!AddStreamOrErr) {
+    llvm::consumeError(AddStreamOrErr.takeError());
+    return scanSourceForDependencyDirectives(Input, Tokens, Directives);
+  }
+  if (!*AddStreamOrErr) {
+    std::unique_ptr<llvm::MemoryBuffer> Entry = takeEntry(Task);
+    size_t NumTokens = Tokens.size(), NumDirectives = Directives.size();
+    if (Entry)
+      if (std::optional<bool> Failed =
+              readEntry(Entry->getBuffer(), Input, Tokens, Directives))
+        return *Failed;
+    // Scan the file again if the entry was malformed.
+    Tokens.truncate(NumTokens);
+    Directives.truncate(NumDirectives);
+    return scanSourceForDependencyDirectives(Input, Tokens, Directives);
+  }
+
+  size_t NumTokens = Tokens.size(), NumDirectives = Directives.size();
+  bool Failed = scanSourceForDependencyDirectives(Input, Tokens, Directives);
+  llvm::Expected<std::unique_ptr<llvm::CachedFileStream>> StreamOrErr =
+      (*AddStreamOrErr)(Task, "");
+  if (!StreamOrErr) {
+    llvm::consumeError(StreamOrErr.takeError());
+    return Failed;
+  }
+  if (Failed)
+    writeEntry(*(*StreamOrErr)->OS, Failed, {}, {});
+  else
+    writeEntry(*(*StreamOrErr)->OS, Failed,
+               ArrayRef(Tokens).drop_front(NumTokens),
+               ArrayRef(Directives).drop_front(NumDirectives));
+  // Committing the stream adds the entry and hands it back to us.
+  StreamOrErr->reset();
+  takeEntry(Task);
+  return Failed;
+}
@@ -7,6 +7,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "clang/Tooling/DependencyScanning/DependencyScanningFilesystem.h"
+#include "clang/Tooling/DependencyScanning/DependencyDirectivesCache.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/SmallVectorMemoryBuffer.h"
 #include "llvm/Support/Threading.h"
@@ -63,10 +64,13 @@ bool DependencyScanningWorkerFilesystem::ensureDirectiveTokensArePopulated(
 
   SmallVector<dependency_directives_scan::Directive, 64> Directives;
   // Scan the file for preprocessor directives that might affect the
-  // dependencies.
-  if (scanSourceForDependencyDirectives(Contents->Original->getBuffer(),
-                                        Contents->DepDirectiveTokens,
-                                        Directives)) {
+  // dependencies, unless an earlier scan of the same contents is on disk.
+  StringRef Input = Contents->Original->getBuffer();
+  DependencyDirectivesCache *DiskCache = SharedCache.getDirectivesCache();
+  if (DiskCache ? DiskCache->scan(Input, Contents->DepDirectiveTokens,
+                                  Directives)
+                : scanSourceForDependencyDirectives(
+                      Input, Contents->DepDirectiveTokens, Directives)) {
     Contents->DepDirectiveTokens.clear();
     // FIXME: Propagate the diagnostic if desired by the client.
     Contents->DepDirectives.store(new std::optional<DependencyDirectivesTy>());
@@ -0,0 +1,59 @@
+// Test that bytecode stored in a PCH is used in place of compiling the
+// functions again.
+
+// RUN: %clang_cc1 -fexperimental-new-constant-interpreter -x c++-header -emit-pch -o %t %s
+// RUN: %clang_cc1 -fexperimental-new-constant-interpreter -include-pch %t -verify %s
+// RUN: llvm-bcanalyzer -dump %t | FileCheck %s
+// RUN: %clang_cc1 -fexperimental-new-constant-interpreter -include-pch %t -verify -print-stats %s 2>&1 \
+// RUN:   | FileCheck -check-prefix=STATS -implicit-check-not='functions compiled' %s
+
+// CHECK: <INTERP_BYTECODE
+
+// None of the functions called below is compiled again.
+// STATS: {{[1-9][0-9]*}} interp - Number of functions loaded from AST files.
+
+#ifndef HEADER
+#define HEADER
+
+constexpr int add(int a, int b) { return a + b; }
+static_assert(add(1, 2) == 3, "");
+
+struct Point {
+  int x, y;
+  constexpr Point(int x, int y) : x(x), y(y) {}
+  constexpr int sum() const { return x + y; }
+};
+static_assert(Point(1, 2).sum() == 3, "");
+
+constexpr double half(double d) { return d / 2.0; }
+static_assert(half(3.0) == 1.5, "");
+
+constexpr const char *hello() { return "hello"; }
+static_assert(hello()[1] == 'e', "");
+
+constexpr int sumArray() {
+  int arr[3] = {1, 2, 3};
+  int s = 0;
+  for (int i : arr)
+    s += i;
+  return s;
+}
+static_assert(sumArray() == 6, "");
+
+constexpr int divide(int a, int b) { return a / b; }
+static_assert(divide(4, 2) == 2, "");
+
+#else
+
+static_assert(add(2, 3) == 5, "");
+static_assert(Point(3, 4).sum() == 7, "");
+static_assert(half(1.0) == 0.5, "");
+static_assert(hello()[4] == 'o', "");
+static_assert(sumArray() == 6, "");
+
+// The source map of the stored bytecode points into the header.
+static_assert(divide(1, 0) == 0, ""); // expected-error {{not an integral constant expression}} \
+                                      // expected-note {{in call to 'divide(1, 0)'}}
+// expected-note@43 {{division by zero}}
+
+#endif
@@ -0,0 +1,20 @@
+// REQUIRES: asserts
+// RUN: %clang_analyze_cc1 -analyzer-checker=core -analyzer-stats %s \
+// RUN:   -analyzer-config analysis-jobs=2 2>&1 | FileCheck %s
+
+// UNSUPPORTED: system-windows
+
+// Test that the statistics of the processes analyzing the functions are added
+// to those of the compiler.
+
+int inc(int x) {
+  return x + 1;
+}
+
+int dec(int x) {
+  return x - 1;
+}
+
+// CHECK: ... Statistics Collected ...
+// CHECK: 2 AnalysisConsumer - The # of functions and blocks analyzed
+// CHECK: 100 AnalysisConsumer - The % of reachable basic blocks.
@@ -0,0 +1,56 @@
+// RUN: %clang_analyze_cc1 -analyzer-checker=core -analyzer-output=text \
+// RUN:   -verify %s
+// RUN: %clang_analyze_cc1 -analyzer-checker=core -analyzer-output=text \
+// RUN:   -verify %s -analyzer-config analysis-jobs=8
+// RUN: %clang_analyze_cc1 -analyzer-checker=core -analyzer-output=plist \
+// RUN:   %s -o %t.plist
+// RUN: %clang_analyze_cc1 -analyzer-checker=core -analyzer-output=plist \
+// RUN:   %s -o %t.jobs.plist -analyzer-config analysis-jobs=8
+// RUN: diff %t.plist %t.jobs.plist
+// RUN: %clang_analyze_cc1 -analyzer-checker=core %s \
+// RUN:   -analyzer-display-progress 2>&1 | grep ANALYZE | sort > %t.txt
+// RUN: %clang_analyze_cc1 -analyzer-checker=core %s \
+// RUN:   -analyzer-config analysis-jobs=8 -analyzer-display-progress 2>&1 \
+// RUN:   | grep ANALYZE | sort > %t.jobs.txt
+// RUN: diff %t.txt %t.jobs.txt
+
+// UNSUPPORTED: system-windows
+
+// Test that analyzing the functions in several processes reports the same
+// bugs, with the same paths, and analyzes the same functions as top level as
+// a single process. 'deref' is inlined into 'caller' and not analyzed as top
+// level, as both are in the same component of the call graph. 'twice' is in a
+// component of its own, but is inlined through a function pointer.
+
+void deref(int *p) {
+  *p = 1; // expected-warning{{Dereference of null pointer (loaded from variable 'p')}}
+          // expected-note@-1{{Dereference of null pointer (loaded from variable 'p')}}
+}
+
+void caller(void) {
+  deref(0);
+  // expected-note@-1{{Passing null pointer value via 1st parameter 'p'}}
+  // expected-note@-2{{Calling 'deref'}}
+}
+
+int divide(int x) {
+  if (x != 0)
+    // expected-note@-1{{Assuming 'x' is equal to 0}}
+    // expected-note@-2{{Taking false branch}}
+    return 1;
+  return 1 / x; // expected-warning{{Division by zero}}
+                // expected-note@-1{{Division by zero}}
+}
+
+int clean(int x) {
+  return x + 1;
+}
+
+static int twice(int x) {
+  return 2 * x;
+}
+
+int callThroughPointer(void) {
+  int (*fp)(int) = twice;
+  return fp(1);
+}
@@ -0,0 +1,48 @@
+// Test that a -cc1 job run on a compile server writes the same output file,
+// diagnostics and stdout as when clang runs it itself.
+// REQUIRES: shell, x86-registered-target
+// RUN: rm -rf %t && mkdir %t && cd %t
+
+// Start a server, which stops by itself if the test does not get to stop it.
+// RUN: { timeout 120 %clang -cc1serve -v -j 1 sock > server.log 2>&1 & \
+// RUN:   echo $! > pid; }
+// RUN: for i in $(seq 100); do test -S sock && break; sleep 0.1; done
+
+// RUN: %clang_cc1 -triple x86_64-linux-gnu -emit-obj -Wunused-variable %s \
+// RUN:   -o local.o 2> local.err
+// RUN: env CLANG_COMPILE_SERVER=sock %clang_cc1 -triple x86_64-linux-gnu \
+// RUN:   -emit-obj -Wunused-variable %s -o served.o 2> served.err
+// RUN: cmp local.o served.o
+// RUN: diff local.err served.err
+// RUN: FileCheck %s --check-prefix=DIAG < served.err
+// DIAG: warning: unused variable 'unused'
+
+// RUN: %clang_cc1 -triple x86_64-linux-gnu -fsyntax-only \
+// RUN:   -fdump-record-layouts %s > local.txt
+// RUN: env CLANG_COMPILE_SERVER=sock %clang_cc1 -triple x86_64-linux-gnu \
+// RUN:   -fsyntax-only -fdump-record-layouts %s > served.txt
+// RUN: diff local.txt served.txt
+// RUN: FileCheck %s --check-prefix=LAYOUT < served.txt
+// LAYOUT: *** Dumping AST Record Layout
+// LAYOUT: struct S
+
+// A job which reads from stdin is run by clang itself.
+// RUN: env CLANG_COMPILE_SERVER=sock %clang_cc1 -triple x86_64-linux-gnu \
+// RUN:   -fsyntax-only -x c - < %s
+
+// RUN: kill $(cat pid)
+// RUN: FileCheck %s --check-prefix=LOG < server.log
+// LOG: cc1serve: ran: -cc1 {{.*}}-emit-obj
+// LOG: cc1serve: ran: -cc1 {{.*}}-fdump-record-layouts
+// LOG: cc1serve: running locally (reads from stdin): -cc1 {{.*}} -
+
+struct S {
+  int a;
+  char b;
+};
+
+int f(void) {
+  int unused;
+  struct S s = {1, 2};
+  return s.a + sizeof(struct S);
+}
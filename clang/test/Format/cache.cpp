@@ -0,0 +1,42 @@
+// RUN: rm -rf %t && mkdir %t
+// RUN: printf 'int a;\n' > %t/clean.cpp
+// RUN: printf 'int  b;\n' > %t/dirty.cpp
+
+// The first run formats both files and remembers the one which is clean.
+// RUN: clang-format -style=LLVM --dry-run --verbose -cache=%t/cache \
+// RUN:   %t/clean.cpp %t/dirty.cpp 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=FIRST --implicit-check-not=Skipping
+// RUN: count 1 < %t/cache
+// FIRST: Formatting [1/2] {{.*}}clean.cpp
+// FIRST: Formatting [2/2] {{.*}}dirty.cpp
+// FIRST: dirty.cpp:1:{{[0-9]+}}: warning: code should be clang-formatted
+
+// The second run skips it.
+// RUN: clang-format -style=LLVM --dry-run --verbose -cache=%t/cache \
+// RUN:   %t/clean.cpp %t/dirty.cpp 2>&1 | FileCheck %s --check-prefix=SECOND
+// SECOND:      Formatting [1/2] {{.*}}clean.cpp
+// SECOND-NEXT: Skipping {{.*}}clean.cpp: formatted correctly already
+// SECOND-NEXT: Formatting [2/2] {{.*}}dirty.cpp
+// SECOND-NEXT: dirty.cpp:1:{{[0-9]+}}: warning: code should be clang-formatted
+
+// Include sorting depends on the name of a file, so the same contents under
+// another name are not known to be clean.
+// RUN: cp %t/clean.cpp %t/renamed.cpp
+// RUN: clang-format -style=LLVM --dry-run --verbose -cache=%t/cache \
+// RUN:   %t/renamed.cpp 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=RENAMED --implicit-check-not=Skipping
+// RUN: count 2 < %t/cache
+// RENAMED: Formatting [1/1] {{.*}}renamed.cpp
+
+// A style which differs does not use what was remembered with another one.
+// RUN: clang-format -style=Google --dry-run --verbose -cache=%t/cache \
+// RUN:   %t/clean.cpp 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=STYLE --implicit-check-not=Skipping
+// STYLE: Formatting [1/1] {{.*}}clean.cpp
+
+// The cache only remembers whole files formatted in place or checked.
+// RUN: not clang-format -style=LLVM -cache=%t/cache %t/clean.cpp 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=ERROR
+// RUN: not clang-format -style=LLVM --dry-run -lines=1:1 -cache=%t/cache \
+// RUN:   %t/clean.cpp 2>&1 | FileCheck %s --check-prefix=ERROR
+// ERROR: error: -cache can only be used with -i or --dry-run on whole files.
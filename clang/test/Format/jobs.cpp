@@ -0,0 +1,28 @@
+// RUN: rm -rf %t && mkdir %t
+// RUN: printf 'int  a;\n' > %t/a.cpp
+// RUN: printf 'int  b;\n' > %t/b.cpp
+// RUN: printf 'int c;\n' > %t/c.cpp
+
+// Every file is checked, and the diagnostics of each file are reported at once.
+// RUN: clang-format -style=LLVM --dry-run -j=2 %t/a.cpp %t/b.cpp %t/c.cpp \
+// RUN:   2>&1 | FileCheck %s --check-prefix=DRY --implicit-check-not=warning:
+// DRY-DAG: a.cpp:1:{{[0-9]+}}: warning: code should be clang-formatted
+// DRY-DAG: b.cpp:1:{{[0-9]+}}: warning: code should be clang-formatted
+
+// RUN: clang-format -style=LLVM -i -j=2 %t/a.cpp %t/b.cpp %t/c.cpp
+// RUN: cat %t/a.cpp %t/b.cpp %t/c.cpp \
+// RUN:   | FileCheck %s --check-prefix=INPLACE --strict-whitespace
+// INPLACE:      {{^}}int a;{{$}}
+// INPLACE-NEXT: {{^}}int b;{{$}}
+// INPLACE-NEXT: {{^}}int c;{{$}}
+
+// With -j=0, all hardware threads are used.
+// RUN: clang-format -style=LLVM --dry-run -Werror -j=0 \
+// RUN:   %t/a.cpp %t/b.cpp %t/c.cpp
+
+// Formatted code written to the standard output cannot be interleaved.
+// RUN: not clang-format -style=LLVM -j=2 %t/a.cpp %t/b.cpp 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=STDOUT
+// RUN: not clang-format -style=LLVM -j=2 --output-replacements-xml %t/a.cpp \
+// RUN:   2>&1 | FileCheck %s --check-prefix=STDOUT
+// STDOUT: error: -j can only be used with -i or --dry-run.
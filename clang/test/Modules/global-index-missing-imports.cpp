@@ -0,0 +1,51 @@
+// Test that looking for missing imports in the global module index neither
+// reports a name which no module declares nor misses a module which the index
+// does not know about yet.
+// RUN: rm -rf %t
+// RUN: split-file %s %t
+
+// Build A and B, and a global module index which only knows about them.
+// RUN: %clang_cc1 -fmodules -fimplicit-module-maps -fmodules-cache-path=%t/cache -fdisable-module-hash -I %t %t/build.cpp -fsyntax-only
+// RUN: ls %t/cache | FileCheck -check-prefix=CACHE %s
+// CACHE: A.pcm
+// CACHE: B.pcm
+// CACHE-NOT: C.pcm
+// CACHE: modules.idx
+
+// RUN: %clang_cc1 -fmodules -fimplicit-module-maps -fmodules-cache-path=%t/cache -fdisable-module-hash -fmodules-search-all -I %t %t/use.cpp -verify
+// RUN: ls %t/cache | FileCheck -check-prefix=SEARCHED %s
+// SEARCHED: C.pcm
+
+//--- module.modulemap
+module A { header "a.h" }
+module B { header "b.h" }
+module C { header "c.h" }
+
+//--- a.h
+int from_a;
+
+//--- b.h
+int from_b;
+
+//--- c.h
+int from_c;
+
+//--- build.cpp
+#include "a.h"
+#include "b.h"
+
+//--- use.cpp
+#include "a.h"
+
+// Not in the index, nor in any module.
+int x = undeclared_anywhere; // expected-error {{use of undeclared identifier 'undeclared_anywhere'}}
+
+// In the index, in a module which is not imported.
+int y = from_b; // expected-error {{missing '#include "b.h"'; 'from_b' must be declared before it is used}}
+// expected-note@b.h:1 {{declaration here is not visible}}
+
+// In a module which the index did not know about.
+int z = from_c; // expected-error {{missing '#include "c.h"'; 'from_c' must be declared before it is used}}
+// expected-note@c.h:1 {{declaration here is not visible}}
+
+int w = from_a;
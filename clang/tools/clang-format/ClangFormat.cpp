@@ -20,12 +20,19 @@
 #include "clang/Basic/Version.h"
 #include "clang/Format/Format.h"
 #include "clang/Rewrite/Core/Rewriter.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/ADT/StringSwitch.h"
+#include "llvm/Support/BLAKE3.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/InitLLVM.h"
 #include "llvm/Support/Process.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include <fstream>
+#include <mutex>
 
 using namespace llvm;
 using clang::tooling::Replacements;
@@ -210,6 +217,20 @@ static cl::opt<bool> FailOnIncompleteFormat(
     cl::desc("If set, fail with exit code 1 on incomplete format."),
     cl::init(false), cl::cat(ClangFormatCategory));
 
+static cl::opt<unsigned>
+    NumThreads("j",
+               cl::desc("The number of files to format concurrently.\n"
+                        "0 uses all hardware threads. Can only be used\n"
+                        "with -i or --dry-run."),
+               cl::init(1), cl::cat(ClangFormatCategory));
+
+static cl::opt<std::string> CacheFile(
+    "cache",
+    cl::desc("A file remembering which file contents are known to be\n"
+             "formatted correctly, so that they are not formatted again.\n"
+             "Can only be used with -i or --dry-run on whole files."),
+    cl::value_desc("filename"), cl::init(""), cl::cat(ClangFormatCategory));
+
 namespace clang {
 namespace format {
 
@@ -345,7 +366,8 @@ static void outputReplacementsXML(const Replacements &Replaces) {
 
 static bool
 emitReplacementWarnings(const Replacements &Replaces, StringRef AssumedFileName,
-                        const std::unique_ptr<llvm::MemoryBuffer> &Code) {
+                        const std::unique_ptr<llvm::MemoryBuffer> &Code,
+                        raw_ostream &ErrOS) {
   if (Replaces.empty())
     return false;
 
@@ -363,7 +385,7 @@ emitReplacementWarnings(const Replacements &Replaces, StringRef AssumedFileName,
                            : SourceMgr::DiagKind::DK_Warning,
           "code should be clang-formatted [-Wclang-format-violations]");
 
-      Diag.print(nullptr, llvm::errs(), (ShowColors && !NoShowColors));
+      Diag.print(nullptr, ErrOS, (ShowColors && !NoShowColors));
       if (ErrorLimit && ++Errors >= ErrorLimit)
         break;
     }
@@ -403,11 +425,168 @@ class ClangFormatDiagConsumer : public DiagnosticConsumer {
   }
 };
 
+namespace {
+/// A style with the command line overrides applied, and a digest of
+/// everything that affects formatting with it.
+struct CachedStyle {
+  FormatStyle Style;
+  std::string Digest;
+};
+
+/// Contents of files known to be formatted correctly, by a digest of the
+/// contents and the style.
+class CleanFileCache {
+public:
+  /// Reads the digests remembered by a previous run, if any.
+  bool load(StringRef Path) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> Buf = MemoryBuffer::getFile(Path);
+    if (std::error_code EC = Buf.getError()) {
+      if (EC == std::errc::no_such_file_or_directory)
+        return false;
+      errs() << "error: cannot read " << Path << ": " << EC.message() << "\n";
+      return true;
+    }
+    SmallVector<StringRef> Lines;
+    (*Buf)->getBuffer().split(Lines, '\n', /*MaxSplit=*/-1,
+                              /*KeepEmpty=*/false);
+    for (StringRef Line : Lines)
+      Keys.insert(Line.trim());
+    return false;
+  }
+
+  /// Writes the digests back if new ones were added.
+  bool save(StringRef Path) {
+    if (!Changed)
+      return false;
+    std::vector<StringRef> Sorted(Keys.keys().begin(), Keys.keys().end());
+    llvm::sort(Sorted);
+    if (Error E = writeToOutput(Path, [&](raw_ostream &OS) {
+          for (StringRef Key : Sorted)
+            OS << Key << "\n";
+          return Error::success();
+        })) {
+      errs() << "error: " << toString(std::move(E)) << "\n";
+      return true;
+    }
+    return false;
+  }
+
+  bool contains(StringRef Key) {
+    std::lock_guard<std::mutex> Guard(Lock);
+    return Keys.contains(Key);
+  }
+
+  void insert(StringRef Key) {
+    std::lock_guard<std::mutex> Guard(Lock);
+    Changed |= Keys.insert(Key).second;
+  }
+
+private:
+  std::mutex Lock;
+  StringSet<> Keys;
+  bool Changed = false;
+};
+} // namespace
+
+/// The cache of correctly formatted files, if one is used.
+static std::unique_ptr<CleanFileCache> Cache;
+
+/// Styles by the language and directory of the files using them. The style
+/// of a file only depends on those, so all such files share one.
+static StringMap<CachedStyle> StyleCache;
+static std::mutex StyleCacheLock;
+
+static void applyStyleOverrides(FormatStyle &S) {
+  StringRef QualifierAlignmentOrder = QualifierAlignment;
+
+  S.QualifierAlignment =
+      StringSwitch<FormatStyle::QualifierAlignmentStyle>(
+          QualifierAlignmentOrder.lower())
+          .Case("right", FormatStyle::QAS_Right)
+          .Case("left", FormatStyle::QAS_Left)
+          .Default(S.QualifierAlignment);
+
+  if (S.QualifierAlignment == FormatStyle::QAS_Left) {
+    S.QualifierOrder = {"const", "volatile", "type"};
+  } else if (S.QualifierAlignment == FormatStyle::QAS_Right) {
+    S.QualifierOrder = {"type", "const", "volatile"};
+  } else if (QualifierAlignmentOrder.contains("type")) {
+    S.QualifierAlignment = FormatStyle::QAS_Custom;
+    SmallVector<StringRef> Qualifiers;
+    QualifierAlignmentOrder.split(Qualifiers, " ", /*MaxSplit=*/-1,
+                                  /*KeepEmpty=*/false);
+    S.QualifierOrder = {Qualifiers.begin(), Qualifiers.end()};
+  }
+
+  if (SortIncludes.getNumOccurrences() != 0) {
+    if (SortIncludes)
+      S.SortIncludes = FormatStyle::SI_CaseSensitive;
+    else
+      S.SortIncludes = FormatStyle::SI_Never;
+  }
+}
+
+// Returns the style to format a file with, reusing the style of earlier files
+// of the same language in the same directory.
+static llvm::Expected<const CachedStyle *>
+getCachedStyle(StringRef AssumedFileName, StringRef Code) {
+  // getStyle() searches for configuration files from the absolute path of the
+  // file, so files with the same parent path find the same ones.
+  SmallString<128> Path(AssumedFileName);
+  (void)sys::fs::make_absolute(Path);
+  SmallString<128> Key(getLanguageName(guessLanguage(AssumedFileName, Code)));
+  Key.push_back('\0');
+  Key += sys::path::parent_path(Path);
+
+  {
+    std::lock_guard<std::mutex> Guard(StyleCacheLock);
+    auto It = StyleCache.find(Key);
+    if (It != StyleCache.end())
+      return &It->second;
+  }
+
+  llvm::Expected<FormatStyle> FormatStyle =
+      getStyle(Style, AssumedFileName, FallbackStyle, Code, nullptr,
+               WNoErrorList.isSet(WNoError::Unknown));
+  if (!FormatStyle)
+    return FormatStyle.takeError();
+  applyStyleOverrides(*FormatStyle);
+
+  CachedStyle Result;
+  Result.Style = std::move(*FormatStyle);
+  if (Cache) {
+    llvm::BLAKE3 Hasher;
+    Hasher.update(getClangToolFullVersion("clang-format"));
+    Hasher.update(configurationAsText(Result.Style));
+    auto Digest = Hasher.final();
+    Result.Digest.assign(Digest.begin(), Digest.end());
+  }
+
+  std::lock_guard<std::mutex> Guard(StyleCacheLock);
+  return &StyleCache.try_emplace(Key, std::move(Result)).first->second;
+}
+
+// Returns the key of the contents of a file in the cache of correctly
+// formatted files.
+static std::string getCacheKey(const CachedStyle &S, StringRef FileName,
+                               StringRef Code) {
+  llvm::BLAKE3 Hasher;
+  Hasher.update(S.Digest);
+  // The name of a file decides which of its #includes is its main header,
+  // which include sorting keeps first.
+  SmallString<64> Name(sys::path::filename(FileName));
+  Name.push_back('\0');
+  Hasher.update(Name);
+  Hasher.update(Code);
+  return toHex(Hasher.final<16>(), /*LowerCase=*/true);
+}
+
 // Returns true on error.
-static bool format(StringRef FileName, bool ErrorOnIncompleteFormat = false) {
+static bool format(StringRef FileName, bool ErrorOnIncompleteFormat = false,
+                   raw_ostream &ErrOS = llvm::errs()) {
   const bool IsSTDIN = FileName == "-";
   if (!OutputXML && Inplace && IsSTDIN) {
-    errs() << "error: cannot use -i when reading from stdin.\n";
+    ErrOS << "error: cannot use -i when reading from stdin.\n";
     return false;
   }
   // On Windows, overwriting a file with an open file mapping doesn't work,
@@ -417,7 +596,7 @@ static bool format(StringRef FileName, bool ErrorOnIncompleteFormat = false) {
           ? MemoryBuffer::getFileAsStream(FileName)
           : MemoryBuffer::getFileOrSTDIN(FileName, /*IsText=*/true);
   if (std::error_code EC = CodeOrErr.getError()) {
-    errs() << EC.message() << "\n";
+    ErrOS << EC.message() << "\n";
     return true;
   }
   std::unique_ptr<llvm::MemoryBuffer> Code = std::move(CodeOrErr.get());
@@ -429,11 +608,11 @@ static bool format(StringRef FileName, bool ErrorOnIncompleteFormat = false) {
   const char *InvalidBOM = SrcMgr::ContentCache::getInvalidBOM(BufStr);
 
   if (InvalidBOM) {
-    errs() << "error: encoding with unsupported byte order mark \""
-           << InvalidBOM << "\" detected";
+    ErrOS << "error: encoding with unsupported byte order mark \""
+          << InvalidBOM << "\" detected";
     if (!IsSTDIN)
-      errs() << " in file '" << FileName << "'";
-    errs() << ".\n";
+      ErrOS << " in file '" << FileName << "'";
+    ErrOS << ".\n";
     return true;
   }
 
@@ -442,45 +621,29 @@ static bool format(StringRef FileName, bool ErrorOnIncompleteFormat = false) {
     return true;
   StringRef AssumedFileName = IsSTDIN ? AssumeFileName : FileName;
   if (AssumedFileName.empty()) {
-    llvm::errs() << "error: empty filenames are not allowed\n";
+    ErrOS << "error: empty filenames are not allowed\n";
     return true;
   }
 
-  llvm::Expected<FormatStyle> FormatStyle =
-      getStyle(Style, AssumedFileName, FallbackStyle, Code->getBuffer(),
-               nullptr, WNoErrorList.isSet(WNoError::Unknown));
-  if (!FormatStyle) {
-    llvm::errs() << llvm::toString(FormatStyle.takeError()) << "\n";
+  llvm::Expected<const CachedStyle *> StyleOrErr =
+      getCachedStyle(AssumedFileName, Code->getBuffer());
+  if (!StyleOrErr) {
+    ErrOS << llvm::toString(StyleOrErr.takeError()) << "\n";
     return true;
   }
-
-  StringRef QualifierAlignmentOrder = QualifierAlignment;
-
-  FormatStyle->QualifierAlignment =
-      StringSwitch<FormatStyle::QualifierAlignmentStyle>(
-          QualifierAlignmentOrder.lower())
-          .Case("right", FormatStyle::QAS_Right)
-          .Case("left", FormatStyle::QAS_Left)
-          .Default(FormatStyle->QualifierAlignment);
-
-  if (FormatStyle->QualifierAlignment == FormatStyle::QAS_Left) {
-    FormatStyle->QualifierOrder = {"const", "volatile", "type"};
-  } else if (FormatStyle->QualifierAlignment == FormatStyle::QAS_Right) {
-    FormatStyle->QualifierOrder = {"type", "const", "volatile"};
-  } else if (QualifierAlignmentOrder.contains("type")) {
-    FormatStyle->QualifierAlignment = FormatStyle::QAS_Custom;
-    SmallVector<StringRef> Qualifiers;
-    QualifierAlignmentOrder.split(Qualifiers, " ", /*MaxSplit=*/-1,
-                                  /*KeepEmpty=*/false);
-    FormatStyle->QualifierOrder = {Qualifiers.begin(), Qualifiers.end()};
+  const FormatStyle *FormatStyle = &(*StyleOrErr)->Style;
+
+  // Skip files whose contents are known to be formatted correctly already.
+  std::string CacheKey;
+  if (Cache) {
+    CacheKey = getCacheKey(**StyleOrErr, AssumedFileName, Code->getBuffer());
+    if (Cache->contains(CacheKey)) {
+      if (Verbose)
+        ErrOS << "Skipping " << FileName << ": formatted correctly already\n";
+      return false;
+    }
   }
 
-  if (SortIncludes.getNumOccurrences() != 0) {
-    if (SortIncludes)
-      FormatStyle->SortIncludes = FormatStyle::SI_CaseSensitive;
-    else
-      FormatStyle->SortIncludes = FormatStyle::SI_Never;
-  }
   unsigned CursorPosition = Cursor;
   Replacements Replaces = sortIncludes(*FormatStyle, Code->getBuffer(), Ranges,
                                        AssumedFileName, &CursorPosition);
@@ -491,12 +654,12 @@ static bool format(StringRef FileName, bool ErrorOnIncompleteFormat = false) {
     auto Err = Replaces.add(tooling::Replacement(
         tooling::Replacement(AssumedFileName, 0, 0, "x = ")));
     if (Err)
-      llvm::errs() << "Bad Json variable insertion\n";
+      ErrOS << "Bad Json variable insertion\n";
   }
 
   auto ChangedCode = tooling::applyAllReplacements(Code->getBuffer(), Replaces);
   if (!ChangedCode) {
-    llvm::errs() << llvm::toString(ChangedCode.takeError()) << "\n";
+    ErrOS << llvm::toString(ChangedCode.takeError()) << "\n";
     return true;
   }
   // Get new affected ranges after sorting `#includes`.
@@ -505,9 +668,11 @@ static bool format(StringRef FileName, bool ErrorOnIncompleteFormat = false) {
   Replacements FormatChanges =
       reformat(*FormatStyle, *ChangedCode, Ranges, AssumedFileName, &Status);
   Replaces = Replaces.merge(FormatChanges);
+  if (Cache && Replaces.empty() && Status.FormatComplete)
+    Cache->insert(CacheKey);
   if (OutputXML || DryRun) {
     if (DryRun)
-      return emitReplacementWarnings(Replaces, AssumedFileName, Code);
+      return emitReplacementWarnings(Replaces, AssumedFileName, Code, ErrOS);
     else
       outputXML(Replaces, FormatChanges, Status, Cursor, CursorPosition);
   } else {
@@ -714,16 +879,67 @@ int main(int argc, const char **argv) {
     return 1;
   }
 
+  // Results are only written to files or reported as warnings by -i and
+  // --dry-run, so only those can handle several files at once.
+  const bool WritesToStdout = OutputXML || (!Inplace && !DryRun);
+  if (NumThreads != 1 && WritesToStdout) {
+    errs() << "error: -j can only be used with -i or --dry-run.\n";
+    return 1;
+  }
+  if (!CacheFile.empty()) {
+    if (WritesToStdout || !Offsets.empty() || !Lengths.empty() ||
+        !LineRanges.empty() || Cursor.getNumOccurrences() != 0) {
+      errs() << "error: -cache can only be used with -i or --dry-run on "
+                "whole files.\n";
+      return 1;
+    }
+    clang::format::Cache = std::make_unique<clang::format::CleanFileCache>();
+    if (clang::format::Cache->load(CacheFile))
+      return 1;
+  }
+
   unsigned FileNo = 1;
   bool Error = false;
-  for (const auto &FileName : FileNames) {
-    if (isIgnored(FileName))
-      continue;
-    if (Verbose) {
-      errs() << "Formatting [" << FileNo++ << "/" << FileNames.size() << "] "
-             << FileName << "\n";
+  if (NumThreads == 1) {
+    for (const auto &FileName : FileNames) {
+      if (isIgnored(FileName))
+        continue;
+      if (Verbose) {
+        errs() << "Formatting [" << FileNo++ << "/" << FileNames.size()
+               << "] " << FileName << "\n";
+      }
+      Error |= clang::format::format(FileName, FailOnIncompleteFormat);
     }
-    Error |= clang::format::format(FileName, FailOnIncompleteFormat);
+  } else {
+    // Each file reports its diagnostics at once so that the diagnostics of
+    // files formatted concurrently do not interleave.
+    std::mutex OutputLock;
+    DefaultThreadPool Pool(hardware_concurrency(NumThreads));
+    for (const auto &FileName : FileNames) {
+      // isIgnored() caches the patterns of the last directory, so it runs on
+      // this thread only.
+      if (isIgnored(FileName))
+        continue;
+      if (Verbose) {
+        errs() << "Formatting [" << FileNo++ << "/" << FileNames.size()
+               << "] " << FileName << "\n";
+      }
+      Pool.async([&, FileName = StringRef(FileName)] {
+        std::string Diagnostics;
+        raw_string_ostream OS(Diagnostics);
+        OS.enable_colors(errs().has_colors());
+        bool Failed =
+            clang::format::format(FileName, FailOnIncompleteFormat, OS);
+        OS.flush();
+        std::lock_guard<std::mutex> Guard(OutputLock);
+        errs() << Diagnostics;
+        Error |= Failed;
+      });
+    }
+    Pool.wait();
   }
+
+  if (clang::format::Cache && clang::format::Cache->save(CacheFile))
+    Error = true;
   return Error ? 1 : 0;
 }
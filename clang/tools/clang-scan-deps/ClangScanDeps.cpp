@@ -11,6 +11,7 @@
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/TextDiagnosticPrinter.h"
 #include "clang/Tooling/CommonOptionsParser.h"
+#include "clang/Tooling/DependencyScanning/DependencyDirectivesCache.h"
 #include "clang/Tooling/DependencyScanning/DependencyScanningService.h"
 #include "clang/Tooling/DependencyScanning/DependencyScanningTool.h"
 #include "clang/Tooling/DependencyScanning/DependencyScanningWorker.h"
@@ -78,6 +79,7 @@ static ScanningOutputFormat Format = ScanningOutputFormat::Make;
 static ScanningOptimizations OptimizeArgs;
 static std::string ModuleFilesDir;
 static bool EagerLoadModules;
+static std::string DirectivesCachePath;
 static unsigned NumThreads = 0;
 static std::string CompilationDB;
 static std::string ModuleName;
@@ -181,6 +183,9 @@ static void ParseArgs(int argc, char **argv) {
 
   EagerLoadModules = Args.hasArg(OPT_eager_load_pcm);
 
+  if (const llvm::opt::Arg *A = Args.getLastArg(OPT_directives_cache_path_EQ))
+    DirectivesCachePath = A->getValue();
+
   if (const llvm::opt::Arg *A = Args.getLastArg(OPT_j)) {
     StringRef S{A->getValue()};
     if (!llvm::to_integer(S, NumThreads, 0)) {
@@ -985,6 +990,16 @@ int clang_scan_deps_main(int argc, char **argv, const llvm::ToolContext &) {
 
   DependencyScanningService Service(ScanMode, Format, OptimizeArgs,
                                     EagerLoadModules);
+  if (!DirectivesCachePath.empty()) {
+    llvm::Expected<std::unique_ptr<DependencyDirectivesCache>> CacheOrErr =
+        DependencyDirectivesCache::create(DirectivesCachePath);
+    if (!CacheOrErr) {
+      llvm::errs() << "error: cannot open the directives cache: "
+                   << llvm::toString(CacheOrErr.takeError()) << '\n';
+      return 1;
+    }
+    Service.getSharedCache().setDirectivesCache(std::move(*CacheOrErr));
+  }
 
   llvm::Timer T;
   T.startTimer();
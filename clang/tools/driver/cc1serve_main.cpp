@@ -0,0 +1,555 @@
+//===-- cc1serve_main.cpp - Clang compile server --------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This is the entry point to the clang -cc1serve functionality, a server that
+// runs the -cc1 jobs of other clang invocations, and the client those use to
+// hand their jobs to it. The server is started with
+//
+//   clang -cc1serve [-j N] [-v] <socket>
+//
+// and used by any clang run with CLANG_COMPILE_SERVER=<socket> in its
+// environment. Its worker processes live across jobs, so each keeps the file
+// contents, failed header lookups and module files of the jobs it ran for the
+// next one, after checking that they are still current. What a job writes to
+// stdout and stderr is sent back to the client. A job the server cannot run
+// exactly as -cc1 would, such as one that reads from stdin, is run by the
+// invoking clang as usual, as is every job while no server is running. Only
+// processes of the user who started the server can use it.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/DiagnosticOptions.h"
+#include "clang/Basic/LLVM.h"
+#include "clang/CodeGen/ObjectFilePCHContainerOperations.h"
+#include "clang/Frontend/CompileServerFileCache.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Frontend/TextDiagnosticBuffer.h"
+#include "clang/Frontend/TextDiagnosticPrinter.h"
+#include "clang/FrontendTool/Utils.h"
+#include "clang/Serialization/InMemoryModuleCache.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/raw_socket_stream.h"
+#include <atomic>
+#include <chrono>
+#include <optional>
+
+#ifdef LLVM_ON_UNIX
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace clang;
+
+#ifdef LLVM_ON_UNIX
+namespace {
+
+/// What a worker keeps between the jobs it runs.
+struct WorkerState {
+  std::string Executable;
+  CompileServerFileCache Files;
+  IntrusiveRefCntPtr<InMemoryModuleCache> ModuleCache =
+      llvm::makeIntrusiveRefCnt<InMemoryModuleCache>();
+  /// The size and modification time of each PCM file in the module cache,
+  /// from the end of the first job that used it.
+  llvm::StringMap<std::pair<uint64_t, llvm::sys::TimePoint<>>> PCMStamps;
+  /// Whether to log each job to stderr.
+  bool Verbose = false;
+
+  /// Drops the module files that changed on disk, and those that the last
+  /// job read but did not use.
+  void pruneModuleCache();
+};
+
+/// Sends what is written to a file descriptor of the worker, such as stdout,
+/// to a temporary file instead while a job runs.
+class CapturedStream {
+  int StreamFD;
+  int SavedFD = -1;
+  int FileFD = -1;
+
+public:
+  CapturedStream(int StreamFD) : StreamFD(StreamFD) {}
+
+  /// Starts capturing. Returns false if the stream cannot be captured.
+  bool start();
+
+  /// Stops capturing and appends what was written to \p Captured.
+  void stop(std::string &Captured);
+};
+
+} // namespace
+
+bool CapturedStream::start() {
+  SmallString<128> Path;
+  if (llvm::sys::fs::createTemporaryFile("cc1serve", "out", FileFD, Path))
+    return false;
+  llvm::sys::fs::remove(Path);
+  SavedFD = ::dup(StreamFD);
+  if (SavedFD != -1 && ::dup2(FileFD, StreamFD) != -1)
+    return true;
+  if (SavedFD != -1)
+    ::close(SavedFD);
+  ::close(FileFD);
+  return false;
+}
+
+void CapturedStream::stop(std::string &Captured) {
+  ::dup2(SavedFD, StreamFD);
+  ::close(SavedFD);
+  char Buffer[4096];
+  ssize_t N;
+  ::lseek(FileFD, 0, SEEK_SET);
+  while ((N = ::read(FileFD, Buffer, sizeof(Buffer))) != 0) {
+    if (N > 0)
+      Captured.append(Buffer, N);
+    else if (errno != EINTR)
+      break;
+  }
+  ::close(FileFD);
+}
+
+/// Flushes everything buffered for stdout and stderr.
+static void flushStdStreams() {
+  llvm::outs().flush();
+  llvm::errs().flush();
+  std::fflush(stdout);
+  std::fflush(stderr);
+}
+
+void WorkerState::pruneModuleCache() {
+  ModuleCache->pruneForReuse(
+      [&](StringRef Filename, const llvm::MemoryBuffer &Buffer) {
+        llvm::sys::fs::file_status Status;
+        if (llvm::sys::fs::status(Filename, Status)) {
+          PCMStamps.erase(Filename);
+          return true;
+        }
+        std::pair<uint64_t, llvm::sys::TimePoint<>> Stamp(
+            Status.getSize(), Status.getLastModificationTime());
+        auto [It, Inserted] = PCMStamps.try_emplace(Filename, Stamp);
+        if (Inserted ? Stamp.first == Buffer.getBufferSize()
+                     : Stamp == It->second)
+          return false;
+        PCMStamps.erase(It);
+        return true;
+      });
+}
+
+/// Returns why \p Clang cannot run on a server, or an empty string if it can.
+static StringRef getReasonToRunLocally(CompilerInstance &Clang) {
+  const FrontendOptions &FrontendOpts = Clang.getFrontendOpts();
+  // Options that change the state of the process for later jobs.
+  if (!FrontendOpts.LLVMArgs.empty() || !FrontendOpts.Plugins.empty() ||
+      !Clang.getCodeGenOpts().PassPlugins.empty())
+    return "changes global state";
+  // Options that cc1_main handles itself, or whose output is printed when the
+  // process exits rather than when the job ends.
+  if (FrontendOpts.ShowStats || FrontendOpts.PrintSupportedCPUs ||
+      FrontendOpts.PrintSupportedExtensions ||
+      !FrontendOpts.TimeTracePath.empty() || Clang.getCodeGenOpts().TimePasses)
+    return "needs a -cc1 process";
+  for (const FrontendInputFile &Input : FrontendOpts.Inputs)
+    if (Input.isFile() && Input.getFile() == "-")
+      return "reads from stdin";
+  return "";
+}
+
+/// Runs the -cc1 job \p Argv as cc1_main would, writing its diagnostics to
+/// \p DiagOS. Returns nothing, and sets \p Reason, if the job has to be run
+/// by the client instead.
+static std::optional<int> runJob(ArrayRef<const char *> Argv,
+                                 const char *Argv0, void *MainAddr,
+                                 WorkerState &State, raw_ostream &DiagOS,
+                                 StringRef &Reason) {
+  auto Clang = std::make_unique<CompilerInstance>(
+      std::make_shared<PCHContainerOperations>(), State.ModuleCache.get());
+  auto PCHOps = Clang->getPCHContainerOperations();
+  PCHOps->registerWriter(std::make_unique<ObjectFilePCHContainerWriter>());
+  PCHOps->registerReader(std::make_unique<ObjectFilePCHContainerReader>());
+
+  IntrusiveRefCntPtr<DiagnosticIDs> DiagID(new DiagnosticIDs());
+  IntrusiveRefCntPtr<DiagnosticOptions> DiagOpts = new DiagnosticOptions();
+  TextDiagnosticBuffer *DiagsBuffer = new TextDiagnosticBuffer;
+  DiagnosticsEngine Diags(DiagID, &*DiagOpts, DiagsBuffer);
+  bool Success = CompilerInvocation::CreateFromArgs(Clang->getInvocation(),
+                                                    Argv, Diags, Argv0);
+  if (Success) {
+    Reason = getReasonToRunLocally(*Clang);
+    if (!Reason.empty())
+      return std::nullopt;
+  }
+
+  if (Clang->getHeaderSearchOpts().UseBuiltinIncludes &&
+      Clang->getHeaderSearchOpts().ResourceDir.empty())
+    Clang->getHeaderSearchOpts().ResourceDir =
+        CompilerInvocation::GetResourcesPath(Argv0, MainAddr);
+  // The worker goes on to run other jobs, so everything must be freed.
+  Clang->getFrontendOpts().DisableFree = false;
+
+  DiagOS.enable_colors(Clang->getDiagnosticOpts().ShowColors);
+  Clang->createDiagnostics(
+      new TextDiagnosticPrinter(DiagOS, &Clang->getDiagnosticOpts()));
+  DiagsBuffer->FlushDiagnostics(Clang->getDiagnostics());
+  if (!Success) {
+    Clang->getDiagnosticClient().finish();
+    return 1;
+  }
+
+  // A directory is only stat'ed once per job, so lookups in those the job
+  // writes to must not be answered from the cache.
+  std::vector<std::string> WrittenDirs;
+  if (!Clang->getHeaderSearchOpts().ModuleCachePath.empty())
+    WrittenDirs.push_back(Clang->getHeaderSearchOpts().ModuleCachePath);
+  for (StringRef Output : {StringRef(Clang->getFrontendOpts().OutputFile),
+                           StringRef(Clang->getDependencyOutputOpts()
+                                         .OutputFile)}) {
+    StringRef Dir = llvm::sys::path::parent_path(Output);
+    if (!Output.empty())
+      WrittenDirs.push_back(Dir.empty() ? "." : Dir.str());
+  }
+  Clang->createFileManager(createVFSFromCompilerInvocation(
+      Clang->getInvocation(), Clang->getDiagnostics(),
+      State.Files.createFileSystem(llvm::vfs::getRealFileSystem(),
+                                   WrittenDirs)));
+
+  Success = ExecuteCompilerInvocation(Clang.get());
+  Clang.reset();
+  State.pruneModuleCache();
+  return !Success;
+}
+
+/// Reads a request line from \p Connection.
+static bool readRequest(llvm::raw_socket_stream &Connection,
+                        std::string &Line) {
+  char Buffer[4096];
+  while (Line.size() < (64 << 20)) {
+    ssize_t N = Connection.read(Buffer, sizeof(Buffer));
+    if (N <= 0)
+      return false;
+    StringRef Data(Buffer, N);
+    size_t End = Data.find('\n');
+    Line += Data.take_front(End);
+    if (End != StringRef::npos)
+      return true;
+  }
+  return false;
+}
+
+/// Runs the job sent on \p Connection. The request is a line holding a JSON
+/// object with the fields "clang", the path of the client's executable, "cwd"
+/// and "args", the arguments of the job starting with -cc1. The response is
+/// a line holding a JSON object with either "status", "stdout" and "stderr",
+/// in which case the line is followed by as many bytes as the latter two give
+/// of what the job wrote to stdout and to stderr, or "local", the reason the
+/// job has to be run by the client.
+static void serveJob(llvm::raw_socket_stream &Connection, WorkerState &State,
+                     const char *Argv0, void *MainAddr) {
+  std::vector<const char *> Argv;
+  auto RunLocally = [&](StringRef Reason) {
+    if (State.Verbose) {
+      llvm::errs() << "cc1serve: running locally (" << Reason << "):";
+      for (const char *Arg : Argv)
+        llvm::errs() << ' ' << Arg;
+      llvm::errs() << '\n';
+    }
+    Connection << llvm::json::Value(llvm::json::Object{{"local", Reason}})
+               << '\n';
+  };
+
+  std::string Line;
+  if (!readRequest(Connection, Line))
+    return;
+  llvm::Expected<llvm::json::Value> RequestOrErr = llvm::json::parse(Line);
+  if (!RequestOrErr) {
+    RunLocally(toString(RequestOrErr.takeError()));
+    return;
+  }
+  const llvm::json::Object *Request = RequestOrErr->getAsObject();
+  std::optional<StringRef> Executable =
+      Request ? Request->getString("clang") : std::nullopt;
+  std::optional<StringRef> Cwd =
+      Request ? Request->getString("cwd") : std::nullopt;
+  const llvm::json::Array *Args = Request ? Request->getArray("args") : nullptr;
+  if (!Executable || !Cwd || !Args || Args->empty()) {
+    RunLocally("malformed request");
+    return;
+  }
+  if (*Executable != State.Executable) {
+    RunLocally("the server runs a different clang");
+    return;
+  }
+  if (llvm::sys::fs::set_current_path(*Cwd)) {
+    RunLocally("cannot change to the working directory");
+    return;
+  }
+  for (const llvm::json::Value &Arg : *Args) {
+    std::optional<StringRef> Str = Arg.getAsString();
+    if (!Str) {
+      RunLocally("malformed request");
+      return;
+    }
+    Argv.push_back(Str->data());
+  }
+
+  // Diagnostics go to stderr, after anything the job writes there directly.
+  std::string Output, Errors;
+  CapturedStream Stdout(STDOUT_FILENO), Stderr(STDERR_FILENO);
+  flushStdStreams();
+  if (!Stdout.start()) {
+    RunLocally("cannot capture stdout");
+    return;
+  }
+  if (!Stderr.start()) {
+    Stdout.stop(Output);
+    RunLocally("cannot capture stderr");
+    return;
+  }
+  std::string Diagnostics;
+  llvm::raw_string_ostream DiagOS(Diagnostics);
+  StringRef Reason;
+  std::optional<int> Status =
+      runJob(Argv, Argv0, MainAddr, State, DiagOS, Reason);
+  flushStdStreams();
+  Stderr.stop(Errors);
+  Stdout.stop(Output);
+  if (!Status) {
+    RunLocally(Reason);
+    return;
+  }
+  Errors += Diagnostics;
+  if (State.Verbose) {
+    llvm::errs() << "cc1serve: ran:";
+    for (const char *Arg : Argv)
+      llvm::errs() << ' ' << Arg;
+    llvm::errs() << '\n';
+  }
+  Connection << llvm::json::Value(llvm::json::Object{
+                    {"status", *Status},
+                    {"stdout", int64_t(Output.size())},
+                    {"stderr", int64_t(Errors.size())}})
+             << '\n'
+             << Output << Errors;
+}
+
+/// Serves jobs until \p KeepServing returns false or the socket is closed.
+static int serveJobs(llvm::ListeningSocket &Socket, const char *Argv0,
+                     void *MainAddr, bool Verbose,
+                     llvm::function_ref<bool()> KeepServing) {
+  WorkerState State;
+  State.Verbose = Verbose;
+  State.Executable = llvm::sys::fs::getMainExecutable(Argv0, MainAddr);
+  for (;;) {
+    llvm::Expected<std::unique_ptr<llvm::raw_socket_stream>> ConnectionOrErr =
+        Socket.accept(std::chrono::seconds(1));
+    if (!ConnectionOrErr) {
+      std::error_code EC = llvm::errorToErrorCode(ConnectionOrErr.takeError());
+      if (EC == std::errc::timed_out && KeepServing())
+        continue;
+      return 0;
+    }
+    llvm::raw_socket_stream &Connection = **ConnectionOrErr;
+    // Only the user who started the server may run jobs on it.
+    if (!Connection.isPeerSameUser())
+      continue;
+    serveJob(Connection, State, Argv0, MainAddr);
+    // The client may have gone away; it runs the job itself if so.
+    Connection.flush();
+    Connection.clear_error();
+  }
+}
+
+static constexpr unsigned MaxWorkers = 256;
+/// The worker processes, so that they stop with the server.
+static std::atomic<pid_t> Workers[MaxWorkers];
+
+static void stopWorkers() {
+  for (std::atomic<pid_t> &Pid : Workers)
+    if (pid_t P = Pid.load())
+      kill(P, SIGTERM);
+  llvm::sys::Process::Exit(1, /*NoCleanup=*/true);
+}
+#endif // LLVM_ON_UNIX
+
+int cc1serve_main(ArrayRef<const char *> Argv, const char *Argv0,
+                  void *MainAddr) {
+#ifndef LLVM_ON_UNIX
+  llvm::errs() << "error: -cc1serve is not supported on this platform\n";
+  return 1;
+#else
+  unsigned NumWorkers = 0;
+  bool Verbose = false;
+  StringRef SocketPath;
+  for (size_t I = 0; I != Argv.size(); ++I) {
+    StringRef Arg = Argv[I];
+    if (Arg == "-j" && I + 1 != Argv.size()) {
+      if (!llvm::to_integer(Argv[++I], NumWorkers) || NumWorkers == 0) {
+        llvm::errs() << "error: invalid number of workers '" << Argv[I]
+                     << "'\n";
+        return 1;
+      }
+    } else if (Arg == "-v") {
+      Verbose = true;
+    } else if (SocketPath.empty() && !Arg.starts_with("-")) {
+      SocketPath = Arg;
+    } else {
+      llvm::errs() << "error: unknown argument '" << Arg << "'\n";
+      return 1;
+    }
+  }
+  if (SocketPath.empty()) {
+    llvm::errs() << "usage: clang -cc1serve [-j N] [-v] <socket>\n";
+    return 1;
+  }
+
+  llvm::InitializeAllTargets();
+  llvm::InitializeAllTargetMCs();
+  llvm::InitializeAllAsmPrinters();
+  llvm::InitializeAllAsmParsers();
+
+  // Only the user who started the server may connect to it.
+  mode_t OldMask = ::umask(0077);
+  llvm::Expected<llvm::ListeningSocket> SocketOrErr =
+      llvm::ListeningSocket::createUnix(SocketPath);
+  ::umask(OldMask);
+  if (!SocketOrErr) {
+    llvm::errs() << "error: cannot listen on '" << SocketPath
+                 << "': " << toString(SocketOrErr.takeError()) << '\n';
+    return 1;
+  }
+  llvm::sys::RemoveFileOnSignal(SocketPath);
+
+  // Run the jobs in worker processes, as a job changes the state of the
+  // process it runs in and may crash it. Each worker keeps its own caches.
+  if (NumWorkers == 0)
+    NumWorkers = llvm::hardware_concurrency().compute_thread_count();
+  NumWorkers = std::min(NumWorkers, MaxWorkers);
+  llvm::sys::SetInterruptFunction(stopWorkers);
+  pid_t Server = getpid();
+  auto StartWorker = [&](unsigned I) {
+    pid_t Pid = fork();
+    if (Pid == 0) {
+      llvm::sys::SetInterruptFunction(nullptr);
+      llvm::sys::DontRemoveFileOnSignal(SocketPath);
+      // Write errors for clients that went away are ignored.
+      ::signal(SIGPIPE, SIG_IGN);
+      llvm::sys::Process::Exit(
+          serveJobs(*SocketOrErr, Argv0, MainAddr, Verbose,
+                    [&] { return getppid() == Server; }),
+          /*NoCleanup=*/true);
+    }
+    Workers[I] = Pid > 0 ? Pid : 0;
+  };
+  for (unsigned I = 0; I != NumWorkers; ++I)
+    StartWorker(I);
+
+  // Replace workers that crashed. A worker that exits normally has found
+  // that the socket can no longer be used.
+  for (;;) {
+    int Status;
+    pid_t Pid = waitpid(-1, &Status, 0);
+    if (Pid == -1) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    for (unsigned I = 0; I != NumWorkers; ++I) {
+      if (Workers[I] != Pid)
+        continue;
+      Workers[I] = 0;
+      if (!WIFEXITED(Status) || WEXITSTATUS(Status) != 0)
+        StartWorker(I);
+    }
+  }
+  llvm::sys::SetInterruptFunction(nullptr);
+  return 0;
+#endif
+}
+
+std::optional<int> cc1serve_client(ArrayRef<const char *> Argv,
+                                   const char *Argv0, void *MainAddr,
+                                   StringRef SocketPath) {
+#ifndef LLVM_ON_UNIX
+  return std::nullopt;
+#else
+  SmallString<256> Cwd;
+  if (llvm::sys::fs::current_path(Cwd) || !llvm::json::isUTF8(Cwd))
+    return std::nullopt;
+  llvm::json::Array Args;
+  for (const char *Arg : Argv) {
+    if (!llvm::json::isUTF8(Arg))
+      return std::nullopt;
+    Args.push_back(Arg);
+  }
+  std::string Executable = llvm::sys::fs::getMainExecutable(Argv0, MainAddr);
+  if (!llvm::json::isUTF8(Executable))
+    return std::nullopt;
+
+  llvm::Expected<std::unique_ptr<llvm::raw_socket_stream>> SocketOrErr =
+      llvm::raw_socket_stream::createConnectedUnix(SocketPath);
+  if (!SocketOrErr) {
+    llvm::consumeError(SocketOrErr.takeError());
+    return std::nullopt;
+  }
+  llvm::raw_socket_stream &Socket = **SocketOrErr;
+  Socket << llvm::json::Value(llvm::json::Object{{"clang", Executable},
+                                                 {"cwd", Cwd},
+                                                 {"args", std::move(Args)}})
+         << '\n';
+  Socket.flush();
+  if (Socket.has_error()) {
+    Socket.clear_error();
+    return std::nullopt;
+  }
+
+  // The server closes the connection after its response.
+  std::string Response;
+  char Buffer[4096];
+  ssize_t N;
+  while ((N = Socket.read(Buffer, sizeof(Buffer))) > 0)
+    Response.append(Buffer, N);
+  if (N < 0)
+    return std::nullopt;
+  auto [Line, Output] = StringRef(Response).split('\n');
+  llvm::Expected<llvm::json::Value> ResultOrErr = llvm::json::parse(Line);
+  if (!ResultOrErr) {
+    llvm::consumeError(ResultOrErr.takeError());
+    return std::nullopt;
+  }
+  const llvm::json::Object *Result = ResultOrErr->getAsObject();
+  std::optional<int64_t> Status =
+      Result ? Result->getInteger("status") : std::nullopt;
+  std::optional<int64_t> OutSize =
+      Result ? Result->getInteger("stdout") : std::nullopt;
+  std::optional<int64_t> ErrSize =
+      Result ? Result->getInteger("stderr") : std::nullopt;
+  if (!Status || !OutSize || !ErrSize || *OutSize < 0 || *ErrSize < 0 ||
+      *OutSize + *ErrSize != int64_t(Output.size()))
+    return std::nullopt;
+  llvm::outs() << Output.take_front(*OutSize);
+  llvm::outs().flush();
+  llvm::errs() << Output.drop_front(*OutSize);
+  return *Status;
+#endif
+}
@@ -84,6 +84,11 @@ extern int cc1as_main(ArrayRef<const char *> Argv, const char *Argv0,
 extern int cc1gen_reproducer_main(ArrayRef<const char *> Argv,
                                   const char *Argv0, void *MainAddr,
                                   const llvm::ToolContext &);
+extern int cc1serve_main(ArrayRef<const char *> Argv, const char *Argv0,
+                         void *MainAddr);
+extern std::optional<int> cc1serve_client(ArrayRef<const char *> Argv,
+                                          const char *Argv0, void *MainAddr,
+                                          StringRef SocketPath);
 
 static void insertTargetAndModeArgs(const ParsedClangName &NameParts,
                                     SmallVectorImpl<const char *> &ArgVector,
@@ -211,17 +216,27 @@ static int ExecuteCC1Tool(SmallVectorImpl<const char *> &ArgV,
   }
   StringRef Tool = ArgV[1];
   void *GetExecutablePathVP = (void *)(intptr_t)GetExecutablePath;
-  if (Tool == "-cc1")
+  if (Tool == "-cc1") {
+    // Hand the job to a compile server if one is running.
+    if (std::optional<std::string> Server =
+            llvm::sys::Process::GetEnv("CLANG_COMPILE_SERVER"))
+      if (std::optional<int> Ret = cc1serve_client(
+              ArrayRef(ArgV).slice(1), ArgV[0], GetExecutablePathVP, *Server))
+        return *Ret;
     return cc1_main(ArrayRef(ArgV).slice(1), ArgV[0], GetExecutablePathVP);
+  }
   if (Tool == "-cc1as")
     return cc1as_main(ArrayRef(ArgV).slice(2), ArgV[0], GetExecutablePathVP);
   if (Tool == "-cc1gen-reproducer")
     return cc1gen_reproducer_main(ArrayRef(ArgV).slice(2), ArgV[0],
                                   GetExecutablePathVP, ToolContext);
+  if (Tool == "-cc1serve")
+    return cc1serve_main(ArrayRef(ArgV).slice(2), ArgV[0],
+                         GetExecutablePathVP);
   // Reject unknown tools.
-  llvm::errs()
-      << "error: unknown integrated tool '" << Tool << "'. "
-      << "Valid tools include '-cc1', '-cc1as' and '-cc1gen-reproducer'.\n";
+  llvm::errs() << "error: unknown integrated tool '" << Tool << "'. "
+               << "Valid tools include '-cc1', '-cc1as', "
+               << "'-cc1gen-reproducer' and '-cc1serve'.\n";
   return 1;
 }
 
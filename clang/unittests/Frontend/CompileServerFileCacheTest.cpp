@@ -0,0 +1,147 @@
+//===- unittests/Frontend/CompileServerFileCacheTest.cpp ------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Frontend/CompileServerFileCache.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+#include <chrono>
+
+using namespace llvm;
+using namespace clang;
+
+namespace {
+
+// Counts the lookups that reach the real file system.
+class CountingFileSystem : public vfs::ProxyFileSystem {
+public:
+  StringMap<unsigned> Stats, Opens;
+
+  CountingFileSystem() : ProxyFileSystem(vfs::getRealFileSystem()) {}
+
+  ErrorOr<vfs::Status> status(const Twine &Path) override {
+    ++Stats[Path.str()];
+    return ProxyFileSystem::status(Path);
+  }
+
+  ErrorOr<std::unique_ptr<vfs::File>>
+  openFileForRead(const Twine &Path) override {
+    ++Opens[Path.str()];
+    return ProxyFileSystem::openFileForRead(Path);
+  }
+};
+
+class CompileServerFileCacheTest : public ::testing::Test {
+protected:
+  SmallString<128> Dir;
+  IntrusiveRefCntPtr<CountingFileSystem> Counts =
+      makeIntrusiveRefCnt<CountingFileSystem>();
+  CompileServerFileCache Cache;
+
+  void SetUp() override {
+    ASSERT_FALSE(sys::fs::createUniqueDirectory("compile-server", Dir));
+    ASSERT_FALSE(sys::fs::real_path(Dir, Dir));
+  }
+
+  void TearDown() override { sys::fs::remove_directories(Dir); }
+
+  std::string path(StringRef Name) {
+    SmallString<128> Path(Dir);
+    sys::path::append(Path, Name);
+    return std::string(Path);
+  }
+
+  // Sets the modification time of a file or directory to Age before now.
+  void age(StringRef Path, std::chrono::seconds Age) {
+    int FD;
+    ASSERT_FALSE(sys::fs::openFileForRead(Path, FD));
+    EXPECT_FALSE(sys::fs::setLastAccessAndModificationTime(
+        FD, std::chrono::system_clock::now() - Age));
+    sys::fs::closeFile(FD);
+  }
+
+  void write(StringRef Name, StringRef Contents) {
+    std::error_code EC;
+    raw_fd_ostream OS(path(Name), EC);
+    ASSERT_FALSE(EC);
+    OS << Contents;
+  }
+
+  std::string read(StringRef Name) {
+    IntrusiveRefCntPtr<vfs::FileSystem> FS = Cache.createFileSystem(Counts);
+    auto F = FS->openFileForRead(path(Name));
+    if (!F)
+      return "<missing>";
+    auto Buffer = (*F)->getBuffer(path(Name));
+    return Buffer ? (*Buffer)->getBuffer().str() : "<error>";
+  }
+};
+
+TEST_F(CompileServerFileCacheTest, ReusesContents) {
+  write("a.h", "int a;");
+  age(path("a.h"), std::chrono::hours(1));
+  EXPECT_EQ("int a;", read("a.h"));
+  EXPECT_EQ("int a;", read("a.h"));
+  EXPECT_EQ(1u, Counts->Opens[path("a.h")]);
+  EXPECT_EQ(1u, Cache.getNumFiles());
+
+  // A change that keeps the size is seen through the modification time.
+  write("a.h", "int b;");
+  age(path("a.h"), std::chrono::minutes(30));
+  EXPECT_EQ("int b;", read("a.h"));
+  EXPECT_EQ(2u, Counts->Opens[path("a.h")]);
+}
+
+TEST_F(CompileServerFileCacheTest, IgnoresRecentFiles) {
+  write("a.h", "int a;");
+  EXPECT_EQ("int a;", read("a.h"));
+  EXPECT_EQ("int a;", read("a.h"));
+  EXPECT_EQ(2u, Counts->Opens[path("a.h")]);
+  EXPECT_EQ(0u, Cache.getNumFiles());
+}
+
+TEST_F(CompileServerFileCacheTest, RemembersMissingFiles) {
+  ASSERT_FALSE(sys::fs::create_directory(path("inc")));
+  age(path("inc"), std::chrono::hours(1));
+  for (unsigned Job = 0; Job != 2; ++Job) {
+    IntrusiveRefCntPtr<vfs::FileSystem> FS = Cache.createFileSystem(Counts);
+    EXPECT_FALSE(FS->status(path("inc/x.h")));
+    EXPECT_FALSE(FS->exists(path("inc/y.h")));
+    EXPECT_EQ("<missing>", read("inc/x.h"));
+  }
+  EXPECT_EQ(1u, Counts->Stats[path("inc/x.h")]);
+  EXPECT_EQ(1u, Counts->Stats[path("inc/y.h")]);
+  EXPECT_EQ(0u, Counts->Opens[path("inc/x.h")]);
+  EXPECT_EQ(2u, Cache.getNumMissing());
+
+  // Creating the file changes the directory.
+  write("inc/x.h", "int x;");
+  IntrusiveRefCntPtr<vfs::FileSystem> FS = Cache.createFileSystem(Counts);
+  EXPECT_TRUE(FS->status(path("inc/x.h")));
+  EXPECT_FALSE(FS->status(path("inc/y.h")));
+  EXPECT_EQ("int x;", read("inc/x.h"));
+}
+
+TEST_F(CompileServerFileCacheTest, IgnoresWrittenDirs) {
+  ASSERT_FALSE(sys::fs::create_directories(path("out/sub")));
+  age(path("out/sub"), std::chrono::hours(1));
+  for (unsigned Job = 0; Job != 2; ++Job) {
+    IntrusiveRefCntPtr<vfs::FileSystem> FS =
+        Cache.createFileSystem(Counts, {path("out")});
+    EXPECT_FALSE(FS->status(path("out/sub/x.pcm")));
+  }
+  EXPECT_EQ(2u, Counts->Stats[path("out/sub/x.pcm")]);
+  EXPECT_EQ(0u, Cache.getNumMissing());
+}
+
+} // namespace
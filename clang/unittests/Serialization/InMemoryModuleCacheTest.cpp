@@ -7,6 +7,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "clang/Serialization/InMemoryModuleCache.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "gtest/gtest.h"
 
@@ -116,4 +117,35 @@ TEST(InMemoryModuleCacheTest, finalizePCM) {
   EXPECT_TRUE(Cache.isPCMFinal("B"));
 }
 
+TEST(InMemoryModuleCacheTest, pruneForReuse) {
+  InMemoryModuleCache Cache;
+  Cache.addPCM("Tentative", getBuffer(1));
+  Cache.addPCM("ToBuild", getBuffer(2));
+  Cache.tryToDropPCM("ToBuild");
+  Cache.addPCM("Final", getBuffer(3));
+  Cache.finalizePCM("Final");
+  Cache.addBuiltPCM("Built", getBuffer(4));
+  Cache.addBuiltPCM("Stale", getBuffer(5));
+
+  std::vector<std::string> Checked;
+  MemoryBuffer *RawStale = Cache.lookupPCM("Stale");
+  Cache.pruneForReuse([&](StringRef Filename, const MemoryBuffer &Buffer) {
+    Checked.push_back(Filename.str());
+    return &Buffer == RawStale;
+  });
+  llvm::sort(Checked);
+  EXPECT_EQ((std::vector<std::string>{"Built", "Final", "Stale"}), Checked);
+
+  EXPECT_EQ(InMemoryModuleCache::Unknown, Cache.getPCMState("Tentative"));
+  EXPECT_EQ(InMemoryModuleCache::Unknown, Cache.getPCMState("ToBuild"));
+  EXPECT_EQ(InMemoryModuleCache::Final, Cache.getPCMState("Final"));
+  EXPECT_EQ(InMemoryModuleCache::Final, Cache.getPCMState("Built"));
+  EXPECT_EQ(InMemoryModuleCache::Unknown, Cache.getPCMState("Stale"));
+
+  // A later compilation may read or build the dropped PCMs again.
+  Cache.addPCM("Tentative", getBuffer(6));
+  Cache.addBuiltPCM("Stale", getBuffer(7));
+  EXPECT_TRUE(Cache.isPCMFinal("Stale"));
+}
+
 } // namespace
@@ -0,0 +1,100 @@
+//===- DependencyDirectivesCacheTest.cpp ----------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Tooling/DependencyScanning/DependencyDirectivesCache.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Testing/Support/Error.h"
+#include "gtest/gtest.h"
+
+using namespace clang;
+using namespace clang::tooling::dependencies;
+using namespace clang::dependency_directives_scan;
+
+namespace {
+
+class DependencyDirectivesCacheTest : public ::testing::Test {
+protected:
+  llvm::SmallString<128> Dir;
+
+  void SetUp() override {
+    ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("directives-cache", Dir));
+  }
+
+  void TearDown() override { llvm::sys::fs::remove_directories(Dir); }
+
+  bool isEmpty() {
+    std::error_code EC;
+    return llvm::sys::fs::directory_iterator(Dir, EC) ==
+           llvm::sys::fs::directory_iterator();
+  }
+
+  // Scans Source, with Cache if given, and prints the directives back as
+  // source.
+  static std::string scan(DependencyDirectivesCache *Cache, StringRef Source,
+                          bool &Failed) {
+    SmallVector<Token> Tokens;
+    SmallVector<Directive> Directives;
+    Failed = Cache ? Cache->scan(Source, Tokens, Directives)
+                   : scanSourceForDependencyDirectives(Source, Tokens,
+                                                       Directives);
+    std::string Out;
+    llvm::raw_string_ostream OS(Out);
+    if (!Failed)
+      printDependencyDirectivesAsSource(Source, Directives, OS);
+    return Out;
+  }
+};
+
+TEST_F(DependencyDirectivesCacheTest, ReusesScans) {
+  StringRef Source = "#include <a.h>\n"
+                     "int x;\n"
+                     "#if FOO\n"
+                     "#define BAR(x) x + 1\n"
+                     "#endif\n"
+                     "import mod;\n";
+  bool Failed;
+  std::string Expected = scan(nullptr, Source, Failed);
+  ASSERT_FALSE(Failed);
+
+  {
+    auto Cache = DependencyDirectivesCache::create(Dir);
+    ASSERT_THAT_EXPECTED(Cache, llvm::Succeeded());
+    EXPECT_EQ(Expected, scan(Cache->get(), Source, Failed));
+    EXPECT_FALSE(Failed);
+    EXPECT_FALSE(isEmpty());
+    EXPECT_EQ(Expected, scan(Cache->get(), Source, Failed));
+    EXPECT_FALSE(Failed);
+  }
+
+  // Another instance, as in a later run, finds the same entry.
+  auto Cache = DependencyDirectivesCache::create(Dir);
+  ASSERT_THAT_EXPECTED(Cache, llvm::Succeeded());
+  EXPECT_EQ(Expected, scan(Cache->get(), Source, Failed));
+  EXPECT_FALSE(Failed);
+
+  // A different file is scanned on its own.
+  StringRef Other = "#include <b.h>\n";
+  Expected = scan(nullptr, Other, Failed);
+  EXPECT_EQ(Expected, scan(Cache->get(), Other, Failed));
+  EXPECT_FALSE(Failed);
+}
+
+TEST_F(DependencyDirectivesCacheTest, ReusesFailures) {
+  StringRef Source = "@import A\n";
+  for (unsigned Run = 0; Run != 2; ++Run) {
+    auto Cache = DependencyDirectivesCache::create(Dir);
+    ASSERT_THAT_EXPECTED(Cache, llvm::Succeeded());
+    bool Failed;
+    scan(Cache->get(), Source, Failed);
+    EXPECT_TRUE(Failed);
+  }
+}
+
+} // namespace
@@ -11,6 +11,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "TableGenBackends.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/TableGen/Error.h"
 #include "llvm/TableGen/Record.h"
 #include "llvm/TableGen/StringMatcher.h"
@@ -52,6 +53,9 @@ private:
   /// Emits the evaluator method.
   void EmitEval(raw_ostream &OS, StringRef N, const Record *R);
 
+  /// Emits the switch case visiting the operands of an opcode.
+  void EmitOperands(raw_ostream &OS, StringRef N, const Record *R);
+
   void PrintTypes(raw_ostream &OS, ArrayRef<const Record *> Types);
 };
 
@@ -97,6 +101,7 @@ void ClangOpcodesEmitter::run(raw_ostream &OS) {
     EmitGroup(OS, N, Opcode);
     EmitEmitter(OS, N, Opcode);
     EmitEval(OS, N, Opcode);
+    EmitOperands(OS, N, Opcode);
   }
 }
 
@@ -391,6 +396,26 @@ void ClangOpcodesEmitter::EmitEval(raw_ostream &OS, StringRef N,
   OS << "#endif\n";
 }
 
+void ClangOpcodesEmitter::EmitOperands(raw_ostream &OS, StringRef N,
+                                       const Record *R) {
+  OS << "#ifdef GET_OPERANDS\n";
+  Enumerate(R, N, [R, &OS](ArrayRef<const Record *>, const Twine &ID) {
+    OS << "case OP_" << ID << ":\n";
+    OS << "  return visitOperands<";
+    ListSeparator LS;
+    for (const auto *Arg : R->getValueAsListOfDefs("Args")) {
+      // Indices of globals are tagged, as they are not plain integers.
+      OS << LS;
+      if (Arg->getValueAsBit("IsGlobal"))
+        OS << "GlobalIndex";
+      else
+        OS << Arg->getValueAsString("Name");
+    }
+    OS << ">(Code, Offset, Visit);\n";
+  });
+  OS << "#endif\n";
+}
+
 void ClangOpcodesEmitter::PrintTypes(raw_ostream &OS,
                                      ArrayRef<const Record *> Types) {
   if (Types.empty())
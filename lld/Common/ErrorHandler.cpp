@@ -248,6 +248,8 @@ void ErrorHandler::warn(const Twine &msg) {
   std::lock_guard<std::mutex> lock(mu);
   reportDiagnostic(getLocation(msg), Colors::MAGENTA, "warning", msg);
   sep = getSeparator(msg);
+  if (recordWarnings)
+    recordedWarnings.push_back(msg.str());
 }
 
 void ErrorHandler::error(const Twine &msg) {
@@ -153,6 +153,7 @@ struct Config {
   uint32_t andFeatures = 0;
   llvm::CachePruningPolicy thinLTOCachePolicy;
   llvm::SetVector<llvm::CachedHashString> dependencyFiles; // for --dependency-file
+  llvm::SetVector<llvm::CachedHashString> missingFiles; // for --incremental
   llvm::StringMap<uint64_t> sectionStartMap;
   llvm::StringRef bfdname;
   llvm::StringRef chroot;
@@ -251,6 +252,7 @@ struct Config {
   bool hasDynSymTab;
   bool ignoreDataAddressEquality;
   bool ignoreFunctionAddressEquality;
+  bool incremental;
   bool ltoCSProfileGenerate;
   bool ltoPGOWarnMismatch;
   bool ltoDebugPassManager;
@@ -291,6 +293,7 @@ struct Config {
   bool sysvHash = false;
   bool target1Rel;
   bool trace;
+  bool thinLTOCachePack;
   bool thinLTOEmitImportsFiles;
   bool thinLTOEmitIndexFiles;
   bool thinLTOIndexOnly;
@@ -356,6 +359,7 @@ struct Config {
   llvm::CodeGenOptLevel ltoCgo;
   unsigned optimize;
   StringRef thinLTOJobs;
+  uint64_t thinLTOMemoryBudget;
   unsigned timeTraceGranularity;
   int32_t splitStackAdjustSize;
   StringRef packageMetadata;
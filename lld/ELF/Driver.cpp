@@ -25,6 +25,7 @@
 #include "Driver.h"
 #include "Config.h"
 #include "ICF.h"
+#include "Incremental.h"
 #include "InputFiles.h"
 #include "InputSection.h"
 #include "LTO.h"
@@ -645,17 +646,23 @@ void LinkerDriver::linkerMain(ArrayRef<const char *> argsArr) {
     llvm::TimeTraceScope timeScope("ExecuteLinker");
 
     initLLVM();
-    createFiles(args);
-    if (errorCount())
-      return;
-
-    inferMachineType();
-    setConfigs(args);
-    checkOptions();
-    if (errorCount())
-      return;
-
-    invokeELFT(link, args);
+    // With --incremental, try to patch the output of the previous link first.
+    if (!config->incremental || !tryIncrementalLink(args)) {
+      // Warnings of this link are reported again when a later link is
+      // skipped or patched, see Incremental.cpp.
+      errorHandler().recordWarnings = config->incremental;
+      createFiles(args);
+      if (errorCount())
+        return;
+
+      inferMachineType();
+      setConfigs(args);
+      checkOptions();
+      if (errorCount())
+        return;
+
+      invokeELFT(link, args);
+    }
   }
 
   if (config->timeTraceEnabled) {
@@ -1274,6 +1281,8 @@ static void readConfigs(opt::InputArgList &args) {
   config->gcSections = args.hasFlag(OPT_gc_sections, OPT_no_gc_sections, false);
   config->gnuUnique = args.hasFlag(OPT_gnu_unique, OPT_no_gnu_unique, true);
   config->gdbIndex = args.hasFlag(OPT_gdb_index, OPT_no_gdb_index, false);
+  config->incremental =
+      args.hasFlag(OPT_incremental, OPT_no_incremental, false);
   config->icf = getICF(args);
   config->ignoreDataAddressEquality =
       args.hasArg(OPT_ignore_data_address_equality);
@@ -1389,6 +1398,7 @@ static void readConfigs(opt::InputArgList &args) {
   config->thinLTOCachePolicy = CHECK(
       parseCachePruningPolicy(args.getLastArgValue(OPT_thinlto_cache_policy)),
       "--thinlto-cache-policy: invalid cache policy");
+  config->thinLTOCachePack = args.hasArg(OPT_thinlto_cache_pack);
   config->thinLTOEmitImportsFiles = args.hasArg(OPT_thinlto_emit_imports_files);
   config->thinLTOEmitIndexFiles = args.hasArg(OPT_thinlto_emit_index_files) ||
                                   args.hasArg(OPT_thinlto_index_only) ||
@@ -1414,6 +1424,8 @@ static void readConfigs(opt::InputArgList &args) {
     error("--thinlto-prefix-replace=old_dir;new_dir;obj_dir must be used with "
           "--thinlto-index-only=");
   }
+  config->thinLTOMemoryBudget =
+      args::getInteger(args, OPT_thinlto_memory_budget_eq, 0);
   config->thinLTOModulesToCompile =
       args::getStrings(args, OPT_thinlto_single_module_eq);
   config->timeTraceEnabled = args.hasArg(OPT_time_trace_eq);
@@ -3105,4 +3117,8 @@ template <class ELFT> void LinkerDriver::link(opt::InputArgList &args) {
 
   // Write the result to the file.
   writeResult<ELFT>();
+
+  // Record the output layout for the next --incremental link.
+  if (config->incremental && !errorCount())
+    writeIncrementalState<ELFT>(args);
 }
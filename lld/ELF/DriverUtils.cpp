@@ -220,6 +220,9 @@ static std::optional<std::string> findFile(StringRef path1,
 
   if (fs::exists(s))
     return std::string(s);
+  // A file created here later could change which file is found.
+  if (config->incremental)
+    config->missingFiles.insert(CachedHashString(s));
   return std::nullopt;
 }
 
@@ -257,5 +260,7 @@ std::optional<std::string> elf::searchLibrary(StringRef name) {
 std::optional<std::string> elf::searchScript(StringRef name) {
   if (fs::exists(name))
     return name.str();
+  if (config->incremental)
+    config->missingFiles.insert(CachedHashString(name));
   return findFromSearchPaths(name);
 }
@@ -0,0 +1,565 @@
+//===- Incremental.cpp ----------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements --incremental, which updates the output of a previous
+// link in place instead of linking from scratch when that is known to produce
+// the same file.
+//
+// After a full link, we write a state file next to the output. It records a
+// hash of the command line, the size and modification time of the output and
+// of every file that was read, and for each object file the sections whose
+// contents were copied to the output, together with their file offsets in the
+// output.
+//
+// The key observation is that the bytes of a regular input section end up in
+// the output unchanged, except near relocations, where the linker writes
+// relocated values and may rewrite instructions for relaxation. Everything
+// else in an object file (headers, symbol tables, relocations, mergeable
+// strings, .eh_frame, notes, ...) can affect symbol resolution and layout. So
+// for each object file we also record a hash of the file with the bytes that
+// are copied verbatim masked out. If an object file changes but that hash
+// does not, its symbols, relocations and section sizes are the same as
+// before, so every address in the output stays the same and the only
+// difference from the old output is in the copied bytes. We then write those
+// bytes into the existing output file and are done.
+//
+// Anything else, such as a changed archive, shared library or linker script,
+// a section that changed size, or a changed relocation, falls back to a full
+// link. Options whose results depend on section contents (ICF, build IDs,
+// compressed output sections, errata fixes, ...) disable the feature, as do
+// targets that relax code in a way that changes section sizes.
+//
+// This deliberately covers only edits that keep the layout fixed. Sections
+// are not padded to leave room for growth, and relocations are never
+// re-applied, so a changed symbol address always means a full link.
+//
+// The state also records every path that was probed without success while
+// searching -L directories, since creating such a file later changes which
+// library is found, and the warnings of the full link, which are reported
+// again whenever a later link is skipped or patched.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Incremental.h"
+#include "Config.h"
+#include "InputFiles.h"
+#include "InputSection.h"
+#include "OutputSections.h"
+#include "lld/Common/ErrorHandler.h"
+#include "lld/Common/Version.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Object/ELF.h"
+#include "llvm/Option/ArgList.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Parallel.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/xxhash.h"
+
+using namespace llvm;
+using namespace llvm::ELF;
+using namespace llvm::object;
+using namespace lld;
+using namespace lld::elf;
+
+namespace {
+// A section of an input object file whose contents are copied to the output.
+struct PatchSection {
+  uint32_t index;     // Section index in the object file
+  uint64_t outOffset; // File offset in the output
+  uint64_t size;
+};
+
+struct InputRecord {
+  std::string path;
+  uint64_t size;
+  int64_t mtime;
+  // True if the file is an object file that can be patched, in which case
+  // hash and sections are valid.
+  bool patchable = false;
+  uint64_t hash = 0;
+  SmallVector<PatchSection, 0> sections;
+};
+
+struct State {
+  uint64_t argsHash = 0;
+  ELFKind ekind = ELFNoneKind;
+  uint64_t outSize = 0;
+  int64_t outMtime = 0;
+  SmallVector<InputRecord, 0> inputs;
+  SmallVector<std::string, 0> missing; // Paths that must not exist
+  SmallVector<std::string, 0> warnings;
+};
+
+// A range of bytes of a patchable section, relative to the section start,
+// that the linker copies to the output verbatim.
+struct CopyRange {
+  uint64_t offset;
+  uint64_t size;
+};
+
+// The copied ranges of one patchable section.
+struct SectionRanges {
+  uint64_t fileOffset; // Offset of the section in the object file
+  uint64_t outOffset;
+  SmallVector<CopyRange, 0> ranges;
+};
+} // namespace
+
+static constexpr const char *stateMagic = "lld-incremental-v2";
+
+// Bytes around a relocation offset that the linker may write, which are
+// never copied verbatim. The largest rewrites on the supported targets are:
+//
+// - x86-64 TLS GD/LD to IE/LE relaxation: the 16-byte sequence from 4 bytes
+//   before the relocated field of the leaq to 12 bytes after it, and the
+//   GOTPCRELX and TLSDESC relaxations: up to 3 bytes before the field.
+// - i386 TLS GD/LD relaxation: 12 bytes from 3 bytes before the field.
+// - AArch64: a single 4-byte instruction per relocation, and TLSDESC
+//   relaxation rewrites each instruction of the sequence at its own
+//   relocation.
+//
+// The windows round these up; a larger window only moves bytes from the
+// patched set to the hashed set.
+static constexpr uint64_t windowBefore = 8;
+static constexpr uint64_t windowAfter = 16;
+
+static std::string getStatePath() {
+  return (config->outputFile + ".incr").str();
+}
+
+static int64_t getMtime(const sys::fs::file_status &st) {
+  return st.getLastModificationTime().time_since_epoch().count();
+}
+
+// Relative paths on the command line depend on the working directory, so it
+// is hashed together with the arguments.
+static uint64_t hashArgs(opt::InputArgList &args) {
+  std::string s = getLLDVersion();
+  SmallString<128> cwd;
+  if (!sys::fs::current_path(cwd))
+    s += cwd;
+  for (unsigned i = 0, e = args.getNumInputArgStrings(); i != e; ++i) {
+    s += '\0';
+    s += args.getArgString(i);
+  }
+  return xxh3_64bits(s);
+}
+
+// Returns true if the output of this link can be updated incrementally.
+static bool isSupported() {
+  if (config->emachine != EM_X86_64 && config->emachine != EM_386 &&
+      config->emachine != EM_AARCH64)
+    return false;
+  return !config->relocatable && !config->emitRelocs &&
+         config->icf == ICFLevel::None &&
+         config->buildId == BuildIdKind::None &&
+         !config->compressDebugSections && config->compressSections.empty() &&
+         !config->gdbIndex && !config->debugNames &&
+         !config->fixCortexA53Errata843419 && !config->oFormatBinary &&
+         config->outputFile != "-" && config->dependencyFile.empty() && !tar;
+}
+
+// Computes the copied ranges of the given sections of an object file. Returns
+// false if the file is not a relocatable object or does not have matching
+// sections.
+template <class ELFT>
+static bool getCopyRanges(MemoryBufferRef mb, ArrayRef<PatchSection> secs,
+                          SmallVectorImpl<SectionRanges> &out) {
+  Expected<ELFFile<ELFT>> objOrErr = ELFFile<ELFT>::create(mb.getBuffer());
+  if (!objOrErr) {
+    consumeError(objOrErr.takeError());
+    return false;
+  }
+  const ELFFile<ELFT> &obj = *objOrErr;
+  if (obj.getHeader().e_type != ET_REL)
+    return false;
+  Expected<typename ELFT::ShdrRange> shdrsOrErr = obj.sections();
+  if (!shdrsOrErr) {
+    consumeError(shdrsOrErr.takeError());
+    return false;
+  }
+  typename ELFT::ShdrRange shdrs = *shdrsOrErr;
+
+  // Collect the relocation offsets of the sections we are interested in.
+  DenseMap<uint32_t, SmallVector<uint64_t, 0>> relocOffsets;
+  for (const PatchSection &ps : secs)
+    relocOffsets[ps.index];
+  for (const typename ELFT::Shdr &sh : shdrs) {
+    auto it = relocOffsets.find(sh.sh_info);
+    if (it == relocOffsets.end())
+      continue;
+    if (sh.sh_type == SHT_REL) {
+      Expected<typename ELFT::RelRange> rels = obj.rels(sh);
+      if (!rels) {
+        consumeError(rels.takeError());
+        return false;
+      }
+      for (const typename ELFT::Rel &rel : *rels)
+        it->second.push_back(rel.r_offset);
+    } else if (sh.sh_type == SHT_RELA) {
+      Expected<typename ELFT::RelaRange> relas = obj.relas(sh);
+      if (!relas) {
+        consumeError(relas.takeError());
+        return false;
+      }
+      for (const typename ELFT::Rela &rel : *relas)
+        it->second.push_back(rel.r_offset);
+    }
+  }
+
+  for (const PatchSection &ps : secs) {
+    if (ps.index >= shdrs.size())
+      return false;
+    const typename ELFT::Shdr &sh = shdrs[ps.index];
+    if (sh.sh_type != SHT_PROGBITS || (sh.sh_flags & SHF_COMPRESSED) ||
+        sh.sh_size != ps.size || sh.sh_offset + sh.sh_size > mb.getBufferSize())
+      return false;
+
+    SectionRanges &sr = out.emplace_back();
+    sr.fileOffset = sh.sh_offset;
+    sr.outOffset = ps.outOffset;
+    SmallVector<uint64_t, 0> &offsets = relocOffsets[ps.index];
+    llvm::sort(offsets);
+    uint64_t pos = 0;
+    for (uint64_t off : offsets) {
+      uint64_t begin = off > windowBefore ? off - windowBefore : 0;
+      if (begin > pos)
+        sr.ranges.push_back({pos, begin - pos});
+      pos = std::max(pos, std::min<uint64_t>(off + windowAfter, sh.sh_size));
+    }
+    if (pos < sh.sh_size)
+      sr.ranges.push_back({pos, sh.sh_size - pos});
+  }
+  return true;
+}
+
+static bool getCopyRanges(ELFKind ekind, MemoryBufferRef mb,
+                          ArrayRef<PatchSection> secs,
+                          SmallVectorImpl<SectionRanges> &out) {
+  switch (ekind) {
+  case ELF32LEKind:
+    return getCopyRanges<ELF32LE>(mb, secs, out);
+  case ELF32BEKind:
+    return getCopyRanges<ELF32BE>(mb, secs, out);
+  case ELF64LEKind:
+    return getCopyRanges<ELF64LE>(mb, secs, out);
+  case ELF64BEKind:
+    return getCopyRanges<ELF64BE>(mb, secs, out);
+  default:
+    return false;
+  }
+}
+
+// Hashes an object file with the copied bytes cleared, so that the hash only
+// changes if something other than those bytes changes.
+static uint64_t hashMasked(MemoryBufferRef mb, ArrayRef<SectionRanges> secs) {
+  SmallVector<uint8_t, 0> buf(mb.getBuffer().bytes_begin(),
+                              mb.getBuffer().bytes_end());
+  for (const SectionRanges &sr : secs)
+    for (const CopyRange &r : sr.ranges)
+      memset(buf.data() + sr.fileOffset + r.offset, 0, r.size);
+  return xxh3_64bits(buf);
+}
+
+// Warnings may span several lines, so they are escaped to a single line.
+static std::string escapeLine(StringRef s) {
+  std::string ret;
+  for (char c : s) {
+    if (c == '\\')
+      ret += "\\\\";
+    else if (c == '\n')
+      ret += "\\n";
+    else
+      ret += c;
+  }
+  return ret;
+}
+
+static std::string unescapeLine(StringRef s) {
+  std::string ret;
+  for (size_t i = 0, e = s.size(); i != e; ++i) {
+    if (s[i] == '\\' && i + 1 != e)
+      ret += s[++i] == 'n' ? '\n' : s[i];
+    else
+      ret += s[i];
+  }
+  return ret;
+}
+
+static std::optional<State> readState() {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> mbOrErr =
+      MemoryBuffer::getFile(getStatePath(), /*IsText=*/true);
+  if (!mbOrErr)
+    return std::nullopt;
+
+  State st;
+  SmallVector<StringRef, 0> lines;
+  (*mbOrErr)->getBuffer().split(lines, '\n', -1, /*KeepEmpty=*/false);
+  if (lines.empty() || lines[0] != stateMagic)
+    return std::nullopt;
+  for (StringRef line : ArrayRef(lines).drop_front()) {
+    auto [kind, rest] = line.split(' ');
+    SmallVector<StringRef, 6> f;
+    if (kind == "args") {
+      if (!to_integer(rest, st.argsHash, 16))
+        return std::nullopt;
+    } else if (kind == "output") {
+      unsigned ekind;
+      rest.split(f, ' ', 2);
+      if (f.size() != 3 || !to_integer(f[0], ekind) ||
+          !to_integer(f[1], st.outSize) || !to_integer(f[2], st.outMtime))
+        return std::nullopt;
+      st.ekind = static_cast<ELFKind>(ekind);
+    } else if (kind == "input") {
+      // The path comes last because it may contain spaces.
+      InputRecord &rec = st.inputs.emplace_back();
+      unsigned patchable;
+      rest.split(f, ' ', 4);
+      if (f.size() != 5 || !to_integer(f[0], rec.size) ||
+          !to_integer(f[1], rec.mtime) || !to_integer(f[2], patchable) ||
+          !to_integer(f[3], rec.hash, 16))
+        return std::nullopt;
+      rec.patchable = patchable;
+      rec.path = f[4].str();
+    } else if (kind == "section") {
+      PatchSection ps;
+      rest.split(f, ' ');
+      if (st.inputs.empty() || f.size() != 3 || !to_integer(f[0], ps.index) ||
+          !to_integer(f[1], ps.outOffset) || !to_integer(f[2], ps.size))
+        return std::nullopt;
+      st.inputs.back().sections.push_back(ps);
+    } else if (kind == "missing") {
+      st.missing.push_back(rest.str());
+    } else if (kind == "warning") {
+      st.warnings.push_back(unescapeLine(rest));
+    } else {
+      return std::nullopt;
+    }
+  }
+  return st;
+}
+
+static void writeState(const State &st) {
+  std::string path = getStatePath();
+  std::error_code ec;
+  raw_fd_ostream os(path, ec, sys::fs::OF_Text);
+  if (ec) {
+    warn("cannot write " + path + ": " + ec.message());
+    return;
+  }
+  os << stateMagic << '\n';
+  os << "args " << utohexstr(st.argsHash) << '\n';
+  os << "output " << unsigned(st.ekind) << ' ' << st.outSize << ' '
+     << st.outMtime << '\n';
+  for (const InputRecord &rec : st.inputs) {
+    os << "input " << rec.size << ' ' << rec.mtime << ' ' << rec.patchable
+       << ' ' << utohexstr(rec.hash) << ' ' << rec.path << '\n';
+    for (const PatchSection &ps : rec.sections)
+      os << "section " << ps.index << ' ' << ps.outOffset << ' ' << ps.size
+         << '\n';
+  }
+  for (const std::string &path : st.missing)
+    os << "missing " << path << '\n';
+  for (const std::string &msg : st.warnings)
+    os << "warning " << escapeLine(msg) << '\n';
+}
+
+template <class ELFT>
+void elf::writeIncrementalState(opt::InputArgList &args) {
+  llvm::TimeTraceScope timeScope("Write incremental state");
+  sys::fs::remove(getStatePath());
+  if (!isSupported()) {
+    log("--incremental: the output cannot be updated incrementally");
+    return;
+  }
+
+  // Object files given directly on the command line, by path. Archive
+  // members and files given more than once are never patched.
+  DenseMap<StringRef, ObjFile<ELFT> *> objs;
+  for (ELFFileBase *file : ctx.objectFiles) {
+    if (file->lazy || !file->archiveName.empty())
+      continue;
+    auto [it, inserted] =
+        objs.try_emplace(file->getName(), cast<ObjFile<ELFT>>(file));
+    if (!inserted)
+      it->second = nullptr;
+  }
+
+  State st;
+  st.argsHash = hashArgs(args);
+  st.ekind = config->ekind;
+  sys::fs::file_status outStat;
+  if (sys::fs::status(config->outputFile, outStat))
+    return;
+  st.outSize = outStat.getSize();
+  st.outMtime = getMtime(outStat);
+  for (const CachedHashString &path : config->missingFiles)
+    st.missing.push_back(path.val().str());
+  st.warnings.assign(errorHandler().recordedWarnings.begin(),
+                     errorHandler().recordedWarnings.end());
+
+  SmallVector<ObjFile<ELFT> *, 0> files;
+  for (const CachedHashString &path : config->dependencyFiles) {
+    InputRecord &rec = st.inputs.emplace_back();
+    rec.path = path.val().str();
+    sys::fs::file_status stat;
+    if (sys::fs::status(rec.path, stat))
+      return;
+    rec.size = stat.getSize();
+    rec.mtime = getMtime(stat);
+
+    ObjFile<ELFT> *file = objs.lookup(path.val());
+    files.push_back(file);
+    if (!file || file->splitStack)
+      continue;
+    ArrayRef<InputSectionBase *> sections = file->getSections();
+    for (size_t i = 0, e = sections.size(); i != e; ++i) {
+      auto *isec = dyn_cast_or_null<InputSection>(sections[i]);
+      if (!isec || isec == &InputSection::discarded ||
+          isec->kind() != SectionBase::Regular || !isec->isLive() ||
+          isec->type != SHT_PROGBITS || isec->getSize() == 0 ||
+          !isec->getParent())
+        continue;
+      OutputSection *osec = isec->getParent();
+      if (osec->type == SHT_NOBITS)
+        continue;
+      rec.sections.push_back(
+          {uint32_t(i), osec->offset + isec->outSecOff, isec->getSize()});
+    }
+  }
+
+  // Hashing reads every patchable object file in full, so do it in parallel.
+  parallelFor(0, st.inputs.size(), [&](size_t i) {
+    InputRecord &rec = st.inputs[i];
+    SmallVector<SectionRanges, 0> ranges;
+    if (rec.sections.empty() ||
+        !getCopyRanges<ELFT>(files[i]->mb, rec.sections, ranges)) {
+      rec.sections.clear();
+      return;
+    }
+    rec.patchable = true;
+    rec.hash = hashMasked(files[i]->mb, ranges);
+  });
+
+  writeState(st);
+}
+
+bool elf::tryIncrementalLink(opt::InputArgList &args) {
+  llvm::TimeTraceScope timeScope("Incremental link");
+  // The output file name may still come from a linker script.
+  if (config->outputFile.empty())
+    return false;
+  std::optional<State> st = readState();
+  if (!st)
+    return false;
+  auto fullLink = [](const Twine &reason) {
+    log("--incremental: performing a full link: " + reason);
+    return false;
+  };
+
+  if (st->argsHash != hashArgs(args))
+    return fullLink("the command line changed");
+  sys::fs::file_status outStat;
+  if (sys::fs::status(config->outputFile, outStat) ||
+      outStat.getSize() != st->outSize || getMtime(outStat) != st->outMtime)
+    return fullLink("the output was modified");
+  for (const std::string &path : st->missing)
+    if (sys::fs::exists(path))
+      return fullLink(path + " was created");
+
+  // Find the inputs that changed and check that they can be patched. Nothing
+  // is written until all of them have been checked.
+  SmallVector<std::unique_ptr<MemoryBuffer>, 0> buffers;
+  SmallVector<std::pair<InputRecord *, SmallVector<SectionRanges, 0>>, 0>
+      patches;
+  for (InputRecord &rec : st->inputs) {
+    sys::fs::file_status stat;
+    if (sys::fs::status(rec.path, stat))
+      return fullLink(rec.path + " cannot be read");
+    if (stat.getSize() == rec.size && getMtime(stat) == rec.mtime)
+      continue;
+    if (!rec.patchable)
+      return fullLink(rec.path + " changed");
+
+    ErrorOr<std::unique_ptr<MemoryBuffer>> mbOrErr = MemoryBuffer::getFile(
+        rec.path, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+    if (!mbOrErr)
+      return fullLink(rec.path + " cannot be read");
+    MemoryBufferRef mb = (*mbOrErr)->getMemBufferRef();
+    SmallVector<SectionRanges, 0> ranges;
+    if (!getCopyRanges(st->ekind, mb, rec.sections, ranges) ||
+        hashMasked(mb, ranges) != rec.hash)
+      return fullLink(rec.path + " changed more than section contents");
+    for (const PatchSection &ps : rec.sections)
+      if (ps.outOffset + ps.size > st->outSize)
+        return fullLink("the output is too small");
+    rec.size = stat.getSize();
+    rec.mtime = getMtime(stat);
+    buffers.push_back(std::move(*mbOrErr));
+    patches.emplace_back(&rec, std::move(ranges));
+  }
+  // The result is the same as that of the last full link, and so are its
+  // diagnostics.
+  auto replayWarnings = [&] {
+    for (const std::string &msg : st->warnings)
+      warn(msg);
+  };
+  if (patches.empty()) {
+    replayWarnings();
+    log("--incremental: the output is up to date");
+    return true;
+  }
+
+  Expected<sys::fs::file_t> fdOrErr = sys::fs::openNativeFileForReadWrite(
+      config->outputFile, sys::fs::CD_OpenExisting, sys::fs::OF_None);
+  if (!fdOrErr) {
+    consumeError(fdOrErr.takeError());
+    return fullLink("the output cannot be opened for writing");
+  }
+  sys::fs::file_t fd = *fdOrErr;
+  std::error_code ec;
+  sys::fs::mapped_file_region out(fd, sys::fs::mapped_file_region::readwrite,
+                                  st->outSize, 0, ec);
+  if (ec) {
+    sys::fs::closeFile(fd);
+    return fullLink("the output cannot be mapped: " + ec.message());
+  }
+
+  // If we do not get to the end, the next link must be a full one.
+  sys::fs::remove(getStatePath());
+  size_t numSections = 0;
+  for (size_t i = 0, e = patches.size(); i != e; ++i) {
+    const uint8_t *in = buffers[i]->getBuffer().bytes_begin();
+    for (const SectionRanges &sr : patches[i].second) {
+      for (const CopyRange &r : sr.ranges)
+        memcpy(out.data() + sr.outOffset + r.offset,
+               in + sr.fileOffset + r.offset, r.size);
+      ++numSections;
+    }
+  }
+  out.unmap();
+  sys::fs::closeFile(fd);
+
+  if (sys::fs::status(config->outputFile, outStat)) {
+    error("cannot stat " + config->outputFile);
+    return true;
+  }
+  st->outMtime = getMtime(outStat);
+  writeState(*st);
+  replayWarnings();
+  log("--incremental: patched " + Twine(numSections) + " sections from " +
+      Twine(patches.size()) + " files");
+  return true;
+}
+
+template void elf::writeIncrementalState<ELF32LE>(opt::InputArgList &);
+template void elf::writeIncrementalState<ELF32BE>(opt::InputArgList &);
+template void elf::writeIncrementalState<ELF64LE>(opt::InputArgList &);
+template void elf::writeIncrementalState<ELF64BE>(opt::InputArgList &);
@@ -0,0 +1,28 @@
+//===- Incremental.h --------------------------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLD_ELF_INCREMENTAL_H
+#define LLD_ELF_INCREMENTAL_H
+
+namespace llvm::opt {
+class InputArgList;
+}
+
+namespace lld::elf {
+
+// Patches the output of a previous --incremental link in place. Returns false
+// if a full link is needed.
+bool tryIncrementalLink(llvm::opt::InputArgList &args);
+
+// Records the layout of the output that has just been written, or removes a
+// stale record if this link cannot be updated incrementally.
+template <class ELFT> void writeIncrementalState(llvm::opt::InputArgList &args);
+
+} // namespace lld::elf
+
+#endif // LLD_ELF_INCREMENTAL_H
@@ -138,6 +138,7 @@ static lto::Config createConfig() {
 
   for (const llvm::StringRef &name : config->thinLTOModulesToCompile)
     c.ThinLTOModulesToCompile.emplace_back(name);
+  c.ThinLTOMemoryBudget = config->thinLTOMemoryBudget << 20;
 
   c.TimeTraceEnabled = config->timeTraceEnabled;
   c.TimeTraceGranularity = config->timeTraceGranularity;
@@ -315,13 +316,23 @@ std::vector<InputFile *> BitcodeCompiler::compile() {
   // to cache native object files for ThinLTO incremental builds. If a path was
   // specified, configure LTO to use it as the cache directory.
   FileCache cache;
-  if (!config->thinLTOCacheDir.empty())
-    cache = check(localCache("ThinLTO", "Thin", config->thinLTOCacheDir,
-                             [&](size_t task, const Twine &moduleName,
-                                 std::unique_ptr<MemoryBuffer> mb) {
-                               files[task] = std::move(mb);
-                               filenames[task] = moduleName.str();
-                             }));
+  auto addBuffer = [&](size_t task, const Twine &moduleName,
+                       std::unique_ptr<MemoryBuffer> mb) {
+    files[task] = std::move(mb);
+    filenames[task] = moduleName.str();
+  };
+  if (!config->thinLTOCacheDir.empty() && config->thinLTOCachePack) {
+    // The pack cache prunes itself, so only the size limit of the policy is
+    // used.
+    PackCachePolicy policy;
+    if (config->thinLTOCachePolicy.MaxSizeBytes)
+      policy.MaxSizeBytes = config->thinLTOCachePolicy.MaxSizeBytes;
+    cache = check(
+        packCache("ThinLTO", config->thinLTOCacheDir, addBuffer, policy));
+  } else if (!config->thinLTOCacheDir.empty()) {
+    cache = check(
+        localCache("ThinLTO", "Thin", config->thinLTOCacheDir, addBuffer));
+  }
 
   if (!ctx.bitcodeFiles.empty())
     checkError(ltoObj->run(
@@ -357,7 +368,7 @@ std::vector<InputFile *> BitcodeCompiler::compile() {
     return {};
   }
 
-  if (!config->thinLTOCacheDir.empty())
+  if (!config->thinLTOCacheDir.empty() && !config->thinLTOCachePack)
     pruneCache(config->thinLTOCacheDir, config->thinLTOCachePolicy, files);
 
   if (!config->ltoObjPath.empty()) {
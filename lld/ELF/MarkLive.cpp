@@ -17,6 +17,12 @@
 // bits. Writer will then ignore sections whose Live bits are off, so that
 // such sections are not included into output.
 //
+// When more than one thread is available, the graph is traversed by several
+// workers in parallel. Each worker has its own queue, and a section is claimed
+// by the worker that updates its partition first, so every section is still
+// scanned once per partition. The resulting live set does not depend on the
+// number of threads.
+//
 //===----------------------------------------------------------------------===//
 
 #include "MarkLive.h"
@@ -31,9 +37,14 @@
 #include "lld/Common/Strings.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/Object/ELF.h"
+#include "llvm/Support/Parallel.h"
 #include "llvm/Support/TimeProfiler.h"
 #include <vector>
 
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
 using namespace llvm;
 using namespace llvm::ELF;
 using namespace llvm::object;
@@ -42,29 +53,50 @@ using namespace lld;
 using namespace lld::elf;
 
 namespace {
+// The state of one thread of the mark phase.
+struct MarkWorker {
+  // A list of sections to visit.
+  SmallVector<InputSection *, 0> queue;
+
+  // Side effects that are deferred until all workers have finished, because
+  // they update bit-fields or plain flags that other workers may be reading
+  // or writing at the same time. Only used when marking in parallel.
+  SmallVector<Symbol *, 0> usedSyms;
+  SmallVector<SharedFile *, 0> neededFiles;
+  SmallVector<std::pair<MergeInputSection *, uint64_t>, 0> livePieces;
+};
+
 template <class ELFT> class MarkLive {
 public:
-  MarkLive(unsigned partition) : partition(partition) {}
+  MarkLive(unsigned partition)
+      : partition(partition), workers(std::max(config->threadCount, 1u)) {}
 
   void run();
   void moveToMain();
 
 private:
-  void enqueue(InputSectionBase *sec, uint64_t offset);
+  void enqueue(MarkWorker &w, InputSectionBase *sec, uint64_t offset);
   void markSymbol(Symbol *sym);
+  void addRoots();
+  void scanSection(MarkWorker &w, InputSectionBase &sec);
   void mark();
+  void applyDeferred();
 
   template <class RelTy>
-  void resolveReloc(InputSectionBase &sec, RelTy &rel, bool fromFDE);
+  void resolveReloc(MarkWorker &w, InputSectionBase &sec, RelTy &rel,
+                    bool fromFDE);
 
   template <class RelTy>
   void scanEhFrameSection(EhInputSection &eh, ArrayRef<RelTy> rels);
 
+  bool isParallel() const { return workers.size() > 1; }
+
   // The index of the partition that we are currently processing.
   unsigned partition;
 
-  // A list of sections to visit.
-  SmallVector<InputSection *, 0> queue;
+  // One entry per thread. Sections found while adding GC roots go to the
+  // first worker.
+  SmallVector<MarkWorker, 0> workers;
 
   // There are normally few input sections whose names are valid C
   // identifiers, so we just store a SmallVector instead of a multimap.
@@ -87,11 +119,17 @@ static uint64_t getAddend(InputSectionBase &sec,
 
 template <class ELFT>
 template <class RelTy>
-void MarkLive<ELFT>::resolveReloc(InputSectionBase &sec, RelTy &rel,
-                                  bool fromFDE) {
-  // If a symbol is referenced in a live section, it is used.
+void MarkLive<ELFT>::resolveReloc(MarkWorker &w, InputSectionBase &sec,
+                                  RelTy &rel, bool fromFDE) {
+  // If a symbol is referenced in a live section, it is used. The flag is not
+  // written by anyone while workers are running, so it is safe to read it.
   Symbol &sym = sec.file->getRelocTargetSym(rel);
-  sym.used = true;
+  if (!sym.used) {
+    if (isParallel())
+      w.usedSyms.push_back(&sym);
+    else
+      sym.used = true;
+  }
 
   if (auto *d = dyn_cast<Defined>(&sym)) {
     auto *relSec = dyn_cast_or_null<InputSectionBase>(d->section);
@@ -112,16 +150,22 @@ void MarkLive<ELFT>::resolveReloc(InputSectionBase &sec, RelTy &rel,
     // discarded, marking the LSDA will unnecessarily retain the text section.
     if (!(fromFDE && ((relSec->flags & (SHF_EXECINSTR | SHF_LINK_ORDER)) ||
                       relSec->nextInSectionGroup)))
-      enqueue(relSec, offset);
+      enqueue(w, relSec, offset);
     return;
   }
 
-  if (auto *ss = dyn_cast<SharedSymbol>(&sym))
-    if (!ss->isWeak())
-      cast<SharedFile>(ss->file)->isNeeded = true;
+  if (auto *ss = dyn_cast<SharedSymbol>(&sym)) {
+    auto *file = cast<SharedFile>(ss->file);
+    if (!ss->isWeak() && !file->isNeeded) {
+      if (isParallel())
+        w.neededFiles.push_back(file);
+      else
+        file->isNeeded = true;
+    }
+  }
 
   for (InputSectionBase *sec : cNamedSections.lookup(sym.getName()))
-    enqueue(sec, 0);
+    enqueue(w, sec, 0);
 }
 
 // The .eh_frame section is an unfortunate special case.
@@ -142,9 +186,10 @@ template <class ELFT>
 template <class RelTy>
 void MarkLive<ELFT>::scanEhFrameSection(EhInputSection &eh,
                                         ArrayRef<RelTy> rels) {
+  MarkWorker &w = workers[0];
   for (const EhSectionPiece &cie : eh.cies)
     if (cie.firstRelocation != unsigned(-1))
-      resolveReloc(eh, rels[cie.firstRelocation], false);
+      resolveReloc(w, eh, rels[cie.firstRelocation], false);
   for (const EhSectionPiece &fde : eh.fdes) {
     size_t firstRelI = fde.firstRelocation;
     if (firstRelI == (unsigned)-1)
@@ -152,7 +197,7 @@ void MarkLive<ELFT>::scanEhFrameSection(EhInputSection &eh,
     uint64_t pieceEnd = fde.inputOff + fde.size;
     for (size_t j = firstRelI, end2 = rels.size();
          j < end2 && rels[j].r_offset < pieceEnd; ++j)
-      resolveReloc(eh, rels[j], true);
+      resolveReloc(w, eh, rels[j], true);
   }
 }
 
@@ -178,36 +223,74 @@ static bool isReserved(InputSectionBase *sec) {
   }
 }
 
+// InputSectionBase::partition is a plain byte shared by all sections, so the
+// parallel marker updates it with atomic builtins rather than std::atomic.
+static uint8_t loadPartition(uint8_t &p) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  return *static_cast<volatile uint8_t *>(&p);
+#else
+  return __atomic_load_n(&p, __ATOMIC_RELAXED);
+#endif
+}
+
+static bool casPartition(uint8_t &p, uint8_t &expected, uint8_t desired) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  char old = _InterlockedCompareExchange8(reinterpret_cast<volatile char *>(&p),
+                                          desired, expected);
+  if (uint8_t(old) == expected)
+    return true;
+  expected = old;
+  return false;
+#else
+  return __atomic_compare_exchange_n(&p, &expected, desired, /*weak=*/false,
+                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+#endif
+}
+
 template <class ELFT>
-void MarkLive<ELFT>::enqueue(InputSectionBase *sec, uint64_t offset) {
+void MarkLive<ELFT>::enqueue(MarkWorker &w, InputSectionBase *sec,
+                             uint64_t offset) {
   // Usually, a whole section is marked as live or dead, but in mergeable
   // (splittable) sections, each piece of data has independent liveness bit.
   // So we explicitly tell it which offset is in use.
-  if (auto *ms = dyn_cast<MergeInputSection>(sec))
-    ms->getSectionPiece(offset).live = true;
+  if (auto *ms = dyn_cast<MergeInputSection>(sec)) {
+    if (isParallel())
+      w.livePieces.emplace_back(ms, offset);
+    else
+      ms->getSectionPiece(offset).live = true;
+  }
 
   // Set Sec->Partition to the meet (i.e. the "minimum") of Partition and
   // Sec->Partition in the following lattice: 1 < other < 0. If Sec->Partition
-  // doesn't change, we don't need to do anything.
-  if (sec->partition == 1 || sec->partition == partition)
-    return;
-  sec->partition = sec->partition ? 1 : partition;
+  // doesn't change, we don't need to do anything. The update is atomic so
+  // that exactly one worker claims the section when several find it at once.
+  uint8_t cur = loadPartition(sec->partition);
+  do {
+    if (cur == 1 || cur == partition)
+      return;
+  } while (!casPartition(sec->partition, cur, cur ? 1 : partition));
 
   // Add input section to the queue.
   if (InputSection *s = dyn_cast<InputSection>(sec))
-    queue.push_back(s);
+    w.queue.push_back(s);
 }
 
 template <class ELFT> void MarkLive<ELFT>::markSymbol(Symbol *sym) {
   if (auto *d = dyn_cast_or_null<Defined>(sym))
     if (auto *isec = dyn_cast_or_null<InputSectionBase>(d->section))
-      enqueue(isec, d->value);
+      enqueue(workers[0], isec, d->value);
 }
 
 // This is the main function of the garbage collector.
 // Starting from GC-root sections, this function visits all reachable
 // sections to set their "Live" bits.
 template <class ELFT> void MarkLive<ELFT>::run() {
+  addRoots();
+  mark();
+}
+
+template <class ELFT> void MarkLive<ELFT>::addRoots() {
+  llvm::TimeTraceScope timeScope("Add GC roots");
   // Add GC root symbols.
 
   // Preserve externally-visible symbols if the symbols defined by this
@@ -217,10 +300,8 @@ template <class ELFT> void MarkLive<ELFT>::run() {
       markSymbol(sym);
 
   // If this isn't the main partition, that's all that we need to preserve.
-  if (partition != 1) {
-    mark();
+  if (partition != 1)
     return;
-  }
 
   markSymbol(symtab.find(config->entry));
   markSymbol(symtab.find(config->init));
@@ -247,7 +328,7 @@ template <class ELFT> void MarkLive<ELFT>::run() {
   }
   for (InputSectionBase *sec : ctx.inputSections) {
     if (sec->flags & SHF_GNU_RETAIN) {
-      enqueue(sec, 0);
+      enqueue(workers[0], sec, 0);
       continue;
     }
     if (sec->flags & SHF_LINK_ORDER)
@@ -286,7 +367,7 @@ template <class ELFT> void MarkLive<ELFT>::run() {
     // Preserve special sections and those which are specified in linker
     // script KEEP command.
     if (isReserved(sec) || script->shouldKeep(sec)) {
-      enqueue(sec, 0);
+      enqueue(workers[0], sec, 0);
     } else if ((!config->zStartStopGC || sec->name.starts_with("__libc_")) &&
                isValidCIdentifier(sec->name)) {
       // As a workaround for glibc libc.a before 2.34
@@ -296,27 +377,80 @@ template <class ELFT> void MarkLive<ELFT>::run() {
       cNamedSections[saver().save("__stop_" + sec->name)].push_back(sec);
     }
   }
+}
 
-  mark();
+template <class ELFT>
+void MarkLive<ELFT>::scanSection(MarkWorker &w, InputSectionBase &sec) {
+  const RelsOrRelas<ELFT> rels = sec.template relsOrRelas<ELFT>();
+  for (const typename ELFT::Rel &rel : rels.rels)
+    resolveReloc(w, sec, rel, false);
+  for (const typename ELFT::Rela &rel : rels.relas)
+    resolveReloc(w, sec, rel, false);
+
+  for (InputSectionBase *isec : sec.dependentSections)
+    enqueue(w, isec, 0);
+
+  // Mark the next group member.
+  if (sec.nextInSectionGroup)
+    enqueue(w, sec.nextInSectionGroup, 0);
 }
 
 template <class ELFT> void MarkLive<ELFT>::mark() {
+  llvm::TimeTraceScope timeScope("Mark reachable sections");
   // Mark all reachable sections.
-  while (!queue.empty()) {
-    InputSectionBase &sec = *queue.pop_back_val();
+  if (!isParallel()) {
+    MarkWorker &w = workers[0];
+    while (!w.queue.empty())
+      scanSection(w, *w.queue.pop_back_val());
+    return;
+  }
 
-    const RelsOrRelas<ELFT> rels = sec.template relsOrRelas<ELFT>();
-    for (const typename ELFT::Rel &rel : rels.rels)
-      resolveReloc(sec, rel, false);
-    for (const typename ELFT::Rela &rel : rels.relas)
-      resolveReloc(sec, rel, false);
+  // Parallel marking proceeds in rounds. Each round splits the pending
+  // sections evenly among the workers. A worker then follows the references
+  // it discovers depth-first through its own queue, until it has visited a
+  // bounded number of sections so that a single long chain of references does
+  // not leave the other workers idle. What is left over is redistributed in
+  // the next round.
+  const size_t roundBudget = 4096;
+  const size_t numWorkers = workers.size();
+  SmallVector<InputSection *, 0> pending;
+  for (;;) {
+    pending.clear();
+    for (MarkWorker &w : workers) {
+      pending.append(w.queue.begin(), w.queue.end());
+      w.queue.clear();
+    }
+    if (pending.empty())
+      break;
+
+    const size_t n = pending.size();
+    parallelFor(0, numWorkers, [&](size_t i) {
+      MarkWorker &w = workers[i];
+      for (size_t j = n * i / numWorkers, e = n * (i + 1) / numWorkers; j != e;
+           ++j)
+        scanSection(w, *pending[j]);
+      for (size_t k = 0; k != roundBudget && !w.queue.empty(); ++k)
+        scanSection(w, *w.queue.pop_back_val());
+    });
+  }
 
-    for (InputSectionBase *isec : sec.dependentSections)
-      enqueue(isec, 0);
+  applyDeferred();
+}
 
-    // Mark the next group member.
-    if (sec.nextInSectionGroup)
-      enqueue(sec.nextInSectionGroup, 0);
+// Apply the side effects that the workers have collected during a parallel
+// mark phase. Duplicates are harmless.
+template <class ELFT> void MarkLive<ELFT>::applyDeferred() {
+  llvm::TimeTraceScope timeScope("Apply deferred marks");
+  for (MarkWorker &w : workers) {
+    for (Symbol *sym : w.usedSyms)
+      sym->used = true;
+    for (SharedFile *file : w.neededFiles)
+      file->isNeeded = true;
+    for (auto [ms, offset] : w.livePieces)
+      ms->getSectionPiece(offset).live = true;
+    w.usedSyms.clear();
+    w.neededFiles.clear();
+    w.livePieces.clear();
   }
 }
 
@@ -342,7 +476,7 @@ template <class ELFT> void MarkLive<ELFT>::moveToMain() {
       continue;
     if (symtab.find(("__start_" + sec->name).str()) ||
         symtab.find(("__stop_" + sec->name).str()))
-      enqueue(sec, 0);
+      enqueue(workers[0], sec, 0);
   }
 
   mark();
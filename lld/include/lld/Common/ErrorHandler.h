@@ -105,6 +105,10 @@ public:
   bool verbose = false;
   bool vsDiagnostics = false;
   bool disableOutput = false;
+  // If set, the text of each reported warning is also kept in
+  // recordedWarnings, so that it can be reported again later.
+  bool recordWarnings = false;
+  std::vector<std::string> recordedWarnings;
   std::function<void()> cleanupCallback;
 
   void error(const Twine &msg);
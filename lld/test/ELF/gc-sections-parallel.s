@@ -0,0 +1,88 @@
+# REQUIRES: x86
+## Test that --gc-sections keeps the same sections, merge pieces and needed
+## shared libraries when sections are marked live by several threads.
+
+# RUN: rm -rf %t && split-file %s %t && cd %t
+# RUN: llvm-mc -filetype=obj -triple=x86_64 main.s -o main.o
+# RUN: llvm-mc -filetype=obj -triple=x86_64 chain.s -o chain.o
+# RUN: llvm-mc -filetype=obj -triple=x86_64 shared.s -o shared.o
+# RUN: ld.lld -shared -soname=used.so shared.o -o used.so
+# RUN: ld.lld -shared -soname=unused.so shared.o -o unused.so
+
+# RUN: ld.lld --gc-sections --print-gc-sections --threads=1 --as-needed \
+# RUN:   main.o chain.o used.so unused.so -o out1 > gc1.txt
+# RUN: ld.lld --gc-sections --print-gc-sections --threads=4 --as-needed \
+# RUN:   main.o chain.o used.so unused.so -o out4 > gc4.txt
+# RUN: cmp gc1.txt gc4.txt
+# RUN: cmp out1 out4
+# RUN: FileCheck %s --check-prefix=GC --implicit-check-not=live < gc4.txt
+# RUN: llvm-readelf -d -x .rodata out4 | FileCheck %s
+
+# GC-DAG: removing unused section chain.o:(.text.dead0)
+# GC-DAG: removing unused section chain.o:(.text.dead1)
+# GC-DAG: removing unused section chain.o:(.meta.dead0)
+# GC-DAG: removing unused section chain.o:(.meta.dead1)
+
+# CHECK:     (NEEDED) Shared library: [used.so]
+# CHECK-NOT: unused.so
+# CHECK:     Hex dump of section '.rodata':
+# CHECK-NEXT: 0x{{[0-9a-f]+}} 6c697665 00 live.{{$}}
+
+## --time-trace reports each step of the mark phase.
+# RUN: ld.lld --gc-sections --threads=4 --time-trace=trace.json \
+# RUN:   --time-trace-granularity=0 main.o chain.o used.so -o out
+# RUN: FileCheck %s --check-prefix=TRACE < trace.json
+# TRACE-DAG: "name":"markLive"
+# TRACE-DAG: "name":"Add GC roots"
+# TRACE-DAG: "name":"Mark reachable sections"
+# TRACE-DAG: "name":"Apply deferred marks"
+
+#--- main.s
+.globl _start
+_start:
+  call live0
+  call use_str
+  ret
+
+#--- chain.s
+## A chain of sections long enough to be spread over the workers, each with a
+## dependent metadata section, and a chain that nothing refers to.
+.macro fn name, callee, meta
+.section .text.\name,"ax",@progbits
+.globl \name
+\name:
+  call \callee
+  ret
+.section .meta.\meta,"ao",@progbits,.text.\name
+  .byte 0
+.endm
+
+fn live0, live1, live0
+fn live1, live2, live1
+fn live2, live3, live2
+fn live3, live4, live3
+fn live4, live5, live4
+fn live5, live6, live5
+fn live6, live7, live6
+fn live7, shared_fn, live7
+fn dead0, dead1, dead0
+fn dead1, live0, dead1
+
+.section .text.str,"ax",@progbits
+.globl use_str
+use_str:
+  leaq .Llive(%rip), %rax
+  ret
+
+## Only the piece that is referred to is kept.
+.section .rodata.str,"aMS",@progbits,1
+.Llive:
+  .asciz "live"
+.Ldead:
+  .asciz "dead"
+
+#--- shared.s
+.globl shared_fn
+.type shared_fn,@function
+shared_fn:
+  ret
@@ -0,0 +1,93 @@
+# REQUIRES: x86
+## Test --incremental: the output of a previous link is patched in place when
+## only section contents changed, and a full link is done otherwise.
+
+# RUN: rm -rf %t && split-file %s %t && cd %t
+# RUN: llvm-mc -filetype=obj -triple=x86_64 main.s -o main.o
+# RUN: llvm-mc -filetype=obj -triple=x86_64 a.s -o a.o
+# RUN: llvm-mc -filetype=obj -triple=x86_64 a2.s -o a2.o
+# RUN: llvm-mc -filetype=obj -triple=x86_64 grow.s -o grow.o
+# RUN: llvm-mc -filetype=obj -triple=x86_64 lib.s -o lib.o
+# RUN: mkdir dir1 dir2 && llvm-ar rc dir2/libl.a lib.o
+# RUN: echo 'missing_sym' > order.txt
+
+## The first link is a full one and records the state.
+# RUN: cp a.o in.o
+# RUN: ld.lld --incremental --verbose main.o in.o -Ldir1 -Ldir2 -ll \
+# RUN:   --symbol-ordering-file=order.txt -o out 2>&1 | FileCheck %s --check-prefix=FIRST
+# RUN: ls out.incr
+# FIRST:     warning: symbol ordering file: no such symbol: missing_sym
+# FIRST-NOT: --incremental:
+
+## Nothing changed: the link is skipped, and its warning is reported again.
+# RUN: ld.lld --incremental --verbose main.o in.o -Ldir1 -Ldir2 -ll \
+# RUN:   --symbol-ordering-file=order.txt -o out 2>&1 | FileCheck %s --check-prefix=UPTODATE
+# UPTODATE: warning: symbol ordering file: no such symbol: missing_sym
+# UPTODATE: --incremental: the output is up to date
+
+## Only the bytes of .text changed: the output is patched, and is identical to
+## the output of a full link.
+# RUN: cp a2.o in.o
+# RUN: ld.lld --incremental --verbose main.o in.o -Ldir1 -Ldir2 -ll \
+# RUN:   --symbol-ordering-file=order.txt -o out 2>&1 | FileCheck %s --check-prefix=HIT
+# RUN: ld.lld main.o in.o -Ldir1 -Ldir2 -ll --symbol-ordering-file=order.txt \
+# RUN:   -o full 2>/dev/null
+# RUN: cmp out full
+# RUN: llvm-objdump -d --no-show-raw-insn out | FileCheck %s --check-prefix=DIS
+# HIT: warning: symbol ordering file: no such symbol: missing_sym
+# HIT: --incremental: patched 1 sections from 1 files
+# DIS:      <f>:
+# DIS-NEXT:   movl $0x2a, %eax
+
+## A section grew: full link.
+# RUN: cp grow.o in.o
+# RUN: ld.lld --incremental --verbose main.o in.o -Ldir1 -Ldir2 -ll \
+# RUN:   --symbol-ordering-file=order.txt -o out 2>&1 | FileCheck %s --check-prefix=MISS
+# MISS: --incremental: performing a full link: in.o changed more than section contents
+
+## A library that shadows the one found before: full link.
+# RUN: llvm-ar rc dir1/libl.a lib.o
+# RUN: ld.lld --incremental --verbose main.o in.o -Ldir1 -Ldir2 -ll \
+# RUN:   --symbol-ordering-file=order.txt -o out 2>&1 | FileCheck %s --check-prefix=SHADOW
+# SHADOW: --incremental: performing a full link: dir1{{/|\\}}libl.a was created
+
+## A different command line: full link.
+# RUN: ld.lld --incremental --verbose main.o in.o -Ldir1 -Ldir2 -ll -o out \
+# RUN:   2>&1 | FileCheck %s --check-prefix=ARGS
+# ARGS: --incremental: performing a full link: the command line changed
+
+## Options whose output depends on section contents disable the feature.
+# RUN: ld.lld --incremental --verbose --build-id main.o in.o -Ldir1 -Ldir2 -ll \
+# RUN:   -o out 2>&1 | FileCheck %s --check-prefix=UNSUPPORTED
+# RUN: not ls out.incr
+# UNSUPPORTED: --incremental: the output cannot be updated incrementally
+
+#--- main.s
+.globl _start
+_start:
+  call f
+  call g
+
+#--- a.s
+.globl f
+f:
+  movl $1, %eax
+  ret
+
+#--- a2.s
+.globl f
+f:
+  movl $42, %eax
+  ret
+
+#--- grow.s
+.globl f
+f:
+  movl $42, %eax
+  nop
+  ret
+
+#--- lib.s
+.globl g
+g:
+  ret
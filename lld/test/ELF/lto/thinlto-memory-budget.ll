@@ -0,0 +1,136 @@
+; REQUIRES: x86
+;; Test that ThinLTO backends are started by their predicted cost, most
+;; expensive first, and that --thinlto-memory-budget= delays backends until
+;; the memory they are predicted to use fits in the budget.
+
+; RUN: rm -rf %t && split-file %s %t && cd %t
+; RUN: opt -module-summary big.ll -o big.o
+; RUN: opt -module-summary mid.ll -o mid.o
+; RUN: opt -module-summary small.ll -o small.o
+; RUN: opt -module-summary data.ll -o data.o
+
+;; The main thread starts the backends most expensive first. data.o has the
+;; largest bitcode but no instructions, so it is started last. Without a
+;; budget, no backend waits.
+; RUN: ld.lld --thinlto-jobs=4 --time-trace=order.json \
+; RUN:   --time-trace-granularity=0 -shared small.o data.o mid.o big.o -o order.so
+; RUN: FileCheck %s --check-prefix=ORDER \
+; RUN:   --implicit-check-not="Wait for ThinLTO memory budget" < order.json
+; ORDER: "name":"Start ThinLTO backend job","args":{"detail":"big.o"}
+; ORDER: "name":"Start ThinLTO backend job","args":{"detail":"mid.o"}
+; ORDER: "name":"Start ThinLTO backend job","args":{"detail":"small.o"}
+; ORDER: "name":"Start ThinLTO backend job","args":{"detail":"data.o"}
+
+;; With a 1 MB budget and a large enough estimate per instruction, every
+;; module but data.o is predicted to exceed the budget on its own. Each
+;; backend waits for the budget, the oversized ones run alone, and all of them
+;; complete with the same result.
+; RUN: ld.lld --thinlto-jobs=4 --thinlto-memory-budget=1 \
+; RUN:   -mllvm -thinlto-backend-bytes-per-inst=1000000 \
+; RUN:   --time-trace=budget.json --time-trace-granularity=0 \
+; RUN:   -shared small.o data.o mid.o big.o -o budget.so
+; RUN: FileCheck %s --check-prefix=BUDGET < budget.json
+; RUN: cmp order.so budget.so
+; BUDGET-DAG: "name":"Wait for ThinLTO memory budget","args":{"detail":"big.o"}
+; BUDGET-DAG: "name":"Wait for ThinLTO memory budget","args":{"detail":"mid.o"}
+; BUDGET-DAG: "name":"Wait for ThinLTO memory budget","args":{"detail":"small.o"}
+; BUDGET-DAG: "name":"Wait for ThinLTO memory budget","args":{"detail":"data.o"}
+; BUDGET-DAG: "name":"ThinLTO backend job","args":{"detail":"big.o"}
+; BUDGET-DAG: "name":"ThinLTO backend job","args":{"detail":"mid.o"}
+; BUDGET-DAG: "name":"ThinLTO backend job","args":{"detail":"small.o"}
+; BUDGET-DAG: "name":"ThinLTO backend job","args":{"detail":"data.o"}
+
+;; Backends whose results are found in the cache do not count against the
+;; budget.
+; RUN: ld.lld --thinlto-jobs=4 --thinlto-memory-budget=1 \
+; RUN:   -mllvm -thinlto-backend-bytes-per-inst=1000000 \
+; RUN:   --thinlto-cache-dir=cache -shared small.o data.o mid.o big.o -o miss.so
+; RUN: ld.lld --thinlto-jobs=4 --thinlto-memory-budget=1 \
+; RUN:   -mllvm -thinlto-backend-bytes-per-inst=1000000 \
+; RUN:   --thinlto-cache-dir=cache --time-trace=hit.json \
+; RUN:   --time-trace-granularity=0 -shared small.o data.o mid.o big.o -o hit.so
+; RUN: FileCheck %s --check-prefix=HIT \
+; RUN:   --implicit-check-not="Wait for ThinLTO memory budget" < hit.json
+; RUN: cmp order.so hit.so
+; HIT-COUNT-4: "name":"ThinLTO backend job"
+
+;--- big.ll
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-i128:128-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define i32 @big(i32 %x0) {
+  %x1 = mul i32 %x0, 2
+  %x2 = mul i32 %x1, 3
+  %x3 = mul i32 %x2, 4
+  %x4 = mul i32 %x3, 5
+  %x5 = mul i32 %x4, 6
+  %x6 = mul i32 %x5, 7
+  %x7 = mul i32 %x6, 8
+  %x8 = mul i32 %x7, 9
+  %x9 = mul i32 %x8, 10
+  %x10 = mul i32 %x9, 11
+  %x11 = mul i32 %x10, 12
+  %x12 = mul i32 %x11, 13
+  %x13 = mul i32 %x12, 14
+  %x14 = mul i32 %x13, 15
+  %x15 = mul i32 %x14, 16
+  %x16 = mul i32 %x15, 17
+  %x17 = mul i32 %x16, 18
+  %x18 = mul i32 %x17, 19
+  %x19 = mul i32 %x18, 20
+  %x20 = mul i32 %x19, 21
+  %x21 = mul i32 %x20, 22
+  %x22 = mul i32 %x21, 23
+  %x23 = mul i32 %x22, 24
+  %x24 = mul i32 %x23, 25
+  %x25 = mul i32 %x24, 26
+  %x26 = mul i32 %x25, 27
+  %x27 = mul i32 %x26, 28
+  %x28 = mul i32 %x27, 29
+  %x29 = mul i32 %x28, 30
+  %x30 = mul i32 %x29, 31
+  %x31 = mul i32 %x30, 32
+  %x32 = mul i32 %x31, 33
+  %x33 = mul i32 %x32, 34
+  %x34 = mul i32 %x33, 35
+  %x35 = mul i32 %x34, 36
+  %x36 = mul i32 %x35, 37
+  %x37 = mul i32 %x36, 38
+  %x38 = mul i32 %x37, 39
+  %x39 = mul i32 %x38, 40
+  %x40 = mul i32 %x39, 41
+  ret i32 %x40
+}
+
+;--- mid.ll
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-i128:128-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define i32 @mid(i32 %x0) {
+  %x1 = mul i32 %x0, 2
+  %x2 = mul i32 %x1, 3
+  %x3 = mul i32 %x2, 4
+  %x4 = mul i32 %x3, 5
+  %x5 = mul i32 %x4, 6
+  %x6 = mul i32 %x5, 7
+  %x7 = mul i32 %x6, 8
+  %x8 = mul i32 %x7, 9
+  %x9 = mul i32 %x8, 10
+  %x10 = mul i32 %x9, 11
+  ret i32 %x10
+}
+
+;--- small.ll
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-i128:128-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define i32 @small(i32 %x0) {
+  %x1 = mul i32 %x0, 2
+  ret i32 %x1
+}
+
+;--- data.ll
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-i128:128-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+@data = constant [4096 x i8] c"iK2ZWeqhFWCEPyYngFb51yBMWXaSCrUZoL8g5ubbbPIa84yRnBUbHoWC8FJowoRoWD8s7bA16J7PglOU3shVv5UTG79BG16QmtsL4F28GzL2cEpVZzAQlxJ4SXRVxfCQGgXkH1zxFUbEctT2NLLzPkkGoaXmI63JozGw82KwD6rQJM9UayY20948VGZiHXJnB8dE3xKJm8GAF0wAwaIINYNvDMbZoOlJLl3fZJZ207qc18Ref3bCaWWrprhZNlwsekkqH8kQrPTsDSuFEhbtyvAYmqgq5UGn9MB0bobzjcU9kCTGRBI1oOZSHCoHPbzRKZuQOBdVti9n4dte2et68tVkAKqiaJ42cL0n95KDk033XTNGcymwgnKR5BLmFg8QysGFbuN3z5sbkm2uZKYivBnrRg1y7Jw641RIFXIpeUcfikk6InrWvMG1qxvvhsp38MX9T4FiLJXgucAey3Yj1ivhNLY7yeKJoKf8rx5sKI7hD5rgYc0saNQafAh04YcmpYLAkhCkRpkV2gB69yZI60sJqTEugnPucbaY7sUMuCzuzee6uMDhqnYNX5I3SEQwqlIntmpxf0rfWCfPKPv8oy9tculuY2L56tpvgINLZMfpobZpzerJ3eUebOasWYwFE32jgGXYueG8QllXjj03utgTG16Msi5njI6UcXu05NZR6J18VSnltBIkdT3QpqXeR9CZBJqIC2IDaz1vkqFbYP7AKbdSwLiLiiq1rzKzlNfoFalHuG5P6C7ROUopuFRE9oTAvJN6U6PrPod6eWGP4xkGXY4nttSt2JxkSSVDMf2h5M9GKyljqBn8KUWYdFRzTOwyG2kIUcHfZqOgrV6f9iXN19QRSfC27p2y8Z5Bzk6uCiN6F9nhBMIA6hQsrpyVJa9mHCLbbOMp1qnlsjImrtLWq1RCY3Z2kIwFA2hXnK4ynsZg5ZbhKVaIs9RWUPieGxKZtBGRwWHuahCTCwtIzvYURKFhP6yynJarOMU4V1UGm7DM1HA7VTtSkCNQHmxHaRyLBzv3NLUS59VeFVpO9PsObAUOjOX7zYr2lXe0XMaw6qZTA3RItjD1qFkDGcrGgVLBeweQCbkGT8kSfzOSrMtnHnp4vreeS16HQxDGJVdktPVT0JrwNVozJzlEYq3NvToq9NTp2Qb253Nzu7B7WpYrmeOUk3LCL67UjM8qDHkiXi5TCxtWzphTnTRtegozuF7g9lcdZMb4WnRcFTH0U94NCvQ1rhNSlgozoFCyWkop0sDJLynCTqvFLh6nfcaZa2Eu4y2Ls6mzk40WPjY6bayj4QIdKyqifDP1t5acIdH1ic7rXhBfmbFOiVrR02mQCyvOrqPOppdL7YLlwBMSJOHd5wJAImT4IB6QeTrVNUWeqlgjd6n2B2cdOf60GEGxguciIcCQi5zWT54CbVHrfqZuftc3ydUquViqYyZh2RtgB1pGJnv7vGYz95LEgiP0CHJU21LSHIb51sVkmxyHugAwiKect0ZPIuAtuwruVVHGaHhju6UuYuKeCrED6x7Vy047f7LZdidHFK2qYpSKVvx8ZPxztDMvIGkbjqRoKi6hlXA8UNdZgIRrTgnqeOKHPf2eY2nP1lG3BbLx52FTZso5mMF355pBCRxI68mZEUe01qAmaVIXyG4FezN4GYLLBcw2Dam9tSSPaIh0tG4VuXIPKJsHAI8079HAMOLtCtiGCLiJXkqOaBVQKcxAzs7Q5WQb5f7f2ayrDrYYxOV2EXvyDZhEwjAjbl0qx2iLYs8Aq8GsVASrBvX6FnT1F8zTBfein9joUbgqjEX8gzPUl1afBN9dJnIBwd8P7gVJRA1QVhqRrlEZYT2dYnRPf3yhQCsRGF5zhM2EgjyN5SmkHqAV47Is3FO5ZI6nYWNv3FgaWUQw749TrdIOCtW51goGrrTpAjiqmAJOM59dI1MGj8ArrEStrFnFxMEpvlMWlV4LSCIjdGuHSiPWZ5nuNFEvhi4iSqofOI1SdKlRhoKmGKQ4tBuaXb0t0NofVorRO3vrMUHybhvwihq5XjRKcwefUgtuprHdxbfi7zx7UOSpgRvraG4u98hw7ZYPU1iM73rzfRKNUHEKAI7zt5oOtJidMGhlpn5BrIbqIr8HqEizTgVxePIxIJ2ZUGRLbNtCRije6LjR40nE1Z2Xvx4skj2Yy1CzhMjrsQRZOM8aI8a60PiyVJ84gDbXBMRBr7xAzMDdgEXcPTSaZc1hLiHGWwJrYK69PwZE0Sp7ZNpgJ8w3khXc6TuB4UwqQO5X6dNBAywsW0vCZSpONHjdvRh5GlIPOF5vWThLbE5nyO18lzTogpvvQpYRDVExFPXQU7mBCzIhKF7r1ijayAgZbPe8lDXyQGZ0s6jjH0g8qbDzZOTVY6oISzaIZpB6kQlvQpeXI7J9klyLbGnBpYc7HUmSGSNPIepzXDhKPdyfJgP0EcHpXab92tDrUAkMiJT0uXIOCGZAJkSzSyZmF0rx7jqKr2lXUNfUxv7jqqqwyrKDaj9i9qomeZLINmIBT3pKiJDzTmfO7ejYQdbVzyARiLMiRIIe7p2yismQUzwV1lotTjwFIsfG0tnTDbsZZNLgNxWCqNdd1YukZi97O0gh2BOLpVnGGzh65Tn08yQ7Hi0TLqUaThZmWKyQEINorcOkQQ6JGo2A9rXQAzrFgQ11ilJbDWcFnz0UI07v6pgeRVc2B1Cm9lMGm2GyHxmoxQ4LWXev5dDc1Nl5j268sEcLGe31KzfzYG1KPtzr5wE97dJ863EbBtLVuYjMLJ2re3MYYXxAzHYbKLhcKHag5vv7xWJcOxLeF5Of2ICvG6ZIa7k6uxnj5LjLgzu3GA0xv2qMxcTeXOp0YqWzJsKYNfeTk578rAfisJUPqpngrUEdVGtY3Zn0IeJuv7s3HicC0xZVcbuAVk4JcTLSQO3HBl5mohLiLGhUrDmYdx9Dv79NUwo77OaaFckq5JcaoW4fH0lc8HmnCspFGxuz8PemMlmRNt97LBNExbFb7gQOKQN82B0TLvvePAmSGZF811MKQJ8G2EMRVK52XCMEk1rR0HtKWZzMIqqtaMWcYDD5woGCnSE7vSOjy3BdPhw3Y6aqWIVdtyauvtL4Y03dnTfvhQ0PeiXSs9AMvob9PSSlWXWGVKPxtsyA7HDZ32e8mA8oMcNpOopTzynNjUtVU4xaTTRtCFkRjbxBJv3ZGFu8MhLPsZJQrBa1tWfOFhGo3MVPV7qBxYodgMGGGkis7d4enaRdBUT2bedacIvvYbNaJnEmrsLJHq4olnz4dpJSCcvuAhbKlGOfWlnolt5ZgdYu4Uje1CjocVs9wdLfCmYoQlhdmdVUhf8YZVo8sTqHB3pUcUqWmuwwDW37Q3Ny3RyfB7p11F4v6lMPhpeXZB4rIt67vW1xADxwuz9EGbxitktKi3JTUjkDPOjikf0NqpwPukr2EteBjJw4C6g2jRueRlEIccU9mPwV9xG73w22YGOZQxvPhl8ycr4NT9Zndp12tuKzpxXdo8sSKamgioxG4rjkoetKGG54IM53IYB33CLGElG3wmBZernoWjiXnbkFxldYxfNpRS3nfCPPmMvkKS11QT7bnu4EJc5d2xFJwiFeGuQV7KQtMu4YKfEvA2eqeQP2ubl6uouq10q3t8FA8askOsdhBB7NnrwXPUKFKsMqRlujwgzwHVKS3mzCj1ESpcUOpfVecHGEKESu6HYkKTFzayJUJ1VCkLLxd1Ux0wCpSPQIt2fCW3wmkiC71c9xKvZlKFEaKo44NdCPkGnzDhuqikvilZ6VNHtoJTBDDGJtkHNG9tL1YnsRjRa0vhByTPGVlN4CC0ICx1ndfUggIyiCzlECH2LcLm8LCFys6wXWl1Mrl4XbJdZQe7JoC2uCv4VgydVDr7ADvGgkzI3B44NV2EGjujwiNmoYZn4DP4jgSgBdDjxJu8rzayFTCtVTtPLyu2WslgFlCjDgIhIuu0F8RJ7OvULuJLZDuFSz0I6nkpIm2M7pdXu5NWdvA8bwxxMM4Q3AnY52s6ouzSyQXlayP599wMYXN15ooe0NuynT3sgBaZwfZA8jhIYU0lWvjyBuI3O8SHr8"
@@ -0,0 +1,141 @@
+//===- MCRelaxationBM.cpp - Benchmarks for MCAssembler relaxation ---------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Assembles synthetic x86-64 functions whose branches need many rounds of
+// relaxation. The benchmarks are skipped if the X86 target is not built.
+//
+//===----------------------------------------------------------------------===//
+
+#include "benchmark/benchmark.h"
+#include "llvm/MC/MCAsmBackend.h"
+#include "llvm/MC/MCAsmInfo.h"
+#include "llvm/MC/MCCodeEmitter.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCObjectFileInfo.h"
+#include "llvm/MC/MCObjectWriter.h"
+#include "llvm/MC/MCParser/MCAsmParser.h"
+#include "llvm/MC/MCParser/MCTargetAsmParser.h"
+#include "llvm/MC/MCRegisterInfo.h"
+#include "llvm/MC/MCStreamer.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/MC/MCTargetOptions.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include <string>
+
+using namespace llvm;
+
+// A chain of short jumps, each just within range of a label a few blocks
+// ahead. The jumps at the end are out of range of the final label, and each
+// one that is relaxed pushes the jumps spanning it out of range in turn, so
+// relaxation proceeds backwards a few blocks at a time.
+static std::string makeBranchCascade(unsigned N) {
+  constexpr unsigned Span = 8;
+  std::string S;
+  raw_string_ostream OS(S);
+  OS << "\t.text\n\t.globl cascade\ncascade:\n";
+  for (unsigned I = 0; I != N; ++I) {
+    OS << ".Lb" << I << ":\n";
+    if (I + Span < N)
+      OS << "\tjmp .Lb" << I + Span << "\n";
+    else
+      OS << "\tjmp .Lend\n";
+    // Fourteen bytes of padding make each block 16 bytes with a short jump,
+    // so a jump eight blocks ahead is 126 bytes from its end.
+    OS << "\tmovabsq $1, %rax\n\taddl $1, %eax\n\tnop\n";
+  }
+  OS << "\t.fill 256, 1, 0x90\n.Lend:\n\tretq\n";
+  return S;
+}
+
+// A large switch lowered to a compare chain, with every case body jumping to
+// a common exit.
+static std::string makeSwitch(unsigned N) {
+  std::string S;
+  raw_string_ostream OS(S);
+  OS << "\t.text\n\t.globl dispatch\ndispatch:\n";
+  for (unsigned I = 0; I != N; ++I)
+    OS << "\tcmpl $" << I << ", %edi\n\tje .Lcase" << I << "\n";
+  OS << "\tjmp .Lexit\n";
+  for (unsigned I = 0; I != N; ++I)
+    OS << ".Lcase" << I << ":\n\taddl $" << I << ", %eax\n\tjmp .Lexit\n";
+  OS << ".Lexit:\n\tretq\n";
+  return S;
+}
+
+static void assemble(benchmark::State &State, const std::string &Source) {
+  InitializeAllTargetInfos();
+  InitializeAllTargetMCs();
+  InitializeAllAsmParsers();
+
+  Triple TT("x86_64-unknown-linux-gnu");
+  std::string Error;
+  const Target *T = TargetRegistry::lookupTarget(TT.str(), Error);
+  if (!T) {
+    State.SkipWithError("X86 target not available");
+    return;
+  }
+  MCTargetOptions Options;
+  std::unique_ptr<MCRegisterInfo> MRI(T->createMCRegInfo(TT.str()));
+  std::unique_ptr<MCAsmInfo> MAI(T->createMCAsmInfo(*MRI, TT.str(), Options));
+  std::unique_ptr<MCInstrInfo> MII(T->createMCInstrInfo());
+  std::unique_ptr<MCSubtargetInfo> STI(
+      T->createMCSubtargetInfo(TT.str(), "", ""));
+
+  SmallString<0> Object;
+  for (auto _ : State) {
+    SourceMgr SrcMgr;
+    SrcMgr.AddNewSourceBuffer(
+        MemoryBuffer::getMemBuffer(Source, "bench.s",
+                                   /*RequiresNullTerminator=*/false),
+        SMLoc());
+    MCContext Ctx(TT, MAI.get(), MRI.get(), STI.get(), &SrcMgr);
+    std::unique_ptr<MCObjectFileInfo> MOFI(
+        T->createMCObjectFileInfo(Ctx, /*PIC=*/false));
+    Ctx.setObjectFileInfo(MOFI.get());
+
+    Object.clear();
+    raw_svector_ostream OS(Object);
+    std::unique_ptr<MCAsmBackend> MAB(
+        T->createMCAsmBackend(*STI, *MRI, Options));
+    std::unique_ptr<MCObjectWriter> OW = MAB->createObjectWriter(OS);
+    std::unique_ptr<MCStreamer> Str(T->createMCObjectStreamer(
+        TT, Ctx, std::move(MAB), std::move(OW),
+        std::unique_ptr<MCCodeEmitter>(T->createMCCodeEmitter(*MII, Ctx)),
+        *STI, /*RelaxAll=*/false, /*IncrementalLinkerCompatible=*/false,
+        /*DWARFMustBeAtTheEnd=*/false));
+
+    std::unique_ptr<MCAsmParser> Parser(
+        createMCAsmParser(SrcMgr, Ctx, *Str, *MAI));
+    std::unique_ptr<MCTargetAsmParser> TAP(
+        T->createMCAsmParser(*STI, *Parser, *MII, Options));
+    Parser->setTargetParser(*TAP);
+    if (Parser->Run(/*NoInitialTextSection=*/false)) {
+      State.SkipWithError("failed to assemble");
+      return;
+    }
+    benchmark::DoNotOptimize(Object.data());
+  }
+  State.SetBytesProcessed(State.iterations() * Source.size());
+}
+
+static void BM_RelaxBranchCascade(benchmark::State &State) {
+  assemble(State, makeBranchCascade(State.range(0)));
+}
+BENCHMARK(BM_RelaxBranchCascade)->Arg(1 << 10)->Arg(1 << 13)->Arg(1 << 16);
+
+static void BM_RelaxSwitch(benchmark::State &State) {
+  assemble(State, makeSwitch(State.range(0)));
+}
+BENCHMARK(BM_RelaxSwitch)->Arg(1 << 10)->Arg(1 << 14);
+
+BENCHMARK_MAIN();
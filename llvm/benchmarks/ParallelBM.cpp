@@ -0,0 +1,110 @@
+//===- ParallelBM.cpp - Benchmarks for llvm/Support/Parallel.h ------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// The default executor is created with a fixed number of threads on first use,
+// so the thread count is selected for the whole run with --threads=N (0 means
+// all hardware threads). To measure scaling, run the benchmark once per thread
+// count, e.g. for N in 1 2 4 ... 128.
+//
+//===----------------------------------------------------------------------===//
+
+#include "benchmark/benchmark.h"
+#include "llvm/Support/Parallel.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace llvm;
+
+// Some work whose cost is proportional to N and which the optimizer cannot
+// remove.
+static uint64_t spin(uint64_t Seed, unsigned N) {
+  for (unsigned I = 0; I != N; ++I)
+    Seed = Seed * 6364136223846793005ULL + 1442695040888963407ULL;
+  return Seed;
+}
+
+// Many small chunks: measures the per-task scheduling overhead.
+static void BM_ParallelForSmallTasks(benchmark::State &State) {
+  size_t N = State.range(0);
+  std::vector<uint64_t> Out(N);
+  for (auto _ : State)
+    parallelFor(0, N, [&](size_t I) { Out[I] = spin(I, 16); });
+  State.SetItemsProcessed(State.iterations() * N);
+}
+BENCHMARK(BM_ParallelForSmallTasks)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 20);
+
+// Item costs vary by two orders of magnitude, so idle workers have to steal.
+static void BM_ParallelForUnbalanced(benchmark::State &State) {
+  size_t N = State.range(0);
+  std::vector<unsigned> Cost(N);
+  std::mt19937 Rng(0);
+  for (unsigned &C : Cost)
+    C = (Rng() % 64 == 0) ? 4096 : 32;
+  std::vector<uint64_t> Out(N);
+  for (auto _ : State)
+    parallelFor(0, N, [&](size_t I) { Out[I] = spin(I, Cost[I]); });
+  State.SetItemsProcessed(State.iterations() * N);
+}
+BENCHMARK(BM_ParallelForUnbalanced)->Arg(1 << 16);
+
+// A parallelFor inside each iteration of a parallelFor.
+static void BM_NestedParallelFor(benchmark::State &State) {
+  size_t Outer = State.range(0);
+  size_t Inner = 1024;
+  std::vector<uint64_t> Out(Outer * Inner);
+  for (auto _ : State)
+    parallelFor(0, Outer, [&](size_t I) {
+      parallelFor(0, Inner, [&](size_t J) {
+        Out[I * Inner + J] = spin(I ^ J, 64);
+      });
+    });
+  State.SetItemsProcessed(State.iterations() * Outer * Inner);
+}
+BENCHMARK(BM_NestedParallelFor)->Arg(8)->Arg(256);
+
+static void BM_ParallelSort(benchmark::State &State) {
+  size_t N = State.range(0);
+  std::vector<uint64_t> Input(N);
+  std::mt19937_64 Rng(0);
+  for (uint64_t &V : Input)
+    V = Rng();
+  std::vector<uint64_t> V;
+  for (auto _ : State) {
+    State.PauseTiming();
+    V = Input;
+    State.ResumeTiming();
+    parallelSort(V.begin(), V.end());
+  }
+  State.SetItemsProcessed(State.iterations() * N);
+}
+BENCHMARK(BM_ParallelSort)->Arg(1 << 20);
+
+int main(int argc, char **argv) {
+  // Remove --threads=N before handing the remaining flags to the benchmark
+  // library.
+  int NewArgc = 1;
+  for (int I = 1; I < argc; ++I) {
+    if (strncmp(argv[I], "--threads=", 10) == 0)
+      parallel::strategy = hardware_concurrency(atoi(argv[I] + 10));
+    else
+      argv[NewArgc++] = argv[I];
+  }
+  argc = NewArgc;
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    return 1;
+  benchmark::AddCustomContext("threads",
+                              std::to_string(parallel::getThreadCount()));
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
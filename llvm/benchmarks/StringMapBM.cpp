@@ -0,0 +1,80 @@
+//===- StringMapBM.cpp - Benchmarks for StringMap and SwissStringMap ------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "benchmark/benchmark.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/SwissStringMap.h"
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+// Symbol-like keys of varying length. Keys with Miss set are never inserted.
+static std::vector<std::string> makeKeys(size_t N, bool Miss) {
+  std::mt19937_64 Rng(Miss ? 1 : 0);
+  std::vector<std::string> Keys;
+  Keys.reserve(N);
+  for (size_t I = 0; I != N; ++I) {
+    std::string Key = Miss ? "_ZN4miss" : "_ZN4llvm";
+    Key += std::to_string(Rng() % (1ULL << (8 + I % 32)));
+    Key += std::to_string(I);
+    Keys.push_back(std::move(Key));
+  }
+  return Keys;
+}
+
+template <typename MapTy> static void BM_Insert(benchmark::State &State) {
+  std::vector<std::string> Keys = makeKeys(State.range(0), false);
+  for (auto _ : State) {
+    MapTy Map;
+    for (const std::string &Key : Keys)
+      Map.try_emplace(Key, 0);
+    benchmark::DoNotOptimize(Map.size());
+    State.PauseTiming();
+    Map.clear();
+    State.ResumeTiming();
+  }
+  State.SetItemsProcessed(State.iterations() * Keys.size());
+}
+
+template <typename MapTy> static void BM_FindHit(benchmark::State &State) {
+  std::vector<std::string> Keys = makeKeys(State.range(0), false);
+  MapTy Map;
+  for (const std::string &Key : Keys)
+    Map.try_emplace(Key, 0);
+  std::shuffle(Keys.begin(), Keys.end(), std::mt19937(2));
+  for (auto _ : State)
+    for (const std::string &Key : Keys)
+      benchmark::DoNotOptimize(Map.find(Key));
+  State.SetItemsProcessed(State.iterations() * Keys.size());
+}
+
+template <typename MapTy> static void BM_FindMiss(benchmark::State &State) {
+  MapTy Map;
+  for (const std::string &Key : makeKeys(State.range(0), false))
+    Map.try_emplace(Key, 0);
+  std::vector<std::string> Keys = makeKeys(State.range(0), true);
+  for (auto _ : State)
+    for (const std::string &Key : Keys)
+      benchmark::DoNotOptimize(Map.find(Key));
+  State.SetItemsProcessed(State.iterations() * Keys.size());
+}
+
+// 1K to 10M entries. 100M entries would need about 10 GB of memory.
+#define STRINGMAP_BENCHMARK(Fn, MapTy)                                         \
+  BENCHMARK_TEMPLATE(Fn, MapTy)->RangeMultiplier(10)->Range(1000, 10000000)
+
+STRINGMAP_BENCHMARK(BM_Insert, StringMap<unsigned>);
+STRINGMAP_BENCHMARK(BM_Insert, SwissStringMap<unsigned>);
+STRINGMAP_BENCHMARK(BM_FindHit, StringMap<unsigned>);
+STRINGMAP_BENCHMARK(BM_FindHit, SwissStringMap<unsigned>);
+STRINGMAP_BENCHMARK(BM_FindMiss, StringMap<unsigned>);
+STRINGMAP_BENCHMARK(BM_FindMiss, SwissStringMap<unsigned>);
+
+BENCHMARK_MAIN();
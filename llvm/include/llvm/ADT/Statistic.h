@@ -202,6 +202,11 @@ void PrintStatisticsJSON(raw_ostream &OS);
 /// completes.
 std::vector<std::pair<StringRef, uint64_t>> GetStatistics();
 
+/// Get the registered statistics themselves rather than their values, e.g. to
+/// add to them the values collected by a process forked from this one, where
+/// they have the same addresses.
+std::vector<TrackingStatistic *> GetTrackedStatistics();
+
 /// Reset the statistics. This can be used to zero and de-register the
 /// statistics in order to measure a compilation.
 ///
@@ -0,0 +1,420 @@
+//===- SwissStringMap.h - Swiss table variant of StringMap ------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file defines the SwissStringMap class, a drop-in replacement for
+/// StringMap that probes a whole group of buckets at once.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_ADT_SWISSSTRINGMAP_H
+#define LLVM_ADT_SWISSSTRINGMAP_H
+
+#include "llvm/ADT/StringMap.h"
+
+namespace llvm {
+
+/// SwissStringMapImpl - This is the base class of SwissStringMap that is
+/// shared among all of its instantiations.
+///
+/// The table is split into groups of 16 buckets (8 on targets without SSE2).
+/// Each bucket has a control byte which is either empty, deleted or holds the
+/// low 7 bits of the hash of its key. A probe loads the control bytes of a
+/// whole group and compares them against the hash in one step, so a lookup
+/// usually inspects a single group, and a miss rarely touches an entry. The
+/// full hash values are only kept to grow the table without rehashing keys.
+class SwissStringMapImpl {
+protected:
+  // Array of NumBuckets pointers to entries, null pointers are holes.
+  // TheTable[NumBuckets] contains a sentinel value for easy iteration. Followed
+  // by an array of the actual hash values as unsigned integers and an array of
+  // NumBuckets control bytes.
+  StringMapEntryBase **TheTable = nullptr;
+  unsigned NumBuckets = 0;
+  unsigned NumItems = 0;
+  unsigned NumTombstones = 0;
+  unsigned ItemSize;
+
+protected:
+  explicit SwissStringMapImpl(unsigned itemSize) : ItemSize(itemSize) {}
+  SwissStringMapImpl(SwissStringMapImpl &&RHS)
+      : TheTable(RHS.TheTable), NumBuckets(RHS.NumBuckets),
+        NumItems(RHS.NumItems), NumTombstones(RHS.NumTombstones),
+        ItemSize(RHS.ItemSize) {
+    RHS.TheTable = nullptr;
+    RHS.NumBuckets = 0;
+    RHS.NumItems = 0;
+    RHS.NumTombstones = 0;
+  }
+
+  SwissStringMapImpl(unsigned InitSize, unsigned ItemSize);
+  unsigned RehashTable(unsigned BucketNo = 0);
+
+  /// LookupBucketFor - Look up the bucket that the specified string should end
+  /// up in.  If it already exists as a key in the map, the Item pointer for the
+  /// specified bucket will be non-null.  Otherwise, it will be null or the
+  /// tombstone, and the bucket is claimed for \p Key.
+  unsigned LookupBucketFor(StringRef Key) {
+    return LookupBucketFor(Key, hash(Key));
+  }
+
+  /// Overload that explicitly takes precomputed hash(Key).
+  unsigned LookupBucketFor(StringRef Key, uint32_t FullHashValue);
+
+  /// FindKey - Look up the bucket that contains the specified key. If it exists
+  /// in the map, return the bucket number of the key.  Otherwise return -1.
+  /// This does not modify the map.
+  int FindKey(StringRef Key) const { return FindKey(Key, hash(Key)); }
+
+  /// Overload that explicitly takes precomputed hash(Key).
+  int FindKey(StringRef Key, uint32_t FullHashValue) const;
+
+  /// RemoveKey - Remove the specified StringMapEntry from the table, but do not
+  /// delete it.  This aborts if the value isn't in the table.
+  void RemoveKey(StringMapEntryBase *V);
+
+  /// RemoveKey - Remove the StringMapEntry for the specified key from the
+  /// table, returning it.  If the key is not in the table, this returns null.
+  StringMapEntryBase *RemoveKey(StringRef Key);
+
+  /// Allocate the table with the specified number of buckets and otherwise
+  /// setup the map as empty.
+  void init(unsigned Size);
+
+  /// Copy the bucket layout of \p RHS into this map, which must have been
+  /// initialized with the same number of buckets. Entry pointers are left for
+  /// the caller to fill in.
+  void copyLayout(const SwissStringMapImpl &RHS);
+
+  /// Mark all buckets as empty without freeing the table.
+  void clearBuckets();
+
+public:
+  static StringMapEntryBase *getTombstoneVal() {
+    return StringMapImpl::getTombstoneVal();
+  }
+
+  unsigned getNumBuckets() const { return NumBuckets; }
+  unsigned getNumItems() const { return NumItems; }
+
+  bool empty() const { return NumItems == 0; }
+  unsigned size() const { return NumItems; }
+
+  /// Returns the hash value that will be used for the given string. This is
+  /// the same value as StringMapImpl::hash(), so precomputed hashes can be
+  /// shared between both kinds of maps.
+  static uint32_t hash(StringRef Key) { return StringMapImpl::hash(Key); }
+
+  void swap(SwissStringMapImpl &Other) {
+    std::swap(TheTable, Other.TheTable);
+    std::swap(NumBuckets, Other.NumBuckets);
+    std::swap(NumItems, Other.NumItems);
+    std::swap(NumTombstones, Other.NumTombstones);
+  }
+};
+
+/// SwissStringMap - A StringMap whose hash table uses SIMD probing of groups of
+/// control bytes. It has the same interface, entry type and iterators as
+/// StringMap, so it can be used instead of a StringMap on a per instance basis
+/// where lookups dominate. Like StringMap, entries are allocated separately and
+/// never move, so references to them stay valid until they are erased.
+template <typename ValueTy, typename AllocatorTy = MallocAllocator>
+class LLVM_ALLOCATORHOLDER_EMPTYBASE SwissStringMap
+    : public SwissStringMapImpl,
+      private detail::AllocatorHolder<AllocatorTy> {
+  using AllocTy = detail::AllocatorHolder<AllocatorTy>;
+
+public:
+  using MapEntryTy = StringMapEntry<ValueTy>;
+
+  SwissStringMap()
+      : SwissStringMapImpl(static_cast<unsigned>(sizeof(MapEntryTy))) {}
+
+  explicit SwissStringMap(unsigned InitialSize)
+      : SwissStringMapImpl(InitialSize,
+                           static_cast<unsigned>(sizeof(MapEntryTy))) {}
+
+  explicit SwissStringMap(AllocatorTy A)
+      : SwissStringMapImpl(static_cast<unsigned>(sizeof(MapEntryTy))),
+        AllocTy(A) {}
+
+  SwissStringMap(unsigned InitialSize, AllocatorTy A)
+      : SwissStringMapImpl(InitialSize,
+                           static_cast<unsigned>(sizeof(MapEntryTy))),
+        AllocTy(A) {}
+
+  SwissStringMap(std::initializer_list<std::pair<StringRef, ValueTy>> List)
+      : SwissStringMapImpl(List.size(),
+                           static_cast<unsigned>(sizeof(MapEntryTy))) {
+    insert(List);
+  }
+
+  SwissStringMap(SwissStringMap &&RHS)
+      : SwissStringMapImpl(std::move(RHS)),
+        AllocTy(std::move(RHS.getAllocator())) {}
+
+  SwissStringMap(const SwissStringMap &RHS)
+      : SwissStringMapImpl(static_cast<unsigned>(sizeof(MapEntryTy))),
+        AllocTy(RHS.getAllocator()) {
+    if (RHS.empty())
+      return;
+
+    // Allocate a table of the same size as RHS's table and copy the hashes and
+    // control bytes, so that no key has to be probed for again.
+    init(RHS.NumBuckets);
+    copyLayout(RHS);
+    for (unsigned I = 0, E = NumBuckets; I != E; ++I) {
+      StringMapEntryBase *Bucket = RHS.TheTable[I];
+      if (!Bucket || Bucket == getTombstoneVal()) {
+        TheTable[I] = Bucket;
+        continue;
+      }
+
+      TheTable[I] = MapEntryTy::create(
+          static_cast<MapEntryTy *>(Bucket)->getKey(), getAllocator(),
+          static_cast<MapEntryTy *>(Bucket)->getValue());
+    }
+  }
+
+  SwissStringMap &operator=(SwissStringMap RHS) {
+    SwissStringMapImpl::swap(RHS);
+    std::swap(getAllocator(), RHS.getAllocator());
+    return *this;
+  }
+
+  ~SwissStringMap() {
+    if (!empty()) {
+      for (unsigned I = 0, E = NumBuckets; I != E; ++I) {
+        StringMapEntryBase *Bucket = TheTable[I];
+        if (Bucket && Bucket != getTombstoneVal())
+          static_cast<MapEntryTy *>(Bucket)->Destroy(getAllocator());
+      }
+    }
+    free(TheTable);
+  }
+
+  using AllocTy::getAllocator;
+
+  using key_type = const char *;
+  using mapped_type = ValueTy;
+  using value_type = StringMapEntry<ValueTy>;
+  using size_type = size_t;
+
+  using const_iterator = StringMapConstIterator<ValueTy>;
+  using iterator = StringMapIterator<ValueTy>;
+
+  iterator begin() { return iterator(TheTable, NumBuckets == 0); }
+  iterator end() { return iterator(TheTable + NumBuckets, true); }
+  const_iterator begin() const {
+    return const_iterator(TheTable, NumBuckets == 0);
+  }
+  const_iterator end() const {
+    return const_iterator(TheTable + NumBuckets, true);
+  }
+
+  iterator_range<StringMapKeyIterator<ValueTy>> keys() const {
+    return make_range(StringMapKeyIterator<ValueTy>(begin()),
+                      StringMapKeyIterator<ValueTy>(end()));
+  }
+
+  iterator find(StringRef Key) { return find(Key, hash(Key)); }
+
+  iterator find(StringRef Key, uint32_t FullHashValue) {
+    int Bucket = FindKey(Key, FullHashValue);
+    if (Bucket == -1)
+      return end();
+    return iterator(TheTable + Bucket, true);
+  }
+
+  const_iterator find(StringRef Key) const { return find(Key, hash(Key)); }
+
+  const_iterator find(StringRef Key, uint32_t FullHashValue) const {
+    int Bucket = FindKey(Key, FullHashValue);
+    if (Bucket == -1)
+      return end();
+    return const_iterator(TheTable + Bucket, true);
+  }
+
+  /// lookup - Return the entry for the specified key, or a default
+  /// constructed value if no such entry exists.
+  ValueTy lookup(StringRef Key) const {
+    const_iterator Iter = find(Key);
+    if (Iter != end())
+      return Iter->second;
+    return ValueTy();
+  }
+
+  /// at - Return the entry for the specified key, or abort if no such
+  /// entry exists.
+  const ValueTy &at(StringRef Val) const {
+    auto Iter = this->find(std::move(Val));
+    assert(Iter != this->end() &&
+           "SwissStringMap::at failed due to a missing key");
+    return Iter->second;
+  }
+
+  /// Lookup the ValueTy for the \p Key, or create a default constructed value
+  /// if the key is not in the map.
+  ValueTy &operator[](StringRef Key) { return try_emplace(Key).first->second; }
+
+  /// contains - Return true if the element is in the map, false otherwise.
+  bool contains(StringRef Key) const { return find(Key) != end(); }
+
+  /// count - Return 1 if the element is in the map, 0 otherwise.
+  size_type count(StringRef Key) const { return contains(Key) ? 1 : 0; }
+
+  template <typename InputTy>
+  size_type count(const StringMapEntry<InputTy> &MapEntry) const {
+    return count(MapEntry.getKey());
+  }
+
+  /// equal - check whether both of the containers are equal.
+  bool operator==(const SwissStringMap &RHS) const {
+    if (size() != RHS.size())
+      return false;
+
+    for (const auto &KeyValue : *this) {
+      auto FindInRHS = RHS.find(KeyValue.getKey());
+
+      if (FindInRHS == RHS.end())
+        return false;
+
+      if constexpr (!std::is_same_v<ValueTy, std::nullopt_t>) {
+        if (!(KeyValue.getValue() == FindInRHS->getValue()))
+          return false;
+      }
+    }
+
+    return true;
+  }
+
+  bool operator!=(const SwissStringMap &RHS) const { return !(*this == RHS); }
+
+  /// insert - Insert the specified key/value pair into the map.  If the key
+  /// already exists in the map, return false and ignore the request, otherwise
+  /// insert it and return true.
+  bool insert(MapEntryTy *KeyValue) {
+    unsigned BucketNo = LookupBucketFor(KeyValue->getKey());
+    StringMapEntryBase *&Bucket = TheTable[BucketNo];
+    if (Bucket && Bucket != getTombstoneVal())
+      return false; // Already exists in map.
+
+    if (Bucket == getTombstoneVal())
+      --NumTombstones;
+    Bucket = KeyValue;
+    ++NumItems;
+    assert(NumItems + NumTombstones <= NumBuckets);
+
+    RehashTable();
+    return true;
+  }
+
+  /// insert - Inserts the specified key/value pair into the map if the key
+  /// isn't already in the map. The bool component of the returned pair is true
+  /// if and only if the insertion takes place, and the iterator component of
+  /// the pair points to the element with key equivalent to the key of the pair.
+  std::pair<iterator, bool> insert(std::pair<StringRef, ValueTy> KV) {
+    return try_emplace_with_hash(KV.first, hash(KV.first),
+                                 std::move(KV.second));
+  }
+
+  std::pair<iterator, bool> insert(std::pair<StringRef, ValueTy> KV,
+                                   uint32_t FullHashValue) {
+    return try_emplace_with_hash(KV.first, FullHashValue, std::move(KV.second));
+  }
+
+  /// Inserts elements from range [first, last). If multiple elements in the
+  /// range have keys that compare equivalent, it is unspecified which element
+  /// is inserted .
+  template <typename InputIt> void insert(InputIt First, InputIt Last) {
+    for (InputIt It = First; It != Last; ++It)
+      insert(*It);
+  }
+
+  ///  Inserts elements from initializer list ilist. If multiple elements in
+  /// the range have keys that compare equivalent, it is unspecified which
+  /// element is inserted
+  void insert(std::initializer_list<std::pair<StringRef, ValueTy>> List) {
+    insert(List.begin(), List.end());
+  }
+
+  /// Inserts an element or assigns to the current element if the key already
+  /// exists. The return type is the same as try_emplace.
+  template <typename V>
+  std::pair<iterator, bool> insert_or_assign(StringRef Key, V &&Val) {
+    auto Ret = try_emplace(Key, std::forward<V>(Val));
+    if (!Ret.second)
+      Ret.first->second = std::forward<V>(Val);
+    return Ret;
+  }
+
+  /// Emplace a new element for the specified key into the map if the key isn't
+  /// already in the map. The bool component of the returned pair is true
+  /// if and only if the insertion takes place, and the iterator component of
+  /// the pair points to the element with key equivalent to the key of the pair.
+  template <typename... ArgsTy>
+  std::pair<iterator, bool> try_emplace(StringRef Key, ArgsTy &&...Args) {
+    return try_emplace_with_hash(Key, hash(Key), std::forward<ArgsTy>(Args)...);
+  }
+
+  template <typename... ArgsTy>
+  std::pair<iterator, bool> try_emplace_with_hash(StringRef Key,
+                                                  uint32_t FullHashValue,
+                                                  ArgsTy &&...Args) {
+    unsigned BucketNo = LookupBucketFor(Key, FullHashValue);
+    StringMapEntryBase *&Bucket = TheTable[BucketNo];
+    if (Bucket && Bucket != getTombstoneVal())
+      return std::make_pair(iterator(TheTable + BucketNo, false),
+                            false); // Already exists in map.
+
+    if (Bucket == getTombstoneVal())
+      --NumTombstones;
+    Bucket =
+        MapEntryTy::create(Key, getAllocator(), std::forward<ArgsTy>(Args)...);
+    ++NumItems;
+    assert(NumItems + NumTombstones <= NumBuckets);
+
+    BucketNo = RehashTable(BucketNo);
+    return std::make_pair(iterator(TheTable + BucketNo, false), true);
+  }
+
+  // clear - Empties out the SwissStringMap
+  void clear() {
+    if (empty())
+      return;
+
+    for (unsigned I = 0, E = NumBuckets; I != E; ++I) {
+      StringMapEntryBase *Bucket = TheTable[I];
+      if (Bucket && Bucket != getTombstoneVal())
+        static_cast<MapEntryTy *>(Bucket)->Destroy(getAllocator());
+    }
+    clearBuckets();
+  }
+
+  /// remove - Remove the specified key/value pair from the map, but do not
+  /// erase it.  This aborts if the key is not in the map.
+  void remove(MapEntryTy *KeyValue) { RemoveKey(KeyValue); }
+
+  void erase(iterator I) {
+    MapEntryTy &V = *I;
+    remove(&V);
+    V.Destroy(getAllocator());
+  }
+
+  bool erase(StringRef Key) {
+    iterator I = find(Key);
+    if (I == end())
+      return false;
+    erase(I);
+    return true;
+  }
+};
+
+} // end namespace llvm
+
+#endif // LLVM_ADT_SWISSSTRINGMAP_H
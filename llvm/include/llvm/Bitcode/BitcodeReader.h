@@ -29,6 +29,7 @@
 #include <vector>
 namespace llvm {
 
+class BitcodeImportCache;
 class LLVMContext;
 class Module;
 class MemoryBuffer;
@@ -112,6 +113,9 @@ struct ParserCallbacks {
     // The bitstream location of this module's MODULE_BLOCK.
     uint64_t ModuleBit;
 
+    // State shared by the modules loaded from this one for importing, if any.
+    std::shared_ptr<BitcodeImportCache> ImportCache;
+
     BitcodeModule(ArrayRef<uint8_t> Buffer, StringRef ModuleIdentifier,
                   uint64_t IdentificationBit, uint64_t ModuleBit)
         : Buffer(Buffer), ModuleIdentifier(ModuleIdentifier),
@@ -143,6 +147,14 @@ struct ParserCallbacks {
     getLazyModule(LLVMContext &Context, bool ShouldLazyLoadMetadata,
                   bool IsImporting, ParserCallbacks Callbacks = {});
 
+    /// Share what is read from this module independently of an LLVMContext,
+    /// such as the index used to lazily load its metadata, between all the
+    /// modules loaded from it with IsImporting set, including through copies
+    /// of this BitcodeModule made after the call. This saves reading the
+    /// module again for each import when it is imported from many times, as
+    /// in a ThinLTO link. The buffer must outlive all the copies.
+    void enableImportCache();
+
     /// Read the entire bitcode module and return it.
     Expected<std::unique_ptr<Module>>
     parseModule(LLVMContext &Context, ParserCallbacks Callbacks = {});
@@ -171,6 +171,12 @@ struct Config {
   /// Specific thinLTO modules to compile.
   std::vector<std::string> ThinLTOModulesToCompile;
 
+  /// If nonzero, the in-process ThinLTO backend only compiles a module when
+  /// the memory that it and the running backends are predicted to use, from
+  /// the number of instructions in the combined index, fits in this many
+  /// bytes. Modules found in the cache do not count against it.
+  uint64_t ThinLTOMemoryBudget = 0;
+
   /// Time trace enabled.
   bool TimeTraceEnabled = false;
 
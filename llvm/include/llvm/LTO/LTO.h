@@ -104,6 +104,7 @@ void updateMemProfAttributes(Module &Mod, const ModuleSummaryIndex &Index);
 
 class LTO;
 struct SymbolResolution;
+class ThinBackendExecutor;
 class ThinBackendProc;
 
 /// An input file. This is a symbol table wrapper that only exposes the
@@ -237,6 +238,20 @@ ThinBackend createWriteIndexesThinBackend(std::string OldPrefix,
                                           raw_fd_ostream *LinkedObjectsFile,
                                           IndexWriteCallback OnWrite);
 
+/// This ThinBackend runs the individual backend jobs outside of the linking
+/// process with \p Executor. For each module it writes the sharded index (and
+/// optionally the imports file) to a file in \p WorkDir and submits a job that
+/// compiles the module's bitcode file with it. The object file of each job is
+/// added to the link, and to the cache if there is one, as soon as the job
+/// finishes. This needs every module, and every module it imports from, to be
+/// a bitcode file on disk. If \p WorkDir is empty, a temporary directory is
+/// used, which is removed when all jobs have finished.
+ThinBackend
+createOutOfProcessThinBackend(std::shared_ptr<ThinBackendExecutor> Executor,
+                              std::string WorkDir = "",
+                              IndexWriteCallback OnWrite = nullptr,
+                              bool ShouldEmitImportsFiles = false);
+
 /// This class implements a resolution-based interface to LLVM's LTO
 /// functionality. It supports regular LTO, parallel LTO code generation and
 /// ThinLTO. You can use it from a linker in the following way:
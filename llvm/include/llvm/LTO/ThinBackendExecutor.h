@@ -0,0 +1,103 @@
+//===- ThinBackendExecutor.h - Out-of-process ThinLTO backends --*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the interface used by createOutOfProcessThinBackend to
+// run ThinLTO backend compilations outside of the linking process, together
+// with an executor that runs them as local processes and a client and server
+// for running them on a job server.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LTO_THINBACKENDEXECUTOR_H
+#define LLVM_LTO_THINBACKENDEXECUTOR_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/FunctionExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/Threading.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm {
+
+class MemoryBuffer;
+class raw_socket_stream;
+
+namespace lto {
+
+/// One ThinLTO backend compilation. The inputs are files: the bitcode of the
+/// module, the summary index written for it by the thin link and the modules
+/// it imports from, whose paths are the ones recorded in the index.
+struct ThinBackendJob {
+  unsigned Task = 0;
+  std::string ModulePath;
+  std::string IndexPath;
+  std::vector<std::string> ImportPaths;
+  /// Where the job should write the native object file.
+  std::string OutputPath;
+};
+
+/// Runs ThinLTO backend jobs outside of the linking process.
+class ThinBackendExecutor {
+public:
+  /// Receives the object file produced by a job, or the reason it failed.
+  using DoneFn = unique_function<void(Expected<std::unique_ptr<MemoryBuffer>>)>;
+
+  virtual ~ThinBackendExecutor();
+
+  /// Starts running \p Job. \p OnDone is called exactly once when it has
+  /// finished, possibly on another thread and before submit returns.
+  virtual void submit(ThinBackendJob Job, DoneFn OnDone) = 0;
+
+  /// Waits until all jobs that were submitted have finished.
+  virtual void wait() = 0;
+
+  /// Returns the number of jobs that may run at the same time.
+  virtual unsigned getParallelism() const = 0;
+};
+
+/// Creates an executor that runs each job as a local process, at most as many
+/// at once as \p Parallelism allows. The arguments (not including the program
+/// name) may contain the placeholders {module}, {index}, {output} and {task},
+/// which are replaced by the corresponding fields of the job. The object file
+/// is read from the job's output path once the process has exited with status
+/// zero. For example, clang runs a backend with
+///
+///   clang -c -x ir {module} -fthinlto-index={index} -o {output}
+std::unique_ptr<ThinBackendExecutor>
+createProcessThinBackendExecutor(std::string Program,
+                                 std::vector<std::string> Args,
+                                 ThreadPoolStrategy Parallelism);
+
+/// Creates an executor that sends jobs to a job server listening on the UNIX
+/// domain socket \p SocketPath; see serveThinBackendJobs. Input files are
+/// passed by path, so they must be visible to the server, but the object files
+/// are sent back over the connection as soon as each job finishes. \p
+/// Parallelism is the number of jobs the server is expected to run at once.
+Expected<std::unique_ptr<ThinBackendExecutor>>
+createRemoteThinBackendExecutor(StringRef SocketPath, unsigned Parallelism);
+
+/// Serves the jobs sent by one client created by
+/// createRemoteThinBackendExecutor on \p Connection, running them with \p
+/// Executor and writing their output to temporary files in \p TempDir.
+/// Returns when the client disconnects and all its jobs have finished.
+///
+/// The protocol is a stream of messages, each a line holding a JSON object.
+/// A request has the fields "id", "task", "module", "index" and "imports". A
+/// response has "id" and either "error", a message, or "size", in which case
+/// the line is followed by that many bytes of the object file. Responses are
+/// sent in the order in which jobs finish.
+Error serveThinBackendJobs(raw_socket_stream &Connection,
+                           ThinBackendExecutor &Executor, StringRef TempDir);
+
+} // namespace lto
+} // namespace llvm
+
+#endif // LLVM_LTO_THINBACKENDEXECUTOR_H
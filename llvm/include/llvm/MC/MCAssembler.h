@@ -155,6 +155,7 @@ private:
   bool RelaxAll : 1;
   bool SubsectionsViaSymbols : 1;
   bool IncrementalLinkerCompatible : 1;
+  bool IncrementalRelaxation : 1;
 
   /// ELF specific e_header flags
   // It would be good if there were an MCELFAssembler class to hold this.
@@ -170,6 +171,19 @@ private:
   VersionInfoType VersionInfo;
   VersionInfoType DarwinTargetVariantVersionInfo;
 
+  /// A fragment that may need relaxation during layout.
+  struct RelaxationCandidate {
+    MCFragment *F;
+    /// The highest layout order of the fragments in F's section whose offsets
+    /// or sizes the relaxation of F depends on, including F itself, or
+    /// UINT_MAX if it may depend on anything outside the section.
+    unsigned MaxDependency;
+  };
+
+  /// The fragments of each section, indexed by ordinal, that may still need
+  /// relaxation, in layout order. Only valid during layout.
+  std::vector<std::vector<RelaxationCandidate>> RelaxationCandidates;
+
   /// Evaluate a fixup to a relocatable expression and the value which should be
   /// placed into the fixup.
   ///
@@ -204,8 +218,20 @@ private:
   bool layoutOnce(MCAsmLayout &Layout);
 
   /// Perform one layout iteration of the given section and return true
-  /// if any offsets were adjusted.
-  bool layoutSectionOnce(MCAsmLayout &Layout, MCSection &Sec);
+  /// if any offsets were adjusted. Fragments that only depend on fragments
+  /// ordered before \p ChangedFrom are not revisited, as they cannot have
+  /// moved since they were last relaxed. On return, \p ChangedFrom is the
+  /// layout order of the first fragment that was relaxed.
+  bool layoutSectionOnce(MCAsmLayout &Layout, MCSection &Sec,
+                         unsigned &ChangedFrom);
+
+  /// Collect the fragments of \p Sec that may need relaxation.
+  void collectRelaxationCandidates(MCSection &Sec);
+
+  /// Compute what the relaxation of \p F depends on, or return false if \p F
+  /// never needs relaxation.
+  bool getRelaxationDependency(const MCFragment &F,
+                               unsigned &MaxDependency) const;
 
   /// Perform relaxation on a single fragment - returns true if the fragment
   /// changes as a result of relaxation.
@@ -362,6 +388,12 @@ public:
   bool getRelaxAll() const { return RelaxAll; }
   void setRelaxAll(bool Value) { RelaxAll = Value; }
 
+  /// Whether a relaxation step skips the fragments that the previous step
+  /// cannot have affected. This is on by default; turning it off revisits
+  /// every fragment in each step, which must produce the same output.
+  bool getIncrementalRelaxation() const { return IncrementalRelaxation; }
+  void setIncrementalRelaxation(bool Value) { IncrementalRelaxation = Value; }
+
   bool isBundlingEnabled() const { return BundleAlignSize != 0; }
 
   unsigned getBundleAlignSize() const { return BundleAlignSize; }
@@ -790,7 +790,11 @@ public:
     }
   }
 
-  /// Factory method to create an indexed reader.
+  /// Return the buffer holding the profile data.
+  const MemoryBuffer &getDataBuffer() const { return *DataBuffer; }
+
+  /// Factory method to create an indexed reader. The profile is mapped into
+  /// memory, and readers of the same file share the mapping.
   static Expected<std::unique_ptr<IndexedInstrProfReader>>
   create(const Twine &Path, vfs::FileSystem &FS,
          const Twine &RemappingPath = "");
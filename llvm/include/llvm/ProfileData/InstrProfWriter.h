@@ -24,6 +24,7 @@
 #include "llvm/Support/Error.h"
 #include <cstdint>
 #include <memory>
+#include <mutex>
 #include <random>
 
 namespace llvm {
@@ -135,6 +136,17 @@ public:
   void mergeRecordsFromWriter(InstrProfWriter &&IPW,
                               function_ref<void(Error)> Warn);
 
+  /// Move the function counts of this writer into the writer of \p Shards
+  /// which owns each function, so that no two shards have counts for the same
+  /// function and the shards can be merged without combining any records.
+  /// \p LockShard is called with the index of a shard before counts are added
+  /// to it and the returned lock is held until they are. Everything else this
+  /// writer holds stays in it.
+  void moveRecordsToShards(
+      ArrayRef<InstrProfWriter *> Shards,
+      function_ref<std::unique_lock<std::mutex>(unsigned)> LockShard,
+      function_ref<void(Error)> Warn);
+
   /// Write the profile to \c OS
   Error write(raw_fd_ostream &OS);
 
@@ -8,7 +8,8 @@
 //
 // This file defines the CachedFileStream and the localCache function, which
 // simplifies caching files on the local filesystem in a directory whose
-// contents are managed by a CachePruningPolicy.
+// contents are managed by a CachePruningPolicy. It also defines packCache,
+// which stores cached files in a few large shared pack files instead.
 //
 //===----------------------------------------------------------------------===//
 
@@ -74,6 +75,42 @@ Expected<FileCache> localCache(
     const Twine &CacheDirectoryPathRef,
     AddBufferFn AddBuffer = [](size_t Task, const Twine &ModuleName,
                                std::unique_ptr<MemoryBuffer> MB) {});
+
+/// Size limits of a cache created by packCache.
+struct PackCachePolicy {
+  /// The total size of the pack files that the cache tries to stay under.
+  uint64_t MaxSizeBytes = 4ULL << 30;
+  /// The number of pack files the cache is split into. The pack holding the
+  /// least recently written objects is dropped as a whole when the cache is
+  /// full, so this is also the granularity of pruning.
+  unsigned NumPacks = 8;
+  /// The number of entries in the on-disk index, which must be a power of two.
+  /// This is only used when the cache directory is created; an existing cache
+  /// keeps its index size.
+  unsigned NumIndexSlots = 1 << 18;
+};
+
+/// Create a file system cache that appends files to a small number of pack
+/// files in the cache directory and finds them through a memory-mapped hash
+/// index shared by all processes using the directory. Lookups take no locks
+/// and return a slice of the pack file mapped into memory, so hits neither
+/// open a file per object nor copy it. Additions are serialized by a lock on
+/// a lock file, and objects larger than 1 MiB are written to a temporary file
+/// rather than held in memory until they are added.
+///
+/// The cache prunes itself according to \p Policy: when the newest pack is
+/// full, a new one is started, and once there are more than
+/// Policy.NumPacks packs the oldest one is removed after copying the objects
+/// that were used since it was filled to the newest pack. The files it
+/// creates are not recognized by pruneCache.
+///
+/// Unlike localCache, this function creates the cache directory and its index
+/// immediately.
+Expected<FileCache> packCache(
+    const Twine &CacheNameRef, const Twine &CacheDirectoryPathRef,
+    AddBufferFn AddBuffer = [](size_t Task, const Twine &ModuleName,
+                               std::unique_ptr<MemoryBuffer> MB) {},
+    PackCachePolicy Policy = PackCachePolicy());
 } // namespace llvm
 
 #endif
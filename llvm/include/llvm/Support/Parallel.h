@@ -9,6 +9,7 @@
 #ifndef LLVM_SUPPORT_PARALLEL_H
 #define LLVM_SUPPORT_PARALLEL_H
 
+#include "llvm/ADT/FunctionExtras.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/Config/llvm-config.h"
 #include "llvm/Support/Error.h"
@@ -73,16 +74,24 @@ public:
     ++Count;
   }
 
-  void dec() {
+  /// Returns true if the count dropped to zero.
+  bool dec() {
     std::lock_guard<std::mutex> lock(Mutex);
-    if (--Count == 0)
-      Cond.notify_all();
+    if (--Count != 0)
+      return false;
+    Cond.notify_all();
+    return true;
   }
 
   void sync() const {
     std::unique_lock<std::mutex> lock(Mutex);
     Cond.wait(lock, [&] { return Count == 0; });
   }
+
+  bool isZero() const {
+    std::lock_guard<std::mutex> lock(Mutex);
+    return Count == 0;
+  }
 };
 } // namespace detail
 
@@ -99,9 +108,11 @@ public:
   // exactly in the order which they were spawned.
   // Note: Sequential tasks may be executed on different
   // threads, but strictly in sequential order.
-  void spawn(std::function<void()> f, bool Sequential = false);
+  void spawn(unique_function<void()> f, bool Sequential = false);
 
-  void sync() const { L.sync(); }
+  // Wait for all spawned tasks to finish. When called from a worker thread of
+  // the default executor, other queued tasks are run while waiting.
+  void sync() const;
 
   bool isParallel() const { return Parallel; }
 };
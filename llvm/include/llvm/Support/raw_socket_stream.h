@@ -129,6 +129,17 @@ public:
   static Expected<std::unique_ptr<raw_socket_stream>>
   createConnectedUnix(StringRef SocketPath);
   ~raw_socket_stream();
+
+  /// Reads up to \p Size bytes into \p Ptr. Unlike raw_fd_stream::read, this
+  /// does not change the state of the stream, so one thread may read while
+  /// another writes. Returns the number of bytes read, 0 once the peer has
+  /// closed the connection or -1 on an error.
+  ssize_t read(char *Ptr, size_t Size);
+
+  /// Returns whether the process at the other end of the connection runs as
+  /// the same user as this one. Always false on Windows, where the peer of a
+  /// UNIX domain socket cannot be queried.
+  bool isPeerSameUser() const;
 };
 
 } // end namespace llvm
@@ -711,7 +711,8 @@ public:
   /// Main interface to parsing a bitcode buffer.
   /// \returns true if an error occurred.
   Error parseBitcodeInto(Module *M, bool ShouldLazyLoadMetadata,
-                         bool IsImporting, ParserCallbacks Callbacks = {});
+                         bool IsImporting, ParserCallbacks Callbacks = {},
+                         BitcodeImportCache *ImportCache = nullptr);
 
   static uint64_t decodeSignRotatedValue(uint64_t V);
 
@@ -4627,7 +4628,8 @@ Error BitcodeReader::parseModule(uint64_t ResumeBit,
 
 Error BitcodeReader::parseBitcodeInto(Module *M, bool ShouldLazyLoadMetadata,
                                       bool IsImporting,
-                                      ParserCallbacks Callbacks) {
+                                      ParserCallbacks Callbacks,
+                                      BitcodeImportCache *ImportCache) {
   TheModule = M;
   MetadataLoaderCallbacks MDCallbacks;
   MDCallbacks.GetTypeByID = [&](unsigned ID) { return getTypeByID(ID); };
@@ -4635,7 +4637,8 @@ Error BitcodeReader::parseBitcodeInto(Module *M, bool ShouldLazyLoadMetadata,
     return getContainedTypeID(I, J);
   };
   MDCallbacks.MDType = Callbacks.MDType;
-  MDLoader = MetadataLoader(Stream, *M, ValueList, IsImporting, MDCallbacks);
+  MDLoader = MetadataLoader(Stream, *M, ValueList, IsImporting, MDCallbacks,
+                            ImportCache);
   return parseModule(0, ShouldLazyLoadMetadata, Callbacks);
 }
 
@@ -8243,7 +8246,8 @@ BitcodeModule::getModuleImpl(LLVMContext &Context, bool MaterializeAll,
 
   // Delay parsing Metadata if ShouldLazyLoadMetadata is true.
   if (Error Err = R->parseBitcodeInto(M.get(), ShouldLazyLoadMetadata,
-                                      IsImporting, Callbacks))
+                                      IsImporting, Callbacks,
+                                      IsImporting ? ImportCache.get() : nullptr))
     return std::move(Err);
 
   if (MaterializeAll) {
@@ -8259,6 +8263,11 @@ BitcodeModule::getModuleImpl(LLVMContext &Context, bool MaterializeAll,
   return std::move(M);
 }
 
+void BitcodeModule::enableImportCache() {
+  if (!ImportCache)
+    ImportCache = std::make_shared<BitcodeImportCache>();
+}
+
 Expected<std::unique_ptr<Module>>
 BitcodeModule::getLazyModule(LLVMContext &Context, bool ShouldLazyLoadMetadata,
                              bool IsImporting, ParserCallbacks Callbacks) {
@@ -71,6 +71,8 @@ using namespace llvm;
 STATISTIC(NumMDStringLoaded, "Number of MDStrings loaded");
 STATISTIC(NumMDNodeTemporary, "Number of MDNode::Temporary created");
 STATISTIC(NumMDRecordLoaded, "Number of Metadata records loaded");
+STATISTIC(NumMDIndexShared,
+          "Number of lazy-loading Metadata indexes shared between imports");
 
 /// Flag whether we need to import full type definitions for ThinLTO.
 /// Currently needed for Darwin and LLDB.
@@ -414,15 +416,23 @@ class MetadataLoader::MetadataLoaderImpl {
   /// the middle of the metadata block and load any record.
   BitstreamCursor IndexCursor;
 
+  /// Shares the index below between the modules loaded from the same bitcode
+  /// for importing, if not null.
+  BitcodeImportCache *ImportCache;
+
+  /// The index built for lazy-loading the module-level metadata, which the
+  /// three fields below refer to.
+  std::shared_ptr<const LazyMetadataIndex> LazyIndex;
+
   /// Index that keeps track of MDString values.
-  std::vector<StringRef> MDStringRef;
+  ArrayRef<StringRef> MDStringRef;
 
   /// On-demand loading of a single MDString. Requires the index above to be
   /// populated.
   MDString *lazyLoadOneMDString(unsigned Idx);
 
   /// Index that keeps track of where to find a metadata record in the stream.
-  std::vector<uint64_t> GlobalMetadataBitPosIndex;
+  ArrayRef<uint64_t> GlobalMetadataBitPosIndex;
 
   /// Cursor position of the start of the global decl attachments, to enable
   /// loading using the index built for lazy loading, instead of forward
@@ -444,6 +454,13 @@ class MetadataLoader::MetadataLoaderImpl {
   /// Metadata.
   Expected<bool> lazyLoadModuleMetadataBlock();
 
+  /// Scan the metadata block to build \p Index. Returns false if the block
+  /// can't be lazy-loaded.
+  Expected<bool> buildLazyMetadataIndex(LazyMetadataIndex &Index);
+
+  /// Load the named metadata whose record is at \p Pos.
+  Error loadNamedMetadata(uint64_t Pos, unsigned AbbrevID);
+
   /// On-demand loading of a single metadata. Requires the index above to be
   /// populated.
   void lazyLoadOneMetadata(unsigned Idx, PlaceholderQueue &Placeholders);
@@ -724,11 +741,12 @@ class MetadataLoader::MetadataLoaderImpl {
 public:
   MetadataLoaderImpl(BitstreamCursor &Stream, Module &TheModule,
                      BitcodeReaderValueList &ValueList,
-                     MetadataLoaderCallbacks Callbacks, bool IsImporting)
+                     MetadataLoaderCallbacks Callbacks, bool IsImporting,
+                     BitcodeImportCache *ImportCache)
       : MetadataList(TheModule.getContext(), Stream.SizeInBytes()),
         ValueList(ValueList), Stream(Stream), Context(TheModule.getContext()),
         TheModule(TheModule), Callbacks(std::move(Callbacks)),
-        IsImporting(IsImporting) {}
+        ImportCache(ImportCache), IsImporting(IsImporting) {}
 
   Error parseMetadata(bool ModuleLevel);
 
@@ -769,19 +787,19 @@ public:
   void upgradeDebugIntrinsics(Function &F) { upgradeDeclareExpressions(F); }
 };
 
-Expected<bool>
-MetadataLoader::MetadataLoaderImpl::lazyLoadModuleMetadataBlock() {
-  IndexCursor = Stream;
+Expected<bool> MetadataLoader::MetadataLoaderImpl::buildLazyMetadataIndex(
+    LazyMetadataIndex &Index) {
+  BitstreamCursor &Cursor = Index.Cursor;
+  Cursor = Stream;
   SmallVector<uint64_t, 64> Record;
-  GlobalDeclAttachmentPos = 0;
   // Get the abbrevs, and preload record positions to make them lazy-loadable.
   while (true) {
-    uint64_t SavedPos = IndexCursor.GetCurrentBitNo();
+    uint64_t SavedPos = Cursor.GetCurrentBitNo();
     BitstreamEntry Entry;
-    if (Error E =
-            IndexCursor
-                .advanceSkippingSubblocks(BitstreamCursor::AF_DontPopBlockAtEnd)
-                .moveInto(Entry))
+    if (Error E = Cursor
+                      .advanceSkippingSubblocks(
+                          BitstreamCursor::AF_DontPopBlockAtEnd)
+                      .moveInto(Entry))
       return std::move(E);
 
     switch (Entry.Kind) {
@@ -794,26 +812,26 @@ MetadataLoader::MetadataLoaderImpl::lazyLoadModuleMetadataBlock() {
     case BitstreamEntry::Record: {
       // The interesting case.
       ++NumMDRecordLoaded;
-      uint64_t CurrentPos = IndexCursor.GetCurrentBitNo();
+      uint64_t CurrentPos = Cursor.GetCurrentBitNo();
       unsigned Code;
-      if (Error E = IndexCursor.skipRecord(Entry.ID).moveInto(Code))
+      if (Error E = Cursor.skipRecord(Entry.ID).moveInto(Code))
         return std::move(E);
       switch (Code) {
       case bitc::METADATA_STRINGS: {
         // Rewind and parse the strings.
-        if (Error Err = IndexCursor.JumpToBit(CurrentPos))
+        if (Error Err = Cursor.JumpToBit(CurrentPos))
           return std::move(Err);
         StringRef Blob;
         Record.clear();
         if (Expected<unsigned> MaybeRecord =
-                IndexCursor.readRecord(Entry.ID, Record, &Blob))
+                Cursor.readRecord(Entry.ID, Record, &Blob))
           ;
         else
           return MaybeRecord.takeError();
         unsigned NumStrings = Record[0];
-        MDStringRef.reserve(NumStrings);
+        Index.MDStrings.reserve(NumStrings);
         auto IndexNextMDString = [&](StringRef Str) {
-          MDStringRef.push_back(Str);
+          Index.MDStrings.push_back(Str);
         };
         if (auto Err = parseMetadataStrings(Record, Blob, IndexNextMDString))
           return std::move(Err);
@@ -822,23 +840,22 @@ MetadataLoader::MetadataLoaderImpl::lazyLoadModuleMetadataBlock() {
       case bitc::METADATA_INDEX_OFFSET: {
         // This is the offset to the index, when we see this we skip all the
         // records and load only an index to these.
-        if (Error Err = IndexCursor.JumpToBit(CurrentPos))
+        if (Error Err = Cursor.JumpToBit(CurrentPos))
           return std::move(Err);
         Record.clear();
         if (Expected<unsigned> MaybeRecord =
-                IndexCursor.readRecord(Entry.ID, Record))
+                Cursor.readRecord(Entry.ID, Record))
           ;
         else
           return MaybeRecord.takeError();
         if (Record.size() != 2)
           return error("Invalid record");
         auto Offset = Record[0] + (Record[1] << 32);
-        auto BeginPos = IndexCursor.GetCurrentBitNo();
-        if (Error Err = IndexCursor.JumpToBit(BeginPos + Offset))
+        auto BeginPos = Cursor.GetCurrentBitNo();
+        if (Error Err = Cursor.JumpToBit(BeginPos + Offset))
           return std::move(Err);
-        Expected<BitstreamEntry> MaybeEntry =
-            IndexCursor.advanceSkippingSubblocks(
-                BitstreamCursor::AF_DontPopBlockAtEnd);
+        Expected<BitstreamEntry> MaybeEntry = Cursor.advanceSkippingSubblocks(
+            BitstreamCursor::AF_DontPopBlockAtEnd);
         if (!MaybeEntry)
           return MaybeEntry.takeError();
         Entry = MaybeEntry.get();
@@ -846,8 +863,7 @@ MetadataLoader::MetadataLoaderImpl::lazyLoadModuleMetadataBlock() {
                "Corrupted bitcode: Expected `Record` when trying to find the "
                "Metadata index");
         Record.clear();
-        if (Expected<unsigned> MaybeCode =
-                IndexCursor.readRecord(Entry.ID, Record))
+        if (Expected<unsigned> MaybeCode = Cursor.readRecord(Entry.ID, Record))
           assert(MaybeCode.get() == bitc::METADATA_INDEX &&
                  "Corrupted bitcode: Expected `METADATA_INDEX` when trying to "
                  "find the Metadata index");
@@ -855,10 +871,10 @@ MetadataLoader::MetadataLoaderImpl::lazyLoadModuleMetadataBlock() {
           return MaybeCode.takeError();
         // Delta unpack
         auto CurrentValue = BeginPos;
-        GlobalMetadataBitPosIndex.reserve(Record.size());
+        Index.RecordBitPos.reserve(Record.size());
         for (auto &Elt : Record) {
           CurrentValue += Elt;
-          GlobalMetadataBitPosIndex.push_back(CurrentValue);
+          Index.RecordBitPos.push_back(CurrentValue);
         }
         break;
       }
@@ -866,56 +882,15 @@ MetadataLoader::MetadataLoaderImpl::lazyLoadModuleMetadataBlock() {
         // We don't expect to get there, the Index is loaded when we encounter
         // the offset.
         return error("Corrupted Metadata block");
-      case bitc::METADATA_NAME: {
-        // Named metadata need to be materialized now and aren't deferred.
-        if (Error Err = IndexCursor.JumpToBit(CurrentPos))
-          return std::move(Err);
-        Record.clear();
-
-        unsigned Code;
-        if (Expected<unsigned> MaybeCode =
-                IndexCursor.readRecord(Entry.ID, Record)) {
-          Code = MaybeCode.get();
-          assert(Code == bitc::METADATA_NAME);
-        } else
-          return MaybeCode.takeError();
-
-        // Read name of the named metadata.
-        SmallString<8> Name(Record.begin(), Record.end());
-        if (Expected<unsigned> MaybeCode = IndexCursor.ReadCode())
-          Code = MaybeCode.get();
-        else
-          return MaybeCode.takeError();
-
-        // Named Metadata comes in two parts, we expect the name to be followed
-        // by the node
-        Record.clear();
-        if (Expected<unsigned> MaybeNextBitCode =
-                IndexCursor.readRecord(Code, Record))
-          assert(MaybeNextBitCode.get() == bitc::METADATA_NAMED_NODE);
-        else
-          return MaybeNextBitCode.takeError();
-
-        // Read named metadata elements.
-        unsigned Size = Record.size();
-        NamedMDNode *NMD = TheModule.getOrInsertNamedMetadata(Name);
-        for (unsigned i = 0; i != Size; ++i) {
-          // FIXME: We could use a placeholder here, however NamedMDNode are
-          // taking MDNode as operand and not using the Metadata infrastructure.
-          // It is acknowledged by 'TODO: Inherit from Metadata' in the
-          // NamedMDNode class definition.
-          MDNode *MD = MetadataList.getMDNodeFwdRefOrNull(Record[i]);
-          assert(MD && "Invalid metadata: expect fwd ref to MDNode");
-          NMD->addOperand(MD);
-        }
+      case bitc::METADATA_NAME:
+        // Named metadata need to be materialized now and aren't deferred, but
+        // that is done once the index is complete.
+        Index.NamedMetadata.emplace_back(CurrentPos, Entry.ID);
         break;
-      }
       case bitc::METADATA_GLOBAL_DECL_ATTACHMENT: {
-        if (!GlobalDeclAttachmentPos)
-          GlobalDeclAttachmentPos = SavedPos;
-#ifndef NDEBUG
-        NumGlobalDeclAttachSkipped++;
-#endif
+        if (!Index.GlobalDeclAttachmentPos)
+          Index.GlobalDeclAttachmentPos = SavedPos;
+        Index.NumGlobalDeclAttachments++;
         break;
       }
       case bitc::METADATA_KIND:
@@ -957,8 +932,6 @@ MetadataLoader::MetadataLoaderImpl::lazyLoadModuleMetadataBlock() {
       case bitc::METADATA_GENERIC_SUBRANGE:
         // We don't expect to see any of these, if we see one, give up on
         // lazy-loading and fallback.
-        MDStringRef.clear();
-        GlobalMetadataBitPosIndex.clear();
         return false;
       }
       break;
@@ -967,6 +940,88 @@ MetadataLoader::MetadataLoaderImpl::lazyLoadModuleMetadataBlock() {
   }
 }
 
+Error MetadataLoader::MetadataLoaderImpl::loadNamedMetadata(uint64_t Pos,
+                                                            unsigned AbbrevID) {
+  SmallVector<uint64_t, 64> Record;
+  if (Error Err = IndexCursor.JumpToBit(Pos))
+    return Err;
+
+  unsigned Code;
+  if (Expected<unsigned> MaybeCode = IndexCursor.readRecord(AbbrevID, Record)) {
+    Code = MaybeCode.get();
+    assert(Code == bitc::METADATA_NAME);
+  } else
+    return MaybeCode.takeError();
+
+  // Read name of the named metadata.
+  SmallString<8> Name(Record.begin(), Record.end());
+  if (Expected<unsigned> MaybeCode = IndexCursor.ReadCode())
+    Code = MaybeCode.get();
+  else
+    return MaybeCode.takeError();
+
+  // Named Metadata comes in two parts, we expect the name to be followed
+  // by the node
+  Record.clear();
+  if (Expected<unsigned> MaybeNextBitCode =
+          IndexCursor.readRecord(Code, Record))
+    assert(MaybeNextBitCode.get() == bitc::METADATA_NAMED_NODE);
+  else
+    return MaybeNextBitCode.takeError();
+
+  // Read named metadata elements.
+  unsigned Size = Record.size();
+  NamedMDNode *NMD = TheModule.getOrInsertNamedMetadata(Name);
+  for (unsigned i = 0; i != Size; ++i) {
+    // FIXME: We could use a placeholder here, however NamedMDNode are
+    // taking MDNode as operand and not using the Metadata infrastructure.
+    // It is acknowledged by 'TODO: Inherit from Metadata' in the
+    // NamedMDNode class definition.
+    MDNode *MD = MetadataList.getMDNodeFwdRefOrNull(Record[i]);
+    assert(MD && "Invalid metadata: expect fwd ref to MDNode");
+    NMD->addOperand(MD);
+  }
+  return Error::success();
+}
+
+Expected<bool>
+MetadataLoader::MetadataLoaderImpl::lazyLoadModuleMetadataBlock() {
+  // The index only depends on the bitcode, so modules loaded from the same
+  // bitcode for importing can share it instead of each scanning the block.
+  uint64_t BlockPos = Stream.GetCurrentBitNo();
+  std::shared_ptr<const LazyMetadataIndex> Index;
+  if (ImportCache)
+    Index = ImportCache->lookupMetadataIndex(BlockPos);
+  if (Index) {
+    ++NumMDIndexShared;
+  } else {
+    auto NewIndex = std::make_shared<LazyMetadataIndex>();
+    Expected<bool> SuccessOrErr = buildLazyMetadataIndex(*NewIndex);
+    if (!SuccessOrErr || !*SuccessOrErr)
+      return SuccessOrErr;
+    // The cursor is only used to read records in the block, and may outlive
+    // this reader's block info.
+    NewIndex->Cursor.setBlockInfo(nullptr);
+    Index = std::move(NewIndex);
+    if (ImportCache)
+      Index = ImportCache->insertMetadataIndex(BlockPos, std::move(Index));
+  }
+
+  LazyIndex = Index;
+  IndexCursor = Index->Cursor;
+  MDStringRef = Index->MDStrings;
+  GlobalMetadataBitPosIndex = Index->RecordBitPos;
+  GlobalDeclAttachmentPos = Index->GlobalDeclAttachmentPos;
+#ifndef NDEBUG
+  NumGlobalDeclAttachSkipped = Index->NumGlobalDeclAttachments;
+#endif
+
+  for (const auto &[Pos, AbbrevID] : Index->NamedMetadata)
+    if (Error Err = loadNamedMetadata(Pos, AbbrevID))
+      return std::move(Err);
+  return true;
+}
+
 // Load the global decl attachments after building the lazy loading index.
 // We don't load them "lazily" - all global decl attachments must be
 // parsed since they aren't materialized on demand. However, by delaying
@@ -2495,9 +2550,11 @@ MetadataLoader::~MetadataLoader() = default;
 MetadataLoader::MetadataLoader(BitstreamCursor &Stream, Module &TheModule,
                                BitcodeReaderValueList &ValueList,
                                bool IsImporting,
-                               MetadataLoaderCallbacks Callbacks)
-    : Pimpl(std::make_unique<MetadataLoaderImpl>(
-          Stream, TheModule, ValueList, std::move(Callbacks), IsImporting)) {}
+                               MetadataLoaderCallbacks Callbacks,
+                               BitcodeImportCache *ImportCache)
+    : Pimpl(std::make_unique<MetadataLoaderImpl>(Stream, TheModule, ValueList,
+                                                 std::move(Callbacks),
+                                                 IsImporting, ImportCache)) {}
 
 Error MetadataLoader::parseMetadata(bool ModuleLevel) {
   return Pimpl->parseMetadata(ModuleLevel);
@@ -13,15 +13,20 @@
 #ifndef LLVM_LIB_BITCODE_READER_METADATALOADER_H
 #define LLVM_LIB_BITCODE_READER_METADATALOADER_H
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Bitstream/BitstreamReader.h"
 #include "llvm/Support/Error.h"
 
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
 
 namespace llvm {
 class BasicBlock;
 class BitcodeReaderValueList;
-class BitstreamCursor;
 class DISubprogram;
 class Function;
 class Instruction;
@@ -44,6 +49,50 @@ struct MetadataLoaderCallbacks {
   std::optional<MDTypeCallbackTy> MDType;
 };
 
+/// The index built to lazily load a module-level METADATA_BLOCK. None of it
+/// depends on the LLVMContext the metadata is loaded into, so it can be
+/// shared by every module loaded from the same bitcode for importing.
+struct LazyMetadataIndex {
+  /// A cursor inside the block, holding the abbreviations it defines.
+  BitstreamCursor Cursor;
+
+  /// The MDStrings, pointing into the bitcode.
+  std::vector<StringRef> MDStrings;
+
+  /// Where to find each of the other metadata records in the bitstream.
+  std::vector<uint64_t> RecordBitPos;
+
+  /// Where to find each named metadata record, and its abbreviation ID.
+  std::vector<std::pair<uint64_t, unsigned>> NamedMetadata;
+
+  /// Cursor position of the start of the global decl attachments, or zero.
+  uint64_t GlobalDeclAttachmentPos = 0;
+  unsigned NumGlobalDeclAttachments = 0;
+};
+
+/// Context-independent state shared by the modules loaded from one
+/// BitcodeModule for importing; see BitcodeModule::enableImportCache.
+class BitcodeImportCache {
+  std::mutex Mu;
+  /// Indexes of the module-level metadata blocks, by their bit position.
+  DenseMap<uint64_t, std::shared_ptr<const LazyMetadataIndex>> MetadataIndexes;
+
+public:
+  std::shared_ptr<const LazyMetadataIndex> lookupMetadataIndex(uint64_t Pos) {
+    std::lock_guard<std::mutex> Lock(Mu);
+    return MetadataIndexes.lookup(Pos);
+  }
+
+  /// Records the index built for the block at \p Pos, unless another thread
+  /// got there first, and returns the one that is kept.
+  std::shared_ptr<const LazyMetadataIndex>
+  insertMetadataIndex(uint64_t Pos,
+                      std::shared_ptr<const LazyMetadataIndex> Index) {
+    std::lock_guard<std::mutex> Lock(Mu);
+    return MetadataIndexes.try_emplace(Pos, std::move(Index)).first->second;
+  }
+};
+
 /// Helper class that handles loading Metadatas and keeping them available.
 class MetadataLoader {
   class MetadataLoaderImpl;
@@ -54,7 +103,8 @@ public:
   ~MetadataLoader();
   MetadataLoader(BitstreamCursor &Stream, Module &TheModule,
                  BitcodeReaderValueList &ValueList, bool IsImporting,
-                 MetadataLoaderCallbacks Callbacks);
+                 MetadataLoaderCallbacks Callbacks,
+                 BitcodeImportCache *ImportCache = nullptr);
   MetadataLoader &operator=(MetadataLoader &&);
   MetadataLoader(MetadataLoader &&);
 
@@ -0,0 +1,438 @@
+//===- ThinBackendExecutor.cpp - Out-of-process ThinLTO backends ----------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the executors used to run ThinLTO backend jobs in other
+// processes, and the server side of the job server protocol.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/LTO/ThinBackendExecutor.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_socket_stream.h"
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+using namespace llvm;
+using namespace lto;
+
+ThinBackendExecutor::~ThinBackendExecutor() = default;
+
+namespace {
+
+class ProcessThinBackendExecutor : public ThinBackendExecutor {
+  std::string Program;
+  std::vector<std::string> Args;
+  DefaultThreadPool Pool;
+
+  Expected<std::unique_ptr<MemoryBuffer>> run(const ThinBackendJob &Job);
+
+public:
+  ProcessThinBackendExecutor(std::string Program,
+                             std::vector<std::string> Args,
+                             ThreadPoolStrategy Parallelism)
+      : Program(std::move(Program)), Args(std::move(Args)), Pool(Parallelism) {
+  }
+
+  void submit(ThinBackendJob Job, DoneFn OnDone) override {
+    // ThreadPool tasks must be copyable.
+    auto Done = std::make_shared<DoneFn>(std::move(OnDone));
+    Pool.async([this, Job = std::move(Job), Done] { (*Done)(run(Job)); });
+  }
+
+  void wait() override { Pool.wait(); }
+
+  unsigned getParallelism() const override {
+    return Pool.getMaxConcurrency();
+  }
+};
+
+} // end anonymous namespace
+
+Expected<std::unique_ptr<MemoryBuffer>>
+ProcessThinBackendExecutor::run(const ThinBackendJob &Job) {
+  std::string Task = utostr(Job.Task);
+  std::pair<StringRef, StringRef> Placeholders[] = {
+      {"{module}", Job.ModulePath},
+      {"{index}", Job.IndexPath},
+      {"{output}", Job.OutputPath},
+      {"{task}", Task}};
+
+  std::vector<std::string> Argv = {Program};
+  for (StringRef Arg : Args) {
+    std::string &Out = Argv.emplace_back();
+    while (!Arg.empty()) {
+      size_t Pos = Arg.find('{');
+      Out += Arg.take_front(Pos);
+      Arg = Arg.drop_front(Pos);
+      if (Arg.empty())
+        break;
+      auto *It = find_if(Placeholders, [&](const auto &P) {
+        return Arg.starts_with(P.first);
+      });
+      if (It == std::end(Placeholders)) {
+        Out += Arg.front();
+        Arg = Arg.drop_front();
+        continue;
+      }
+      Out += It->second;
+      Arg = Arg.drop_front(It->first.size());
+    }
+  }
+
+  SmallVector<StringRef, 16> ArgvRefs(Argv.begin(), Argv.end());
+  std::string ErrMsg;
+  int Status = sys::ExecuteAndWait(Program, ArgvRefs, /*Env=*/std::nullopt,
+                                   /*Redirects=*/{}, /*SecondsToWait=*/0,
+                                   /*MemoryLimit=*/0, &ErrMsg);
+  if (Status < 0)
+    return createStringError(inconvertibleErrorCode(),
+                             "backend job for " + Job.ModulePath +
+                                 " failed: " + ErrMsg);
+  if (Status > 0)
+    return createStringError(inconvertibleErrorCode(),
+                             "backend job for " + Job.ModulePath +
+                                 " exited with status " + Twine(Status));
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> ObjOrErr = MemoryBuffer::getFile(
+      Job.OutputPath, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+  if (!ObjOrErr)
+    return createFileError(Job.OutputPath, ObjOrErr.getError());
+  return std::move(*ObjOrErr);
+}
+
+std::unique_ptr<ThinBackendExecutor>
+lto::createProcessThinBackendExecutor(std::string Program,
+                                      std::vector<std::string> Args,
+                                      ThreadPoolStrategy Parallelism) {
+  return std::make_unique<ProcessThinBackendExecutor>(
+      std::move(Program), std::move(Args), Parallelism);
+}
+
+namespace {
+
+// Reads the messages of the job server protocol from a socket, while other
+// threads may write to it.
+class MessageReader {
+  raw_socket_stream &Socket;
+  std::vector<char> Buffer;
+  size_t Begin = 0, End = 0;
+
+  // Reads more data after the unconsumed bytes. Returns false at the end of
+  // the stream or on an error.
+  bool fill() {
+    if (Begin == End) {
+      Begin = End = 0;
+    } else if (Begin > Buffer.size() / 2) {
+      std::copy(Buffer.begin() + Begin, Buffer.begin() + End, Buffer.begin());
+      End -= Begin;
+      Begin = 0;
+    }
+    if (End == Buffer.size())
+      Buffer.resize(Buffer.size() * 2);
+    ssize_t N = Socket.read(Buffer.data() + End, Buffer.size() - End);
+    if (N <= 0)
+      return false;
+    End += N;
+    return true;
+  }
+
+public:
+  explicit MessageReader(raw_socket_stream &Socket)
+      : Socket(Socket), Buffer(1 << 16) {}
+
+  // Reads a line without its terminator.
+  bool readLine(std::string &Line) {
+    // The number of bytes after Begin known not to contain a newline.
+    size_t Scanned = 0;
+    for (;;) {
+      auto First = Buffer.begin() + Begin, Last = Buffer.begin() + End;
+      auto It = std::find(First + Scanned, Last, '\n');
+      if (It != Last) {
+        Line.assign(First, It);
+        Begin = It - Buffer.begin() + 1;
+        return true;
+      }
+      Scanned = End - Begin;
+      if (!fill())
+        return false;
+    }
+  }
+
+  bool readBytes(char *Dest, size_t Size) {
+    while (Size != 0) {
+      if (Begin == End && !fill())
+        return false;
+      size_t N = std::min(Size, End - Begin);
+      memcpy(Dest, Buffer.data() + Begin, N);
+      Begin += N;
+      Dest += N;
+      Size -= N;
+    }
+    return true;
+  }
+};
+
+class RemoteThinBackendExecutor : public ThinBackendExecutor {
+  std::unique_ptr<raw_socket_stream> Socket;
+  unsigned Parallelism;
+
+  // Guards the state below. It is never held while writing to the socket: a
+  // write may block until the server reads, and the server may be blocked
+  // sending a response that the receiver thread needs this mutex to handle.
+  std::mutex Mu;
+  std::condition_variable Idle;
+  int64_t NextID = 0;
+  DenseMap<int64_t, DoneFn> Pending;
+  // The number of jobs whose OnDone has not returned yet.
+  size_t Running = 0;
+  bool Disconnected = false;
+
+  // Serializes the requests written to the socket.
+  std::mutex WriteMu;
+
+  std::thread Receiver;
+
+  void receive();
+  void finish(DoneFn &OnDone, Expected<std::unique_ptr<MemoryBuffer>> Obj) {
+    OnDone(std::move(Obj));
+    std::lock_guard<std::mutex> Lock(Mu);
+    if (--Running == 0)
+      Idle.notify_all();
+  }
+
+public:
+  RemoteThinBackendExecutor(std::unique_ptr<raw_socket_stream> Socket,
+                            unsigned Parallelism)
+      : Socket(std::move(Socket)), Parallelism(Parallelism) {
+    Receiver = std::thread([this] { receive(); });
+  }
+
+  ~RemoteThinBackendExecutor() override {
+    wait();
+    {
+      // An empty message tells the server that no more jobs will be sent, so
+      // it closes the connection and the receiver thread exits.
+      std::lock_guard<std::mutex> Lock(WriteMu);
+      *Socket << "{}\n";
+      Socket->flush();
+      Socket->clear_error();
+    }
+    Receiver.join();
+  }
+
+  void submit(ThinBackendJob Job, DoneFn OnDone) override {
+    std::unique_lock<std::mutex> Lock(Mu);
+    if (Disconnected) {
+      Lock.unlock();
+      OnDone(createStringError(inconvertibleErrorCode(),
+                               "lost connection to the ThinLTO job server"));
+      return;
+    }
+    int64_t ID = NextID++;
+    Pending[ID] = std::move(OnDone);
+    ++Running;
+    Lock.unlock();
+
+    json::Object Request{
+        {"id", ID},
+        {"task", int64_t(Job.Task)},
+        {"module", std::move(Job.ModulePath)},
+        {"index", std::move(Job.IndexPath)},
+        {"imports", json::Array(Job.ImportPaths)},
+    };
+    std::lock_guard<std::mutex> WriteLock(WriteMu);
+    *Socket << json::Value(std::move(Request)) << '\n';
+    Socket->flush();
+    // A failed write means the connection is gone; the receiver fails the
+    // pending jobs when it sees the end of the stream.
+    Socket->clear_error();
+  }
+
+  void wait() override {
+    std::unique_lock<std::mutex> Lock(Mu);
+    Idle.wait(Lock, [&] { return Running == 0; });
+  }
+
+  unsigned getParallelism() const override { return Parallelism; }
+};
+
+} // end anonymous namespace
+
+void RemoteThinBackendExecutor::receive() {
+  MessageReader In(*Socket);
+  std::string Line;
+  while (In.readLine(Line)) {
+    Expected<json::Value> MessageOrErr = json::parse(Line);
+    if (!MessageOrErr) {
+      consumeError(MessageOrErr.takeError());
+      break;
+    }
+    const json::Object *Message = MessageOrErr->getAsObject();
+    std::optional<int64_t> ID;
+    if (Message)
+      ID = Message->getInteger("id");
+    if (!ID)
+      break;
+
+    DoneFn OnDone;
+    {
+      std::lock_guard<std::mutex> Lock(Mu);
+      auto It = Pending.find(*ID);
+      if (It == Pending.end())
+        break;
+      OnDone = std::move(It->second);
+      Pending.erase(It);
+    }
+
+    if (std::optional<StringRef> Err = Message->getString("error")) {
+      finish(OnDone, createStringError(inconvertibleErrorCode(), *Err));
+      continue;
+    }
+    std::optional<int64_t> Size = Message->getInteger("size");
+    if (!Size || *Size < 0) {
+      finish(OnDone, createStringError(inconvertibleErrorCode(),
+                                       "malformed response from the ThinLTO "
+                                       "job server"));
+      break;
+    }
+    std::unique_ptr<WritableMemoryBuffer> Obj =
+        WritableMemoryBuffer::getNewUninitMemBuffer(*Size, "thinlto-job-" +
+                                                               Twine(*ID));
+    if (!In.readBytes(Obj->getBufferStart(), *Size)) {
+      finish(OnDone, createStringError(inconvertibleErrorCode(),
+                                       "lost connection to the ThinLTO job "
+                                       "server"));
+      break;
+    }
+    finish(OnDone, std::move(Obj));
+  }
+
+  // The server is gone or misbehaved. Fail the jobs still waiting for it.
+  DenseMap<int64_t, DoneFn> Orphans;
+  {
+    std::lock_guard<std::mutex> Lock(Mu);
+    Disconnected = true;
+    Orphans.swap(Pending);
+  }
+  for (auto &[ID, OnDone] : Orphans)
+    finish(OnDone, createStringError(inconvertibleErrorCode(),
+                                     "lost connection to the ThinLTO job "
+                                     "server"));
+}
+
+Expected<std::unique_ptr<ThinBackendExecutor>>
+lto::createRemoteThinBackendExecutor(StringRef SocketPath,
+                                     unsigned Parallelism) {
+  Expected<std::unique_ptr<raw_socket_stream>> SocketOrErr =
+      raw_socket_stream::createConnectedUnix(SocketPath);
+  if (!SocketOrErr)
+    return SocketOrErr.takeError();
+  return std::make_unique<RemoteThinBackendExecutor>(std::move(*SocketOrErr),
+                                                     std::max(Parallelism, 1u));
+}
+
+Error lto::serveThinBackendJobs(raw_socket_stream &Connection,
+                                ThinBackendExecutor &Executor,
+                                StringRef TempDir) {
+  // Mu guards Running and is never held while writing to the connection, so
+  // that a response blocked on a slow client does not stop this thread from
+  // reading the requests the client is trying to send.
+  std::mutex Mu, WriteMu;
+  std::condition_variable Idle;
+  size_t Running = 0;
+
+  auto Respond = [&](json::Object Response, StringRef Data) {
+    std::lock_guard<std::mutex> Lock(WriteMu);
+    Connection << json::Value(std::move(Response)) << '\n' << Data;
+    Connection.flush();
+  };
+
+  MessageReader In(Connection);
+  std::string Line;
+  std::optional<Error> Failure;
+  while (In.readLine(Line)) {
+    Expected<json::Value> MessageOrErr = json::parse(Line);
+    if (!MessageOrErr) {
+      Failure = MessageOrErr.takeError();
+      break;
+    }
+    const json::Object *Message = MessageOrErr->getAsObject();
+    if (Message && Message->empty())
+      break;
+
+    std::optional<int64_t> ID, Task;
+    std::optional<StringRef> Module, Index;
+    const json::Array *Imports = nullptr;
+    if (Message) {
+      ID = Message->getInteger("id");
+      Task = Message->getInteger("task");
+      Module = Message->getString("module");
+      Index = Message->getString("index");
+      Imports = Message->getArray("imports");
+    }
+    if (!ID || !Task || !Module || !Index || !Imports) {
+      Failure = createStringError(inconvertibleErrorCode(),
+                                  "malformed ThinLTO job request: " + Line);
+      break;
+    }
+
+    ThinBackendJob Job;
+    Job.Task = *Task;
+    Job.ModulePath = Module->str();
+    Job.IndexPath = Index->str();
+    for (const json::Value &Import : *Imports)
+      if (std::optional<StringRef> Path = Import.getAsString())
+        Job.ImportPaths.push_back(Path->str());
+    SmallString<128> Output;
+    sys::path::append(Output, TempDir, "thinlto-job-%%%%%%%%.o");
+    sys::fs::createUniquePath(Output, Output, /*MakeAbsolute=*/false);
+    Job.OutputPath = std::string(Output);
+
+    {
+      std::lock_guard<std::mutex> Lock(Mu);
+      ++Running;
+    }
+    Executor.submit(
+        std::move(Job),
+        [&, ID = *ID, Output = std::string(Output)](
+            Expected<std::unique_ptr<MemoryBuffer>> ObjOrErr) {
+          if (ObjOrErr) {
+            StringRef Obj = (*ObjOrErr)->getBuffer();
+            Respond(json::Object{{"id", ID}, {"size", int64_t(Obj.size())}},
+                    Obj);
+          } else {
+            Respond(json::Object{{"id", ID},
+                                 {"error", toString(ObjOrErr.takeError())}},
+                    "");
+          }
+          ObjOrErr = std::unique_ptr<MemoryBuffer>();
+          sys::fs::remove(Output);
+          std::lock_guard<std::mutex> Lock(Mu);
+          if (--Running == 0)
+            Idle.notify_all();
+        });
+  }
+
+  std::unique_lock<std::mutex> Lock(Mu);
+  Idle.wait(Lock, [&] { return Running == 0; });
+  Error Err = Failure ? std::move(*Failure) : Error::success();
+  if (!Err && Connection.has_error())
+    Err = errorCodeToError(Connection.error());
+  Connection.clear_error();
+  return Err;
+}
@@ -38,6 +38,7 @@
 #include "llvm/Support/raw_ostream.h"
 #include <cassert>
 #include <cstdint>
+#include <limits>
 #include <tuple>
 #include <utility>
 
@@ -70,6 +71,8 @@ STATISTIC(FragmentLayouts, "Number of fragment layouts");
 STATISTIC(ObjectBytes, "Number of emitted object file bytes");
 STATISTIC(RelaxationSteps, "Number of assembler layout and relaxation steps");
 STATISTIC(RelaxedInstructions, "Number of relaxed instructions");
+STATISTIC(SkippedRelaxations,
+          "Number of fragments not revisited during relaxation");
 
 } // end namespace stats
 } // end anonymous namespace
@@ -88,7 +91,8 @@ MCAssembler::MCAssembler(MCContext &Context,
     : Context(Context), Backend(std::move(Backend)),
       Emitter(std::move(Emitter)), Writer(std::move(Writer)),
       BundleAlignSize(0), RelaxAll(false), SubsectionsViaSymbols(false),
-      IncrementalLinkerCompatible(false), ELFHeaderEFlags(0) {
+      IncrementalLinkerCompatible(false), IncrementalRelaxation(true),
+      ELFHeaderEFlags(0) {
   VersionInfo.Major = 0; // Major version == 0 for "none specified"
   DarwinTargetVariantVersionInfo.Major = 0;
 }
@@ -107,6 +111,7 @@ void MCAssembler::reset() {
   RelaxAll = false;
   SubsectionsViaSymbols = false;
   IncrementalLinkerCompatible = false;
+  IncrementalRelaxation = true;
   ELFHeaderEFlags = 0;
   LOHContainer.reset();
   VersionInfo.Major = 0;
@@ -122,6 +127,7 @@ void MCAssembler::reset() {
   if (getWriterPtr())
     getWriterPtr()->reset();
   getLOHContainer().reset();
+  RelaxationCandidates.clear();
 }
 
 bool MCAssembler::registerSection(MCSection &Section) {
@@ -840,6 +846,10 @@ void MCAssembler::layout(MCAsmLayout &Layout) {
       Frag.setLayoutOrder(FragmentIndex++);
   }
 
+  RelaxationCandidates.assign(SectionIndex, {});
+  for (MCSection &Sec : *this)
+    collectRelaxationCandidates(Sec);
+
   // Layout until everything fits.
   while (layoutOnce(Layout)) {
     if (getContext().hadError())
@@ -854,6 +864,7 @@ void MCAssembler::layout(MCAsmLayout &Layout) {
   DEBUG_WITH_TYPE("mc-dump", {
       errs() << "assembler backend - post-relaxation\n--\n";
       dump(); });
+  RelaxationCandidates.clear();
 
   // Finalize the layout, including fragment lowering.
   finishLayout(Layout);
@@ -1219,22 +1230,135 @@ bool MCAssembler::relaxFragment(MCAsmLayout &Layout, MCFragment &F) {
   }
 }
 
-bool MCAssembler::layoutSectionOnce(MCAsmLayout &Layout, MCSection &Sec) {
+/// Returns the highest layout order of the fragments of \p Sec whose offsets
+/// the value of \p Expr depends on, or UINT_MAX if it may depend on anything
+/// else.
+static unsigned getMaxDependency(const MCExpr &Expr, const MCSection &Sec) {
+  switch (Expr.getKind()) {
+  case MCExpr::Constant:
+    return 0;
+  case MCExpr::SymbolRef: {
+    const MCSymbol &Sym = cast<MCSymbolRefExpr>(Expr).getSymbol();
+    if (Sym.isVariable() || !Sym.isInSection() ||
+        Sym.getFragment()->getParent() != &Sec)
+      return std::numeric_limits<unsigned>::max();
+    return Sym.getFragment()->getLayoutOrder();
+  }
+  case MCExpr::Unary:
+    return getMaxDependency(*cast<MCUnaryExpr>(Expr).getSubExpr(), Sec);
+  case MCExpr::Binary: {
+    const MCBinaryExpr &BE = cast<MCBinaryExpr>(Expr);
+    return std::max(getMaxDependency(*BE.getLHS(), Sec),
+                    getMaxDependency(*BE.getRHS(), Sec));
+  }
+  case MCExpr::Target:
+    return std::numeric_limits<unsigned>::max();
+  }
+  llvm_unreachable("Invalid expression kind!");
+}
+
+bool MCAssembler::getRelaxationDependency(const MCFragment &F,
+                                          unsigned &MaxDependency) const {
+  const MCSection &Sec = *F.getParent();
+  MaxDependency = F.getLayoutOrder();
+  switch (F.getKind()) {
+  default:
+    return false;
+  case MCFragment::FT_Relaxable: {
+    const auto &RF = cast<MCRelaxableFragment>(F);
+    if (!getBackend().mayNeedRelaxation(RF.getInst(), *RF.getSubtargetInfo()))
+      return false;
+    for (const MCFixup &Fixup : RF.getFixups())
+      MaxDependency =
+          std::max(MaxDependency, getMaxDependency(*Fixup.getValue(), Sec));
+    return true;
+  }
+  case MCFragment::FT_Dwarf:
+    MaxDependency = std::max(
+        MaxDependency,
+        getMaxDependency(cast<MCDwarfLineAddrFragment>(F).getAddrDelta(), Sec));
+    return true;
+  case MCFragment::FT_DwarfFrame:
+    MaxDependency = std::max(
+        MaxDependency,
+        getMaxDependency(cast<MCDwarfCallFrameFragment>(F).getAddrDelta(),
+                         Sec));
+    return true;
+  case MCFragment::FT_LEB:
+    MaxDependency =
+        std::max(MaxDependency,
+                 getMaxDependency(cast<MCLEBFragment>(F).getValue(), Sec));
+    return true;
+  case MCFragment::FT_PseudoProbe:
+    MaxDependency = std::max(
+        MaxDependency,
+        getMaxDependency(cast<MCPseudoProbeAddrFragment>(F).getAddrDelta(),
+                         Sec));
+    return true;
+  case MCFragment::FT_BoundaryAlign: {
+    // The padding depends on the sizes of the fragments it aligns.
+    const MCFragment *Last = cast<MCBoundaryAlignFragment>(F).getLastFragment();
+    if (!Last)
+      return false;
+    MaxDependency = std::max(MaxDependency, Last->getLayoutOrder());
+    return true;
+  }
+  case MCFragment::FT_CVInlineLines:
+  case MCFragment::FT_CVDefRange:
+    MaxDependency = std::numeric_limits<unsigned>::max();
+    return true;
+  }
+}
+
+void MCAssembler::collectRelaxationCandidates(MCSection &Sec) {
+  std::vector<RelaxationCandidate> &Candidates =
+      RelaxationCandidates[Sec.getOrdinal()];
+  for (MCFragment &Frag : Sec) {
+    unsigned MaxDependency;
+    if (getRelaxationDependency(Frag, MaxDependency))
+      Candidates.push_back({&Frag, MaxDependency});
+  }
+}
+
+bool MCAssembler::layoutSectionOnce(MCAsmLayout &Layout, MCSection &Sec,
+                                    unsigned &ChangedFrom) {
   // Holds the first fragment which needed relaxing during this layout. It will
   // remain NULL if none were relaxed.
   // When a fragment is relaxed, all the fragments following it should get
   // invalidated because their offset is going to change.
   MCFragment *FirstRelaxedFragment = nullptr;
 
-  // Attempt to relax all the fragments in the section.
-  for (MCFragment &Frag : Sec) {
-    // Check if this is a fragment that needs relaxation.
+  // Attempt to relax the fragments in the section that may need it. A
+  // fragment whose relaxation only depends on fragments before the first one
+  // relaxed in the previous iteration would come to the same result as then.
+  std::vector<RelaxationCandidate> &Candidates =
+      RelaxationCandidates[Sec.getOrdinal()];
+  bool DroppedCandidates = false;
+  for (RelaxationCandidate &Candidate : Candidates) {
+    if (IncrementalRelaxation && Candidate.MaxDependency < ChangedFrom) {
+      ++stats::SkippedRelaxations;
+      continue;
+    }
+    MCFragment &Frag = *Candidate.F;
     bool RelaxedFrag = relaxFragment(Layout, Frag);
-    if (RelaxedFrag && !FirstRelaxedFragment)
+    if (!RelaxedFrag)
+      continue;
+    if (!FirstRelaxedFragment)
       FirstRelaxedFragment = &Frag;
+    // An instruction may have been relaxed to one that never needs relaxation.
+    if (!getRelaxationDependency(Frag, Candidate.MaxDependency)) {
+      Candidate.F = nullptr;
+      DroppedCandidates = true;
+    }
   }
+  if (DroppedCandidates)
+    llvm::erase_if(Candidates, [](const RelaxationCandidate &Candidate) {
+      return !Candidate.F;
+    });
+
   if (FirstRelaxedFragment) {
     Layout.invalidateFragmentsFrom(FirstRelaxedFragment);
+    ChangedFrom = FirstRelaxedFragment->getLayoutOrder();
     return true;
   }
   return false;
@@ -1245,7 +1369,9 @@ bool MCAssembler::layoutOnce(MCAsmLayout &Layout) {
 
   bool WasRelaxed = false;
   for (MCSection &Sec : *this) {
-    while (layoutSectionOnce(Layout, Sec))
+    // Fragments in other sections may have moved since the last iteration.
+    unsigned ChangedFrom = 0;
+    while (layoutSectionOnce(Layout, Sec, ChangedFrom))
       WasRelaxed = true;
   }
 
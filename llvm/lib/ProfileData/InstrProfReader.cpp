@@ -32,7 +32,9 @@
 #include <cstddef>
 #include <cstdint>
 #include <limits>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <system_error>
 #include <utility>
@@ -77,6 +79,78 @@ setupMemoryBuffer(const Twine &Filename, vfs::FileSystem &FS) {
   return std::move(BufferOrErr.get());
 }
 
+namespace {
+/// A buffer referring to a mapping of an indexed profile that may be shared
+/// with other readers.
+class SharedProfileBuffer : public MemoryBuffer {
+  std::shared_ptr<MemoryBuffer> Mapping;
+
+public:
+  SharedProfileBuffer(std::shared_ptr<MemoryBuffer> Mapping)
+      : Mapping(std::move(Mapping)) {
+    init(this->Mapping->getBufferStart(), this->Mapping->getBufferEnd(),
+         /*RequiresNullTerminator=*/false);
+  }
+
+  StringRef getBufferIdentifier() const override {
+    return Mapping->getBufferIdentifier();
+  }
+
+  BufferKind getBufferKind() const override {
+    return Mapping->getBufferKind();
+  }
+};
+} // end anonymous namespace
+
+/// Map an indexed profile for reading. Indexed profiles are only ever read
+/// through the on-disk hash tables, which decode the records of a function
+/// when it is looked up, so the file is mapped rather than read no matter
+/// its size. Readers of the same unmodified file, such as the frontend and
+/// PGOInstrumentationUse in one compilation or compilations running on
+/// different threads, share one mapping for as long as any of them is alive.
+static Expected<std::unique_ptr<MemoryBuffer>>
+setupIndexedMemoryBuffer(const Twine &Filename, vfs::FileSystem &FS) {
+  if (Filename.str() == "-")
+    return setupMemoryBuffer(Filename, FS);
+
+  auto FileOrErr = FS.openFileForRead(Filename);
+  if (std::error_code EC = FileOrErr.getError())
+    return errorCodeToError(EC);
+  vfs::File &File = **FileOrErr;
+  auto StatusOrErr = File.status();
+  if (std::error_code EC = StatusOrErr.getError())
+    return errorCodeToError(EC);
+
+  using MappingKey =
+      std::tuple<sys::fs::UniqueID, uint64_t, sys::TimePoint<>>;
+  static std::mutex MappingsMutex;
+  static std::map<MappingKey, std::weak_ptr<MemoryBuffer>> Mappings;
+  MappingKey Key(StatusOrErr->getUniqueID(), StatusOrErr->getSize(),
+                 StatusOrErr->getLastModificationTime());
+  {
+    std::lock_guard<std::mutex> Lock(MappingsMutex);
+    auto It = Mappings.find(Key);
+    if (It != Mappings.end())
+      if (std::shared_ptr<MemoryBuffer> Mapping = It->second.lock())
+        return std::make_unique<SharedProfileBuffer>(std::move(Mapping));
+  }
+
+  auto BufferOrErr = File.getBuffer(Filename, StatusOrErr->getSize(),
+                                    /*RequiresNullTerminator=*/false);
+  if (std::error_code EC = BufferOrErr.getError())
+    return errorCodeToError(EC);
+  // Only mappings are worth sharing; a small profile is simply read.
+  if ((*BufferOrErr)->getBufferKind() != MemoryBuffer::MemoryBuffer_MMap)
+    return std::move(*BufferOrErr);
+
+  std::shared_ptr<MemoryBuffer> Mapping = std::move(*BufferOrErr);
+  std::lock_guard<std::mutex> Lock(MappingsMutex);
+  for (auto It = Mappings.begin(); It != Mappings.end();)
+    It = It->second.expired() ? Mappings.erase(It) : std::next(It);
+  Mappings[Key] = Mapping;
+  return std::make_unique<SharedProfileBuffer>(std::move(Mapping));
+}
+
 static Error initializeReader(InstrProfReader &Reader) {
   return Reader.readHeader();
 }
@@ -197,7 +271,7 @@ Expected<std::unique_ptr<IndexedInstrProfReader>>
 IndexedInstrProfReader::create(const Twine &Path, vfs::FileSystem &FS,
                                const Twine &RemappingPath) {
   // Set up the buffer to read.
-  auto BufferOrError = setupMemoryBuffer(Path, FS);
+  auto BufferOrError = setupIndexedMemoryBuffer(Path, FS);
   if (Error E = BufferOrError.takeError())
     return std::move(E);
 
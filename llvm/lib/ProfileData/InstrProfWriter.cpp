@@ -27,6 +27,7 @@
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/OnDiskHashTable.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
 #include <cstdint>
 #include <memory>
 #include <string>
@@ -375,6 +376,26 @@ void InstrProfWriter::addTemporalProfileTraces(
     TemporalProfTraces[Index] = std::move(Trace);
 }
 
+void InstrProfWriter::moveRecordsToShards(
+    ArrayRef<InstrProfWriter *> Shards,
+    function_ref<std::unique_lock<std::mutex>(unsigned)> LockShard,
+    function_ref<void(Error)> Warn) {
+  // Hash each function once and take the lock of each shard once.
+  std::vector<std::vector<StringMapEntry<ProfilingData> *>> Owned(
+      Shards.size());
+  for (auto &Entry : FunctionData)
+    Owned[xxh3_64bits(Entry.getKey()) % Shards.size()].push_back(&Entry);
+  for (unsigned I = 0, E = Shards.size(); I != E; ++I) {
+    if (Owned[I].empty())
+      continue;
+    std::unique_lock<std::mutex> Guard = LockShard(I);
+    for (StringMapEntry<ProfilingData> *Entry : Owned[I])
+      for (auto &[Hash, Record] : Entry->getValue())
+        Shards[I]->addRecord(Entry->getKey(), Hash, std::move(Record), 1, Warn);
+  }
+  FunctionData.clear();
+}
+
 void InstrProfWriter::mergeRecordsFromWriter(InstrProfWriter &&IPW,
                                              function_ref<void(Error)> Warn) {
   for (auto &I : IPW.FunctionData)
@@ -385,6 +406,9 @@ void InstrProfWriter::mergeRecordsFromWriter(InstrProfWriter &&IPW,
   for (auto &I : IPW.BinaryIds)
     addBinaryIds(I);
 
+  for (const auto &VTableName : IPW.VTableNames)
+    addVTableName(VTableName.getKey());
+
   addTemporalProfileTraces(IPW.TemporalProfTraces,
                            IPW.TemporalProfTraceStreamSize);
 
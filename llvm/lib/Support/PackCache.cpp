@@ -0,0 +1,752 @@
+//===- PackCache.cpp - LLVM Pack File Cache -------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the packCache function. The cache directory holds an
+// index file, "llvmpack.index", a lock file, "llvmpack.lock", and a few pack
+// files, "llvmpack-<G>-<N>.pack", to which cached objects are appended. The
+// index is an open addressing hash table mapped into memory by every process
+// using the cache:
+//
+//   IndexHeader | Slot[NumSlots]
+//
+// Each slot maps the 64-bit hash of a key to the pack and offset of an entry:
+//
+//   EntryHeader | key | padding to 16 bytes | data | padding to 16 bytes
+//
+// Readers never lock. They load a slot's hash with acquire ordering, then
+// check the full key stored in front of the data, so a slot that is being
+// reused concurrently can only cause a miss. Writers hold a lock on the index
+// file (and a mutex, since file locks are per process) while they append to
+// the newest pack, fill in a free slot and publish its hash last.
+//
+// Pack numbers only grow, so a location is never reused for another entry.
+// When the newest pack is full a new one is started; when there are more than
+// PackCachePolicy::NumPacks packs, entries of the oldest pack that were used
+// after the next pack was started are copied to the newest pack, the others
+// are dropped from the index and the oldest pack is removed. Buffers that are
+// already mapped stay valid on POSIX systems.
+//
+// Other processes map the index and the packs, so no file is ever truncated
+// or shrunk. An index that cannot be used is replaced by renaming a new one
+// over it, and the new index gets a new generation G, so that its packs never
+// reuse the name of a pack that is still mapped somewhere. Writers that still
+// use a replaced index notice it and stop adding to it. All writers lock the
+// lock file rather than the index, because the index may be replaced.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/Caching.h"
+#include "llvm/Support/Errc.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SmallVectorMemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <optional>
+
+using namespace llvm;
+
+namespace {
+
+constexpr char IndexMagic[8] = {'L', 'L', 'V', 'M', 'P', 'A', 'C', 'K'};
+constexpr uint32_t IndexVersion = 2;
+constexpr uint32_t EntryMagic = 0x454b4350; // "PCKE"
+
+// Upper bound on PackCachePolicy::NumPacks, which sizes IndexHeader.
+constexpr unsigned MaxPacks = 64;
+
+// Number of slots probed for a key. Additions only use slots in this window,
+// so lookups can stop there as well.
+constexpr unsigned MaxProbes = 32;
+
+// Slot hashes with special meaning. Key hashes are remapped to avoid them.
+constexpr uint64_t EmptySlot = 0;
+constexpr uint64_t DeletedSlot = 1;
+
+constexpr unsigned OffsetBits = 40;
+
+struct IndexHeader {
+  char Magic[8];
+  uint32_t Version;
+  uint32_t NumSlots;
+  uint64_t Generation; // Part of the pack file names.
+  // The remaining fields are only accessed with the index locked.
+  uint64_t FirstPack;  // The oldest pack that may still be referenced.
+  uint64_t ActivePack; // The pack that entries are appended to.
+  uint64_t ActiveSize; // The number of bytes used in the active pack.
+  // The time each live pack was started, indexed by pack number % MaxPacks.
+  uint64_t PackStart[MaxPacks];
+};
+
+struct Slot {
+  uint64_t KeyHash;
+  uint64_t Location; // Pack number << OffsetBits | offset in the pack.
+  uint64_t Size;     // The size of the data.
+  uint64_t LastUse;  // The time of the last lookup or addition.
+};
+
+struct EntryHeader {
+  uint32_t Magic;
+  uint32_t KeySize;
+  uint64_t DataSize;
+};
+
+static_assert(sizeof(Slot) == 32, "index layout changed");
+static_assert(sizeof(EntryHeader) == 16, "pack layout changed");
+
+template <typename T> std::atomic<T> &atomicRef(T &V) {
+  static_assert(sizeof(std::atomic<T>) == sizeof(T), "not lock free");
+  return *reinterpret_cast<std::atomic<T> *>(&V);
+}
+
+// Returns the time in microseconds. Recency only matters relative to the start
+// of a pack, which may be filled in a fraction of a second.
+uint64_t now() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+uint64_t hashKey(StringRef Key) {
+  uint64_t H = xxh3_64bits(Key);
+  return H > DeletedSlot ? H : H + 2;
+}
+
+uint64_t dataOffset(uint64_t KeySize) {
+  return alignTo(sizeof(EntryHeader) + KeySize, 16);
+}
+
+uint64_t entrySize(uint64_t KeySize, uint64_t DataSize) {
+  return alignTo(dataOffset(KeySize) + DataSize, 16);
+}
+
+// A buffer holding a slice of a mapped pack. The mapping stays alive as long
+// as any buffer refers to it, even after the pack has been removed.
+class PackMemoryBuffer : public MemoryBuffer {
+  std::shared_ptr<sys::fs::mapped_file_region> Region;
+  std::string Name;
+
+public:
+  PackMemoryBuffer(std::shared_ptr<sys::fs::mapped_file_region> Region,
+                   StringRef Data, StringRef Name)
+      : Region(std::move(Region)), Name(Name) {
+    init(Data.begin(), Data.end(), /*RequiresNullTerminator=*/false);
+  }
+
+  StringRef getBufferIdentifier() const override { return Name; }
+  BufferKind getBufferKind() const override { return MemoryBuffer_MMap; }
+};
+
+class PackCache {
+public:
+  PackCache(StringRef CacheName, StringRef Dir, PackCachePolicy Policy)
+      : CacheName(CacheName), Dir(Dir), Policy(Policy) {}
+  ~PackCache() {
+    Index.unmap();
+    if (IndexFD != -1)
+      sys::fs::closeFile(IndexFD);
+    if (LockFD != -1)
+      sys::fs::closeFile(LockFD);
+  }
+
+  Error open();
+  std::unique_ptr<MemoryBuffer> lookup(StringRef Key);
+  void add(StringRef Key, StringRef Data);
+  StringRef getDirectory() const { return Dir; }
+
+private:
+  IndexHeader &header() const {
+    return *reinterpret_cast<IndexHeader *>(Index.data());
+  }
+  MutableArrayRef<Slot> slots() const {
+    return MutableArrayRef<Slot>(
+        reinterpret_cast<Slot *>(Index.data() + sizeof(IndexHeader)),
+        header().NumSlots);
+  }
+  uint64_t packCapacity() const {
+    return std::clamp<uint64_t>(Policy.MaxSizeBytes / Policy.NumPacks, 1,
+                                uint64_t(1) << OffsetBits);
+  }
+  std::string packPath(uint64_t Pack) const;
+  std::error_code createIndex(StringRef IndexPath);
+  bool isIndexCurrent() const;
+  std::shared_ptr<sys::fs::mapped_file_region> mapPack(uint64_t Pack,
+                                                       uint64_t End);
+  std::unique_ptr<MemoryBuffer> readEntry(uint64_t Location, uint64_t Size,
+                                          StringRef Key);
+  Expected<uint64_t> append(StringRef Key, StringRef Data);
+  Error startPack();
+  void evictOldestPack();
+  void publish(uint64_t H, uint64_t Location, uint64_t Size);
+
+  std::string CacheName;
+  std::string Dir;
+  PackCachePolicy Policy;
+  std::string IndexPath;
+  int IndexFD = -1;
+  int LockFD = -1;
+  sys::fs::mapped_file_region Index;
+
+  // The packs this cache has mapped for reading, by pack number. A pack is
+  // mapped again when an entry beyond the end of its mapping is read.
+  std::mutex PacksMutex;
+  DenseMap<uint64_t, std::shared_ptr<sys::fs::mapped_file_region>> Packs;
+};
+
+// Serializes changes to the index within this process. File locks are owned
+// by the process, so they do not exclude other threads or other PackCaches.
+std::mutex &writerMutex() {
+  static std::mutex M;
+  return M;
+}
+
+} // end anonymous namespace
+
+std::string PackCache::packPath(uint64_t Pack) const {
+  SmallString<128> Path;
+  sys::path::append(Path, Dir,
+                    "llvmpack-" + utohexstr(header().Generation) + "-" +
+                        Twine(Pack) + ".pack");
+  return std::string(Path);
+}
+
+// Creates an empty index under a temporary name and renames it over the
+// current one, which other processes may still have mapped. Packs of other
+// generations are removed; mappings of them stay valid on POSIX systems.
+// Called with the cache locked.
+std::error_code PackCache::createIndex(StringRef IndexPath) {
+  unsigned NumSlots = PowerOf2Ceil(std::max(Policy.NumIndexSlots, MaxProbes));
+  uint64_t Size = sizeof(IndexHeader) + uint64_t(NumSlots) * sizeof(Slot);
+  SmallString<128> TempPath;
+  int FD;
+  if (std::error_code EC = sys::fs::createUniqueFile(
+          Twine(IndexPath) + "-%%%%%%.tmp", FD, TempPath))
+    return EC;
+  auto Fail = [&](std::error_code EC) {
+    Index.unmap();
+    sys::fs::closeFile(FD);
+    sys::fs::remove(TempPath);
+    return EC;
+  };
+  if (std::error_code EC = sys::fs::resize_file(FD, Size))
+    return Fail(EC);
+  std::error_code EC;
+  Index = sys::fs::mapped_file_region(sys::fs::convertFDToNativeFile(FD),
+                                      sys::fs::mapped_file_region::readwrite,
+                                      Size, 0, EC);
+  if (EC)
+    return Fail(EC);
+
+  IndexHeader &H = header();
+  memcpy(H.Magic, IndexMagic, sizeof(IndexMagic));
+  H.Version = IndexVersion;
+  H.NumSlots = NumSlots;
+  H.Generation = now();
+  H.FirstPack = H.ActivePack = H.ActiveSize = 0;
+  H.PackStart[0] = now();
+  int PackFD;
+  if ((EC = sys::fs::openFileForReadWrite(packPath(0), PackFD,
+                                          sys::fs::CD_CreateNew,
+                                          sys::fs::OF_None)))
+    return Fail(EC);
+  sys::fs::closeFile(PackFD);
+  if ((EC = sys::fs::rename(TempPath, IndexPath))) {
+    sys::fs::remove(packPath(0));
+    return Fail(EC);
+  }
+  if (IndexFD != -1)
+    sys::fs::closeFile(IndexFD);
+  IndexFD = FD;
+
+  std::string Prefix = "llvmpack-" + utohexstr(H.Generation) + "-";
+  std::error_code DirEC;
+  for (sys::fs::directory_iterator I(Dir, DirEC), E; I != E && !DirEC;
+       I.increment(DirEC)) {
+    StringRef Name = sys::path::filename(I->path());
+    if (Name.starts_with("llvmpack-") && Name.ends_with(".pack") &&
+        !Name.starts_with(Prefix))
+      sys::fs::remove(I->path());
+  }
+  return std::error_code();
+}
+
+// Returns false if another process has replaced the index this cache uses.
+// Called with the cache locked.
+bool PackCache::isIndexCurrent() const {
+  sys::fs::file_status Mapped, Current;
+  return !sys::fs::status(IndexFD, Mapped) &&
+         !sys::fs::status(IndexPath, Current) &&
+         Mapped.getUniqueID() == Current.getUniqueID();
+}
+
+Error PackCache::open() {
+  if (Policy.NumPacks < 2 || Policy.NumPacks > MaxPacks)
+    return createStringError(errc::invalid_argument,
+                             Twine(CacheName) +
+                                 ": the number of packs must be between 2 "
+                                 "and " +
+                                 Twine(MaxPacks));
+  if (std::error_code EC =
+          sys::fs::create_directories(Dir, /*IgnoreExisting=*/true))
+    return createStringError(EC, Twine("can't create cache directory ") + Dir +
+                                     ": " + EC.message());
+
+  SmallString<128> Path;
+  sys::path::append(Path, Dir, "llvmpack.index");
+  IndexPath = std::string(Path);
+  SmallString<128> LockPath;
+  sys::path::append(LockPath, Dir, "llvmpack.lock");
+  auto Fail = [&](std::error_code EC, const char *What,
+                  StringRef File) -> Error {
+    return createStringError(EC, Twine(CacheName) + ": can't " + What + " " +
+                                     File + ": " + EC.message());
+  };
+  if (std::error_code EC = sys::fs::openFileForReadWrite(
+          LockPath, LockFD, sys::fs::CD_OpenAlways, sys::fs::OF_None))
+    return Fail(EC, "open", LockPath);
+
+  std::lock_guard<std::mutex> Lock(writerMutex());
+  if (std::error_code EC = sys::fs::lockFile(LockFD))
+    return Fail(EC, "lock", LockPath);
+  auto Unlock = make_scope_exit([&] { sys::fs::unlockFile(LockFD); });
+
+  if (!sys::fs::openFileForReadWrite(IndexPath, IndexFD,
+                                     sys::fs::CD_OpenExisting,
+                                     sys::fs::OF_None)) {
+    sys::fs::file_status Status;
+    if (std::error_code EC = sys::fs::status(IndexFD, Status))
+      return errorCodeToError(EC);
+    uint64_t FileSize = Status.getSize();
+    if (FileSize >= sizeof(IndexHeader)) {
+      std::error_code EC;
+      Index = sys::fs::mapped_file_region(
+          sys::fs::convertFDToNativeFile(IndexFD),
+          sys::fs::mapped_file_region::readwrite, FileSize, 0, EC);
+      if (EC)
+        return Fail(EC, "map", IndexPath);
+      const IndexHeader &H = header();
+      if (memcmp(H.Magic, IndexMagic, sizeof(IndexMagic)) == 0 &&
+          H.Version == IndexVersion && isPowerOf2_32(H.NumSlots) &&
+          H.NumSlots >= MaxProbes &&
+          FileSize ==
+              sizeof(IndexHeader) + uint64_t(H.NumSlots) * sizeof(Slot))
+        return Error::success();
+      Index.unmap();
+    }
+    // Otherwise the index was left behind by an incompatible compiler or by a
+    // process that died while creating it. Replace it.
+  }
+
+  if (std::error_code EC = createIndex(IndexPath))
+    return Fail(EC, "create", IndexPath);
+  return Error::success();
+}
+
+// Returns a mapping of the pack that covers at least its first End bytes, or
+// null if the pack is gone or shorter than that.
+std::shared_ptr<sys::fs::mapped_file_region>
+PackCache::mapPack(uint64_t Pack, uint64_t End) {
+  std::lock_guard<std::mutex> Lock(PacksMutex);
+  auto It = Packs.find(Pack);
+  if (It != Packs.end() && It->second->size() >= End)
+    return It->second;
+
+  // Drop the mappings of packs that have been removed. Buffers that are in
+  // use keep them alive.
+  uint64_t FirstPack =
+      atomicRef(header().FirstPack).load(std::memory_order_relaxed);
+  for (auto I = Packs.begin(), E = Packs.end(); I != E; ++I)
+    if (I->first < FirstPack)
+      Packs.erase(I);
+  if (Pack < FirstPack)
+    return nullptr;
+
+  Expected<sys::fs::file_t> FDOrErr =
+      sys::fs::openNativeFileForRead(packPath(Pack));
+  if (!FDOrErr) {
+    // The pack was removed after the slot was read.
+    consumeError(FDOrErr.takeError());
+    return nullptr;
+  }
+  auto Close = make_scope_exit([&] { sys::fs::closeFile(*FDOrErr); });
+  sys::fs::file_status Status;
+  if (sys::fs::status(*FDOrErr, Status) || Status.getSize() < End ||
+      Status.getSize() == 0)
+    return nullptr;
+  std::error_code EC;
+  auto NewRegion = std::make_shared<sys::fs::mapped_file_region>(
+      *FDOrErr, sys::fs::mapped_file_region::readonly, Status.getSize(), 0,
+      EC);
+  if (EC)
+    return nullptr;
+  Packs[Pack] = NewRegion;
+  return NewRegion;
+}
+
+std::unique_ptr<MemoryBuffer>
+PackCache::readEntry(uint64_t Location, uint64_t Size, StringRef Key) {
+  uint64_t Pack = Location >> OffsetBits;
+  uint64_t Offset = Location & maskTrailingOnes<uint64_t>(OffsetBits);
+  uint64_t DataOffset = Offset + dataOffset(Key.size());
+  std::shared_ptr<sys::fs::mapped_file_region> Region =
+      mapPack(Pack, DataOffset + Size);
+  if (!Region)
+    return nullptr;
+
+  EntryHeader EH;
+  memcpy(&EH, Region->const_data() + Offset, sizeof(EH));
+  if (EH.Magic != EntryMagic || EH.KeySize != Key.size() ||
+      EH.DataSize != Size ||
+      StringRef(Region->const_data() + Offset + sizeof(EH), Key.size()) != Key)
+    return nullptr;
+  StringRef Data(Region->const_data() + DataOffset, Size);
+  return std::make_unique<PackMemoryBuffer>(std::move(Region), Data,
+                                            packPath(Pack));
+}
+
+std::unique_ptr<MemoryBuffer> PackCache::lookup(StringRef Key) {
+  uint64_t H = hashKey(Key);
+  MutableArrayRef<Slot> Slots = slots();
+  size_t Mask = Slots.size() - 1;
+  for (unsigned Probe = 0; Probe != MaxProbes; ++Probe) {
+    Slot &S = Slots[(H + Probe) & Mask];
+    uint64_t SlotHash = atomicRef(S.KeyHash).load(std::memory_order_acquire);
+    if (SlotHash == EmptySlot)
+      return nullptr;
+    if (SlotHash != H)
+      continue;
+    uint64_t Location = atomicRef(S.Location).load(std::memory_order_relaxed);
+    uint64_t Size = atomicRef(S.Size).load(std::memory_order_relaxed);
+    if (std::unique_ptr<MemoryBuffer> MB = readEntry(Location, Size, Key)) {
+      atomicRef(S.LastUse).store(now(), std::memory_order_relaxed);
+      return MB;
+    }
+  }
+  return nullptr;
+}
+
+// Appends an entry to the active pack and returns its location. Called with
+// the index locked.
+Expected<uint64_t> PackCache::append(StringRef Key, StringRef Data) {
+  IndexHeader &H = header();
+  uint64_t Offset = H.ActiveSize;
+  int FD;
+  if (std::error_code EC =
+          sys::fs::openFileForReadWrite(packPath(H.ActivePack), FD,
+                                        sys::fs::CD_OpenAlways,
+                                        sys::fs::OF_None))
+    return errorCodeToError(EC);
+  raw_fd_ostream OS(FD, /*shouldClose=*/true);
+  OS.seek(Offset);
+  EntryHeader EH = {EntryMagic, uint32_t(Key.size()), uint64_t(Data.size())};
+  OS.write(reinterpret_cast<const char *>(&EH), sizeof(EH));
+  OS << Key;
+  OS.write_zeros(dataOffset(Key.size()) - sizeof(EH) - Key.size());
+  OS << Data;
+  uint64_t Size = entrySize(Key.size(), Data.size());
+  OS.write_zeros(Size - dataOffset(Key.size()) - Data.size());
+  OS.close();
+  if (OS.has_error())
+    return errorCodeToError(OS.error());
+  H.ActiveSize = Offset + Size;
+  return H.ActivePack << OffsetBits | Offset;
+}
+
+// Starts a new active pack and removes the oldest packs if there are too many.
+// Called with the index locked.
+Error PackCache::startPack() {
+  IndexHeader &H = header();
+  uint64_t Pack = H.ActivePack + 1;
+  int FD;
+  // Never truncate: a pack left behind by a process that died here is not
+  // referenced by the index, but other packs may be mapped.
+  if (std::error_code EC = sys::fs::openFileForReadWrite(
+          packPath(Pack), FD, sys::fs::CD_OpenAlways, sys::fs::OF_None))
+    return errorCodeToError(EC);
+  sys::fs::closeFile(FD);
+  H.PackStart[Pack % MaxPacks] = now();
+  H.ActivePack = Pack;
+  H.ActiveSize = 0;
+  while (H.ActivePack - H.FirstPack >= Policy.NumPacks)
+    evictOldestPack();
+  return Error::success();
+}
+
+// Removes the oldest pack. Entries that were used since the next pack was
+// started are copied to the active pack as long as it has room. Called with
+// the index locked.
+void PackCache::evictOldestPack() {
+  IndexHeader &H = header();
+  uint64_t Pack = H.FirstPack;
+  uint64_t RecentlyUsed = H.PackStart[(Pack + 1) % MaxPacks];
+  std::string Path = packPath(Pack);
+  ErrorOr<std::unique_ptr<MemoryBuffer>> PackOrErr =
+      MemoryBuffer::getFile(Path, /*IsText=*/false,
+                            /*RequiresNullTerminator=*/false);
+
+  for (Slot &S : slots()) {
+    uint64_t SlotHash = atomicRef(S.KeyHash).load(std::memory_order_relaxed);
+    if (SlotHash == EmptySlot || SlotHash == DeletedSlot ||
+        S.Location >> OffsetBits != Pack)
+      continue;
+
+    uint64_t Offset = S.Location & maskTrailingOnes<uint64_t>(OffsetBits);
+    if (PackOrErr && atomicRef(S.LastUse).load(std::memory_order_relaxed) >=
+                         RecentlyUsed) {
+      StringRef Contents = (*PackOrErr)->getBuffer();
+      EntryHeader EH;
+      if (Offset + sizeof(EH) <= Contents.size()) {
+        memcpy(&EH, Contents.data() + Offset, sizeof(EH));
+        uint64_t Size = entrySize(EH.KeySize, EH.DataSize);
+        if (EH.Magic == EntryMagic && Offset + Size <= Contents.size() &&
+            H.ActiveSize + Size <= packCapacity()) {
+          StringRef Key = Contents.substr(Offset + sizeof(EH), EH.KeySize);
+          StringRef Data = Contents.substr(Offset + dataOffset(EH.KeySize),
+                                           EH.DataSize);
+          if (Expected<uint64_t> LocOrErr = append(Key, Data)) {
+            atomicRef(S.Location).store(*LocOrErr, std::memory_order_release);
+            continue;
+          } else {
+            consumeError(LocOrErr.takeError());
+          }
+        }
+      }
+    }
+    atomicRef(S.KeyHash).store(DeletedSlot, std::memory_order_release);
+  }
+
+  ++H.FirstPack;
+  PackOrErr = std::error_code();
+  sys::fs::remove(Path);
+  std::lock_guard<std::mutex> Lock(PacksMutex);
+  Packs.erase(Pack);
+}
+
+// Points a slot for H at a new entry, preferring a slot already holding H,
+// then a free one, then the least recently used one in the probe window.
+// Called with the index locked.
+void PackCache::publish(uint64_t H, uint64_t Location, uint64_t Size) {
+  MutableArrayRef<Slot> Slots = slots();
+  size_t Mask = Slots.size() - 1;
+  Slot *Match = nullptr, *Free = nullptr, *Oldest = nullptr;
+  for (unsigned Probe = 0; Probe != MaxProbes; ++Probe) {
+    Slot &S = Slots[(H + Probe) & Mask];
+    uint64_t SlotHash = atomicRef(S.KeyHash).load(std::memory_order_relaxed);
+    if (SlotHash == H) {
+      Match = &S;
+      break;
+    }
+    if (SlotHash == EmptySlot || SlotHash == DeletedSlot) {
+      if (!Free)
+        Free = &S;
+      // Lookups stop at an empty slot, so H cannot be in a later one.
+      if (SlotHash == EmptySlot)
+        break;
+      continue;
+    }
+    if (!Oldest || atomicRef(S.LastUse).load(std::memory_order_relaxed) <
+                       atomicRef(Oldest->LastUse).load(
+                           std::memory_order_relaxed))
+      Oldest = &S;
+  }
+  Slot *Victim = Match ? Match : Free ? Free : Oldest;
+
+  // Hide the slot while it is rewritten so that readers do not combine the
+  // new hash with an old location. They check the key anyway.
+  atomicRef(Victim->KeyHash).store(DeletedSlot, std::memory_order_relaxed);
+  atomicRef(Victim->Location).store(Location, std::memory_order_relaxed);
+  atomicRef(Victim->Size).store(Size, std::memory_order_relaxed);
+  atomicRef(Victim->LastUse).store(now(), std::memory_order_relaxed);
+  atomicRef(Victim->KeyHash).store(H, std::memory_order_release);
+}
+
+void PackCache::add(StringRef Key, StringRef Data) {
+  uint64_t Size = entrySize(Key.size(), Data.size());
+  if (Key.size() > UINT32_MAX || Size > packCapacity())
+    return;
+
+  std::lock_guard<std::mutex> Lock(writerMutex());
+  if (sys::fs::lockFile(LockFD))
+    return;
+  auto Unlock = make_scope_exit([&] { sys::fs::unlockFile(LockFD); });
+  // Adding to a replaced index would recreate packs of its generation that
+  // nobody removes.
+  if (!isIndexCurrent())
+    return;
+
+  IndexHeader &H = header();
+  if (H.ActiveSize + Size > packCapacity())
+    if (Error E = startPack()) {
+      consumeError(std::move(E));
+      return;
+    }
+  Expected<uint64_t> LocOrErr = append(Key, Data);
+  if (!LocOrErr) {
+    consumeError(LocOrErr.takeError());
+    return;
+  }
+  publish(hashKey(Key), *LocOrErr, Data.size());
+}
+
+namespace {
+// Collects an object being added to the cache. Small objects are kept in
+// memory; once an object grows past SpillSize it is moved to a temporary file
+// in the cache directory and the rest is written there, so that large objects
+// are never held in memory as a whole.
+class PackCacheStream : public raw_pwrite_stream {
+public:
+  static constexpr size_t SpillSize = 1 << 20;
+
+  explicit PackCacheStream(StringRef Dir)
+      : raw_pwrite_stream(/*Unbuffered=*/true), Dir(Dir) {}
+  ~PackCacheStream() override {
+    flush();
+    File.reset();
+    if (Temp)
+      consumeError(Temp->discard());
+  }
+
+  /// Finishes writing and returns the contents, or an error if the temporary
+  /// file cannot be read back.
+  ErrorOr<std::unique_ptr<MemoryBuffer>> takeContents(StringRef Name) {
+    flush();
+    if (!Temp)
+      return std::make_unique<SmallVectorMemoryBuffer>(
+          std::move(Buffer), Name, /*RequiresNullTerminator=*/false);
+    File->flush();
+    if (File->has_error())
+      return File->error();
+    return MemoryBuffer::getOpenFile(sys::fs::convertFDToNativeFile(Temp->FD),
+                                     Temp->TmpName, /*FileSize=*/-1,
+                                     /*RequiresNullTerminator=*/false);
+  }
+
+private:
+  void spill() {
+    SmallString<128> Model;
+    sys::path::append(Model, Dir, "llvmpack-%%%%%%.tmp");
+    Expected<sys::fs::TempFile> TempOrErr = sys::fs::TempFile::create(
+        Model, sys::fs::owner_read | sys::fs::owner_write);
+    if (!TempOrErr) {
+      // Keep the object in memory instead.
+      consumeError(TempOrErr.takeError());
+      return;
+    }
+    Temp.emplace(std::move(*TempOrErr));
+    File = std::make_unique<raw_fd_ostream>(Temp->FD, /*shouldClose=*/false);
+    File->write(Buffer.data(), Buffer.size());
+    Buffer = SmallVector<char, 0>();
+  }
+
+  void write_impl(const char *Ptr, size_t Size) override {
+    if (!File && !Tried && Buffer.size() + Size > SpillSize) {
+      Tried = true;
+      spill();
+    }
+    if (File)
+      File->write(Ptr, Size);
+    else
+      Buffer.append(Ptr, Ptr + Size);
+  }
+
+  void pwrite_impl(const char *Ptr, size_t Size, uint64_t Offset) override {
+    if (File)
+      File->pwrite(Ptr, Size, Offset);
+    else
+      memcpy(Buffer.data() + Offset, Ptr, Size);
+  }
+
+  uint64_t current_pos() const override {
+    return File ? File->tell() : Buffer.size();
+  }
+
+  std::string Dir;
+  SmallVector<char, 0> Buffer;
+  std::optional<sys::fs::TempFile> Temp;
+  std::unique_ptr<raw_fd_ostream> File;
+  bool Tried = false;
+};
+} // end anonymous namespace
+
+Expected<FileCache> llvm::packCache(const Twine &CacheNameRef,
+                                    const Twine &CacheDirectoryPathRef,
+                                    AddBufferFn AddBuffer,
+                                    PackCachePolicy Policy) {
+  SmallString<64> CacheName, CacheDirectoryPath;
+  CacheNameRef.toVector(CacheName);
+  CacheDirectoryPathRef.toVector(CacheDirectoryPath);
+
+  auto Cache =
+      std::make_shared<PackCache>(CacheName, CacheDirectoryPath, Policy);
+  if (Error E = Cache->open())
+    return std::move(E);
+
+  return [=](unsigned Task, StringRef Key,
+             const Twine &ModuleName) -> Expected<AddStreamFn> {
+    if (std::unique_ptr<MemoryBuffer> MB = Cache->lookup(Key)) {
+      AddBuffer(Task, ModuleName, std::move(MB));
+      return AddStreamFn();
+    }
+
+    // This stream collects the object, appends it to a pack when it is
+    // complete and hands AddBuffer the copy in the mapped pack. Failing to add
+    // the object to the cache is not an error.
+    struct CacheStream : CachedFileStream {
+      PackCacheStream *Stream;
+      std::shared_ptr<PackCache> Cache;
+      AddBufferFn AddBuffer;
+      std::string Key;
+      std::string ModuleName;
+      unsigned Task;
+
+      CacheStream(std::shared_ptr<PackCache> Cache, AddBufferFn AddBuffer,
+                  std::string Key, std::string ModuleName, unsigned Task)
+          : CachedFileStream(nullptr), Cache(std::move(Cache)),
+            AddBuffer(std::move(AddBuffer)), Key(std::move(Key)),
+            ModuleName(std::move(ModuleName)), Task(Task) {
+        auto S = std::make_unique<PackCacheStream>(this->Cache->getDirectory());
+        Stream = S.get();
+        OS = std::move(S);
+      }
+
+      ~CacheStream() {
+        ErrorOr<std::unique_ptr<MemoryBuffer>> MBOrErr =
+            Stream->takeContents(ModuleName);
+        if (!MBOrErr)
+          report_fatal_error(Twine("Failed to read back cache entry for ") +
+                             ModuleName + ": " + MBOrErr.getError().message() +
+                             "\n");
+        std::unique_ptr<MemoryBuffer> MB = std::move(*MBOrErr);
+        Cache->add(Key, MB->getBuffer());
+        // Prefer the copy in the pack, which does not keep the temporary file
+        // or the memory of the stream alive.
+        if (std::unique_ptr<MemoryBuffer> Packed = Cache->lookup(Key))
+          MB = std::move(Packed);
+        else if (MB->getBufferKind() == MemoryBuffer::MemoryBuffer_MMap)
+          MB = MemoryBuffer::getMemBufferCopy(MB->getBuffer(), ModuleName);
+        OS.reset();
+        AddBuffer(Task, ModuleName, std::move(MB));
+      }
+    };
+
+    return [=, Key = Key.str()](size_t Task, const Twine &ModuleName)
+               -> Expected<std::unique_ptr<CachedFileStream>> {
+      return std::make_unique<CacheStream>(Cache, AddBuffer, Key,
+                                           ModuleName.str(), Task);
+    };
+  };
+}
@@ -7,6 +7,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/Support/Parallel.h"
+#include "llvm/ADT/FunctionExtras.h"
 #include "llvm/Config/llvm-config.h"
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/Threading.h"
@@ -14,6 +15,7 @@
 #include <atomic>
 #include <deque>
 #include <future>
+#include <memory>
 #include <thread>
 #include <vector>
 
@@ -31,26 +33,58 @@ unsigned getThreadIndex() { GET_THREAD_INDEX_IMPL; }
 thread_local unsigned threadIndex = UINT_MAX;
 #endif
 
+/// True while this thread runs a sequential task.
+static thread_local bool inSequentialTask = false;
+
 namespace detail {
 
 namespace {
 
+/// A closure and the latch of the TaskGroup that spawned it. Most closures
+/// spawned by the parallel algorithms fit in the inline storage of
+/// unique_function, so queueing them does not allocate.
+struct Task {
+  unique_function<void()> F;
+  Latch *L = nullptr;
+
+  /// Returns true if this was the last pending task of its TaskGroup.
+  bool run() {
+    {
+      // Destroy the closure before signalling the TaskGroup, which may go
+      // away as soon as its latch reaches zero.
+      unique_function<void()> Fn = std::move(F);
+      Fn();
+    }
+    return L && L->dec();
+  }
+};
+
 /// An abstract class that takes closures and runs them asynchronously.
 class Executor {
 public:
   virtual ~Executor() = default;
-  virtual void add(std::function<void()> func, bool Sequential = false) = 0;
+  virtual void add(Task T, bool Sequential = false) = 0;
+  /// Called on a worker thread: runs queued tasks until \p L reaches zero.
+  virtual void waitFor(const Latch &L) = 0;
   virtual size_t getThreadCount() const = 0;
 
   static Executor *getDefaultExecutor();
 };
 
-/// An implementation of an Executor that runs closures on a thread pool
-///   in filo order.
+/// An implementation of an Executor that runs closures on a thread pool.
+///
+/// Each worker owns a deque. Tasks spawned by a worker are pushed to and
+/// popped from the back of its own deque, so nested parallelism runs in filo
+/// order close to the data it was spawned from. An idle worker steals from the
+/// front of the other deques, where the oldest and usually largest pieces of
+/// work are. Tasks spawned from outside the pool and sequential tasks go
+/// through shared queues guarded by a single mutex, which is also used to put
+/// idle workers to sleep.
 class ThreadPoolExecutor : public Executor {
 public:
   explicit ThreadPoolExecutor(ThreadPoolStrategy S = hardware_concurrency()) {
     ThreadCount = S.compute_thread_count();
+    Queues = std::make_unique<WorkerQueue[]>(ThreadCount);
     // Spawn all but one of the threads in another thread as spawning threads
     // can take a while.
     Threads.reserve(ThreadCount);
@@ -98,56 +132,186 @@ public:
     static void call(void *Ptr) { ((ThreadPoolExecutor *)Ptr)->stop(); }
   };
 
-  void add(std::function<void()> F, bool Sequential = false) override {
-    {
+  void add(Task T, bool Sequential = false) override {
+    if (Sequential) {
+      {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        WorkQueueSequential.emplace_front(std::move(T));
+        ++SharedTasks;
+      }
+      Cond.notify_one();
+      return;
+    }
+
+    // Count the task before it becomes visible so that PendingTasks never
+    // drops below the number of queued tasks.
+    ++PendingTasks;
+    unsigned Index = threadIndex;
+    if (Index < ThreadCount) {
+      WorkerQueue &Q = Queues[Index];
+      std::lock_guard<std::mutex> Lock(Q.Mutex);
+      Q.Tasks.emplace_back(std::move(T));
+      ++Q.Size;
+    } else {
       std::lock_guard<std::mutex> Lock(Mutex);
-      if (Sequential)
-        WorkQueueSequential.emplace_front(std::move(F));
-      else
-        WorkQueue.emplace_back(std::move(F));
+      WorkQueue.emplace_back(std::move(T));
+      ++SharedTasks;
+    }
+    // Pairs with the increment of Sleepers in work(): either the sleeper sees
+    // the new task or we see the sleeper. Taking the mutex orders the
+    // notification after the sleeper has started waiting.
+    if (Sleepers) {
+      { std::lock_guard<std::mutex> Lock(Mutex); }
+      Cond.notify_one();
+    }
+  }
+
+  void waitFor(const Latch &L) override {
+    unsigned Index = threadIndex;
+    assert(Index < ThreadCount && "waitFor() called outside of the pool");
+    // Blocking here could deadlock if the tasks of the group are queued
+    // behind this thread, so help running tasks instead, and only sleep
+    // while there is nothing to run. runTask() wakes the sleepers when a
+    // TaskGroup is done.
+    while (!L.isZero()) {
+      if (runTask(Index))
+        continue;
+      std::unique_lock<std::mutex> Lock(Mutex);
+      ++Sleepers;
+      Cond.wait(Lock, [&] {
+        return L.isZero() || hasGeneralTasks() || hasSequentialTasks();
+      });
+      --Sleepers;
     }
-    Cond.notify_one();
   }
 
   size_t getThreadCount() const override { return ThreadCount; }
 
 private:
+  struct alignas(64) WorkerQueue {
+    std::mutex Mutex;
+    std::deque<Task> Tasks;
+    /// Size of Tasks, readable without holding Mutex.
+    std::atomic<size_t> Size{0};
+  };
+
   bool hasSequentialTasks() const {
     return !WorkQueueSequential.empty() && !SequentialQueueIsLocked;
   }
 
-  bool hasGeneralTasks() const { return !WorkQueue.empty(); }
+  bool hasGeneralTasks() const { return PendingTasks != 0; }
+
+  bool popLocal(unsigned Index, Task &T) {
+    WorkerQueue &Q = Queues[Index];
+    if (Q.Size == 0)
+      return false;
+    std::lock_guard<std::mutex> Lock(Q.Mutex);
+    if (Q.Tasks.empty())
+      return false;
+    T = std::move(Q.Tasks.back());
+    Q.Tasks.pop_back();
+    --Q.Size;
+    --PendingTasks;
+    return true;
+  }
+
+  bool popShared(Task &T, bool &Sequential) {
+    if (SharedTasks == 0)
+      return false;
+    std::lock_guard<std::mutex> Lock(Mutex);
+    Sequential = hasSequentialTasks();
+    if (Sequential) {
+      SequentialQueueIsLocked = true;
+      T = std::move(WorkQueueSequential.back());
+      WorkQueueSequential.pop_back();
+    } else if (!WorkQueue.empty()) {
+      T = std::move(WorkQueue.front());
+      WorkQueue.pop_front();
+      --PendingTasks;
+    } else {
+      return false;
+    }
+    --SharedTasks;
+    return true;
+  }
+
+  bool steal(unsigned Index, Task &T) {
+    for (unsigned I = 1; I < ThreadCount; ++I) {
+      WorkerQueue &Q = Queues[(Index + I) % ThreadCount];
+      if (Q.Size == 0)
+        continue;
+      std::lock_guard<std::mutex> Lock(Q.Mutex);
+      if (Q.Tasks.empty())
+        continue;
+      T = std::move(Q.Tasks.front());
+      Q.Tasks.pop_front();
+      --Q.Size;
+      --PendingTasks;
+      return true;
+    }
+    return false;
+  }
+
+  /// Runs one task if there is any available to the worker \p Index.
+  bool runTask(unsigned Index) {
+    Task T;
+    bool Sequential = false;
+    if (!popLocal(Index, T) && !popShared(T, Sequential) && !steal(Index, T))
+      return false;
+    bool Done;
+    if (Sequential) {
+      inSequentialTask = true;
+      Done = T.run();
+      inSequentialTask = false;
+    } else {
+      Done = T.run();
+    }
+    // A worker may be waiting for this TaskGroup in waitFor().
+    if (Done && Sleepers) {
+      { std::lock_guard<std::mutex> Lock(Mutex); }
+      Cond.notify_all();
+    }
+    if (Sequential) {
+      bool More;
+      {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        SequentialQueueIsLocked = false;
+        More = !WorkQueueSequential.empty();
+      }
+      // The remaining sequential tasks may only be runnable by others if this
+      // thread is helping a TaskGroup that is now done.
+      if (More)
+        Cond.notify_one();
+    }
+    return true;
+  }
 
   void work(ThreadPoolStrategy S, unsigned ThreadID) {
     threadIndex = ThreadID;
     S.apply_thread_strategy(ThreadID);
-    while (true) {
+    while (!Stop) {
+      if (runTask(ThreadID))
+        continue;
       std::unique_lock<std::mutex> Lock(Mutex);
+      ++Sleepers;
       Cond.wait(Lock, [&] {
         return Stop || hasGeneralTasks() || hasSequentialTasks();
       });
-      if (Stop)
-        break;
-      bool Sequential = hasSequentialTasks();
-      if (Sequential)
-        SequentialQueueIsLocked = true;
-      else
-        assert(hasGeneralTasks());
-
-      auto &Queue = Sequential ? WorkQueueSequential : WorkQueue;
-      auto Task = std::move(Queue.back());
-      Queue.pop_back();
-      Lock.unlock();
-      Task();
-      if (Sequential)
-        SequentialQueueIsLocked = false;
+      --Sleepers;
     }
   }
 
   std::atomic<bool> Stop{false};
   std::atomic<bool> SequentialQueueIsLocked{false};
-  std::deque<std::function<void()>> WorkQueue;
-  std::deque<std::function<void()>> WorkQueueSequential;
+  /// Number of general tasks in all queues.
+  std::atomic<size_t> PendingTasks{0};
+  /// Number of tasks in WorkQueue and WorkQueueSequential.
+  std::atomic<size_t> SharedTasks{0};
+  /// Number of workers waiting on Cond.
+  std::atomic<unsigned> Sleepers{0};
+  std::unique_ptr<WorkerQueue[]> Queues;
+  std::deque<Task> WorkQueue;
+  std::deque<Task> WorkQueueSequential;
   std::mutex Mutex;
   std::condition_variable Cond;
   std::promise<void> ThreadsCreated;
@@ -188,39 +352,46 @@ size_t getThreadCount() {
 }
 #endif
 
-// Latch::sync() called by the dtor may cause one thread to block. If is a dead
-// lock if all threads in the default executor are blocked. To prevent the dead
-// lock, only allow the root TaskGroup to run tasks parallelly. In the scenario
-// of nested parallel_for_each(), only the outermost one runs parallelly.
+// Nested TaskGroups run in parallel as well: a worker thread waiting for a
+// nested TaskGroup keeps running queued tasks instead of blocking, so it cannot
+// dead lock the default executor. The exception are TaskGroups created by a
+// sequential task. Their sequential tasks could not start before the task that
+// waits for them is done, so they run their tasks in place.
 TaskGroup::TaskGroup()
 #if LLVM_ENABLE_THREADS
-    : Parallel((parallel::strategy.ThreadsRequested != 1) &&
-               (threadIndex == UINT_MAX)) {}
+    : Parallel(parallel::strategy.ThreadsRequested != 1 &&
+               !inSequentialTask) {}
 #else
     : Parallel(false) {}
 #endif
 TaskGroup::~TaskGroup() {
   // We must ensure that all the workloads have finished before decrementing the
   // instances count.
-  L.sync();
+  sync();
 }
 
-void TaskGroup::spawn(std::function<void()> F, bool Sequential) {
+void TaskGroup::spawn(unique_function<void()> F, bool Sequential) {
 #if LLVM_ENABLE_THREADS
   if (Parallel) {
     L.inc();
-    detail::Executor::getDefaultExecutor()->add(
-        [&, F = std::move(F)] {
-          F();
-          L.dec();
-        },
-        Sequential);
+    detail::Executor::getDefaultExecutor()->add({std::move(F), &L},
+                                                Sequential);
     return;
   }
 #endif
   F();
 }
 
+void TaskGroup::sync() const {
+#if LLVM_ENABLE_THREADS
+  if (Parallel && threadIndex != UINT_MAX) {
+    detail::Executor::getDefaultExecutor()->waitFor(L);
+    return;
+  }
+#endif
+  L.sync();
+}
+
 } // namespace parallel
 } // namespace llvm
 
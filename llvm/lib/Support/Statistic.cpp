@@ -263,6 +263,11 @@ std::vector<std::pair<StringRef, uint64_t>> llvm::GetStatistics() {
   return ReturnStats;
 }
 
+std::vector<TrackingStatistic *> llvm::GetTrackedStatistics() {
+  sys::SmartScopedLock<true> Reader(*StatLock);
+  return std::vector<TrackingStatistic *>(StatInfo->begin(), StatInfo->end());
+}
+
 void llvm::ResetStatistics() {
   StatInfo->reset();
 }
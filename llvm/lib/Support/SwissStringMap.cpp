@@ -0,0 +1,371 @@
+//===--- SwissStringMap.cpp - Swiss table variant of StringMap ------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the SwissStringMap class.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/SwissStringMap.h"
+#include "llvm/ADT/bit.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/ReverseIteration.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace llvm;
+
+namespace {
+
+// Control byte values. Full buckets hold the low 7 bits of the hash, so only
+// the empty and deleted markers have the top bit set.
+constexpr uint8_t CtrlEmpty = 0x80;
+constexpr uint8_t CtrlDeleted = 0xFE;
+
+/// The set of buckets of a group that matched a probe, lowest first.
+class BitMask {
+  uint64_t Mask;
+  // log2 of the number of mask bits per bucket.
+  unsigned Shift;
+
+public:
+  BitMask(uint64_t Mask, unsigned Shift) : Mask(Mask), Shift(Shift) {}
+
+  explicit operator bool() const { return Mask != 0; }
+  unsigned lowest() const { return llvm::countr_zero(Mask) >> Shift; }
+  void clearLowest() { Mask &= Mask - 1; }
+};
+
+#ifdef __SSE2__
+/// The control bytes of a group of 16 buckets, compared with SSE2.
+struct Group {
+  static constexpr unsigned Width = 16;
+  __m128i Ctrl;
+
+  explicit Group(const uint8_t *P)
+      : Ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i *>(P))) {}
+
+  BitMask match(uint8_t H2) const {
+    __m128i Match = _mm_cmpeq_epi8(_mm_set1_epi8(static_cast<char>(H2)), Ctrl);
+    return BitMask(static_cast<uint32_t>(_mm_movemask_epi8(Match)), 0);
+  }
+
+  BitMask matchEmpty() const { return match(CtrlEmpty); }
+
+  BitMask matchEmptyOrDeleted() const {
+    return BitMask(static_cast<uint32_t>(_mm_movemask_epi8(Ctrl)), 0);
+  }
+};
+#else
+/// The control bytes of a group of 8 buckets, compared as one 64-bit word.
+struct Group {
+  static constexpr unsigned Width = 8;
+  static constexpr uint64_t LSBs = 0x0101010101010101ULL;
+  static constexpr uint64_t MSBs = 0x8080808080808080ULL;
+  uint64_t Ctrl;
+
+  explicit Group(const uint8_t *P) : Ctrl(support::endian::read64le(P)) {}
+
+  // May also report a full bucket next to a real match whose hash differs
+  // only in the lowest bit. Callers compare the keys anyway.
+  BitMask match(uint8_t H2) const {
+    uint64_t X = Ctrl ^ (LSBs * H2);
+    return BitMask((X - LSBs) & ~X & MSBs, 3);
+  }
+
+  // Empty is the only control value with bit 7 set and bit 1 clear.
+  BitMask matchEmpty() const { return BitMask(Ctrl & ~(Ctrl << 6) & MSBs, 3); }
+
+  BitMask matchEmptyOrDeleted() const { return BitMask(Ctrl & MSBs, 3); }
+};
+#endif
+
+} // namespace
+
+static inline uint8_t getH2(uint32_t FullHashValue) {
+  return FullHashValue & 0x7F;
+}
+
+/// The first group probed for a hash. The low bits of the hash select the
+/// bucket within a group through the control byte, so use the high ones.
+static inline unsigned getFirstGroup(uint32_t FullHashValue,
+                                     unsigned GroupMask) {
+  return (FullHashValue >> 7) & GroupMask;
+}
+
+/// Start loading the entry pointers of the group at \p Buckets while its
+/// control bytes are compared, so that following a match does not wait for
+/// another cache miss.
+static inline void prefetchGroup(StringMapEntryBase *const *Buckets) {
+  for (unsigned I = 0; I < Group::Width; I += 64 / sizeof(*Buckets))
+    LLVM_PREFETCH(Buckets + I, 0, 3);
+}
+
+/// Returns the number of buckets to allocate to ensure that the map can
+/// accommodate \p NumEntries without need to grow().
+static inline unsigned getMinBucketToReserveForEntries(unsigned NumEntries) {
+  // Ensure that "NumEntries * 8 <= NumBuckets * 7"
+  if (NumEntries == 0)
+    return 0;
+  return std::max<unsigned>(NextPowerOf2(NumEntries * 8 / 7), 16);
+}
+
+static inline unsigned *getHashTable(StringMapEntryBase **TheTable,
+                                     unsigned NumBuckets) {
+  return reinterpret_cast<unsigned *>(TheTable + NumBuckets + 1);
+}
+
+static inline uint8_t *getCtrlTable(StringMapEntryBase **TheTable,
+                                    unsigned NumBuckets) {
+  return reinterpret_cast<uint8_t *>(getHashTable(TheTable, NumBuckets) +
+                                     NumBuckets);
+}
+
+static inline StringMapEntryBase **createTable(unsigned NewNumBuckets) {
+  auto **Table = static_cast<StringMapEntryBase **>(
+      safe_malloc((NewNumBuckets + 1) * sizeof(StringMapEntryBase *) +
+                  NewNumBuckets * (sizeof(unsigned) + 1)));
+  std::fill(Table, Table + NewNumBuckets, nullptr);
+  memset(getCtrlTable(Table, NewNumBuckets), CtrlEmpty, NewNumBuckets);
+
+  // Allocate one extra bucket, set it to look filled so the iterators stop at
+  // end.
+  Table[NewNumBuckets] = (StringMapEntryBase *)2;
+  return Table;
+}
+
+/// Returns the first bucket along the probe sequence of \p FullHashValue that
+/// is either empty or deleted.
+static unsigned findFirstAvailable(const uint8_t *Ctrl, unsigned NumBuckets,
+                                   uint32_t FullHashValue) {
+  unsigned GroupMask = NumBuckets / Group::Width - 1;
+  unsigned GroupNo = getFirstGroup(FullHashValue, GroupMask);
+  for (unsigned ProbeAmt = 1;; ++ProbeAmt) {
+    if (BitMask Available = Group(Ctrl + GroupNo * Group::Width)
+                                .matchEmptyOrDeleted())
+      return GroupNo * Group::Width + Available.lowest();
+    // Triangular probing over the groups visits each group once.
+    GroupNo = (GroupNo + ProbeAmt) & GroupMask;
+  }
+}
+
+SwissStringMapImpl::SwissStringMapImpl(unsigned InitSize, unsigned itemSize) {
+  ItemSize = itemSize;
+
+  // If a size is specified, initialize the table with that many buckets.
+  if (InitSize) {
+    init(getMinBucketToReserveForEntries(InitSize));
+    return;
+  }
+
+  // Otherwise, initialize it with zero buckets to avoid the allocation.
+  TheTable = nullptr;
+  NumBuckets = 0;
+  NumItems = 0;
+  NumTombstones = 0;
+}
+
+void SwissStringMapImpl::init(unsigned InitSize) {
+  assert((InitSize & (InitSize - 1)) == 0 &&
+         "Init Size must be a power of 2 or zero!");
+  assert((InitSize == 0 || InitSize >= Group::Width) &&
+         "Init Size must hold at least one group!");
+
+  unsigned NewNumBuckets = InitSize ? InitSize : 16;
+  NumItems = 0;
+  NumTombstones = 0;
+
+  TheTable = createTable(NewNumBuckets);
+
+  // Set the member only if TheTable was successfully allocated
+  NumBuckets = NewNumBuckets;
+}
+
+void SwissStringMapImpl::copyLayout(const SwissStringMapImpl &RHS) {
+  assert(NumBuckets == RHS.NumBuckets && "Tables of different size!");
+  memcpy(getHashTable(TheTable, NumBuckets),
+         getHashTable(RHS.TheTable, NumBuckets),
+         NumBuckets * (sizeof(unsigned) + 1));
+  NumItems = RHS.NumItems;
+  NumTombstones = RHS.NumTombstones;
+}
+
+void SwissStringMapImpl::clearBuckets() {
+  std::fill(TheTable, TheTable + NumBuckets, nullptr);
+  memset(getCtrlTable(TheTable, NumBuckets), CtrlEmpty, NumBuckets);
+  NumItems = 0;
+  NumTombstones = 0;
+}
+
+/// LookupBucketFor - Look up the bucket that the specified string should end
+/// up in.  If it already exists as a key in the map, the Item pointer for the
+/// specified bucket will be non-null.  Otherwise, the first empty or deleted
+/// bucket on the probe sequence is claimed for the key.
+unsigned SwissStringMapImpl::LookupBucketFor(StringRef Name,
+                                             uint32_t FullHashValue) {
+#ifdef EXPENSIVE_CHECKS
+  assert(FullHashValue == hash(Name));
+#endif
+  // Hash table unallocated so far?
+  if (NumBuckets == 0)
+    init(16);
+  if (shouldReverseIterate())
+    FullHashValue = ~FullHashValue;
+  unsigned *HashTable = getHashTable(TheTable, NumBuckets);
+  uint8_t *Ctrl = getCtrlTable(TheTable, NumBuckets);
+  uint8_t H2 = getH2(FullHashValue);
+  unsigned GroupMask = NumBuckets / Group::Width - 1;
+  unsigned GroupNo = getFirstGroup(FullHashValue, GroupMask);
+
+  int FirstAvailable = -1;
+  for (unsigned ProbeAmt = 1;; ++ProbeAmt) {
+    unsigned Base = GroupNo * Group::Width;
+    prefetchGroup(TheTable + Base);
+    Group G(Ctrl + Base);
+    for (BitMask Match = G.match(H2); Match; Match.clearLowest()) {
+      unsigned BucketNo = Base + Match.lowest();
+      // Do the comparison like this because Name isn't necessarily
+      // null-terminated!
+      StringMapEntryBase *BucketItem = TheTable[BucketNo];
+      char *ItemStr = (char *)BucketItem + ItemSize;
+      if (LLVM_LIKELY(Name == StringRef(ItemStr, BucketItem->getKeyLength())))
+        return BucketNo;
+    }
+
+    // Reuse the first deleted bucket we pass instead of an empty one further
+    // along the probe sequence.  This reduces probing.
+    if (FirstAvailable == -1)
+      if (BitMask Available = G.matchEmptyOrDeleted())
+        FirstAvailable = Base + Available.lowest();
+
+    // A group with an empty bucket ends every probe sequence that reaches it.
+    if (LLVM_LIKELY(G.matchEmpty()))
+      break;
+
+    GroupNo = (GroupNo + ProbeAmt) & GroupMask;
+  }
+
+  Ctrl[FirstAvailable] = H2;
+  HashTable[FirstAvailable] = FullHashValue;
+  return FirstAvailable;
+}
+
+/// FindKey - Look up the bucket that contains the specified key. If it exists
+/// in the map, return the bucket number of the key.  Otherwise return -1.
+/// This does not modify the map.
+int SwissStringMapImpl::FindKey(StringRef Key, uint32_t FullHashValue) const {
+  if (NumBuckets == 0)
+    return -1; // Really empty table?
+#ifdef EXPENSIVE_CHECKS
+  assert(FullHashValue == hash(Key));
+#endif
+  if (shouldReverseIterate())
+    FullHashValue = ~FullHashValue;
+  const uint8_t *Ctrl = getCtrlTable(TheTable, NumBuckets);
+  uint8_t H2 = getH2(FullHashValue);
+  unsigned GroupMask = NumBuckets / Group::Width - 1;
+  unsigned GroupNo = getFirstGroup(FullHashValue, GroupMask);
+
+  for (unsigned ProbeAmt = 1;; ++ProbeAmt) {
+    unsigned Base = GroupNo * Group::Width;
+    prefetchGroup(TheTable + Base);
+    Group G(Ctrl + Base);
+    for (BitMask Match = G.match(H2); Match; Match.clearLowest()) {
+      unsigned BucketNo = Base + Match.lowest();
+      // Do the comparison like this because Key isn't necessarily
+      // null-terminated!
+      StringMapEntryBase *BucketItem = TheTable[BucketNo];
+      char *ItemStr = (char *)BucketItem + ItemSize;
+      if (LLVM_LIKELY(Key == StringRef(ItemStr, BucketItem->getKeyLength())))
+        return BucketNo;
+    }
+
+    if (LLVM_LIKELY(G.matchEmpty()))
+      return -1;
+
+    GroupNo = (GroupNo + ProbeAmt) & GroupMask;
+  }
+}
+
+/// RemoveKey - Remove the specified StringMapEntry from the table, but do not
+/// delete it.  This aborts if the value isn't in the table.
+void SwissStringMapImpl::RemoveKey(StringMapEntryBase *V) {
+  const char *VStr = (char *)V + ItemSize;
+  StringMapEntryBase *V2 = RemoveKey(StringRef(VStr, V->getKeyLength()));
+  (void)V2;
+  assert(V == V2 && "Didn't find key?");
+}
+
+/// RemoveKey - Remove the StringMapEntry for the specified key from the
+/// table, returning it.  If the key is not in the table, this returns null.
+StringMapEntryBase *SwissStringMapImpl::RemoveKey(StringRef Key) {
+  int Bucket = FindKey(Key);
+  if (Bucket == -1)
+    return nullptr;
+
+  StringMapEntryBase *Result = TheTable[Bucket];
+  uint8_t *Ctrl = getCtrlTable(TheTable, NumBuckets);
+  // A group that still has an empty bucket has never been full, so no probe
+  // sequence continues past it and the bucket can simply become empty again.
+  // Otherwise leave a tombstone.
+  unsigned Base = Bucket & ~(Group::Width - 1);
+  if (Group(Ctrl + Base).matchEmpty()) {
+    Ctrl[Bucket] = CtrlEmpty;
+    TheTable[Bucket] = nullptr;
+  } else {
+    Ctrl[Bucket] = CtrlDeleted;
+    TheTable[Bucket] = getTombstoneVal();
+    ++NumTombstones;
+  }
+  --NumItems;
+  assert(NumItems + NumTombstones <= NumBuckets);
+
+  return Result;
+}
+
+/// RehashTable - Grow the table, redistributing values into the buckets with
+/// the appropriate mod-of-hashtable-size.
+unsigned SwissStringMapImpl::RehashTable(unsigned BucketNo) {
+  // Group probing keeps working at a much higher load than probing one bucket
+  // at a time. Rehash once more than 7/8 of the buckets are in use, and only
+  // grow if at least half of those are live items rather than tombstones.
+  if (LLVM_LIKELY((NumItems + NumTombstones) * 8 <= NumBuckets * 7))
+    return BucketNo;
+  unsigned NewSize = NumItems * 16 > NumBuckets * 7 ? NumBuckets * 2
+                                                    : NumBuckets;
+
+  unsigned NewBucketNo = BucketNo;
+  auto **NewTableArray = createTable(NewSize);
+  unsigned *NewHashArray = getHashTable(NewTableArray, NewSize);
+  uint8_t *NewCtrl = getCtrlTable(NewTableArray, NewSize);
+  unsigned *HashTable = getHashTable(TheTable, NumBuckets);
+
+  // Rehash all the items into their new buckets.  Luckily :) we already have
+  // the hash values available, so we don't have to rehash any strings.
+  for (unsigned I = 0, E = NumBuckets; I != E; ++I) {
+    StringMapEntryBase *Bucket = TheTable[I];
+    if (Bucket && Bucket != getTombstoneVal()) {
+      unsigned FullHash = HashTable[I];
+      unsigned NewBucket = findFirstAvailable(NewCtrl, NewSize, FullHash);
+      NewTableArray[NewBucket] = Bucket;
+      NewHashArray[NewBucket] = FullHash;
+      NewCtrl[NewBucket] = getH2(FullHash);
+      if (I == BucketNo)
+        NewBucketNo = NewBucket;
+    }
+  }
+
+  free(TheTable);
+
+  TheTable = NewTableArray;
+  NumBuckets = NewSize;
+  NumTombstones = 0;
+  return NewBucketNo;
+}
@@ -16,7 +16,10 @@
 #include "llvm/Support/Error.h"
 #include "llvm/Support/FileSystem.h"
 
+#include <algorithm>
 #include <atomic>
+#include <cerrno>
+#include <climits>
 #include <fcntl.h>
 #include <thread>
 
@@ -304,3 +307,33 @@ raw_socket_stream::createConnectedUnix(StringRef SocketPath) {
 }
 
 raw_socket_stream::~raw_socket_stream() {}
+
+ssize_t raw_socket_stream::read(char *Ptr, size_t Size) {
+#ifdef _WIN32
+  // The descriptor wraps a SOCKET, which the CRT's _read cannot read from.
+  SOCKET Socket = (SOCKET)_get_osfhandle(get_fd());
+  int Ret = ::recv(Socket, Ptr, (int)std::min<size_t>(Size, INT_MAX), 0);
+  return Ret == SOCKET_ERROR ? -1 : Ret;
+#else
+  ssize_t Ret;
+  do
+    Ret = ::read(get_fd(), (void *)Ptr, Size);
+  while (Ret < 0 && errno == EINTR);
+  return Ret;
+#endif // _WIN32
+}
+
+bool raw_socket_stream::isPeerSameUser() const {
+#if defined(_WIN32)
+  return false;
+#elif defined(__linux__)
+  struct ucred Cred;
+  socklen_t Len = sizeof(Cred);
+  return ::getsockopt(get_fd(), SOL_SOCKET, SO_PEERCRED, &Cred, &Len) == 0 &&
+         Cred.uid == ::geteuid();
+#else
+  uid_t Uid;
+  gid_t Gid;
+  return ::getpeereid(get_fd(), &Uid, &Gid) == 0 && Uid == ::geteuid();
+#endif
+}
@@ -0,0 +1,34 @@
+;; Test that backends held back by -thinlto-memory-budget all run, including
+;; those predicted to exceed the budget on their own.
+
+; RUN: rm -rf %t && split-file %s %t
+; RUN: opt -module-summary %t/a.ll -o %t/a.bc
+; RUN: opt -module-summary %t/b.ll -o %t/b.bc
+; RUN: llvm-lto2 run %t/a.bc %t/b.bc -o %t/out -thinlto-threads=2 \
+; RUN:   -thinlto-memory-budget=1 -thinlto-backend-bytes-per-inst=1000000 \
+; RUN:   -r=%t/a.bc,f,px -r=%t/a.bc,g, -r=%t/b.bc,g,px
+; RUN: llvm-nm %t/out.1 | FileCheck %s --check-prefix=A
+; RUN: llvm-nm %t/out.2 | FileCheck %s --check-prefix=B
+; A: T f
+; B: T g
+
+;--- a.ll
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-i128:128-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+declare i32 @g(i32)
+
+define i32 @f(i32 %x) {
+  %y = call i32 @g(i32 %x)
+  %z = add i32 %y, 1
+  ret i32 %z
+}
+
+;--- b.ll
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-i128:128-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define i32 @g(i32 %x) {
+  %y = mul i32 %x, %x
+  ret i32 %y
+}
@@ -19,6 +19,7 @@
 #include "llvm/CodeGen/CommandFlags.h"
 #include "llvm/IR/DiagnosticPrinter.h"
 #include "llvm/LTO/LTO.h"
+#include "llvm/LTO/ThinBackendExecutor.h"
 #include "llvm/Passes/PassPlugin.h"
 #include "llvm/Remarks/HotnessThresholdParser.h"
 #include "llvm/Support/Caching.h"
@@ -97,12 +98,31 @@ static cl::opt<bool>
                                 "specified with -thinlto-emit-indexes or "
                                 "-thinlto-distributed-indexes"));
 
+static cl::opt<std::string> ThinLTOBackendProgram(
+    "thinlto-backend-program",
+    cl::desc("Run each ThinLTO backend as a process of this program"));
+
+static cl::list<std::string> ThinLTOBackendArgs(
+    "thinlto-backend-arg",
+    cl::desc("Argument for -thinlto-backend-program, which may contain "
+             "{module}, {index}, {output} and {task}"));
+
+static cl::opt<std::string> ThinLTOJobServer(
+    "thinlto-job-server",
+    cl::desc("Send ThinLTO backend jobs to the job server listening on this "
+             "socket"));
+
 // Default to using all available threads in the system, but using only one
 // thread per core (no SMT).
 // Use -thinlto-threads=all to use hardware_concurrency() instead, which means
 // to use all hardware threads or cores in the system.
 static cl::opt<std::string> Threads("thinlto-threads");
 
+static cl::opt<uint64_t> ThinLTOMemoryBudget(
+    "thinlto-memory-budget", cl::init(0),
+    cl::desc("Delay ThinLTO backends while the memory running backends are "
+             "predicted to use would exceed this many megabytes"));
+
 static cl::list<std::string> SymbolResolutions(
     "r",
     cl::desc("Specify a symbol resolution: filename,symbolname,resolution\n"
@@ -341,6 +361,7 @@ static int run(int argc, char **argv) {
   Conf.OverrideTriple = OverrideTriple;
   Conf.DefaultTriple = DefaultTriple;
   Conf.StatsFile = StatsFile;
+  Conf.ThinLTOMemoryBudget = ThinLTOMemoryBudget << 20;
   Conf.PTO.LoopVectorization = Conf.OptLevel > 1;
   Conf.PTO.SLPVectorization = Conf.OptLevel > 1;
 
@@ -352,6 +373,20 @@ static int run(int argc, char **argv) {
                                             ThinLTOEmitImports,
                                             /*LinkedObjectsFile=*/nullptr,
                                             /*OnWrite=*/{});
+  else if (!ThinLTOJobServer.empty())
+    Backend = createOutOfProcessThinBackend(
+        check(createRemoteThinBackendExecutor(
+                  ThinLTOJobServer,
+                  llvm::heavyweight_hardware_concurrency(Threads)
+                      .compute_thread_count()),
+              ThinLTOJobServer),
+        /*WorkDir=*/"", /*OnWrite=*/{}, ThinLTOEmitImports);
+  else if (!ThinLTOBackendProgram.empty())
+    Backend = createOutOfProcessThinBackend(
+        createProcessThinBackendExecutor(
+            ThinLTOBackendProgram, ThinLTOBackendArgs,
+            llvm::heavyweight_hardware_concurrency(Threads)),
+        /*WorkDir=*/"", /*OnWrite=*/{}, ThinLTOEmitImports);
   else
     Backend = createInProcessThinBackend(
         llvm::heavyweight_hardware_concurrency(Threads),
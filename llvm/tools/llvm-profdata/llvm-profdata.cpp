@@ -792,22 +792,56 @@ static void loadInput(const WeightedFile &Input, SymbolRemapper *Remapper,
   }
 }
 
-/// Merge the \p Src writer context into \p Dst.
-static void mergeWriterContexts(WriterContext *Dst, WriterContext *Src) {
-  for (auto &ErrorPair : Src->Errors)
-    Dst->Errors.push_back(std::move(ErrorPair));
-  Src->Errors.clear();
-
-  if (Error E = Dst->Writer.mergeProfileKind(Src->Writer.getProfileKind()))
-    exitWithError(std::move(E));
+/// Load an input into a writer context of its own, then move the records of
+/// each function into the shard of \p Shards that owns the function and the
+/// rest of the input, including errors, into the first shard. Every function
+/// is owned by exactly one shard, so the shards never have to be merged with
+/// each other.
+static void loadInputIntoShards(const WeightedFile &Input,
+                                SymbolRemapper *Remapper,
+                                const InstrProfCorrelator *Correlator,
+                                const StringRef ProfiledBinary,
+                                ArrayRef<std::unique_ptr<WriterContext>> Shards,
+                                uint64_t ReservoirSize,
+                                uint64_t MaxTraceLength) {
+  WriterContext *First = Shards[0].get();
+  WriterContext Src(OutputSparse, First->ErrLock, First->WriterErrorCodes,
+                    ReservoirSize, MaxTraceLength);
+  loadInput(Input, Remapper, Correlator, ProfiledBinary, &Src);
+
+  if (Src.Writer.getProfileKind() != InstrProfKind::Unknown) {
+    std::unique_lock<std::mutex> CtxGuard{First->Lock};
+    if (Error E = First->Writer.mergeProfileKind(Src.Writer.getProfileKind())) {
+      consumeError(std::move(E));
+      First->Errors.emplace_back(
+          make_error<StringError>(
+              "Merge IR generated profile with Clang generated profile.",
+              std::error_code()),
+          Input.Filename);
+      return;
+    }
+  }
 
-  Dst->Writer.mergeRecordsFromWriter(std::move(Src->Writer), [&](Error E) {
+  auto Warn = [&](Error E) {
     auto [ErrorCode, Msg] = InstrProfError::take(std::move(E));
-    std::unique_lock<std::mutex> ErrGuard{Dst->ErrLock};
-    bool firstTime = Dst->WriterErrorCodes.insert(ErrorCode).second;
+    std::unique_lock<std::mutex> ErrGuard{First->ErrLock};
+    bool firstTime = First->WriterErrorCodes.insert(ErrorCode).second;
     if (firstTime)
       warn(toString(make_error<InstrProfError>(ErrorCode, Msg)));
-  });
+  };
+
+  SmallVector<InstrProfWriter *, 8> ShardWriters;
+  for (const std::unique_ptr<WriterContext> &Shard : Shards)
+    ShardWriters.push_back(&Shard->Writer);
+  Src.Writer.moveRecordsToShards(
+      ShardWriters,
+      [&](unsigned I) { return std::unique_lock<std::mutex>{Shards[I]->Lock}; },
+      Warn);
+
+  std::unique_lock<std::mutex> CtxGuard{First->Lock};
+  for (auto &ErrorPair : Src.Errors)
+    First->Errors.push_back(std::move(ErrorPair));
+  First->Writer.mergeRecordsFromWriter(std::move(Src.Writer), Warn);
 }
 
 static StringRef
@@ -944,32 +978,21 @@ static void mergeInstrProfile(const WeightedFileVector &Inputs,
   } else {
     DefaultThreadPool Pool(hardware_concurrency(NumThreads));
 
-    // Load the inputs in parallel (N/NumThreads serial steps).
-    unsigned Ctx = 0;
-    for (const auto &Input : Inputs) {
-      Pool.async(loadInput, Input, Remapper, Correlator.get(), ProfiledBinary,
-                 Contexts[Ctx].get());
-      Ctx = (Ctx + 1) % NumThreads;
-    }
+    // Load the inputs in parallel, with each writer context acting as the
+    // shard for a disjoint set of functions. Unlike merging per-thread
+    // contexts, this keeps a single copy of each function in memory and
+    // spreads the merging of records over all threads.
+    for (const auto &Input : Inputs)
+      Pool.async(loadInputIntoShards, Input, Remapper, Correlator.get(),
+                 ProfiledBinary, ArrayRef(Contexts), TraceReservoirSize,
+                 MaxTraceLength);
     Pool.wait();
 
-    // Merge the writer contexts together (~ lg(NumThreads) serial steps).
-    unsigned Mid = Contexts.size() / 2;
-    unsigned End = Contexts.size();
-    assert(Mid > 0 && "Expected more than one context");
-    do {
-      for (unsigned I = 0; I < Mid; ++I)
-        Pool.async(mergeWriterContexts, Contexts[I].get(),
-                   Contexts[I + Mid].get());
-      Pool.wait();
-      if (End & 1) {
-        Pool.async(mergeWriterContexts, Contexts[0].get(),
-                   Contexts[End - 1].get());
-        Pool.wait();
-      }
-      End = Mid;
-      Mid /= 2;
-    } while (Mid > 0);
+    // Gather the shards into the first context to write them out. Their
+    // functions are disjoint, so this only moves records.
+    for (unsigned I = 1; I < NumThreads; ++I)
+      Contexts[0]->Writer.mergeRecordsFromWriter(
+          std::move(Contexts[I]->Writer), [&](Error E) { warn(std::move(E)); });
   }
 
   // Handle deferred errors encountered during merging. If the number of errors
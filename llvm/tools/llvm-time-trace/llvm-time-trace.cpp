@@ -0,0 +1,497 @@
+//===- llvm-time-trace.cpp - Aggregate -ftime-trace profiles --------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// llvm-time-trace aggregates the time trace profiles written by -ftime-trace
+// for every translation unit of a build, and reports which headers, template
+// instantiations, functions and passes cost the most time build-wide.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+#include <mutex>
+#include <tuple>
+
+using namespace llvm;
+
+static cl::OptionCategory TimeTraceCategory("Time Trace Options");
+
+static cl::list<std::string>
+    InputPaths(cl::Positional, cl::OneOrMore,
+               cl::desc("<time trace files or directories>"),
+               cl::cat(TimeTraceCategory));
+static cl::opt<std::string> OutputFilename("o", cl::init("-"),
+                                           cl::desc("Output file"),
+                                           cl::value_desc("filename"),
+                                           cl::cat(TimeTraceCategory));
+static cl::opt<unsigned>
+    NumThreads("j", cl::init(0),
+               cl::desc("Number of threads to use (0 = all hardware threads)"),
+               cl::cat(TimeTraceCategory));
+static cl::opt<unsigned> TopN("top", cl::init(10),
+                              cl::desc("Number of entries to report for each "
+                                       "category"),
+                              cl::cat(TimeTraceCategory));
+static cl::opt<unsigned> MaxNames(
+    "max-names", cl::init(1 << 18),
+    cl::desc("Maximum number of distinct names kept for each category; the "
+             "names with the smallest totals are discarded beyond it "
+             "(0 = no limit)"),
+    cl::cat(TimeTraceCategory));
+
+static void warn(Twine Message) {
+  WithColor::warning() << Message << "\n";
+}
+
+static void exitWithError(Twine Message) {
+  WithColor::error() << Message << "\n";
+  ::exit(1);
+}
+
+namespace {
+
+/// The groups of names which times are aggregated by.
+enum Category : unsigned {
+  Headers,
+  Templates,
+  TemplateSets,
+  FunctionCodeGen,
+  FunctionOpt,
+  Passes,
+  Activities,
+  NumCategories
+};
+
+const char *const CategoryTitles[NumCategories] = {
+    "Headers (parse time, including nested includes)",
+    "Template instantiations",
+    "Template sets (instantiations grouped by template name)",
+    "Function code generation",
+    "Function optimization",
+    "Passes",
+    "Activities",
+};
+
+/// The time spent in one name, in microseconds.
+struct Stat {
+  /// Time of the outermost events with this name. Events nested within an
+  /// event with the same name, such as recursive instantiations, are not
+  /// counted twice.
+  uint64_t Total = 0;
+  /// Time of all events with this name, excluding nested events.
+  uint64_t Self = 0;
+  /// Number of events with this name.
+  uint64_t Count = 0;
+  /// Number of translation units with this name.
+  uint64_t Units = 0;
+  /// Largest total in a single translation unit.
+  uint64_t MaxPerUnit = 0;
+};
+
+using StatMap = StringMap<Stat>;
+
+/// The times of one translation unit.
+struct UnitSummary {
+  StatMap Stats[NumCategories];
+  /// Wall time of the whole compilation, in microseconds.
+  uint64_t Time = 0;
+};
+
+/// A complete event of a time trace.
+struct Event {
+  StringRef Name;
+  StringRef Detail;
+  int64_t Tid = 0;
+  uint64_t Start = 0;
+  uint64_t Dur = 0;
+  /// Time of the events directly nested within this one.
+  uint64_t ChildDur = 0;
+  /// Whether the event is part of an optimization or code generation
+  /// pipeline.
+  bool InPipeline = false;
+  /// The categories in which no enclosing event has the same name.
+  unsigned Outermost = 0;
+};
+
+} // namespace
+
+static bool isInstantiation(StringRef Name) {
+  return Name == "InstantiateClass" || Name == "InstantiateFunction";
+}
+
+/// Returns whether passes run within events with the given name.
+static bool isPipeline(StringRef Name) {
+  return Name == "Optimizer" || Name == "CodeGenPasses";
+}
+
+/// Returns the name under which an event is recorded in a category, or an
+/// empty string if it does not belong to the category.
+static StringRef getKey(const Event &E, unsigned C) {
+  switch (C) {
+  case Headers:
+    return E.Name == "Source" ? E.Detail : StringRef();
+  case Templates:
+    return isInstantiation(E.Name) ? E.Detail : StringRef();
+  case TemplateSets:
+    if (!isInstantiation(E.Name))
+      return StringRef();
+    return E.Detail.take_until([](char C) { return C == '<'; });
+  case FunctionCodeGen:
+    return E.Name == "CodeGen Function" ? E.Detail : StringRef();
+  case FunctionOpt:
+    return E.Name == "OptFunction" ? E.Detail : StringRef();
+  case Passes:
+    // The legacy pass manager names passes in the detail, the new pass manager
+    // uses the pass name as the event name.
+    if (E.Name == "RunPass")
+      return E.Detail;
+    if (!E.InPipeline || E.Name == "OptFunction" || E.Name == "OptModule")
+      return StringRef();
+    return E.Name;
+  case Activities:
+    return E.Name;
+  }
+  llvm_unreachable("unknown category");
+}
+
+/// Reads the time trace of one translation unit.
+static Error summarizeUnit(StringRef Path, UnitSummary &Summary) {
+  auto BufferOrErr = MemoryBuffer::getFile(Path, /*IsText=*/false,
+                                           /*RequiresNullTerminator=*/false);
+  if (!BufferOrErr)
+    return createFileError(Path, BufferOrErr.getError());
+  // The parsed value owns its strings, so the buffer can go right away.
+  Expected<json::Value> Trace = json::parse((*BufferOrErr)->getBuffer());
+  BufferOrErr->reset();
+  if (!Trace)
+    return createFileError(Path, Trace.takeError());
+
+  const json::Object *Root = Trace->getAsObject();
+  const json::Array *TraceEvents =
+      Root ? Root->getArray("traceEvents") : nullptr;
+  if (!TraceEvents)
+    return createFileError(Path, createStringError(inconvertibleErrorCode(),
+                                                   "no trace events"));
+
+  std::vector<Event> Events;
+  Events.reserve(TraceEvents->size());
+  uint64_t Begin = UINT64_MAX, End = 0;
+  for (const json::Value &V : *TraceEvents) {
+    const json::Object *O = V.getAsObject();
+    if (!O || O->getString("ph") != "X")
+      continue;
+    std::optional<StringRef> Name = O->getString("name");
+    std::optional<int64_t> Start = O->getInteger("ts");
+    std::optional<int64_t> Dur = O->getInteger("dur");
+    // Skip the per-name totals the profiler appends to each trace.
+    if (!Name || !Start || !Dur || *Start < 0 || *Dur < 0 ||
+        Name->starts_with("Total "))
+      continue;
+
+    Event E;
+    E.Name = *Name;
+    E.Tid = O->getInteger("tid").value_or(0);
+    E.Start = *Start;
+    E.Dur = *Dur;
+    if (const json::Object *Args = O->getObject("args"))
+      E.Detail = Args->getString("detail").value_or(StringRef());
+    Events.push_back(E);
+
+    Begin = std::min(Begin, E.Start);
+    End = std::max(End, E.Start + E.Dur);
+    if (E.Name == "ExecuteCompiler")
+      Summary.Time = std::max(Summary.Time, E.Dur);
+  }
+  if (!Summary.Time && End > Begin)
+    Summary.Time = End - Begin;
+
+  // Events on a thread nest by time. Sort them so that every event follows
+  // the events enclosing it, and walk them with a stack of enclosing events.
+  llvm::sort(Events, [](const Event &A, const Event &B) {
+    return std::make_tuple(A.Tid, A.Start, B.Dur) <
+           std::make_tuple(B.Tid, B.Start, A.Dur);
+  });
+
+  SmallVector<Event *, 32> Stack;
+  StringMap<unsigned> Open[NumCategories];
+  unsigned OpenPipelines = 0;
+
+  auto Enter = [&](Event &E) {
+    E.InPipeline = OpenPipelines != 0;
+    if (isPipeline(E.Name))
+      ++OpenPipelines;
+    for (unsigned C = 0; C != NumCategories; ++C) {
+      StringRef Key = getKey(E, C);
+      if (!Key.empty() && Open[C][Key]++ == 0)
+        E.Outermost |= 1u << C;
+    }
+    Stack.push_back(&E);
+  };
+
+  auto Leave = [&]() {
+    Event &E = *Stack.pop_back_val();
+    if (isPipeline(E.Name))
+      --OpenPipelines;
+    for (unsigned C = 0; C != NumCategories; ++C) {
+      StringRef Key = getKey(E, C);
+      if (Key.empty())
+        continue;
+      --Open[C][Key];
+      Stat &S = Summary.Stats[C][Key];
+      ++S.Count;
+      S.Self += E.Dur - std::min(E.ChildDur, E.Dur);
+      if (E.Outermost & (1u << C))
+        S.Total += E.Dur;
+    }
+  };
+
+  for (Event &E : Events) {
+    while (!Stack.empty() && (Stack.back()->Tid != E.Tid ||
+                              Stack.back()->Start + Stack.back()->Dur <=
+                                  E.Start))
+      Leave();
+    if (!Stack.empty())
+      Stack.back()->ChildDur += E.Dur;
+    Enter(E);
+  }
+  while (!Stack.empty())
+    Leave();
+
+  for (StatMap &Stats : Summary.Stats) {
+    for (auto &Entry : Stats) {
+      Entry.second.Units = 1;
+      Entry.second.MaxPerUnit = Entry.second.Total;
+    }
+  }
+  return Error::success();
+}
+
+namespace {
+
+/// Combines the summaries of all translation units.
+class Aggregator {
+public:
+  /// Adds the summary of a translation unit.
+  void add(StringRef Path, UnitSummary &&Unit) {
+    std::lock_guard<std::mutex> Guard(Lock);
+    ++NumUnits;
+    TotalTime += Unit.Time;
+    for (unsigned C = 0; C != NumCategories; ++C) {
+      StatMap &Stats = AllStats[C];
+      for (const auto &Entry : Unit.Stats[C]) {
+        const Stat &From = Entry.second;
+        Stat &To = Stats[Entry.first()];
+        To.Total += From.Total;
+        To.Self += From.Self;
+        To.Count += From.Count;
+        To.Units += From.Units;
+        To.MaxPerUnit = std::max(To.MaxPerUnit, From.MaxPerUnit);
+      }
+      if (MaxNames && Stats.size() > 2 * (size_t)MaxNames)
+        prune(C);
+    }
+
+    SlowestUnits.emplace_back(Unit.Time, Path.str());
+    llvm::sort(SlowestUnits, [](const auto &A, const auto &B) {
+      return std::tie(B.first, A.second) < std::tie(A.first, B.second);
+    });
+    if (SlowestUnits.size() > TopN)
+      SlowestUnits.pop_back();
+
+    // The slowest translation unit bounds the time of a build which compiles
+    // all of them in parallel, so keep its breakdown.
+    if (NumUnits == 1 || Unit.Time > CriticalTime) {
+      CriticalTime = Unit.Time;
+      CriticalPath = Path.str();
+      for (unsigned C = 0; C != NumCategories; ++C)
+        CriticalStats[C] = std::move(Unit.Stats[C]);
+    }
+  }
+
+  /// Records that a translation unit could not be read.
+  void fail(Error E) {
+    std::lock_guard<std::mutex> Guard(Lock);
+    ++NumFailed;
+    warn(toString(std::move(E)));
+  }
+
+  void print(raw_ostream &OS) const;
+
+private:
+  /// Discards the names with the smallest totals in a category.
+  void prune(unsigned C);
+
+  std::mutex Lock;
+  StatMap AllStats[NumCategories];
+  uint64_t NumDiscarded[NumCategories] = {};
+  uint64_t NumUnits = 0;
+  uint64_t NumFailed = 0;
+  uint64_t TotalTime = 0;
+  /// The slowest translation units by time, slowest first.
+  std::vector<std::pair<uint64_t, std::string>> SlowestUnits;
+  /// The breakdown of the slowest translation unit.
+  StatMap CriticalStats[NumCategories];
+  uint64_t CriticalTime = 0;
+  std::string CriticalPath;
+};
+
+} // namespace
+
+void Aggregator::prune(unsigned C) {
+  StatMap &Stats = AllStats[C];
+  std::vector<uint64_t> Totals;
+  Totals.reserve(Stats.size());
+  for (const auto &Entry : Stats)
+    Totals.push_back(Entry.second.Total);
+  auto Nth = Totals.begin() + (Totals.size() - MaxNames);
+  std::nth_element(Totals.begin(), Nth, Totals.end());
+  uint64_t Threshold = *Nth;
+
+  for (auto I = Stats.begin(), E = Stats.end(); I != E;) {
+    auto Cur = I++;
+    if (Cur->second.Total < Threshold) {
+      Stats.erase(Cur);
+      ++NumDiscarded[C];
+    }
+  }
+}
+
+static std::string formatMs(uint64_t Us) {
+  return formatv("{0:F1}", Us / 1000.0).str();
+}
+
+void Aggregator::print(raw_ostream &OS) const {
+  OS << "Time traces: " << NumUnits;
+  if (NumFailed)
+    OS << " (" << NumFailed << " could not be read)";
+  OS << "\n";
+  OS << "Total time: " << formatMs(TotalTime) << " ms\n";
+  if (!CriticalPath.empty())
+    OS << "Critical path: " << formatMs(CriticalTime) << " ms ("
+       << CriticalPath << ")\n";
+
+  OS << "\n*** Slowest translation units\n";
+  for (const auto &Unit : SlowestUnits)
+    OS << formatv("{0,12}  {1}\n", formatMs(Unit.first), Unit.second);
+
+  for (unsigned C = 0; C != NumCategories; ++C) {
+    const StatMap &Stats = AllStats[C];
+    if (Stats.empty())
+      continue;
+
+    std::vector<const StatMap::value_type *> Sorted;
+    Sorted.reserve(Stats.size());
+    for (const auto &Entry : Stats)
+      Sorted.push_back(&Entry);
+    auto ByTotal = [](const StatMap::value_type *A,
+                      const StatMap::value_type *B) {
+      return std::make_tuple(B->second.Total, B->second.Self, A->first()) <
+             std::make_tuple(A->second.Total, A->second.Self, B->first());
+    };
+    size_t N = std::min<size_t>(TopN, Sorted.size());
+    std::partial_sort(Sorted.begin(), Sorted.begin() + N, Sorted.end(),
+                      ByTotal);
+
+    OS << "\n*** " << CategoryTitles[C] << "\n";
+    OS << formatv("{0,12}{1,12}{2,10}{3,8}{4,12}{5,12}  {6}\n", "Total ms",
+                  "Self ms", "Count", "Units", "Max ms", "Critical",
+                  "Name");
+    for (const StatMap::value_type *Entry : ArrayRef(Sorted).take_front(N)) {
+      const Stat &S = Entry->second;
+      auto Critical = CriticalStats[C].find(Entry->first());
+      uint64_t CriticalTotal =
+          Critical == CriticalStats[C].end() ? 0 : Critical->second.Total;
+      OS << formatv("{0,12}{1,12}{2,10}{3,8}{4,12}{5,12}  {6}\n",
+                    formatMs(S.Total), formatMs(S.Self), S.Count, S.Units,
+                    formatMs(S.MaxPerUnit), formatMs(CriticalTotal),
+                    Entry->first());
+    }
+    if (NumDiscarded[C])
+      OS << "(" << NumDiscarded[C]
+         << " names with small totals were discarded to bound memory use)\n";
+  }
+}
+
+/// Adds the time trace files at a path to the list of inputs, searching
+/// directories recursively.
+static void collectInputs(StringRef Path, std::vector<std::string> &Files) {
+  if (!sys::fs::is_directory(Path)) {
+    Files.push_back(Path.str());
+    return;
+  }
+
+  std::error_code EC;
+  for (sys::fs::recursive_directory_iterator I(Path, EC), E; I != E && !EC;
+       I.increment(EC)) {
+    if (sys::path::extension(I->path()) == ".json" &&
+        sys::fs::is_regular_file(I->path()))
+      Files.push_back(I->path());
+  }
+  if (EC)
+    warn(Path + ": " + EC.message());
+}
+
+int main(int argc, const char **argv) {
+  InitLLVM X(argc, argv);
+
+  cl::HideUnrelatedOptions(TimeTraceCategory);
+  cl::ParseCommandLineOptions(
+      argc, argv,
+      "LLVM time trace aggregator\n\n"
+      "Reads the time traces written by -ftime-trace for every translation\n"
+      "unit of a build and reports the headers, template instantiations,\n"
+      "functions and passes which cost the most time. 'Critical' is the time\n"
+      "spent in the slowest translation unit, which bounds the time of a\n"
+      "fully parallel build.\n");
+
+  std::vector<std::string> Files;
+  for (const std::string &Path : InputPaths)
+    collectInputs(Path, Files);
+  llvm::sort(Files);
+  if (Files.empty())
+    exitWithError("no time trace files found");
+
+  std::error_code EC;
+  ToolOutputFile Out(OutputFilename, EC, sys::fs::OF_TextWithCRLF);
+  if (EC)
+    exitWithError(OutputFilename + ": " + EC.message());
+
+  // Each thread holds one trace at a time, and only the aggregated times of
+  // the names are kept, so memory use does not grow with the traces.
+  Aggregator Result;
+  DefaultThreadPool Pool(hardware_concurrency(NumThreads));
+  for (const std::string &File : Files) {
+    Pool.async([&Result, &File] {
+      UnitSummary Unit;
+      if (Error E = summarizeUnit(File, Unit))
+        Result.fail(std::move(E));
+      else
+        Result.add(File, std::move(Unit));
+    });
+  }
+  Pool.wait();
+
+  Result.print(Out.os());
+  Out.keep();
+  return 0;
+}
@@ -0,0 +1,151 @@
+//===- llvm/unittest/ADT/SwissStringMapTest.cpp - SwissStringMap tests ----===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/SwissStringMap.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringExtras.h"
+#include "gtest/gtest.h"
+#include <map>
+#include <random>
+using namespace llvm;
+
+namespace {
+
+static_assert(sizeof(SwissStringMap<uint32_t>) <
+                  sizeof(SwissStringMap<uint32_t, MallocAllocator &>),
+              "Ensure empty base optimization happens with default allocator");
+
+TEST(SwissStringMapTest, EmptyMap) {
+  SwissStringMap<uint32_t> Map;
+  EXPECT_EQ(0u, Map.size());
+  EXPECT_TRUE(Map.empty());
+  EXPECT_TRUE(Map.begin() == Map.end());
+  EXPECT_EQ(0u, Map.count("a"));
+  EXPECT_TRUE(Map.find("a") == Map.end());
+  EXPECT_EQ(0u, Map.lookup("a"));
+  EXPECT_FALSE(Map.erase("a"));
+}
+
+TEST(SwissStringMapTest, InsertFindErase) {
+  SwissStringMap<uint32_t> Map;
+  EXPECT_TRUE(Map.insert({"key", 1}).second);
+  EXPECT_FALSE(Map.insert({"key", 2}).second);
+  EXPECT_EQ(1u, Map.lookup("key"));
+  EXPECT_EQ(1u, Map.at("key"));
+  EXPECT_TRUE(Map.contains("key"));
+
+  // Keys are compared by content, including embedded nulls and empty keys.
+  StringRef WithNull("a\0b", 3);
+  Map[WithNull] = 3;
+  Map[""] = 4;
+  EXPECT_EQ(3u, Map.size());
+  EXPECT_EQ(3u, Map.lookup(WithNull));
+  EXPECT_EQ(0u, Map.count("a"));
+  EXPECT_EQ(4u, Map.lookup(""));
+
+  auto [It, Inserted] = Map.insert_or_assign("key", 5u);
+  EXPECT_FALSE(Inserted);
+  EXPECT_EQ("key", It->getKey());
+  EXPECT_EQ(5u, It->second);
+
+  EXPECT_TRUE(Map.erase("key"));
+  EXPECT_FALSE(Map.contains("key"));
+  EXPECT_EQ(2u, Map.size());
+
+  Map.clear();
+  EXPECT_TRUE(Map.empty());
+  EXPECT_TRUE(Map.begin() == Map.end());
+  EXPECT_FALSE(Map.contains(""));
+  Map["again"] = 6;
+  EXPECT_EQ(6u, Map.lookup("again"));
+}
+
+TEST(SwissStringMapTest, PrecomputedHash) {
+  SwissStringMap<int> Map;
+  uint32_t Hash = StringMapImpl::hash("key");
+  Map.insert({"key", 1}, Hash);
+  EXPECT_EQ(1, Map.find("key", Hash)->second);
+  EXPECT_EQ(1, Map.find("key")->second);
+}
+
+TEST(SwissStringMapTest, EntriesDoNotMove) {
+  SwissStringMap<int> Map;
+  StringMapEntry<int> *First = &*Map.try_emplace("first", 1).first;
+  for (int I = 0; I != 10000; ++I)
+    Map["key" + utostr(I)] = I;
+  EXPECT_EQ(First, &*Map.find("first"));
+  EXPECT_EQ(&StringMapEntry<int>::GetStringMapEntryFromKeyData(
+                First->getKeyData()),
+            First);
+}
+
+// Compare against std::map under a random mix of inserts and erases, which
+// exercises growing, tombstones and rehashing in place.
+TEST(SwissStringMapTest, RandomOperations) {
+  SwissStringMap<unsigned> Map;
+  std::map<std::string, unsigned> Ref;
+  std::mt19937 Rng(42);
+  for (unsigned Step = 0; Step != 200000; ++Step) {
+    std::string Key = "k" + utostr(Rng() % 5000);
+    switch (Rng() % 3) {
+    case 0:
+    case 1: {
+      bool Inserted = Map.try_emplace(Key, Step).second;
+      EXPECT_EQ(Ref.emplace(Key, Step).second, Inserted);
+      break;
+    }
+    case 2:
+      EXPECT_EQ(Ref.erase(Key) != 0, Map.erase(Key));
+      break;
+    }
+  }
+
+  EXPECT_EQ(Ref.size(), Map.size());
+  for (const auto &[Key, Value] : Ref)
+    EXPECT_EQ(Value, Map.lookup(Key));
+  size_t Count = 0;
+  for (const auto &Entry : Map) {
+    EXPECT_EQ(Ref[Entry.getKey().str()], Entry.second);
+    ++Count;
+  }
+  EXPECT_EQ(Ref.size(), Count);
+}
+
+TEST(SwissStringMapTest, CopyMoveAndEquality) {
+  SwissStringMap<int> Map = {{"a", 1}, {"b", 2}, {"c", 3}};
+  Map.erase("b");
+
+  SwissStringMap<int> Copy(Map);
+  EXPECT_EQ(Map, Copy);
+  EXPECT_EQ(2u, Copy.size());
+  EXPECT_FALSE(Copy.contains("b"));
+  EXPECT_NE(&*Map.find("a"), &*Copy.find("a"));
+  Copy["d"] = 4;
+  EXPECT_NE(Map, Copy);
+
+  SwissStringMap<int> Moved(std::move(Copy));
+  EXPECT_EQ(3u, Moved.size());
+  EXPECT_EQ(4, Moved.lookup("d"));
+
+  Map = Moved;
+  EXPECT_EQ(Map, Moved);
+
+  SmallVector<StringRef> Keys(Map.keys());
+  llvm::sort(Keys);
+  EXPECT_EQ((SmallVector<StringRef>{"a", "c", "d"}), Keys);
+}
+
+TEST(SwissStringMapTest, Reserve) {
+  SwissStringMap<int> Map(1000);
+  unsigned NumBuckets = Map.getNumBuckets();
+  for (int I = 0; I != 1000; ++I)
+    Map["key" + utostr(I)] = I;
+  EXPECT_EQ(NumBuckets, Map.getNumBuckets());
+}
+
+} // end anonymous namespace
@@ -257,6 +257,51 @@ TEST(BitReaderTest, MaterializeFunctionsForBlockAddrInFunctionAfter) {
   EXPECT_FALSE(verifyModule(*M, &dbgs()));
 }
 
+// Tests that modules loaded for importing from copies of a BitcodeModule can
+// share the index used to lazily load their metadata.
+TEST(BitReaderTest, ImportCache) {
+  // There must be enough nodes for the writer to emit an index.
+  constexpr unsigned NumNodes = 64;
+  std::string Assembly;
+  raw_string_ostream OS(Assembly);
+  OS << "!named = !{";
+  for (unsigned I = 0; I != NumNodes; ++I)
+    OS << (I ? ", !" : "!") << I;
+  OS << "}\n";
+  for (unsigned I = 0; I != NumNodes; ++I)
+    OS << "!" << I << " = !{!\"node" << I << "\", i32 " << I << "}\n";
+
+  SmallString<1024> Mem;
+  {
+    LLVMContext Context;
+    writeModuleToBuffer(parseAssembly(Context, OS.str().c_str()), Mem);
+  }
+  std::vector<BitcodeModule> BMs =
+      cantFail(getBitcodeModuleList(MemoryBufferRef(Mem.str(), "test")));
+  ASSERT_EQ(1u, BMs.size());
+  BMs[0].enableImportCache();
+  BitcodeModule Copy = BMs[0];
+
+  for (BitcodeModule *BM : {&BMs[0], &Copy, &BMs[0]}) {
+    LLVMContext Context;
+    std::unique_ptr<Module> M =
+        cantFail(BM->getLazyModule(Context, /*ShouldLazyLoadMetadata=*/true,
+                                   /*IsImporting=*/true));
+    ASSERT_FALSE(M->materializeMetadata());
+    NamedMDNode *Named = M->getNamedMetadata("named");
+    ASSERT_TRUE(Named);
+    ASSERT_EQ(NumNodes, Named->getNumOperands());
+    for (unsigned I = 0; I != NumNodes; ++I) {
+      MDNode *N = Named->getOperand(I);
+      ASSERT_EQ(2u, N->getNumOperands());
+      EXPECT_EQ("node" + std::to_string(I),
+                cast<MDString>(N->getOperand(0))->getString());
+      EXPECT_EQ(I, mdconst::extract<ConstantInt>(N->getOperand(1))
+                       ->getZExtValue());
+    }
+  }
+}
+
 // Helper function to convert type metadata to a string for testing
 static std::string mdToString(Metadata *MD) {
   std::string S;
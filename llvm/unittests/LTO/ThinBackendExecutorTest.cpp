@@ -0,0 +1,415 @@
+//===- ThinBackendExecutorTest.cpp - Out-of-process ThinLTO backends ------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/LTO/ThinBackendExecutor.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Analysis/ModuleSummaryAnalysis.h"
+#include "llvm/AsmParser/Parser.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/LTO/LTO.h"
+#include "llvm/Support/Caching.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/raw_socket_stream.h"
+#include "llvm/Testing/Support/Error.h"
+#include "llvm/Testing/Support/SupportHelpers.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include <mutex>
+#include <optional>
+#include <thread>
+
+using namespace llvm;
+using namespace lto;
+using llvm::unittest::TempDir;
+
+namespace {
+
+// Collects the results of jobs by task.
+struct Results {
+  std::mutex Mu;
+  std::vector<std::optional<std::string>> Objects;
+  std::vector<std::string> Errors;
+
+  explicit Results(unsigned NumTasks) : Objects(NumTasks) {}
+
+  ThinBackendExecutor::DoneFn onDone(unsigned Task) {
+    return [this, Task](Expected<std::unique_ptr<MemoryBuffer>> ObjOrErr) {
+      std::lock_guard<std::mutex> Lock(Mu);
+      if (ObjOrErr)
+        Objects[Task] = (*ObjOrErr)->getBuffer().str();
+      else
+        Errors.push_back(toString(ObjOrErr.takeError()));
+    };
+  }
+};
+
+std::vector<std::string> getImports(unsigned Task) {
+  // Make some requests large enough to fill the socket buffers.
+  if (Task % 10 == 5)
+    return std::vector<std::string>(10000, std::string(100, 'i'));
+  return {"a.o", "b.o"};
+}
+
+ThinBackendJob makeJob(unsigned Task, StringRef Module) {
+  ThinBackendJob Job;
+  Job.Task = Task;
+  Job.ModulePath = Module.str();
+  Job.IndexPath = (Module + ".thinlto.bc").str();
+  Job.ImportPaths = getImports(Task);
+  return Job;
+}
+
+TEST(ThinBackendExecutorTest, Process) {
+  ErrorOr<std::string> Cp = sys::findProgramByName("cp");
+  if (!Cp)
+    GTEST_SKIP() << "cp not found";
+
+  TempDir Dir("thin-backend-executor-test", /*Unique=*/true);
+  Results R(2);
+  {
+    std::unique_ptr<ThinBackendExecutor> Executor =
+        createProcessThinBackendExecutor(*Cp, {"{module}", "{output}"},
+                                         hardware_concurrency(2));
+    EXPECT_EQ(2u, Executor->getParallelism());
+
+    std::string Module(Dir.path("module.o"));
+    {
+      std::error_code EC;
+      raw_fd_ostream OS(Module, EC);
+      ASSERT_FALSE(EC);
+      OS << "native object";
+    }
+    ThinBackendJob Job = makeJob(0, Module);
+    Job.OutputPath = std::string(Dir.path("out.o"));
+    Executor->submit(Job, R.onDone(0));
+
+    // A job whose process fails reports an error.
+    Job = makeJob(1, Dir.path("missing.o"));
+    Job.OutputPath = std::string(Dir.path("out1.o"));
+    Executor->submit(Job, R.onDone(1));
+    Executor->wait();
+  }
+
+  EXPECT_EQ("native object", R.Objects[0]);
+  EXPECT_FALSE(R.Objects[1]);
+  ASSERT_EQ(1u, R.Errors.size());
+  EXPECT_TRUE(StringRef(R.Errors[0]).contains("exited with status"))
+      << R.Errors[0];
+}
+
+// Stands in for the executor a job server would use. A job's object file is
+// a description of the job; jobs for modules named "bad.o" fail.
+class FakeExecutor : public ThinBackendExecutor {
+  std::mutex Mu;
+  std::vector<std::thread> Threads;
+
+public:
+  ~FakeExecutor() override { wait(); }
+
+  void submit(ThinBackendJob Job, DoneFn OnDone) override {
+    std::lock_guard<std::mutex> Lock(Mu);
+    Threads.emplace_back([Job = std::move(Job),
+                          OnDone = std::move(OnDone)]() mutable {
+      EXPECT_FALSE(Job.OutputPath.empty());
+      if (Job.ModulePath == "bad.o") {
+        OnDone(createStringError(inconvertibleErrorCode(), "cannot compile"));
+        return;
+      }
+      std::string Obj = utostr(Job.Task) + ":" + Job.ModulePath + ":" +
+                        Job.IndexPath + ":" + join(Job.ImportPaths, ",");
+      // Make some objects large enough to arrive in several pieces.
+      if (Job.Task % 10 == 0)
+        Obj.resize(1 << 20, 'x');
+      OnDone(MemoryBuffer::getMemBufferCopy(Obj));
+    });
+  }
+
+  void wait() override {
+    std::vector<std::thread> ToJoin;
+    {
+      std::lock_guard<std::mutex> Lock(Mu);
+      ToJoin.swap(Threads);
+    }
+    for (std::thread &T : ToJoin)
+      T.join();
+  }
+
+  unsigned getParallelism() const override { return 4; }
+};
+
+TEST(ThinBackendExecutorTest, JobServer) {
+  TempDir Dir("thin-backend-executor-test", /*Unique=*/true);
+  std::string SocketPath(Dir.path("jobs.sock"));
+  Expected<ListeningSocket> SocketOrErr =
+      ListeningSocket::createUnix(SocketPath);
+  if (!SocketOrErr) {
+    // Not all hosts support UNIX domain sockets.
+    consumeError(SocketOrErr.takeError());
+    GTEST_SKIP();
+  }
+
+  FakeExecutor Fake;
+  std::thread Server([&] {
+    Expected<std::unique_ptr<raw_socket_stream>> ConnectionOrErr =
+        SocketOrErr->accept();
+    ASSERT_THAT_EXPECTED(ConnectionOrErr, Succeeded());
+    EXPECT_THAT_ERROR(
+        serveThinBackendJobs(**ConnectionOrErr, Fake, Dir.path()),
+        Succeeded());
+  });
+
+  constexpr unsigned NumJobs = 100;
+  Results R(NumJobs);
+  {
+    Expected<std::unique_ptr<ThinBackendExecutor>> ExecutorOrErr =
+        createRemoteThinBackendExecutor(SocketPath, 8);
+    ASSERT_THAT_EXPECTED(ExecutorOrErr, Succeeded());
+    ThinBackendExecutor &Executor = **ExecutorOrErr;
+    EXPECT_EQ(8u, Executor.getParallelism());
+    for (unsigned I = 0; I != NumJobs; ++I)
+      Executor.submit(makeJob(I, I == 7 ? "bad.o" : "m" + utostr(I) + ".o"),
+                      R.onDone(I));
+    Executor.wait();
+  }
+  Server.join();
+
+  for (unsigned I = 0; I != NumJobs; ++I) {
+    if (I == 7) {
+      EXPECT_FALSE(R.Objects[I]);
+      continue;
+    }
+    std::string Expected = utostr(I) + ":m" + utostr(I) + ".o:m" + utostr(I) +
+                           ".o.thinlto.bc:" + join(getImports(I), ",");
+    if (I % 10 == 0)
+      Expected.resize(1 << 20, 'x');
+    EXPECT_EQ(Expected, R.Objects[I]);
+  }
+  EXPECT_EQ(std::vector<std::string>{"cannot compile"}, R.Errors);
+}
+
+TEST(ThinBackendExecutorTest, JobServerMalformedRequest) {
+  TempDir Dir("thin-backend-executor-test", /*Unique=*/true);
+  std::string SocketPath(Dir.path("jobs.sock"));
+  Expected<ListeningSocket> SocketOrErr =
+      ListeningSocket::createUnix(SocketPath);
+  if (!SocketOrErr) {
+    // Not all hosts support UNIX domain sockets.
+    consumeError(SocketOrErr.takeError());
+    GTEST_SKIP();
+  }
+
+  // Each request ends the connection it is sent on with an error.
+  const std::pair<const char *, const char *> Requests[] = {
+      {"not json\n", "Invalid JSON value"},
+      {"{\"id\": 1, \"task\": 0}\n", "malformed ThinLTO job request"},
+  };
+  FakeExecutor Fake;
+  std::thread Server([&] {
+    for (auto [Request, Message] : Requests) {
+      Expected<std::unique_ptr<raw_socket_stream>> ConnectionOrErr =
+          SocketOrErr->accept();
+      ASSERT_THAT_EXPECTED(ConnectionOrErr, Succeeded());
+      EXPECT_THAT_ERROR(
+          serveThinBackendJobs(**ConnectionOrErr, Fake, Dir.path()),
+          FailedWithMessage(testing::HasSubstr(Message)));
+    }
+  });
+
+  for (auto [Request, Message] : Requests) {
+    Expected<std::unique_ptr<raw_socket_stream>> ClientOrErr =
+        raw_socket_stream::createConnectedUnix(SocketPath);
+    ASSERT_THAT_EXPECTED(ClientOrErr, Succeeded());
+    **ClientOrErr << Request;
+    (*ClientOrErr)->flush();
+  }
+  Server.join();
+}
+
+// Records the jobs it is given and runs each of them before submit returns.
+// A job's object file names the module it compiles.
+class RecordingExecutor : public ThinBackendExecutor {
+public:
+  std::vector<ThinBackendJob> Jobs;
+
+  void submit(ThinBackendJob Job, DoneFn OnDone) override {
+    // The files a job reads are written before it is submitted.
+    EXPECT_TRUE(sys::fs::exists(Job.IndexPath));
+    EXPECT_TRUE(sys::fs::exists(
+        StringRef(Job.IndexPath).drop_back(strlen(".thinlto.bc")) +
+        ".imports"));
+    std::string Obj = "object of " + sys::path::filename(Job.ModulePath).str();
+    Jobs.push_back(std::move(Job));
+    OnDone(MemoryBuffer::getMemBufferCopy(Obj));
+  }
+
+  void wait() override {}
+
+  unsigned getParallelism() const override { return 1; }
+};
+
+std::string getBitcode(StringRef IR) {
+  LLVMContext Ctx;
+  SMDiagnostic Diag;
+  std::unique_ptr<Module> M = parseAssemblyString(IR, Diag, Ctx);
+  EXPECT_TRUE(M) << Diag.getMessage();
+  if (!M)
+    return "";
+  ModuleSummaryIndex Index = buildModuleSummaryIndex(*M, nullptr, nullptr);
+  std::string Bitcode;
+  raw_string_ostream OS(Bitcode);
+  WriteBitcodeToFile(*M, OS, /*ShouldPreserveUseListOrder=*/false, &Index,
+                     /*GenerateHash=*/true);
+  return Bitcode;
+}
+
+void writeFile(StringRef Path, StringRef Contents) {
+  std::error_code EC;
+  raw_fd_ostream OS(Path, EC);
+  ASSERT_FALSE(EC);
+  OS << Contents;
+}
+
+// Links \p Inputs with ThinLTO, running the backends with \p Executor, and
+// returns the object file produced for each task.
+Expected<std::vector<std::string>>
+thinLink(std::vector<std::unique_ptr<MemoryBuffer>> Inputs,
+         std::shared_ptr<ThinBackendExecutor> Executor, StringRef WorkDir,
+         StringRef CacheDir = "") {
+  LTO Lto(Config(), createOutOfProcessThinBackend(
+                        std::move(Executor), WorkDir.str(), /*OnWrite=*/nullptr,
+                        /*ShouldEmitImportsFiles=*/true));
+  for (const std::unique_ptr<MemoryBuffer> &Input : Inputs) {
+    Expected<std::unique_ptr<InputFile>> FileOrErr =
+        InputFile::create(Input->getMemBufferRef());
+    if (!FileOrErr)
+      return FileOrErr.takeError();
+    std::vector<SymbolResolution> Res;
+    for (const InputFile::Symbol &Sym : (*FileOrErr)->symbols()) {
+      SymbolResolution &R = Res.emplace_back();
+      R.Prevailing = !Sym.isUndefined();
+      R.VisibleToRegularObj = true;
+    }
+    if (Error E = Lto.add(std::move(*FileOrErr), Res))
+      return std::move(E);
+  }
+
+  std::mutex Mu;
+  std::vector<std::string> Objects(Lto.getMaxTasks());
+  std::vector<SmallString<0>> Streams(Lto.getMaxTasks());
+  auto AddStream = [&](unsigned Task, const Twine &ModuleName) {
+    return std::make_unique<CachedFileStream>(
+        std::make_unique<raw_svector_ostream>(Streams[Task]));
+  };
+  auto AddBuffer = [&](unsigned Task, const Twine &ModuleName,
+                       std::unique_ptr<MemoryBuffer> MB) {
+    std::lock_guard<std::mutex> Lock(Mu);
+    Objects[Task] = MB->getBuffer().str();
+  };
+  FileCache Cache;
+  if (!CacheDir.empty()) {
+    Expected<FileCache> CacheOrErr =
+        localCache("ThinLTO", "Thin", CacheDir, AddBuffer);
+    if (!CacheOrErr)
+      return CacheOrErr.takeError();
+    Cache = std::move(*CacheOrErr);
+  }
+  if (Error E = Lto.run(AddStream, Cache))
+    return std::move(E);
+
+  for (unsigned Task = 0; Task != Objects.size(); ++Task)
+    if (!Streams[Task].empty())
+      Objects[Task] = Streams[Task].str().str();
+  return Objects;
+}
+
+const char *ModuleA = R"(
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+declare i32 @g()
+
+define i32 @f() {
+  %r = call i32 @g()
+  ret i32 %r
+}
+)";
+
+std::string getModuleB(int Value) {
+  return R"(
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define i32 @g() {
+  ret i32 )" + itostr(Value) +
+         "\n}\n";
+}
+
+TEST(ThinBackendExecutorTest, OutOfProcessThinBackend) {
+  TempDir Dir("thin-backend-executor-test", /*Unique=*/true);
+  std::string A(Dir.path("a.bc")), B(Dir.path("b.bc"));
+  std::string WorkDir(Dir.path("jobs")), CacheDir(Dir.path("cache"));
+  ASSERT_FALSE(sys::fs::create_directory(WorkDir));
+  writeFile(A, getBitcode(ModuleA));
+  writeFile(B, getBitcode(getModuleB(1)));
+
+  auto Executor = std::make_shared<RecordingExecutor>();
+  auto Link = [&] {
+    std::vector<std::unique_ptr<MemoryBuffer>> Inputs;
+    for (StringRef Path : {A, B})
+      Inputs.push_back(
+          cantFail(errorOrToExpected(MemoryBuffer::getFile(Path))));
+    return thinLink(std::move(Inputs), Executor, WorkDir, CacheDir);
+  };
+  // Task 0 is the regular LTO partition, which is empty.
+  std::vector<std::string> Objects = {"", "object of a.bc", "object of b.bc"};
+
+  EXPECT_THAT_EXPECTED(Link(), HasValue(Objects));
+  ASSERT_EQ(2u, Executor->Jobs.size());
+  EXPECT_EQ(A, Executor->Jobs[0].ModulePath);
+  EXPECT_EQ(B, Executor->Jobs[1].ModulePath);
+  // a.bc imports g from b.bc.
+  EXPECT_EQ(std::vector<std::string>{B}, Executor->Jobs[0].ImportPaths);
+  EXPECT_TRUE(Executor->Jobs[1].ImportPaths.empty());
+  // The index and object file of a job are removed once it has finished.
+  for (const ThinBackendJob &Job : Executor->Jobs) {
+    EXPECT_FALSE(sys::fs::exists(Job.IndexPath));
+    EXPECT_FALSE(sys::fs::exists(Job.OutputPath));
+  }
+
+  // Nothing changed, so both objects come from the cache.
+  Executor->Jobs.clear();
+  EXPECT_THAT_EXPECTED(Link(), HasValue(Objects));
+  EXPECT_TRUE(Executor->Jobs.empty());
+
+  // Changing b.bc changes the key of a.bc too, since it imports from b.bc.
+  writeFile(B, getBitcode(getModuleB(2)));
+  EXPECT_THAT_EXPECTED(Link(), HasValue(Objects));
+  EXPECT_EQ(2u, Executor->Jobs.size());
+}
+
+TEST(ThinBackendExecutorTest, OutOfProcessThinBackendNeedsFiles) {
+  TempDir Dir("thin-backend-executor-test", /*Unique=*/true);
+  std::string Name(Dir.path("in-memory.bc"));
+  std::vector<std::unique_ptr<MemoryBuffer>> Inputs;
+  Inputs.push_back(MemoryBuffer::getMemBufferCopy(getBitcode(ModuleA), Name));
+
+  auto Executor = std::make_shared<RecordingExecutor>();
+  EXPECT_THAT_EXPECTED(thinLink(std::move(Inputs), Executor, Dir.path()),
+                       FailedWithMessage(testing::HasSubstr(
+                           "need " + Name + " to be a bitcode file")));
+  EXPECT_TRUE(Executor->Jobs.empty());
+}
+
+} // end anonymous namespace
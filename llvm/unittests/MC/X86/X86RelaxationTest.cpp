@@ -0,0 +1,137 @@
+//===- X86RelaxationTest.cpp - Tests for MCAssembler relaxation -----------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/MC/MCAsmBackend.h"
+#include "llvm/MC/MCAsmInfo.h"
+#include "llvm/MC/MCAssembler.h"
+#include "llvm/MC/MCCodeEmitter.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCObjectFileInfo.h"
+#include "llvm/MC/MCObjectStreamer.h"
+#include "llvm/MC/MCObjectWriter.h"
+#include "llvm/MC/MCParser/MCAsmParser.h"
+#include "llvm/MC/MCParser/MCTargetAsmParser.h"
+#include "llvm/MC/MCRegisterInfo.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/MC/MCTargetOptions.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+
+using namespace llvm;
+
+namespace {
+
+const char *TripleName = "x86_64-unknown-linux-gnu";
+
+// Assembles Source to an object file, with or without skipping the fragments
+// that a relaxation step cannot have affected.
+std::string assemble(const std::string &Source, bool IncrementalRelaxation) {
+  std::string Error;
+  const Target *T = TargetRegistry::lookupTarget(TripleName, Error);
+  MCTargetOptions Options;
+  std::unique_ptr<MCRegisterInfo> MRI(T->createMCRegInfo(TripleName));
+  std::unique_ptr<MCAsmInfo> MAI(T->createMCAsmInfo(*MRI, TripleName, Options));
+  std::unique_ptr<MCInstrInfo> MII(T->createMCInstrInfo());
+  std::unique_ptr<MCSubtargetInfo> STI(
+      T->createMCSubtargetInfo(TripleName, "", ""));
+
+  SourceMgr SrcMgr;
+  SrcMgr.AddNewSourceBuffer(MemoryBuffer::getMemBuffer(Source), SMLoc());
+  MCContext Ctx(Triple(TripleName), MAI.get(), MRI.get(), STI.get(), &SrcMgr);
+  std::unique_ptr<MCObjectFileInfo> MOFI(
+      T->createMCObjectFileInfo(Ctx, /*PIC=*/false));
+  Ctx.setObjectFileInfo(MOFI.get());
+
+  SmallString<0> Object;
+  raw_svector_ostream OS(Object);
+  std::unique_ptr<MCAsmBackend> MAB(T->createMCAsmBackend(*STI, *MRI, Options));
+  std::unique_ptr<MCObjectWriter> OW = MAB->createObjectWriter(OS);
+  std::unique_ptr<MCStreamer> Str(T->createMCObjectStreamer(
+      Triple(TripleName), Ctx, std::move(MAB), std::move(OW),
+      std::unique_ptr<MCCodeEmitter>(T->createMCCodeEmitter(*MII, Ctx)), *STI,
+      /*RelaxAll=*/false, /*IncrementalLinkerCompatible=*/false,
+      /*DWARFMustBeAtTheEnd=*/false));
+  static_cast<MCObjectStreamer &>(*Str)
+      .getAssembler()
+      .setIncrementalRelaxation(IncrementalRelaxation);
+
+  std::unique_ptr<MCAsmParser> Parser(
+      createMCAsmParser(SrcMgr, Ctx, *Str, *MAI));
+  std::unique_ptr<MCTargetAsmParser> TAP(
+      T->createMCAsmParser(*STI, *Parser, *MII, Options));
+  Parser->setTargetParser(*TAP);
+  EXPECT_FALSE(Parser->Run(/*NoInitialTextSection=*/false));
+  return std::string(Object);
+}
+
+class X86RelaxationTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    LLVMInitializeX86TargetInfo();
+    LLVMInitializeX86TargetMC();
+    LLVMInitializeX86AsmParser();
+
+    // If we didn't build x86, do not run the test.
+    std::string Error;
+    if (!TargetRegistry::lookupTarget(TripleName, Error))
+      GTEST_SKIP();
+  }
+
+  void expectSameObject(const std::string &Source) {
+    std::string Full = assemble(Source, /*IncrementalRelaxation=*/false);
+    std::string Incremental = assemble(Source, /*IncrementalRelaxation=*/true);
+    ASSERT_FALSE(Full.empty());
+    EXPECT_TRUE(Full == Incremental);
+  }
+};
+
+// A chain of short jumps, each just within range of a label a few blocks
+// ahead, which relaxes backwards a few blocks per step.
+TEST_F(X86RelaxationTest, BranchCascade) {
+  std::string Source;
+  raw_string_ostream OS(Source);
+  OS << "\t.text\n";
+  for (unsigned I = 0; I != 200; ++I) {
+    OS << ".Lb" << I << ":\n";
+    if (I + 8 < 200)
+      OS << "\tjmp .Lb" << I + 8 << "\n";
+    else
+      OS << "\tjmp .Lend\n";
+    OS << "\tmovabsq $1, %rax\n\taddl $1, %eax\n\tnop\n";
+  }
+  OS << "\t.fill 256, 1, 0x90\n.Lend:\n\tretq\n";
+  expectSameObject(Source);
+}
+
+// Branches around alignment padding, line table entries and a second
+// section whose size depends on the first.
+TEST_F(X86RelaxationTest, MixedFragments) {
+  std::string Source;
+  raw_string_ostream OS(Source);
+  OS << "\t.text\n\t.file 1 \"a.c\"\nf:\n";
+  for (unsigned I = 0; I != 100; ++I)
+    OS << "\t.loc 1 " << I + 1 << "\n\tcmpl $" << I << ", %edi\n\tje .Lcase"
+       << I << "\n";
+  OS << "\tjmp .Lexit\n";
+  for (unsigned I = 0; I != 100; ++I) {
+    OS << ".Lcase" << I << ":\n\taddl $" << I << ", %eax\n";
+    if (I % 10 == 0)
+      OS << "\t.p2align 4\n";
+    OS << "\tjmp .Lexit\n";
+  }
+  OS << ".Lexit:\n\tretq\n.Lfend:\n";
+  OS << "\t.data\n\t.uleb128 .Lfend-f\n\t.uleb128 .Lexit-.Lcase0\n";
+  expectSameObject(Source);
+}
+
+} // end anonymous namespace
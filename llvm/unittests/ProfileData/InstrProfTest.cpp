@@ -7,6 +7,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
@@ -17,8 +18,11 @@
 #include "llvm/ProfileData/MemProf.h"
 #include "llvm/ProfileData/MemProfData.inc"
 #include "llvm/Support/Compression.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/VirtualFileSystem.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Testing/Support/Error.h"
+#include "llvm/Testing/Support/SupportHelpers.h"
 #include "gtest/gtest.h"
 #include <cstdarg>
 #include <optional>
@@ -174,6 +178,57 @@ TEST_P(MaybeSparseInstrProfTest, get_function_counts) {
   ASSERT_TRUE(ErrorEquals(instrprof_error::unknown_function, std::move(E2)));
 }
 
+// Readers of the same file may share its mapping, but not once the file has
+// been replaced.
+TEST_F(InstrProfTest, read_profile_file) {
+  unittest::TempDir Dir("instr-prof-test", /*Unique=*/true);
+  std::string Path(Dir.path("default.profdata"));
+  auto WriteProfile = [&](uint64_t Count) {
+    InstrProfWriter Writer;
+    // Enough functions for the profile to be mapped.
+    for (unsigned I = 0; I != 1000; ++I)
+      Writer.addRecord({"foo" + std::to_string(I), 0x1234, {Count, I}}, Err);
+    std::string TmpPath = Path + ".tmp";
+    {
+      std::error_code EC;
+      raw_fd_ostream OS(TmpPath, EC);
+      ASSERT_FALSE(EC);
+      EXPECT_THAT_ERROR(Writer.write(OS), Succeeded());
+    }
+    ASSERT_FALSE(sys::fs::rename(TmpPath, Path));
+  };
+  auto ExpectCounts = [](IndexedInstrProfReader &Reader, uint64_t Count) {
+    for (unsigned I : {0, 500, 999}) {
+      std::vector<uint64_t> Counts;
+      EXPECT_THAT_ERROR(
+          Reader.getFunctionCounts("foo" + std::to_string(I), 0x1234, Counts),
+          Succeeded());
+      EXPECT_EQ((std::vector<uint64_t>{Count, I}), Counts);
+    }
+  };
+
+  auto FS = vfs::getRealFileSystem();
+  WriteProfile(1);
+  auto Reader1 = IndexedInstrProfReader::create(Path, *FS);
+  ASSERT_THAT_EXPECTED(Reader1, Succeeded());
+  auto Reader2 = IndexedInstrProfReader::create(Path, *FS);
+  ASSERT_THAT_EXPECTED(Reader2, Succeeded());
+  ExpectCounts(**Reader1, 1);
+  ExpectCounts(**Reader2, 1);
+  const MemoryBuffer &Buffer1 = (*Reader1)->getDataBuffer();
+  EXPECT_EQ(MemoryBuffer::MemoryBuffer_MMap, Buffer1.getBufferKind());
+  EXPECT_EQ(Buffer1.getBufferStart(),
+            (*Reader2)->getDataBuffer().getBufferStart());
+
+  WriteProfile(2);
+  auto Reader3 = IndexedInstrProfReader::create(Path, *FS);
+  ASSERT_THAT_EXPECTED(Reader3, Succeeded());
+  ExpectCounts(**Reader3, 2);
+  ExpectCounts(**Reader1, 1);
+  EXPECT_NE(Buffer1.getBufferStart(),
+            (*Reader3)->getDataBuffer().getBufferStart());
+}
+
 // Profile data is copied from general.proftext
 TEST_F(InstrProfTest, get_profile_summary) {
   Writer.addRecord({"func1", 0x1234, {97531}}, Err);
@@ -1198,6 +1253,113 @@ TEST_P(MaybeSparseInstrProfTest, icall_and_vtable_data_merge) {
   }
 }
 
+// Build the same three profiles on each call. Their functions, value profiles
+// and vtable names overlap, so merging them combines records.
+static std::vector<std::unique_ptr<InstrProfWriter>> makeShardTestInputs() {
+  std::vector<std::unique_ptr<InstrProfWriter>> Inputs;
+  for (uint64_t I = 0; I != 3; ++I) {
+    auto Input = std::make_unique<InstrProfWriter>();
+    for (uint64_t F = 0; F != 8; ++F) {
+      if ((F + I) % 3 == 0)
+        continue;
+      std::string Name = "func" + std::to_string(F);
+      NamedInstrProfRecord Record(Name, 0x1234, {I + 1, F});
+      Record.reserveSites(IPVK_IndirectCallTarget, 1);
+      InstrProfValueData Calls[] = {{0x1000 + I, I + 1}, {0x2000, F + 1}};
+      Record.addValueData(IPVK_IndirectCallTarget, 0, Calls, 2, nullptr);
+      Record.reserveSites(IPVK_VTableTarget, 1);
+      InstrProfValueData VTables[] = {{0x3000, F + 1}, {0x4000 + I, 1}};
+      Record.addValueData(IPVK_VTableTarget, 0, VTables, 2, nullptr);
+      Input->addRecord(std::move(Record), Err);
+      // A second record of the same function, with a different hash.
+      if (F % 2 == 0)
+        Input->addRecord({Name, 0x5678, {I, I}}, Err);
+    }
+    Input->addVTableName("vtable" + std::to_string(I));
+    Input->addVTableName("vtable_common");
+    Inputs.push_back(std::move(Input));
+  }
+  return Inputs;
+}
+
+static std::vector<std::pair<uint64_t, uint64_t>>
+getSortedValues(const InstrProfRecord &Record, uint32_t ValueKind,
+                uint32_t Site) {
+  std::vector<std::pair<uint64_t, uint64_t>> Values;
+  auto VD = Record.getValueForSite(ValueKind, Site);
+  for (uint32_t I = 0, E = Record.getNumValueDataForSite(ValueKind, Site);
+       I != E; ++I)
+    Values.emplace_back(VD[I].Value, VD[I].Count);
+  llvm::sort(Values);
+  return Values;
+}
+
+TEST_F(InstrProfTest, test_merge_writers_through_shards) {
+  for (auto &Input : makeShardTestInputs())
+    Writer.mergeRecordsFromWriter(std::move(*Input), Err);
+
+  // Move the functions of each input into the shards which own them and the
+  // rest of it into the first shard, then gather the shards.
+  InstrProfWriter Shards[3];
+  SmallVector<InstrProfWriter *, 3> ShardPtrs;
+  for (InstrProfWriter &Shard : Shards)
+    ShardPtrs.push_back(&Shard);
+  for (auto &Input : makeShardTestInputs()) {
+    Input->moveRecordsToShards(
+        ShardPtrs, [](unsigned) { return std::unique_lock<std::mutex>(); },
+        Err);
+    EXPECT_TRUE(Input->getProfileData().empty());
+    Shards[0].mergeRecordsFromWriter(std::move(*Input), Err);
+  }
+  StringSet<> Owned;
+  for (InstrProfWriter &Shard : Shards)
+    for (const auto &Entry : Shard.getProfileData())
+      EXPECT_TRUE(Owned.insert(Entry.getKey()).second) << Entry.getKey();
+  EXPECT_EQ(8U, Owned.size());
+  for (unsigned I = 1; I != 3; ++I)
+    Shards[0].mergeRecordsFromWriter(std::move(Shards[I]), Err);
+
+  readProfile(Writer.writeBuffer());
+  auto ShardedOrErr = IndexedInstrProfReader::create(Shards[0].writeBuffer());
+  ASSERT_THAT_ERROR(ShardedOrErr.takeError(), Succeeded());
+  IndexedInstrProfReader &Sharded = **ShardedOrErr;
+
+  unsigned NumRecords = 0;
+  for (const NamedInstrProfRecord &Serial : *Reader) {
+    ++NumRecords;
+    Expected<InstrProfRecord> R =
+        Sharded.getInstrProfRecord(Serial.Name, Serial.Hash);
+    ASSERT_THAT_ERROR(R.takeError(), Succeeded());
+    EXPECT_EQ(Serial.Counts, R->Counts) << Serial.Name;
+    for (uint32_t Kind : {IPVK_IndirectCallTarget, IPVK_VTableTarget}) {
+      ASSERT_EQ(Serial.getNumValueSites(Kind), R->getNumValueSites(Kind));
+      for (uint32_t Site = 0; Site != R->getNumValueSites(Kind); ++Site)
+        EXPECT_EQ(getSortedValues(Serial, Kind, Site),
+                  getSortedValues(*R, Kind, Site))
+            << Serial.Name;
+    }
+  }
+  EXPECT_EQ(12U, NumRecords);
+  unsigned NumSharded = 0;
+  for (const NamedInstrProfRecord &Record : Sharded) {
+    (void)Record;
+    ++NumSharded;
+  }
+  EXPECT_EQ(NumRecords, NumSharded);
+
+  auto getVTableNames = [](InstrProfReader &R) {
+    std::vector<std::string> Names;
+    for (const auto &Entry : R.getSymtab().getVTableNames())
+      Names.push_back(Entry.getKey().str());
+    llvm::sort(Names);
+    return Names;
+  };
+  EXPECT_THAT(getVTableNames(*Reader),
+              testing::ElementsAre("vtable0", "vtable1", "vtable2",
+                                   "vtable_common"));
+  EXPECT_EQ(getVTableNames(*Reader), getVTableNames(Sharded));
+}
+
 struct ValueProfileMergeEdgeCaseTest
     : public InstrProfTest,
       public ::testing::WithParamInterface<std::tuple<bool, uint32_t>> {
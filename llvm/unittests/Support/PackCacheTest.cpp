@@ -0,0 +1,233 @@
+//===- PackCacheTest.cpp - Tests for packCache ----------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/Caching.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Testing/Support/Error.h"
+#include "llvm/Testing/Support/SupportHelpers.h"
+#include "gtest/gtest.h"
+#include <thread>
+
+using namespace llvm;
+using llvm::unittest::TempDir;
+
+namespace {
+
+// Opens a cache in Dir whose hits and additions for task I are stored in
+// Results[I].
+FileCache openCache(StringRef Dir, std::vector<std::string> &Results,
+                    PackCachePolicy Policy = PackCachePolicy()) {
+  Expected<FileCache> CacheOrErr = packCache(
+      "Test", Dir,
+      [&Results](size_t Task, const Twine &ModuleName,
+                 std::unique_ptr<MemoryBuffer> MB) {
+        Results[Task] = MB->getBuffer().str();
+      },
+      Policy);
+  EXPECT_THAT_EXPECTED(CacheOrErr, Succeeded());
+  return CacheOrErr ? *CacheOrErr : FileCache();
+}
+
+// Returns true on a hit, otherwise adds Data to the cache.
+bool lookupOrAdd(FileCache &Cache, unsigned Task, StringRef Key,
+                 StringRef Data) {
+  Expected<AddStreamFn> AddStreamOrErr = Cache(Task, Key, "module");
+  EXPECT_THAT_EXPECTED(AddStreamOrErr, Succeeded());
+  if (!AddStreamOrErr || !*AddStreamOrErr)
+    return true;
+  auto StreamOrErr = (*AddStreamOrErr)(Task, "module");
+  EXPECT_THAT_EXPECTED(StreamOrErr, Succeeded());
+  if (StreamOrErr)
+    *(*StreamOrErr)->OS << Data;
+  return false;
+}
+
+std::string object(unsigned I, size_t Size = 100) {
+  std::string Data = "object " + utostr(I);
+  Data.resize(Size, char('a' + I % 26));
+  return Data;
+}
+
+TEST(PackCacheTest, HitAcrossInstances) {
+  TempDir Dir("pack-cache-test", /*Unique=*/true);
+  std::vector<std::string> Results(1);
+  {
+    FileCache Cache = openCache(Dir.path(), Results);
+    EXPECT_FALSE(lookupOrAdd(Cache, 0, "key", object(1)));
+    EXPECT_EQ(object(1), Results[0]);
+    Results[0].clear();
+    EXPECT_TRUE(lookupOrAdd(Cache, 0, "key", ""));
+    EXPECT_EQ(object(1), Results[0]);
+  }
+
+  // A new cache, as used by a later link, finds the same object, including
+  // an empty one and one large enough to be mapped.
+  FileCache Cache = openCache(Dir.path(), Results);
+  Results[0].clear();
+  EXPECT_TRUE(lookupOrAdd(Cache, 0, "key", ""));
+  EXPECT_EQ(object(1), Results[0]);
+  EXPECT_FALSE(lookupOrAdd(Cache, 0, "empty", ""));
+  EXPECT_TRUE(lookupOrAdd(Cache, 0, "empty", "x"));
+  EXPECT_EQ("", Results[0]);
+  EXPECT_FALSE(lookupOrAdd(Cache, 0, "large", object(2, 1 << 20)));
+  EXPECT_TRUE(lookupOrAdd(Cache, 0, "large", ""));
+  EXPECT_EQ(object(2, 1 << 20), Results[0]);
+  EXPECT_FALSE(lookupOrAdd(Cache, 0, "other", object(3)));
+}
+
+TEST(PackCacheTest, CorruptIndex) {
+  TempDir Dir("pack-cache-test", /*Unique=*/true);
+  std::vector<std::string> Results(1);
+  {
+    FileCache Cache = openCache(Dir.path(), Results);
+    EXPECT_FALSE(lookupOrAdd(Cache, 0, "key", object(1)));
+  }
+  {
+    std::error_code EC;
+    raw_fd_ostream OS(Dir.path("llvmpack.index"), EC);
+    ASSERT_FALSE(EC);
+    OS << "garbage";
+  }
+  FileCache Cache = openCache(Dir.path(), Results);
+  EXPECT_FALSE(lookupOrAdd(Cache, 0, "key", object(1)));
+  EXPECT_TRUE(lookupOrAdd(Cache, 0, "key", ""));
+}
+
+// An object larger than what the cache keeps in memory goes through a
+// temporary file, which is removed once the object is in a pack.
+TEST(PackCacheTest, LargeObject) {
+  TempDir Dir("pack-cache-test", /*Unique=*/true);
+  std::vector<std::string> Results(1);
+  FileCache Cache = openCache(Dir.path(), Results);
+  std::string Large = object(4, 3 << 20);
+  EXPECT_FALSE(lookupOrAdd(Cache, 0, "large", Large));
+  EXPECT_EQ(Large, Results[0]);
+  Results[0].clear();
+  EXPECT_TRUE(lookupOrAdd(Cache, 0, "large", ""));
+  EXPECT_EQ(Large, Results[0]);
+
+  std::error_code EC;
+  for (sys::fs::directory_iterator I(Dir.path(), EC), E; I != E && !EC;
+       I.increment(EC))
+    EXPECT_FALSE(StringRef(I->path()).ends_with(".tmp")) << I->path();
+}
+
+// A process replacing an index it cannot use must not break the buffers and
+// the index that another process still has mapped.
+TEST(PackCacheTest, ReplacedIndex) {
+  TempDir Dir("pack-cache-test", /*Unique=*/true);
+  std::vector<std::unique_ptr<MemoryBuffer>> Buffers(1);
+  Expected<FileCache> OldOrErr = packCache(
+      "Test", Dir.path(),
+      [&Buffers](size_t Task, const Twine &ModuleName,
+                 std::unique_ptr<MemoryBuffer> MB) {
+        Buffers[Task] = std::move(MB);
+      });
+  ASSERT_THAT_EXPECTED(OldOrErr, Succeeded());
+  EXPECT_FALSE(lookupOrAdd(*OldOrErr, 0, "key", object(1)));
+  EXPECT_TRUE(lookupOrAdd(*OldOrErr, 0, "key", ""));
+  ASSERT_TRUE(Buffers[0]);
+  std::unique_ptr<MemoryBuffer> Held = std::move(Buffers[0]);
+
+  // Install an index with another version, as an incompatible compiler
+  // would, without touching the file that is mapped.
+  {
+    auto IndexOrErr = MemoryBuffer::getFile(Dir.path("llvmpack.index"));
+    ASSERT_TRUE(bool(IndexOrErr));
+    std::string Index = (*IndexOrErr)->getBuffer().str();
+    Index[8] ^= 0xff;
+    std::error_code EC;
+    raw_fd_ostream OS(Dir.path("other.index"), EC);
+    ASSERT_FALSE(EC);
+    OS << Index;
+  }
+  ASSERT_FALSE(
+      sys::fs::rename(Dir.path("other.index"), Dir.path("llvmpack.index")));
+
+  std::vector<std::string> Results(1);
+  FileCache New = openCache(Dir.path(), Results);
+  EXPECT_EQ(object(1), Held->getBuffer());
+  EXPECT_FALSE(lookupOrAdd(New, 0, "key", object(1)));
+  EXPECT_TRUE(lookupOrAdd(New, 0, "key", ""));
+  EXPECT_EQ(object(1), Results[0]);
+
+  // The old cache keeps working, but no longer adds objects.
+  lookupOrAdd(*OldOrErr, 0, "key", object(1));
+  EXPECT_FALSE(lookupOrAdd(*OldOrErr, 0, "other", object(2)));
+  EXPECT_FALSE(lookupOrAdd(New, 0, "other", object(2)));
+  EXPECT_EQ(object(1), Held->getBuffer());
+}
+
+// Fill a small cache many times over while keeping one object in use. It must
+// survive the removal of the packs it was written to, while old objects that
+// were not used are dropped.
+TEST(PackCacheTest, Pruning) {
+  TempDir Dir("pack-cache-test", /*Unique=*/true);
+  std::vector<std::string> Results(1);
+  PackCachePolicy Policy;
+  Policy.MaxSizeBytes = 16 * 1024;
+  Policy.NumPacks = 4;
+  Policy.NumIndexSlots = 1024;
+  FileCache Cache = openCache(Dir.path(), Results, Policy);
+
+  EXPECT_FALSE(lookupOrAdd(Cache, 0, "hot", object(0)));
+  for (unsigned I = 1; I != 1000; ++I) {
+    EXPECT_FALSE(lookupOrAdd(Cache, 0, "key" + utostr(I), object(I)));
+    EXPECT_TRUE(lookupOrAdd(Cache, 0, "hot", ""));
+    EXPECT_EQ(object(0), Results[0]);
+  }
+  EXPECT_FALSE(lookupOrAdd(Cache, 0, "key1", object(1)));
+  EXPECT_TRUE(lookupOrAdd(Cache, 0, "key999", ""));
+
+  // Objects that do not fit in a pack are not cached.
+  EXPECT_FALSE(lookupOrAdd(Cache, 0, "big", object(1, 8 * 1024)));
+  EXPECT_EQ(object(1, 8 * 1024), Results[0]);
+  EXPECT_FALSE(lookupOrAdd(Cache, 0, "big", object(1, 8 * 1024)));
+
+  uint64_t Total = 0;
+  std::error_code EC;
+  for (sys::fs::directory_iterator I(Dir.path(), EC), E; I != E && !EC;
+       I.increment(EC)) {
+    uint64_t Size;
+    ASSERT_FALSE(sys::fs::file_size(I->path(), Size));
+    if (StringRef(I->path()).ends_with(".pack"))
+      Total += Size;
+  }
+  EXPECT_LE(Total, Policy.MaxSizeBytes);
+}
+
+// Several caches on the same directory, as in concurrent links, add and look
+// up overlapping objects.
+TEST(PackCacheTest, Concurrent) {
+  TempDir Dir("pack-cache-test", /*Unique=*/true);
+  PackCachePolicy Policy;
+  Policy.MaxSizeBytes = 256 * 1024;
+  Policy.NumIndexSlots = 4096;
+  constexpr unsigned NumThreads = 8;
+  std::vector<std::string> Results(NumThreads);
+  std::vector<FileCache> Caches;
+  for (unsigned I = 0; I != 2; ++I)
+    Caches.push_back(openCache(Dir.path(), Results, Policy));
+
+  std::vector<std::thread> Threads;
+  for (unsigned T = 0; T != NumThreads; ++T)
+    Threads.emplace_back([&, T] {
+      FileCache &Cache = Caches[T % 2];
+      for (unsigned I = 0; I != 2000; ++I) {
+        unsigned N = (I * 7 + T * 13) % 500;
+        lookupOrAdd(Cache, T, "key" + utostr(N), object(N, 200 + N));
+        EXPECT_EQ(object(N, 200 + N), Results[T]);
+      }
+    });
+  for (std::thread &T : Threads)
+    T.join();
+}
+
+} // end anonymous namespace
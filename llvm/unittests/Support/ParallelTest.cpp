@@ -105,9 +105,8 @@ TEST(Parallel, TaskGroupSequentialFor) {
 
 #if LLVM_ENABLE_THREADS
 TEST(Parallel, NestedTaskGroup) {
-  // This test checks:
-  // 1. Root TaskGroup is in Parallel mode.
-  // 2. Nested TaskGroup is not in Parallel mode.
+  // This test checks that both the root TaskGroup and a TaskGroup nested in
+  // one of its tasks are in Parallel mode.
   parallel::TaskGroup tg;
 
   tg.spawn([&]() {
@@ -116,17 +115,66 @@ TEST(Parallel, NestedTaskGroup) {
 
   tg.spawn([&]() {
     parallel::TaskGroup nestedTG;
-    EXPECT_FALSE(nestedTG.isParallel());
+    EXPECT_TRUE(nestedTG.isParallel() ||
+                (parallel::strategy.ThreadsRequested == 1));
 
     nestedTG.spawn([&]() {
-      // Check that root TaskGroup is in Parallel mode.
       EXPECT_TRUE(tg.isParallel() ||
                   (parallel::strategy.ThreadsRequested == 1));
+      EXPECT_TRUE(nestedTG.isParallel() ||
+                  (parallel::strategy.ThreadsRequested == 1));
+    });
+  });
+}
 
-      // Check that nested TaskGroup is not in Parallel mode.
-      EXPECT_FALSE(nestedTG.isParallel());
+TEST(Parallel, NestedParallelFor) {
+  // Every worker thread waits for a nested TaskGroup at the same time. This
+  // must not dead lock the executor.
+  std::atomic<size_t> Count{0};
+  parallelFor(0, 64, [&](size_t) {
+    parallelFor(0, 64, [&](size_t) {
+      parallelFor(0, 16, [&](size_t) { ++Count; });
     });
   });
+  EXPECT_EQ(Count, 64u * 64u * 16u);
+}
+
+TEST(Parallel, NestedSequentialTasks) {
+  // Sequential tasks of a nested TaskGroup still run in spawn order.
+  size_t Count = 0;
+  {
+    parallel::TaskGroup tg;
+    tg.spawn([&] {
+      parallel::TaskGroup nestedTG;
+      for (size_t Idx = 0; Idx < 100; Idx++)
+        nestedTG.spawn([&Count, Idx]() { EXPECT_EQ(Count++, Idx); }, true);
+    });
+  }
+  EXPECT_EQ(Count, 100ul);
+}
+
+TEST(Parallel, SequentialTasksInSequentialTask) {
+  // A sequential task that spawns sequential tasks of its own must not wait
+  // for the sequential queue it is holding.
+  std::vector<size_t> Order;
+  {
+    parallel::TaskGroup tg;
+    for (size_t Outer = 0; Outer < 10; Outer++) {
+      tg.spawn(
+          [&Order, Outer] {
+            parallel::TaskGroup nestedTG;
+            EXPECT_FALSE(nestedTG.isParallel());
+            for (size_t Inner = 0; Inner < 10; Inner++)
+              nestedTG.spawn(
+                  [&Order, Idx = Outer * 10 + Inner] { Order.push_back(Idx); },
+                  true);
+          },
+          true);
+    }
+  }
+  ASSERT_EQ(Order.size(), 100ul);
+  for (size_t Idx = 0; Idx < 100; Idx++)
+    EXPECT_EQ(Order[Idx], Idx);
 }
 
 TEST(Parallel, ParallelNestedTaskGroup) {
@@ -143,18 +191,13 @@ TEST(Parallel, ParallelNestedTaskGroup) {
         EXPECT_TRUE(tg.isParallel() ||
                     (parallel::strategy.ThreadsRequested == 1));
 
-        // Check that nested TaskGroup is not in Parallel mode.
         parallel::TaskGroup nestedTG;
-        EXPECT_FALSE(nestedTG.isParallel());
         ++Count;
 
         nestedTG.spawn([&]() {
           // Check that root TaskGroup is in Parallel mode.
           EXPECT_TRUE(tg.isParallel() ||
                       (parallel::strategy.ThreadsRequested == 1));
-
-          // Check that nested TaskGroup is not in Parallel mode.
-          EXPECT_FALSE(nestedTG.isParallel());
           ++Count;
         });
       });
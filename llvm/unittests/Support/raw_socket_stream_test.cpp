@@ -68,6 +68,37 @@ TEST(raw_socket_streamTest, CLIENT_TO_SERVER_AND_SERVER_TO_CLIENT) {
   ASSERT_EQ("01234567", string);
 }
 
+TEST(raw_socket_streamTest, PEER_IS_SAME_USER) {
+  if (!hasUnixSocketSupport())
+    GTEST_SKIP();
+
+  SmallString<100> SocketPath;
+  llvm::sys::fs::createUniquePath("peer_same_user.sock", SocketPath, true);
+
+  // Make sure socket file does not exist. May still be there from the last test
+  std::remove(SocketPath.c_str());
+
+  Expected<ListeningSocket> MaybeServerListener =
+      ListeningSocket::createUnix(SocketPath);
+  ASSERT_THAT_EXPECTED(MaybeServerListener, llvm::Succeeded());
+  ListeningSocket ServerListener = std::move(*MaybeServerListener);
+
+  Expected<std::unique_ptr<raw_socket_stream>> MaybeClient =
+      raw_socket_stream::createConnectedUnix(SocketPath);
+  ASSERT_THAT_EXPECTED(MaybeClient, llvm::Succeeded());
+
+  Expected<std::unique_ptr<raw_socket_stream>> MaybeServer =
+      ServerListener.accept();
+  ASSERT_THAT_EXPECTED(MaybeServer, llvm::Succeeded());
+
+#ifdef _WIN32
+  EXPECT_FALSE((*MaybeServer)->isPeerSameUser());
+#else
+  EXPECT_TRUE((*MaybeServer)->isPeerSameUser());
+  EXPECT_TRUE((*MaybeClient)->isPeerSameUser());
+#endif
+}
+
 TEST(raw_socket_streamTest, TIMEOUT_PROVIDED) {
   if (!hasUnixSocketSupport())
     GTEST_SKIP();
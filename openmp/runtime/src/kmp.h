@@ -1105,6 +1105,7 @@ extern omp_allocator_handle_t __kmp_def_allocator;
 #endif
 
 extern int __kmp_memkind_available;
+extern int __kmp_alloc_huge_pages;
 
 typedef omp_memspace_handle_t kmp_memspace_t; // placeholder
 
@@ -1117,6 +1118,7 @@ typedef struct kmp_allocator_t {
   kmp_uint64 pool_size;
   kmp_uint64 pool_used;
   bool pinned;
+  omp_alloctrait_value_t partition; // partition trait, 0 if not specified
 } kmp_allocator_t;
 
 extern omp_allocator_handle_t __kmpc_init_allocator(int gtid,
@@ -1148,6 +1150,8 @@ extern void ___kmpc_free(int gtid, void *ptr, omp_allocator_handle_t al);
 
 extern void __kmp_init_memkind();
 extern void __kmp_fini_memkind();
+extern void __kmp_init_numa_alloc();
+extern void __kmp_fini_numa_alloc();
 extern void __kmp_init_target_mem();
 
 /* ------------------------------------------------------------------------ */
@@ -1293,6 +1297,9 @@ extern kmp_uint64 __kmp_now_nsec();
 
 #define KMP_MAX_ORDERED 8
 
+#define KMP_MIN_TASK_STEAL_BATCH 1
+#define KMP_MAX_TASK_STEAL_BATCH 32
+
 #define KMP_MAX_FIELDS 32
 
 #define KMP_MAX_BRANCH_BITS 31
@@ -2424,6 +2431,11 @@ extern kmp_tasking_mode_t
     __kmp_tasking_mode; /* determines how/when to execute tasks */
 extern int __kmp_task_stealing_constraint;
 extern int __kmp_enable_task_throttling;
+extern int __kmp_task_steal_locality;
+extern int __kmp_task_steal_batch;
+extern int __kmp_prof_enabled; /* per-construct profiling, see kmp_profile.h */
+extern char *__kmp_prof_file; /* KMP_PROFILE_FILE, NULL if unset */
+extern int __kmp_prof_period; /* time one in this many region instances */
 extern kmp_int32 __kmp_default_device; // Set via OMP_DEFAULT_DEVICE if
 // specified, defaults to 0 otherwise
 // Set via OMP_MAX_TASK_PRIORITY if specified, defaults to 0 otherwise
@@ -2794,6 +2806,16 @@ struct kmp_taskdata { /* aligned during dynamic allocation       */
 KMP_BUILD_ASSERT(sizeof(kmp_taskdata_t) % sizeof(void *) == 0);
 
 // Data for task team but per thread
+// Locality tiers used to order steal victims when KMP_TASK_STEAL_LOCALITY is
+// set. Threads in a lower tier are tried before threads in a higher one.
+typedef enum kmp_steal_tier {
+  steal_tier_core = 0, // Same core (SMT siblings)
+  steal_tier_llc, // Same last level cache
+  steal_tier_numa, // Same NUMA domain
+  steal_tier_remote, // Everything else
+  steal_tier_last
+} kmp_steal_tier_t;
+
 typedef struct kmp_base_thread_data {
   kmp_info_p *td_thr; // Pointer back to thread info
   // Used only in __kmp_execute_tasks_template, maybe not avail until task is
@@ -2807,6 +2829,12 @@ typedef struct kmp_base_thread_data {
   kmp_int32 td_deque_ntasks; // Number of tasks in deque
   // GEH: shouldn't this be volatile since used in while-spin?
   kmp_int32 td_deque_last_stolen; // Thread number of last successful steal
+  // Steal victims ordered by topological distance (KMP_TASK_STEAL_LOCALITY).
+  // Built lazily by the owner thread; td_steal_nthreads == 0 means stale.
+  kmp_int32 *td_steal_order; // Victim thread numbers, nearest first
+  kmp_int32 td_steal_order_size; // Allocated size of td_steal_order
+  kmp_int32 td_steal_nthreads; // Team size td_steal_order was built for
+  kmp_int32 td_steal_tier_end[steal_tier_last]; // End of each tier in order
 #ifdef BUILD_TIED_TASK_STACK
   kmp_task_stack_t td_susp_tied_tasks; // Stack of suspended tied tasks for task
 // scheduling constraint
@@ -2978,6 +3006,8 @@ typedef struct KMP_ALIGN_CACHE kmp_base_info {
 #endif
   int th_prev_level; /* previous level for affinity format */
   int th_prev_num_threads; /* previous num_threads for affinity format */
+  struct kmp_prof_table *th_prof; /* per-construct profile, lazily allocated */
+  kmp_uint64 th_prof_arrive_time; /* join barrier arrival, timed instances */
 #if USE_ITT_BUILD
   kmp_uint64 th_bar_arrive_time; /* arrival to barrier timestamp */
   kmp_uint64 th_bar_min_time; /* minimum arrival time at the barrier */
@@ -3178,6 +3208,8 @@ typedef struct KMP_ALIGN_CACHE kmp_base_team {
   int t_last_place; // Restore these values to primary thread after par region.
 #endif // KMP_AFFINITY_SUPPORTED
   int t_display_affinity;
+  int t_prof_sampled; // this region instance is timed by the profiler
+  kmp_uint64 t_prof_fork_time; // fork timestamp of a timed instance
   int t_size_changed; // team size was changed?: 0: no, 1: yes, -1: changed via
   // omp_set_num_threads() call
   omp_allocator_handle_t t_def_allocator; /* default allocator */
@@ -14,6 +14,12 @@
 #include "kmp_io.h"
 #include "kmp_wrapper_malloc.h"
 
+#if KMP_OS_LINUX
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 // Disable bget when it is not used
 #if KMP_USE_BGET
 
@@ -1376,6 +1382,314 @@ void __kmp_init_target_mem() {
   *(void **)(&kmp_target_unlock_mem) = KMP_DLSYM("llvm_omp_target_unlock_mem");
 }
 
+#if KMP_OS_LINUX
+// Native NUMA-aware allocation path, used for custom allocators when the
+// memkind library is not available. Memory is mmap'd and bound with mbind()
+// before it is touched, so the partition trait is honoured and pages that are
+// not explicitly bound keep first-touch placement.
+//
+// Nearest and interleaved blocks are carved out of shared arenas, one per
+// placement, whose chunks are bound once when they are mapped. Freed arena
+// blocks go back to a per-arena free list of their size class, so the common
+// case costs no system call. Blocked blocks need their own per-node slices,
+// and blocks too large for an arena are mapped on their own. Blocks smaller
+// than a page cannot be placed on their own pages, so they stay in bget.
+
+// Values from <numaif.h>; libnuma is deliberately not required.
+#define KMP_MPOL_PREFERRED 1
+#define KMP_MPOL_INTERLEAVE 3
+
+#define KMP_NUMA_MAX_NODES 1024
+#define KMP_NUMA_MASK_BITS (CHAR_BIT * sizeof(unsigned long))
+#define KMP_NUMA_CHUNK_SIZE ((size_t)4 * 1024 * 1024) // arena chunk size
+#define KMP_NUMA_CHUNK_HEADER 64 // chunk link, keeps blocks cache aligned
+#define KMP_NUMA_MAX_CLASSES 24 // arena blocks of 2^0 .. 2^23 bytes
+#define KMP_HUGE_PAGE_SIZE ((size_t)2 * 1024 * 1024)
+
+typedef struct kmp_numa_block { // Header at the start of every block
+  size_t size; // Size of the block (arena) or mapping (direct), with header
+  int partition; // omp_atv_* partition the block was bound with
+  int node; // NUMA node for omp_atv_nearest blocks, -1 otherwise
+  int arena; // Non-zero if the block was carved out of an arena
+  struct kmp_numa_block *next; // Link in the arena free list
+} kmp_numa_block_t;
+
+typedef struct kmp_numa_arena { // Memory bound with one placement
+  kmp_bootstrap_lock_t lock;
+  char *cur; // Unused part of the current chunk
+  char *end;
+  void *chunks; // Mapped chunks, linked through their first word
+  kmp_numa_block_t *free[KMP_NUMA_MAX_CLASSES]; // Free blocks by size class
+} kmp_numa_arena_t;
+
+static int __kmp_numa_num_nodes = 0;
+static unsigned long
+    __kmp_numa_nodes_mask[KMP_NUMA_MAX_NODES / KMP_NUMA_MASK_BITS];
+static int __kmp_numa_nodes[KMP_NUMA_MAX_NODES]; // online node numbers
+static size_t __kmp_numa_page_size;
+// Arenas for omp_atv_nearest by node, the last one is for interleaved blocks
+static kmp_numa_arena_t *volatile __kmp_numa_arenas[KMP_NUMA_MAX_NODES + 1];
+static kmp_bootstrap_lock_t __kmp_numa_arenas_lock =
+    KMP_BOOTSTRAP_LOCK_INITIALIZER(__kmp_numa_arenas_lock);
+
+// Read the online NUMA nodes from sysfs; the file contains CSV of integer
+// ranges, e.g., 0-1,3
+void __kmp_init_numa_alloc() {
+  __kmp_numa_page_size = (size_t)getpagesize();
+  __kmp_numa_num_nodes = 0;
+  kmp_safe_raii_file_t online_file;
+  if (online_file.try_open("/sys/devices/system/node/online", "r") != 0)
+    return;
+  int begin, end;
+  while (fscanf(online_file, "%d", &begin) == 1) {
+    end = begin;
+    int c = fgetc(online_file);
+    if (c == '-') {
+      if (fscanf(online_file, "%d", &end) != 1)
+        break;
+      c = fgetc(online_file);
+    }
+    if (begin < 0 || end >= KMP_NUMA_MAX_NODES || begin > end)
+      break;
+    for (int node = begin; node <= end; ++node) {
+      __kmp_numa_nodes_mask[node / KMP_NUMA_MASK_BITS] |=
+          1UL << (node % KMP_NUMA_MASK_BITS);
+      __kmp_numa_nodes[__kmp_numa_num_nodes++] = node;
+    }
+    if (c != ',')
+      break;
+  }
+  KE_TRACE(25, ("__kmp_init_numa_alloc: %d NUMA nodes online\n",
+                __kmp_numa_num_nodes));
+}
+
+// Unmap all arena chunks, called when the runtime shuts down.
+void __kmp_fini_numa_alloc() {
+  for (int i = 0; i <= KMP_NUMA_MAX_NODES; ++i) {
+    kmp_numa_arena_t *arena = __kmp_numa_arenas[i];
+    if (arena == NULL)
+      continue;
+    void *chunk = arena->chunks;
+    while (chunk != NULL) {
+      void *next = *(void **)chunk;
+      munmap(chunk, KMP_NUMA_CHUNK_SIZE);
+      chunk = next;
+    }
+    __kmp_free(arena);
+    __kmp_numa_arenas[i] = NULL;
+  }
+}
+
+static int __kmp_numa_current_node() {
+  unsigned cpu, node;
+  if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0)
+    return -1;
+  return (int)node;
+}
+
+static void __kmp_numa_bind(void *addr, size_t len, int mode, int node) {
+  long rc;
+  if (node < 0) {
+    rc = syscall(SYS_mbind, addr, len, mode, __kmp_numa_nodes_mask,
+                 (unsigned long)KMP_NUMA_MAX_NODES, 0);
+  } else {
+    unsigned long mask[KMP_NUMA_MAX_NODES / KMP_NUMA_MASK_BITS] = {0};
+    mask[node / KMP_NUMA_MASK_BITS] = 1UL << (node % KMP_NUMA_MASK_BITS);
+    rc = syscall(SYS_mbind, addr, len, mode, mask,
+                 (unsigned long)KMP_NUMA_MAX_NODES, 0);
+  }
+  // Binding is only a placement hint, the memory is usable either way
+  (void)rc;
+  KE_TRACE(25, ("__kmp_numa_bind: %p len=%d mode=%d node=%d rc=%d\n", addr,
+                (int)len, mode, node, (int)rc));
+}
+
+// Decide whether a block of the given size for allocator al should be served
+// by the native path.
+static bool __kmp_numa_alloc_use(kmp_allocator_t *al, size_t size) {
+  if (al->partition == omp_atv_nearest || al->partition == omp_atv_blocked ||
+      al->partition == omp_atv_interleaved)
+    return __kmp_numa_num_nodes > 1 && size >= __kmp_numa_page_size;
+  return __kmp_alloc_huge_pages && size >= KMP_HUGE_PAGE_SIZE;
+}
+
+// Return the arena size class of a block of total bytes, or -1 if the block
+// is too large for an arena and is mapped on its own.
+static int __kmp_numa_size_class(size_t total) {
+  int cls = 0;
+  while (((size_t)1 << cls) < total)
+    ++cls;
+  if (((size_t)1 << cls) > (KMP_NUMA_CHUNK_SIZE - KMP_NUMA_CHUNK_HEADER) / 4)
+    return -1;
+  return cls;
+}
+
+// Return the arena of a placement, creating it on first use.
+static kmp_numa_arena_t *__kmp_numa_get_arena(int partition, int node) {
+  int idx = partition == omp_atv_nearest ? node : KMP_NUMA_MAX_NODES;
+  kmp_numa_arena_t *arena = __kmp_numa_arenas[idx];
+  if (arena != NULL)
+    return arena;
+  __kmp_acquire_bootstrap_lock(&__kmp_numa_arenas_lock);
+  arena = __kmp_numa_arenas[idx];
+  if (arena == NULL) {
+    arena = (kmp_numa_arena_t *)__kmp_allocate(sizeof(kmp_numa_arena_t));
+    __kmp_init_bootstrap_lock(&arena->lock);
+    KMP_MB(); // publish the initialized arena
+    __kmp_numa_arenas[idx] = arena;
+  }
+  __kmp_release_bootstrap_lock(&__kmp_numa_arenas_lock);
+  return arena;
+}
+
+// Map len bytes bound with the given placement.
+static void *__kmp_numa_map(size_t len, int partition, int node) {
+  void *addr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (addr == MAP_FAILED)
+    return NULL;
+  // Bind before anything is written, otherwise the first page would already
+  // be placed by first touch.
+  if (partition == omp_atv_nearest && node >= 0) {
+    __kmp_numa_bind(addr, len, KMP_MPOL_PREFERRED, node);
+  } else if (partition == omp_atv_interleaved) {
+    __kmp_numa_bind(addr, len, KMP_MPOL_INTERLEAVE, -1);
+  } else if (partition == omp_atv_blocked) {
+    // One contiguous, page aligned block per node
+    size_t pages = len / __kmp_numa_page_size;
+    size_t per_node = (pages + __kmp_numa_num_nodes - 1) / __kmp_numa_num_nodes;
+    for (int i = 0; i < __kmp_numa_num_nodes && i * per_node < pages; ++i) {
+      size_t first = i * per_node;
+      size_t count = KMP_MIN(per_node, pages - first);
+      __kmp_numa_bind((char *)addr + first * __kmp_numa_page_size,
+                      count * __kmp_numa_page_size, KMP_MPOL_PREFERRED,
+                      __kmp_numa_nodes[i]);
+    }
+  }
+#ifdef MADV_HUGEPAGE
+  if (__kmp_alloc_huge_pages && len >= KMP_HUGE_PAGE_SIZE)
+    madvise(addr, len, MADV_HUGEPAGE);
+#endif
+  return addr;
+}
+
+// Carve a block of size class cls out of the arena of a placement.
+static kmp_numa_block_t *__kmp_numa_arena_alloc(int cls, int partition,
+                                                int node) {
+  kmp_numa_arena_t *arena = __kmp_numa_get_arena(partition, node);
+  size_t size = (size_t)1 << cls;
+  kmp_numa_block_t *b;
+  __kmp_acquire_bootstrap_lock(&arena->lock);
+  b = arena->free[cls];
+  if (b != NULL) {
+    arena->free[cls] = b->next;
+  } else {
+    if ((size_t)(arena->end - arena->cur) < size) {
+      // The rest of the current chunk is abandoned; it is at most a quarter
+      // of the chunk, as larger blocks are not carved out of arenas.
+      char *chunk =
+          (char *)__kmp_numa_map(KMP_NUMA_CHUNK_SIZE, partition, node);
+      if (chunk == NULL) {
+        __kmp_release_bootstrap_lock(&arena->lock);
+        return NULL;
+      }
+      *(void **)chunk = arena->chunks;
+      arena->chunks = chunk;
+      arena->cur = chunk + KMP_NUMA_CHUNK_HEADER;
+      arena->end = chunk + KMP_NUMA_CHUNK_SIZE;
+      KE_TRACE(25, ("__kmp_numa_arena_alloc: mapped chunk %p partition=%d "
+                    "node=%d\n",
+                    chunk, partition, node));
+    }
+    b = (kmp_numa_block_t *)arena->cur;
+    arena->cur += size;
+  }
+  __kmp_release_bootstrap_lock(&arena->lock);
+  b->size = size;
+  b->arena = 1;
+  return b;
+}
+
+static void *__kmp_numa_alloc(kmp_allocator_t *al, size_t size) {
+  size_t total = size + sizeof(kmp_numa_block_t);
+  int partition = al->partition;
+  int node = -1;
+  if (partition == omp_atv_nearest) {
+    node = __kmp_numa_current_node();
+    if (node < 0 || node >= KMP_NUMA_MAX_NODES)
+      partition = omp_atv_environment;
+  } else if (partition != omp_atv_blocked &&
+             partition != omp_atv_interleaved) {
+    partition = omp_atv_environment;
+  }
+  kmp_numa_block_t *b = NULL;
+  int cls = __kmp_numa_size_class(total);
+  if (cls >= 0 &&
+      (partition == omp_atv_nearest || partition == omp_atv_interleaved)) {
+    b = __kmp_numa_arena_alloc(cls, partition, node);
+    if (b == NULL)
+      return NULL;
+  } else {
+    size_t len =
+        (total + __kmp_numa_page_size - 1) & ~(__kmp_numa_page_size - 1);
+    if (__kmp_alloc_huge_pages && len >= KMP_HUGE_PAGE_SIZE)
+      len = (len + KMP_HUGE_PAGE_SIZE - 1) & ~(KMP_HUGE_PAGE_SIZE - 1);
+    b = (kmp_numa_block_t *)__kmp_numa_map(len, partition, node);
+    if (b == NULL)
+      return NULL;
+    b->size = len;
+    b->arena = 0;
+  }
+  b->partition = partition;
+  b->node = node;
+  b->next = NULL;
+  KE_TRACE(25, ("__kmp_numa_alloc: %p size=%d partition=%d node=%d arena=%d\n",
+                (void *)b, (int)b->size, partition, node, b->arena));
+  return (void *)(b + 1);
+}
+
+static void __kmp_numa_free(void *ptr) {
+  kmp_numa_block_t *b = (kmp_numa_block_t *)ptr - 1;
+  if (!b->arena) {
+    munmap((void *)b, b->size);
+    return;
+  }
+  int cls = __kmp_numa_size_class(b->size);
+  KMP_DEBUG_ASSERT(cls >= 0 && ((size_t)1 << cls) == b->size);
+  kmp_numa_arena_t *arena = __kmp_numa_get_arena(b->partition, b->node);
+  __kmp_acquire_bootstrap_lock(&arena->lock);
+  b->next = arena->free[cls];
+  arena->free[cls] = b;
+  __kmp_release_bootstrap_lock(&arena->lock);
+}
+#else
+void __kmp_init_numa_alloc() {}
+void __kmp_fini_numa_alloc() {}
+#endif // KMP_OS_LINUX
+
+// Allocate and free memory for a custom allocator when memkind is not used
+static void *__kmp_custom_malloc(int gtid, kmp_allocator_t *al, size_t size,
+                                 bool *numa) {
+#if KMP_OS_LINUX
+  if (__kmp_numa_alloc_use(al, size)) {
+    *numa = true;
+    return __kmp_numa_alloc(al, size);
+  }
+#endif
+  *numa = false;
+  return __kmp_thread_malloc(__kmp_thread_from_gtid(gtid), size);
+}
+
+static void __kmp_custom_free(int gtid, void *ptr, bool numa) {
+#if KMP_OS_LINUX
+  if (numa) {
+    __kmp_numa_free(ptr);
+    return;
+  }
+#endif
+  __kmp_thread_free(__kmp_thread_from_gtid(gtid), ptr);
+}
+
 omp_allocator_handle_t __kmpc_init_allocator(int gtid, omp_memspace_handle_t ms,
                                              int ntraits,
                                              omp_alloctrait_t traits[]) {
@@ -1412,6 +1726,7 @@ omp_allocator_handle_t __kmpc_init_allocator(int gtid, omp_memspace_handle_t ms,
       al->fb_data = RCAST(kmp_allocator_t *, traits[i].value);
       break;
     case omp_atk_partition:
+      al->partition = (omp_alloctrait_value_t)traits[i].value;
       al->memkind = RCAST(void **, traits[i].value);
       break;
     default:
@@ -1496,6 +1811,7 @@ typedef struct kmp_mem_desc { // Memory block descriptor
   size_t size_orig; // Original size requested
   void *ptr_align; // Pointer to aligned memory, returned
   kmp_allocator_t *allocator; // allocator
+  bool numa; // Block comes from the native NUMA path
 } kmp_mem_desc_t;
 static int alignment = sizeof(void *); // align to pointer size by default
 
@@ -1569,6 +1885,7 @@ void *__kmp_alloc(int gtid, size_t algn, size_t size,
     align = algn; // max of allocator trait, parameter and sizeof(void*)
   desc.size_orig = size;
   desc.size_a = size + sz_desc + align;
+  desc.numa = false;
   bool is_pinned = false;
   if (allocator > kmp_max_mem_alloc)
     is_pinned = al->pinned;
@@ -1723,14 +2040,14 @@ void *__kmp_alloc(int gtid, size_t algn, size_t size,
       } // else ptr == NULL;
     } else {
       // pool has enough space
-      ptr = __kmp_thread_malloc(__kmp_thread_from_gtid(gtid), desc.size_a);
+      ptr = __kmp_custom_malloc(gtid, al, desc.size_a, &desc.numa);
       if (ptr == NULL && al->fb == omp_atv_abort_fb) {
         KMP_ASSERT(0); // abort fallback requested
       } // no sense to look for another fallback because of same internal alloc
     }
   } else {
     // custom allocator, pool size not requested
-    ptr = __kmp_thread_malloc(__kmp_thread_from_gtid(gtid), desc.size_a);
+    ptr = __kmp_custom_malloc(gtid, al, desc.size_a, &desc.numa);
     if (ptr == NULL && al->fb == omp_atv_abort_fb) {
       KMP_ASSERT(0); // abort fallback requested
     } // no sense to look for another fallback because of same internal alloc
@@ -1890,7 +2207,7 @@ void ___kmpc_free(int gtid, void *ptr, omp_allocator_handle_t allocator) {
       (void)used; // to suppress compiler warning
       KMP_DEBUG_ASSERT(used >= desc.size_a);
     }
-    __kmp_thread_free(__kmp_thread_from_gtid(gtid), desc.ptr_alloc);
+    __kmp_custom_free(gtid, desc.ptr_alloc, desc.numa);
   }
 }
 
@@ -14,6 +14,7 @@
 #include "kmp_barrier.h"
 #include "kmp_itt.h"
 #include "kmp_os.h"
+#include "kmp_profile.h"
 #include "kmp_stats.h"
 #include "ompt-specific.h"
 // for distributed barrier
@@ -1809,7 +1810,9 @@ static int __kmp_barrier_template(enum barrier_type bt, int gtid, int is_split,
   }
 #endif
 
+  kmp_uint64 prof_start = 0;
   if (!team->t.t_serialized) {
+    prof_start = __kmp_prof_barrier_start(team);
 #if USE_ITT_BUILD
     // This value will be used in itt notify events below.
     void *itt_sync_obj = NULL;
@@ -2050,6 +2053,7 @@ static int __kmp_barrier_template(enum barrier_type bt, int gtid, int is_split,
       }
     }
   }
+  __kmp_prof_barrier_end(this_thr, team, prof_start);
   KA_TRACE(15, ("__kmp_barrier: T#%d(%d:%d) is leaving with return value %d\n",
                 gtid, __kmp_team_from_gtid(gtid)->t.t_id,
                 __kmp_tid_from_gtid(gtid), status));
@@ -2266,6 +2270,7 @@ void __kmp_join_barrier(int gtid) {
   if (__itt_sync_create_ptr || KMP_ITT_DEBUG)
     __kmp_itt_barrier_starting(gtid, itt_sync_obj);
 #endif /* USE_ITT_BUILD */
+  __kmp_prof_join_arrive(this_thr, team);
 
   switch (__kmp_barrier_gather_pattern[bs_forkjoin_barrier]) {
   case bp_dist_bar: {
@@ -2307,6 +2312,8 @@ void __kmp_join_barrier(int gtid) {
     if (__kmp_display_affinity) {
       KMP_CHECK_UPDATE(team->t.t_display_affinity, 0);
     }
+    if (UNLIKELY(__kmp_prof_enabled) && team->t.t_prof_sampled)
+      __kmp_prof_join(this_thr, team);
 #if KMP_STATS_ENABLED
     // Have primary thread flag the workers to indicate they are now waiting for
     // next parallel region, Also wake them up so they switch their timers to
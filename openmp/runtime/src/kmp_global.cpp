@@ -301,6 +301,7 @@ kmp_int32 __kmp_max_task_priority = 0;
 kmp_uint64 __kmp_taskloop_min_tasks = 0;
 
 int __kmp_memkind_available = 0;
+int __kmp_alloc_huge_pages = FALSE;
 omp_allocator_handle_t const omp_null_allocator = NULL;
 omp_allocator_handle_t const omp_default_mem_alloc =
     (omp_allocator_handle_t const)1;
@@ -354,6 +355,11 @@ KMP_BUILD_ASSERT(sizeof(kmp_tasking_flags_t) == 4);
 
 int __kmp_task_stealing_constraint = 1; /* Constrain task stealing by default */
 int __kmp_enable_task_throttling = 1;
+int __kmp_task_steal_locality = FALSE; /* Random victim selection by default */
+int __kmp_task_steal_batch = 1; /* Max tasks moved by one steal */
+int __kmp_prof_enabled = FALSE;
+char *__kmp_prof_file = NULL;
+int __kmp_prof_period = 1; /* Time every region instance by default */
 
 #ifdef DEBUG_SUSPEND
 int __kmp_suspend_count = 0;
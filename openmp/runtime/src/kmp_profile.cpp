@@ -0,0 +1,222 @@
+/*
+ * kmp_profile.cpp -- low overhead per-construct profiling
+ */
+
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "kmp_profile.h"
+#include "kmp_i18n.h"
+#include "kmp_io.h"
+#include "kmp_str.h"
+
+#define KMP_PROF_INITIAL_CAPACITY 64
+
+// All per-thread tables. Tables are never freed before shutdown, so the data
+// of threads that have been reaped is still reported.
+static kmp_prof_table_t *__kmp_prof_tables = NULL;
+static kmp_bootstrap_lock_t __kmp_prof_lock =
+    KMP_BOOTSTRAP_LOCK_INITIALIZER(__kmp_prof_lock);
+
+static inline kmp_uint32 __kmp_prof_hash(ident_t *loc) {
+  kmp_uint64 h = (kmp_uint64)(kmp_uintptr_t)loc;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return (kmp_uint32)h;
+}
+
+static void __kmp_prof_table_grow(kmp_prof_table_t *table) {
+  kmp_int32 old_capacity = table->capacity;
+  kmp_prof_entry_t *old_entries = table->entries;
+  kmp_int32 capacity =
+      old_capacity ? old_capacity * 2 : KMP_PROF_INITIAL_CAPACITY;
+  // Cannot use __kmp_thread_malloc() because the table outlives its thread
+  table->entries = (kmp_prof_entry_t *)__kmp_allocate(
+      capacity * sizeof(kmp_prof_entry_t)); // zeroed
+  table->capacity = capacity;
+  for (kmp_int32 i = 0; i < old_capacity; ++i) {
+    if (old_entries[i].loc == NULL)
+      continue;
+    kmp_uint32 idx = __kmp_prof_hash(old_entries[i].loc) & (capacity - 1);
+    while (table->entries[idx].loc != NULL)
+      idx = (idx + 1) & (capacity - 1);
+    table->entries[idx] = old_entries[i];
+  }
+  if (old_entries != NULL)
+    __kmp_free(old_entries);
+  // Entry addresses changed
+  table->last_loc = NULL;
+  table->last_entry = NULL;
+}
+
+// Find the entry for loc, inserting a zeroed one if it does not exist yet
+static kmp_prof_entry_t *__kmp_prof_table_find(kmp_prof_table_t *table,
+                                               ident_t *loc) {
+  if (loc == NULL) {
+    table->used = 1;
+    return &table->null_entry;
+  }
+  // Keep the load factor below 1/2
+  if (2 * (table->count + 1) > table->capacity)
+    __kmp_prof_table_grow(table);
+  kmp_int32 mask = table->capacity - 1;
+  kmp_uint32 idx = __kmp_prof_hash(loc) & mask;
+  while (table->entries[idx].loc != NULL) {
+    if (table->entries[idx].loc == loc)
+      return &table->entries[idx];
+    idx = (idx + 1) & mask;
+  }
+  table->entries[idx].loc = loc;
+  table->count++;
+  return &table->entries[idx];
+}
+
+kmp_prof_entry_t *__kmp_prof_lookup(kmp_info_t *th, ident_t *loc) {
+  kmp_prof_table_t *table = th->th.th_prof;
+  if (UNLIKELY(table == NULL)) {
+    table = (kmp_prof_table_t *)__kmp_allocate(sizeof(kmp_prof_table_t));
+    __kmp_acquire_bootstrap_lock(&__kmp_prof_lock);
+    table->next = __kmp_prof_tables;
+    __kmp_prof_tables = table;
+    __kmp_release_bootstrap_lock(&__kmp_prof_lock);
+    th->th.th_prof = table;
+  }
+  if (table->last_entry != NULL && table->last_loc == loc)
+    return table->last_entry;
+  kmp_prof_entry_t *entry = __kmp_prof_table_find(table, loc);
+  table->last_loc = loc;
+  table->last_entry = entry;
+  return entry;
+}
+
+// Called by the primary thread once the new team is set up, before the
+// workers are released.
+void __kmp_prof_fork(kmp_info_t *master_th, kmp_team_t *team, ident_t *loc) {
+  kmp_prof_entry_t *entry = __kmp_prof_lookup(master_th, loc);
+  int sampled = (entry->instances++ % __kmp_prof_period) == 0;
+  KMP_CHECK_UPDATE(team->t.t_prof_sampled, sampled);
+  if (sampled)
+    team->t.t_prof_fork_time = __kmp_now_nsec();
+}
+
+// Called by the primary thread at the join barrier after all threads of a
+// timed instance have arrived, so their arrival times can be read safely.
+void __kmp_prof_join(kmp_info_t *master_th, kmp_team_t *team) {
+  kmp_uint64 now = __kmp_now_nsec();
+  kmp_uint64 first = now, last = 0, wait = 0;
+  for (int i = 0; i < team->t.t_nproc; ++i) {
+    kmp_uint64 arrive = team->t.t_threads[i]->th.th_prof_arrive_time;
+    if (arrive < first)
+      first = arrive;
+    if (arrive > last)
+      last = arrive;
+    wait += now - arrive;
+  }
+  kmp_prof_entry_t *entry = __kmp_prof_lookup(master_th, team->t.t_ident);
+  entry->sampled++;
+  entry->time_ns += now - team->t.t_prof_fork_time;
+  entry->barrier_ns += wait;
+  entry->imbalance_ns += last > first ? last - first : 0;
+}
+
+static void __kmp_prof_merge(kmp_prof_entry_t *to,
+                             const kmp_prof_entry_t *from) {
+  to->instances += from->instances;
+  to->serialized += from->serialized;
+  to->sampled += from->sampled;
+  to->time_ns += from->time_ns;
+  to->barrier_ns += from->barrier_ns;
+  to->imbalance_ns += from->imbalance_ns;
+  to->tasks += from->tasks;
+  to->steals += from->steals;
+}
+
+static void __kmp_prof_print_json_str(FILE *f, const char *str) {
+  fputc('"', f);
+  for (; str != NULL && *str; ++str) {
+    if (*str == '"' || *str == '\\')
+      fputc('\\', f);
+    if ((unsigned char)*str >= 0x20)
+      fputc(*str, f);
+  }
+  fputc('"', f);
+}
+
+static void __kmp_prof_print_entry(FILE *f, const kmp_prof_entry_t *e,
+                                   bool first) {
+  kmp_str_loc_t loc =
+      __kmp_str_loc_init(e->loc != NULL ? e->loc->psource : NULL, false);
+  fprintf(f, "%s\n    {\"file\": ", first ? "" : ",");
+  __kmp_prof_print_json_str(f, loc.file);
+  fprintf(f, ", \"function\": ");
+  __kmp_prof_print_json_str(f, loc.func);
+  fprintf(f,
+          ", \"line\": %d, \"instances\": %llu, \"serialized\": %llu, "
+          "\"sampled\": %llu, \"time_ns\": %llu, \"barrier_wait_ns\": %llu, "
+          "\"imbalance_ns\": %llu, \"tasks\": %llu, \"steals\": %llu}",
+          loc.line, (unsigned long long)e->instances,
+          (unsigned long long)e->serialized,
+          (unsigned long long)e->sampled, (unsigned long long)e->time_ns,
+          (unsigned long long)e->barrier_ns,
+          (unsigned long long)e->imbalance_ns, (unsigned long long)e->tasks,
+          (unsigned long long)e->steals);
+  __kmp_str_loc_free(&loc);
+}
+
+// Merge the tables of all threads and write them to KMP_PROFILE_FILE.
+void __kmp_prof_fini() {
+  if (!__kmp_prof_enabled)
+    return;
+  __kmp_acquire_bootstrap_lock(&__kmp_prof_lock);
+  kmp_prof_table_t merged = {};
+  for (kmp_prof_table_t *t = __kmp_prof_tables; t != NULL; t = t->next) {
+    for (kmp_int32 i = 0; i < t->capacity; ++i)
+      if (t->entries[i].loc != NULL)
+        __kmp_prof_merge(__kmp_prof_table_find(&merged, t->entries[i].loc),
+                         &t->entries[i]);
+    if (t->used)
+      __kmp_prof_merge(__kmp_prof_table_find(&merged, NULL), &t->null_entry);
+  }
+
+  kmp_safe_raii_file_t f;
+  int code = f.try_open(__kmp_prof_file, "w");
+  if (code == 0) {
+    bool first = true;
+    fprintf(f, "{\n  \"period\": %d,\n  \"regions\": [", __kmp_prof_period);
+    if (merged.used) {
+      __kmp_prof_print_entry(f, &merged.null_entry, first);
+      first = false;
+    }
+    for (kmp_int32 i = 0; i < merged.capacity; ++i) {
+      if (merged.entries[i].loc == NULL)
+        continue;
+      __kmp_prof_print_entry(f, &merged.entries[i], first);
+      first = false;
+    }
+    fprintf(f, "\n  ]\n}\n");
+  } else {
+    // Losing the profile must not turn a successful run into a failure
+    __kmp_msg(kmp_ms_warning, KMP_MSG(CantOpenFileForReading, __kmp_prof_file),
+              KMP_ERR(code), KMP_HNT(CheckEnvVar, "KMP_PROFILE_FILE",
+                                     __kmp_prof_file),
+              __kmp_msg_null);
+  }
+
+  // Free all tables; the thread structures are gone at this point
+  if (merged.entries != NULL)
+    __kmp_free(merged.entries);
+  while (__kmp_prof_tables != NULL) {
+    kmp_prof_table_t *next = __kmp_prof_tables->next;
+    if (__kmp_prof_tables->entries != NULL)
+      __kmp_free(__kmp_prof_tables->entries);
+    __kmp_free(__kmp_prof_tables);
+    __kmp_prof_tables = next;
+  }
+  __kmp_release_bootstrap_lock(&__kmp_prof_lock);
+}
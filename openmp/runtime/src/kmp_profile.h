@@ -0,0 +1,97 @@
+/*
+ * kmp_profile.h -- low overhead per-construct profiling
+ */
+
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KMP_PROFILE_H
+#define KMP_PROFILE_H
+
+#include "kmp.h"
+
+/* Unlike the statistics in kmp_stats.h, the profile is always compiled in and
+   switched on at run time by setting KMP_PROFILE_FILE. Data is aggregated per
+   parallel region source location (ident_t) in tables owned by each thread,
+   so recording never takes a lock. Counters are updated for every region
+   instance; timings are taken for one in KMP_PROFILE_PERIOD instances. The
+   tables are merged and written as JSON when the library shuts down.
+   Serialized instances of a region (if(0), nesting beyond max-active-levels,
+   a single thread) are only counted: they have no team barriers to time. */
+
+// Statistics of one parallel region source location
+typedef struct kmp_prof_entry {
+  ident_t *loc; // Source location of the region, key of the entry
+  kmp_uint64 instances; // Number of times the region was forked
+  kmp_uint64 serialized; // Number of times the region ran serialized
+  kmp_uint64 sampled; // Number of instances that were timed
+  kmp_uint64 time_ns; // Fork to join wall time of timed instances
+  kmp_uint64 barrier_ns; // Time threads spent in barriers (timed instances)
+  kmp_uint64 imbalance_ns; // Last minus first arrival at the join barrier
+  kmp_uint64 tasks; // Explicit tasks executed inside the region
+  kmp_uint64 steals; // Tasks moved here from another thread's deque
+} kmp_prof_entry_t;
+
+// Open addressing hash table of entries, keyed by ident_t address
+typedef struct kmp_prof_table {
+  kmp_prof_entry_t *entries;
+  kmp_int32 capacity; // Always a power of two
+  kmp_int32 count;
+  int used; // The loc == NULL entry is in use
+  kmp_prof_entry_t null_entry; // Entry for regions without source location
+  ident_t *last_loc; // Last looked up location and its entry
+  kmp_prof_entry_t *last_entry;
+  struct kmp_prof_table *next; // Link in the list of all thread tables
+} kmp_prof_table_t;
+
+extern kmp_uint64 __kmp_now_nsec();
+
+extern kmp_prof_entry_t *__kmp_prof_lookup(kmp_info_t *th, ident_t *loc);
+extern void __kmp_prof_fork(kmp_info_t *master_th, kmp_team_t *team,
+                            ident_t *loc);
+extern void __kmp_prof_join(kmp_info_t *master_th, kmp_team_t *team);
+extern void __kmp_prof_fini();
+
+// Record the arrival of this_thr at the join barrier of a timed instance
+static inline void __kmp_prof_join_arrive(kmp_info_t *this_thr,
+                                          kmp_team_t *team) {
+  if (UNLIKELY(__kmp_prof_enabled) && team->t.t_prof_sampled)
+    this_thr->th.th_prof_arrive_time = __kmp_now_nsec();
+}
+
+static inline void __kmp_prof_count_task(kmp_info_t *th) {
+  if (UNLIKELY(__kmp_prof_enabled) && th->th.th_team != NULL)
+    __kmp_prof_lookup(th, th->th.th_team->t.t_ident)->tasks++;
+}
+
+// A steal may take extra tasks along with the one that is executed
+static inline void __kmp_prof_count_steal(kmp_info_t *th, int ntasks) {
+  if (UNLIKELY(__kmp_prof_enabled) && th->th.th_team != NULL)
+    __kmp_prof_lookup(th, th->th.th_team->t.t_ident)->steals += ntasks;
+}
+
+static inline void __kmp_prof_count_serialized(kmp_info_t *th, ident_t *loc) {
+  if (UNLIKELY(__kmp_prof_enabled))
+    __kmp_prof_lookup(th, loc)->serialized++;
+}
+
+// Explicit barriers: start returns 0 when the instance is not timed
+static inline kmp_uint64 __kmp_prof_barrier_start(kmp_team_t *team) {
+  if (UNLIKELY(__kmp_prof_enabled) && team->t.t_prof_sampled)
+    return __kmp_now_nsec();
+  return 0;
+}
+
+static inline void __kmp_prof_barrier_end(kmp_info_t *th, kmp_team_t *team,
+                                          kmp_uint64 start) {
+  if (start != 0)
+    __kmp_prof_lookup(th, team->t.t_ident)->barrier_ns +=
+        __kmp_now_nsec() - start;
+}
+
+#endif // KMP_PROFILE_H
@@ -18,6 +18,7 @@
 #include "kmp_i18n.h"
 #include "kmp_io.h"
 #include "kmp_itt.h"
+#include "kmp_profile.h"
 #include "kmp_settings.h"
 #include "kmp_stats.h"
 #include "kmp_str.h"
@@ -562,9 +563,13 @@ static void __kmp_print_team_storage_map(const char *header, kmp_team_t *team,
 
 static void __kmp_init_allocator() {
   __kmp_init_memkind();
+  __kmp_init_numa_alloc();
   __kmp_init_target_mem();
 }
-static void __kmp_fini_allocator() { __kmp_fini_memkind(); }
+static void __kmp_fini_allocator() {
+  __kmp_fini_memkind();
+  __kmp_fini_numa_alloc();
+}
 
 /* ------------------------------------------------------------------------ */
 
@@ -1175,6 +1180,7 @@ void __kmp_serialized_parallel(ident_t *loc, kmp_int32 global_tid) {
 
   this_thr = __kmp_threads[global_tid];
   serial_team = this_thr->th.th_serial_team;
+  __kmp_prof_count_serialized(this_thr, loc);
 
   /* utilize the serialized team held by this thread */
   KMP_DEBUG_ASSERT(serial_team);
@@ -1444,6 +1450,8 @@ __kmp_fork_in_teams(ident_t *loc, int gtid, kmp_team_t *parent_team,
   int i;
 
   parent_team->t.t_ident = loc;
+  if (__kmp_prof_enabled)
+    __kmp_prof_fork(master_th, parent_team, loc);
   __kmp_alloc_argv_entries(argc, parent_team, TRUE);
   parent_team->t.t_argc = argc;
   argv = (void **)parent_team->t.t_argv;
@@ -2177,6 +2185,8 @@ int __kmp_fork_call(ident_t *loc, int gtid,
     KMP_CHECK_UPDATE(team->t.t_master_tid, master_tid);
     KMP_CHECK_UPDATE(team->t.t_master_this_cons, master_this_cons);
     KMP_CHECK_UPDATE(team->t.t_ident, loc);
+    if (__kmp_prof_enabled)
+      __kmp_prof_fork(master_th, team, loc);
     KMP_CHECK_UPDATE(team->t.t_parent, parent_team);
     KMP_CHECK_UPDATE_SYNC(team->t.t_pkfn, microtask);
 #if OMPT_SUPPORT
@@ -8257,6 +8267,8 @@ void __kmp_cleanup(void) {
   __kmp_stats_fini();
 #endif
 
+  __kmp_prof_fini();
+
   KA_TRACE(10, ("__kmp_cleanup: exit\n"));
 }
 
@@ -4033,6 +4033,19 @@ static void __kmp_stg_print_allocator(kmp_str_buf_t *buffer, char const *name,
   }
 }
 
+// -----------------------------------------------------------------------------
+// KMP_ALLOC_HUGE_PAGES
+
+static void __kmp_stg_parse_alloc_huge_pages(char const *name,
+                                             char const *value, void *data) {
+  __kmp_stg_parse_bool(name, value, &__kmp_alloc_huge_pages);
+} // __kmp_stg_parse_alloc_huge_pages
+
+static void __kmp_stg_print_alloc_huge_pages(kmp_str_buf_t *buffer,
+                                             char const *name, void *data) {
+  __kmp_stg_print_bool(buffer, name, __kmp_alloc_huge_pages);
+} // __kmp_stg_print_alloc_huge_pages
+
 // -----------------------------------------------------------------------------
 // OMP_DYNAMIC
 
@@ -5354,6 +5367,70 @@ static void __kmp_stg_print_task_throttling(kmp_str_buf_t *buffer,
   __kmp_stg_print_bool(buffer, name, __kmp_enable_task_throttling);
 } // __kmp_stg_print_task_throttling
 
+// -----------------------------------------------------------------------------
+// KMP_TASK_STEAL_LOCALITY
+
+static void __kmp_stg_parse_task_steal_locality(char const *name,
+                                                char const *value, void *data) {
+  __kmp_stg_parse_bool(name, value, &__kmp_task_steal_locality);
+} // __kmp_stg_parse_task_steal_locality
+
+static void __kmp_stg_print_task_steal_locality(kmp_str_buf_t *buffer,
+                                                char const *name, void *data) {
+  __kmp_stg_print_bool(buffer, name, __kmp_task_steal_locality);
+} // __kmp_stg_print_task_steal_locality
+
+// -----------------------------------------------------------------------------
+// KMP_TASK_STEAL_BATCH
+
+static void __kmp_stg_parse_task_steal_batch(char const *name,
+                                             char const *value, void *data) {
+  __kmp_stg_parse_int(name, value, KMP_MIN_TASK_STEAL_BATCH,
+                      KMP_MAX_TASK_STEAL_BATCH, &__kmp_task_steal_batch);
+} // __kmp_stg_parse_task_steal_batch
+
+static void __kmp_stg_print_task_steal_batch(kmp_str_buf_t *buffer,
+                                             char const *name, void *data) {
+  __kmp_stg_print_int(buffer, name, __kmp_task_steal_batch);
+} // __kmp_stg_print_task_steal_batch
+
+// -----------------------------------------------------------------------------
+// KMP_PROFILE_FILE
+
+static void __kmp_stg_parse_profile_file(char const *name, char const *value,
+                                         void *data) {
+  __kmp_stg_parse_str(name, value, &__kmp_prof_file);
+  __kmp_prof_enabled = (__kmp_prof_file != NULL && *__kmp_prof_file != '\0');
+  K_DIAG(1, ("__kmp_prof_file == %s\n", __kmp_prof_file));
+} // __kmp_stg_parse_profile_file
+
+static void __kmp_stg_print_profile_file(kmp_str_buf_t *buffer,
+                                         char const *name, void *data) {
+  if (__kmp_env_format) {
+    KMP_STR_BUF_PRINT_NAME;
+  } else {
+    __kmp_str_buf_print(buffer, "   %s", name);
+  }
+  if (__kmp_prof_file) {
+    __kmp_str_buf_print(buffer, "='%s'\n", __kmp_prof_file);
+  } else {
+    __kmp_str_buf_print(buffer, ": %s\n", KMP_I18N_STR(NotDefined));
+  }
+} // __kmp_stg_print_profile_file
+
+// -----------------------------------------------------------------------------
+// KMP_PROFILE_PERIOD
+
+static void __kmp_stg_parse_profile_period(char const *name, char const *value,
+                                           void *data) {
+  __kmp_stg_parse_int(name, value, 1, INT_MAX, &__kmp_prof_period);
+} // __kmp_stg_parse_profile_period
+
+static void __kmp_stg_print_profile_period(kmp_str_buf_t *buffer,
+                                           char const *name, void *data) {
+  __kmp_stg_print_int(buffer, name, __kmp_prof_period);
+} // __kmp_stg_print_profile_period
+
 #if KMP_HAVE_MWAIT || KMP_HAVE_UMWAIT
 // -----------------------------------------------------------------------------
 // KMP_USER_LEVEL_MWAIT
@@ -5743,6 +5820,14 @@ static kmp_setting_t __kmp_stg_table[] = {
 #endif
     {"KMP_ENABLE_TASK_THROTTLING", __kmp_stg_parse_task_throttling,
      __kmp_stg_print_task_throttling, NULL, 0, 0},
+    {"KMP_TASK_STEAL_LOCALITY", __kmp_stg_parse_task_steal_locality,
+     __kmp_stg_print_task_steal_locality, NULL, 0, 0},
+    {"KMP_TASK_STEAL_BATCH", __kmp_stg_parse_task_steal_batch,
+     __kmp_stg_print_task_steal_batch, NULL, 0, 0},
+    {"KMP_PROFILE_FILE", __kmp_stg_parse_profile_file,
+     __kmp_stg_print_profile_file, NULL, 0, 0},
+    {"KMP_PROFILE_PERIOD", __kmp_stg_parse_profile_period,
+     __kmp_stg_print_profile_period, NULL, 0, 0},
 
     {"OMP_DISPLAY_ENV", __kmp_stg_parse_omp_display_env,
      __kmp_stg_print_omp_display_env, NULL, 0, 0},
@@ -5750,6 +5835,8 @@ static kmp_setting_t __kmp_stg_table[] = {
      __kmp_stg_print_omp_cancellation, NULL, 0, 0},
     {"OMP_ALLOCATOR", __kmp_stg_parse_allocator, __kmp_stg_print_allocator,
      NULL, 0, 0},
+    {"KMP_ALLOC_HUGE_PAGES", __kmp_stg_parse_alloc_huge_pages,
+     __kmp_stg_print_alloc_huge_pages, NULL, 0, 0},
     {"LIBOMP_USE_HIDDEN_HELPER_TASK", __kmp_stg_parse_use_hidden_helper,
      __kmp_stg_print_use_hidden_helper, NULL, 0, 0},
     {"LIBOMP_NUM_HIDDEN_HELPER_THREADS",
@@ -11,8 +11,10 @@
 //===----------------------------------------------------------------------===//
 
 #include "kmp.h"
+#include "kmp_affinity.h"
 #include "kmp_i18n.h"
 #include "kmp_itt.h"
+#include "kmp_profile.h"
 #include "kmp_stats.h"
 #include "kmp_wait_release.h"
 #include "kmp_taskdeps.h"
@@ -1830,6 +1832,7 @@ __kmp_invoke_task(kmp_int32 gtid, kmp_task_t *task,
       taskdata->td_last_tied = current_task->td_last_tied;
       KMP_DEBUG_ASSERT(taskdata->td_last_tied);
     }
+    __kmp_prof_count_task(__kmp_threads[gtid]);
 #if KMP_STATS_ENABLED
     KMP_COUNT_BLOCK(TASK_executed);
     switch (KMP_GET_THREAD_STATE()) {
@@ -3215,6 +3218,41 @@ static kmp_task_t *__kmp_remove_my_task(kmp_info_t *thread, kmp_int32 gtid,
   return task;
 }
 
+// __kmp_push_stolen_tasks: append tasks taken from a victim's deque by a
+// batched steal to the tail of the calling thread's own deque. The victim's
+// deque lock must not be held, otherwise two threads stealing from each other
+// could deadlock.
+static void __kmp_push_stolen_tasks(kmp_int32 gtid, kmp_task_team_t *task_team,
+                                    kmp_taskdata_t **tasks, int ntasks) {
+  kmp_info_t *thread = __kmp_threads[gtid];
+  kmp_thread_data_t *thread_data =
+      &task_team->tt.tt_threads_data[__kmp_tid_from_gtid(gtid)];
+
+  // No lock needed since only owner can allocate.
+  if (UNLIKELY(thread_data->td.td_deque == NULL)) {
+    __kmp_alloc_task_deque(thread, thread_data);
+  }
+
+  __kmp_acquire_bootstrap_lock(&thread_data->td.td_deque_lock);
+  for (int i = 0; i < ntasks; ++i) {
+    if (TCR_4(thread_data->td.td_deque_ntasks) >=
+        TASK_DEQUE_SIZE(thread_data->td)) {
+      __kmp_realloc_task_deque(thread, thread_data);
+    }
+    thread_data->td.td_deque[thread_data->td.td_deque_tail] = tasks[i];
+    // Wrap index.
+    thread_data->td.td_deque_tail =
+        (thread_data->td.td_deque_tail + 1) & TASK_DEQUE_MASK(thread_data->td);
+    TCW_4(thread_data->td.td_deque_ntasks,
+          TCR_4(thread_data->td.td_deque_ntasks) + 1); // Adjust task count
+  }
+  KA_TRACE(20, ("__kmp_push_stolen_tasks: T#%d moved %d stolen tasks to its "
+                "deque: ntasks=%d head=%u tail=%u\n",
+                gtid, ntasks, thread_data->td.td_deque_ntasks,
+                thread_data->td.td_deque_head, thread_data->td.td_deque_tail));
+  __kmp_release_bootstrap_lock(&thread_data->td.td_deque_lock);
+}
+
 // __kmp_steal_task: remove a task from another thread's deque
 // Assume that calling thread has already checked existence of
 // task_team thread_data before calling this routine.
@@ -3229,6 +3267,8 @@ static kmp_task_t *__kmp_steal_task(kmp_int32 victim_tid, kmp_int32 gtid,
   kmp_thread_data_t *victim_td, *threads_data;
   kmp_int32 target;
   kmp_info_t *victim_thr;
+  kmp_taskdata_t *extra[KMP_MAX_TASK_STEAL_BATCH];
+  int nextra = 0;
 
   KMP_DEBUG_ASSERT(__kmp_tasking_mode != tskm_immediate_exec);
 
@@ -3276,6 +3316,19 @@ static kmp_task_t *__kmp_steal_task(kmp_int32 victim_tid, kmp_int32 gtid,
     // Bump head pointer and Wrap.
     victim_td->td.td_deque_head =
         (victim_td->td.td_deque_head + 1) & TASK_DEQUE_MASK(victim_td->td);
+    // Steal up to half of the victim's tasks when batching is enabled. The
+    // extra tasks are taken from the head as long as we are allowed to run
+    // them and are moved to our own deque once the victim's lock is released.
+    int max_extra = KMP_MIN(__kmp_task_steal_batch, ntasks / 2) - 1;
+    while (nextra < max_extra) {
+      kmp_taskdata_t *next =
+          victim_td->td.td_deque[victim_td->td.td_deque_head];
+      if (!__kmp_task_is_allowed(gtid, is_constrained, next, current))
+        break;
+      extra[nextra++] = next;
+      victim_td->td.td_deque_head =
+          (victim_td->td.td_deque_head + 1) & TASK_DEQUE_MASK(victim_td->td);
+    }
   } else {
     if (!task_team->tt.tt_untied_task_encountered) {
       // The TSC does not allow to steal victim task
@@ -3334,21 +3387,152 @@ static kmp_task_t *__kmp_steal_task(kmp_int32 victim_tid, kmp_int32 gtid,
          gtid, count + 1, task_team));
     *thread_finished = FALSE;
   }
-  TCW_4(victim_td->td.td_deque_ntasks, ntasks - 1);
+  TCW_4(victim_td->td.td_deque_ntasks, ntasks - 1 - nextra);
 
   __kmp_release_bootstrap_lock(&victim_td->td.td_deque_lock);
 
+  if (nextra > 0)
+    __kmp_push_stolen_tasks(gtid, task_team, extra, nextra);
+
   KMP_COUNT_BLOCK(TASK_stolen);
+  __kmp_prof_count_steal(__kmp_threads[gtid], 1 + nextra);
   KA_TRACE(10,
-           ("__kmp_steal_task(exit #5): T#%d stole task %p from T#%d: "
+           ("__kmp_steal_task(exit #5): T#%d stole task %p (+%d) from T#%d: "
             "task_team=%p ntasks=%d head=%u tail=%u\n",
-            gtid, taskdata, __kmp_gtid_from_thread(victim_thr), task_team,
-            ntasks, victim_td->td.td_deque_head, victim_td->td.td_deque_tail));
+            gtid, taskdata, nextra, __kmp_gtid_from_thread(victim_thr),
+            task_team, ntasks, victim_td->td.td_deque_head,
+            victim_td->td.td_deque_tail));
 
   task = KMP_TASKDATA_TO_TASK(taskdata);
   return task;
 }
 
+// __kmp_task_share_hw_unit: return true if the threads placed at ids1 and ids2
+// are both bound inside the same topology unit of the given type.
+static bool __kmp_task_share_hw_unit(const kmp_affinity_ids_t &ids1,
+                                     const kmp_affinity_ids_t &ids2,
+                                     kmp_hw_t type) {
+  int level = __kmp_topology->get_level(type);
+  if (level < 0)
+    return false;
+  // sub_ids restart under every parent, so all levels above must match too
+  for (int i = 0; i <= level; ++i) {
+    kmp_hw_t t = __kmp_topology->get_type(i);
+    int id = ids1.ids[t];
+    if (id == kmp_hw_thread_t::UNKNOWN_ID ||
+        id == kmp_hw_thread_t::MULTIPLE_ID || id != ids2.ids[t])
+      return false;
+  }
+  return true;
+}
+
+// __kmp_task_steal_tier: classify victim relative to thief by the closest
+// topology unit they share.
+static kmp_steal_tier_t __kmp_task_steal_tier(kmp_info_t *thief,
+                                              kmp_info_t *victim) {
+  if (__kmp_topology == NULL || !KMP_AFFINITY_CAPABLE())
+    return steal_tier_remote;
+  const kmp_affinity_ids_t &ids1 = thief->th.th_topology_ids;
+  const kmp_affinity_ids_t &ids2 = victim->th.th_topology_ids;
+  if (__kmp_task_share_hw_unit(ids1, ids2, KMP_HW_CORE))
+    return steal_tier_core;
+  if (__kmp_task_share_hw_unit(ids1, ids2, KMP_HW_LLC))
+    return steal_tier_llc;
+  if (__kmp_task_share_hw_unit(ids1, ids2, KMP_HW_NUMA))
+    return steal_tier_numa;
+  return steal_tier_remote;
+}
+
+// __kmp_build_steal_order: (re)build the calling thread's list of steal
+// victims, grouped by locality tier. Only the owner thread touches its list.
+static void __kmp_build_steal_order(kmp_task_team_t *task_team,
+                                    kmp_int32 tid) {
+  kmp_thread_data_t *threads_data = task_team->tt.tt_threads_data;
+  kmp_thread_data_t *thread_data = &threads_data[tid];
+  kmp_info_t *thread = thread_data->td.td_thr;
+  kmp_int32 nthreads = task_team->tt.tt_nproc;
+
+  if (thread_data->td.td_steal_order_size < nthreads) {
+    if (thread_data->td.td_steal_order != NULL)
+      __kmp_free(thread_data->td.td_steal_order);
+    // Cannot use __kmp_thread_malloc() because threads not around for
+    // kmp_reap_task_team( ).
+    thread_data->td.td_steal_order =
+        (kmp_int32 *)__kmp_allocate(nthreads * sizeof(kmp_int32));
+    thread_data->td.td_steal_order_size = nthreads;
+  }
+
+  kmp_int32 n = 0;
+  for (int tier = steal_tier_core; tier < steal_tier_last; ++tier) {
+    for (kmp_int32 i = 0; i < nthreads; ++i) {
+      if (i == tid)
+        continue;
+      if (__kmp_task_steal_tier(thread, threads_data[i].td.td_thr) == tier)
+        thread_data->td.td_steal_order[n++] = i;
+    }
+    thread_data->td.td_steal_tier_end[tier] = n;
+  }
+  KMP_DEBUG_ASSERT(n == nthreads - 1);
+  thread_data->td.td_steal_nthreads = nthreads;
+
+  KA_TRACE(20, ("__kmp_build_steal_order: T#%d core=%d llc=%d numa=%d "
+                "remote=%d\n",
+                __kmp_gtid_from_thread(thread),
+                thread_data->td.td_steal_tier_end[steal_tier_core],
+                thread_data->td.td_steal_tier_end[steal_tier_llc],
+                thread_data->td.td_steal_tier_end[steal_tier_numa],
+                thread_data->td.td_steal_tier_end[steal_tier_remote]));
+}
+
+// __kmp_steal_task_by_locality: try to steal a task from the victims closest
+// to the calling thread first: threads on the same core, then the same last
+// level cache, then the same NUMA domain and finally any other thread. Victims
+// within a tier are visited round-robin starting at a random position.
+// On success the victim's thread number is returned through victim_tid.
+static kmp_task_t *__kmp_steal_task_by_locality(
+    kmp_info_t *thread, kmp_int32 gtid, kmp_task_team_t *task_team,
+    std::atomic<kmp_int32> *unfinished_threads, int *thread_finished,
+    kmp_int32 is_constrained, kmp_int32 *victim_tid) {
+  kmp_thread_data_t *threads_data = task_team->tt.tt_threads_data;
+  kmp_int32 tid = thread->th.th_info.ds.ds_tid;
+  kmp_thread_data_t *thread_data = &threads_data[tid];
+
+  if (thread_data->td.td_steal_nthreads != task_team->tt.tt_nproc)
+    __kmp_build_steal_order(task_team, tid);
+
+  kmp_int32 *order = thread_data->td.td_steal_order;
+  kmp_int32 begin = 0;
+  for (int tier = steal_tier_core; tier < steal_tier_last; ++tier) {
+    kmp_int32 end = thread_data->td.td_steal_tier_end[tier];
+    kmp_int32 n = end - begin;
+    if (n > 0) {
+      kmp_int32 start = __kmp_get_random(thread) % n;
+      for (kmp_int32 i = 0; i < n; ++i) {
+        kmp_int32 victim = order[begin + (start + i) % n];
+        kmp_info_t *other_thread = threads_data[victim].td.td_thr;
+        // Wake up a sleeping victim the same way random selection does; it
+        // should not have any tasks, so move on to the next one.
+        if ((__kmp_tasking_mode == tskm_task_teams) &&
+            (__kmp_dflt_blocktime != KMP_MAX_BLOCKTIME) &&
+            (TCR_PTR(CCAST(void *, other_thread->th.th_sleep_loc)) != NULL)) {
+          __kmp_null_resume_wrapper(other_thread);
+          continue;
+        }
+        kmp_task_t *task =
+            __kmp_steal_task(victim, gtid, task_team, unfinished_threads,
+                             thread_finished, is_constrained);
+        if (task != NULL) {
+          *victim_tid = victim;
+          return task;
+        }
+      }
+    }
+    begin = end;
+  }
+  *victim_tid = -1;
+  return NULL;
+}
+
 // __kmp_execute_tasks_template: Choose and execute tasks until either the
 // condition is statisfied (return true) or there are none left (return false).
 //
@@ -3413,6 +3597,12 @@ static inline int __kmp_execute_tasks_template(
         }
         if (victim_tid != -1) { // found last victim
           asleep = 0;
+        } else if (!new_victim && __kmp_task_steal_locality) {
+          // Walk the victims nearest first; the walk performs the steal
+          // attempts itself, so asleep stays set to skip the one below.
+          task = __kmp_steal_task_by_locality(
+              thread, gtid, task_team, unfinished_threads, thread_finished,
+              is_constrained, &victim_tid);
         } else if (!new_victim) { // no recent steals and we haven't already
           // used a new victim; select a random thread
           do { // Find a different thread to steal work from.
@@ -3789,6 +3979,10 @@ static void __kmp_free_task_deque(kmp_thread_data_t *thread_data) {
     thread_data->td.td_deque = NULL;
     __kmp_release_bootstrap_lock(&thread_data->td.td_deque_lock);
   }
+  if (thread_data->td.td_steal_order != NULL) {
+    __kmp_free(thread_data->td.td_steal_order);
+    thread_data->td.td_steal_order = NULL;
+  }
 
 #ifdef BUILD_TIED_TASK_STACK
   // GEH: Figure out what to do here for td_susp_tied_tasks
@@ -3896,6 +4090,9 @@ static int __kmp_realloc_task_threads_data(kmp_info_t *thread,
         // parallel region will exhibit the same behavior as previous region.
         thread_data->td.td_deque_last_stolen = -1;
       }
+      // Team membership and thread placement may have changed as well, so
+      // the locality-ordered victim list is rebuilt on the next steal.
+      thread_data->td.td_steal_nthreads = 0;
     }
 
     KMP_MB();
@@ -0,0 +1,65 @@
+// RUN: %libomp-compile-and-run
+// RUN: env KMP_ALLOC_HUGE_PAGES=1 %libomp-run
+// UNSUPPORTED: gnu
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#define NTH 8
+#define NREP 16
+#define AL 64
+
+// Every partition value must produce usable, correctly aligned memory that
+// can be reused after being freed, whether or not the native NUMA path or
+// memkind serves it.
+int main()
+{
+  int err = 0;
+  int k;
+  omp_alloctrait_value_t parts[] = {omp_atv_environment, omp_atv_nearest,
+                                    omp_atv_blocked, omp_atv_interleaved};
+  for (k = 0; k < 4; ++k) {
+    omp_alloctrait_t at[2];
+    omp_allocator_handle_t a;
+    at[0].key = omp_atk_partition;
+    at[0].value = parts[k];
+    at[1].key = omp_atk_alignment;
+    at[1].value = AL;
+    a = omp_init_allocator(omp_default_mem_space, 2, at);
+    printf("allocator partition %d created: %p\n", (int)parts[k], (void *)a);
+    #pragma omp parallel num_threads(NTH)
+    {
+      int i, r;
+      for (r = 0; r < NREP; ++r) {
+        // Sizes from a few bytes up to several huge pages
+        size_t size = (size_t)1 << (4 + (r + omp_get_thread_num()) % 20);
+        char *p = (char *)omp_alloc(size, a);
+        if (p == NULL || (size_t)p % AL) {
+          #pragma omp atomic
+            err++;
+          printf("Error: th %d, ptr %p of size %d\n", omp_get_thread_num(),
+                 (void *)p, (int)size);
+          continue;
+        }
+        memset(p, r, size);
+        for (i = 0; i < (int)size; i += 4096)
+          if (p[i] != (char)r) {
+            #pragma omp atomic
+              err++;
+            break;
+          }
+        omp_free(p, a);
+      }
+    }
+    omp_destroy_allocator(a);
+  }
+
+  if (err == 0) {
+    printf("passed\n");
+    return 0;
+  } else {
+    printf("failed\n");
+    return 1;
+  }
+}
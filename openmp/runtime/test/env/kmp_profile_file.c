@@ -0,0 +1,55 @@
+// RUN: %libomp-compile
+// RUN: env KMP_PROFILE_FILE=%t.json %libomp-run
+// RUN: FileCheck %s < %t.json
+// RUN: env KMP_PROFILE_FILE=%t.period.json KMP_PROFILE_PERIOD=4 %libomp-run
+// RUN: FileCheck --check-prefix=PERIOD %s < %t.period.json
+// UNSUPPORTED: gcc
+
+// The profile must have one entry per parallel region source location, with
+// instances counted exactly and tasks counted inside the region creating them.
+// Serialized instances are counted separately and never timed.
+// CHECK: "regions": [
+// CHECK-DAG: "line": [[@LINE+20]], "instances": 10, "serialized": 0, "sampled": 10,
+// CHECK-DAG: "line": [[@LINE+26]], "instances": 3, "serialized": 0, "sampled": 3,{{.*}}"tasks": 96,
+// CHECK-DAG: "line": [[@LINE+36]], "instances": 0, "serialized": 5, "sampled": 0,
+// PERIOD-DAG: "line": [[@LINE+17]], "instances": 10, "serialized": 0, "sampled": 3,
+// PERIOD-DAG: "line": [[@LINE+23]], "instances": 3, "serialized": 0, "sampled": 1,
+#include <stdio.h>
+#include <omp.h>
+
+#define NTASKS 32
+
+int work(int n) {
+  int i, s = 0;
+  for (i = 0; i < n; ++i)
+    s += i % 7;
+  return s;
+}
+
+int main() {
+  int i, sum = 0;
+  for (i = 0; i < 10; ++i) {
+#pragma omp parallel reduction(+ : sum)
+    {
+      sum += work(1000 * (omp_get_thread_num() + 1));
+#pragma omp barrier
+    }
+  }
+  for (i = 0; i < 3; ++i) {
+#pragma omp parallel
+#pragma omp single
+    {
+      int t;
+      for (t = 0; t < NTASKS; ++t) {
+#pragma omp task
+        work(10000);
+      }
+    }
+  }
+  for (i = 0; i < 5; ++i) {
+#pragma omp parallel if (0)
+    sum += work(100);
+  }
+  printf("sum = %d\n", sum);
+  return 0;
+}
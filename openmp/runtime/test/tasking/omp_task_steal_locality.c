@@ -0,0 +1,61 @@
+// RUN: %libomp-compile
+// RUN: env KMP_TASK_STEAL_LOCALITY=0 %libomp-run
+// RUN: env KMP_TASK_STEAL_LOCALITY=1 %libomp-run
+// RUN: env KMP_TASK_STEAL_LOCALITY=1 KMP_AFFINITY=compact %libomp-run
+// RUN: env KMP_TASK_STEAL_LOCALITY=1 KMP_TASK_STEAL_BATCH=8 %libomp-run
+// RUN: env KMP_TASK_STEAL_LOCALITY=0 KMP_TASK_STEAL_BATCH=32 %libomp-run
+
+#include <stdio.h>
+
+/*
+ * Build an unbalanced recursive task tree so that threads run out of work and
+ * have to steal from each other, both with random and with locality-ordered
+ * victim selection and with and without batched steals. Every task must be
+ * executed exactly once regardless of the stealing policy.
+ */
+
+#define DEPTH 14
+#define NUM_ROUNDS 5
+
+static int count_tasks(int depth) {
+  int left = 0, right = 0;
+  if (depth == 0)
+    return 1;
+#pragma omp task shared(left)
+  left = count_tasks(depth - 1);
+  // Skew the tree so that some threads finish early
+  if (depth % 3 != 0) {
+#pragma omp task shared(right)
+    right = count_tasks(depth - 2 > 0 ? depth - 2 : 0);
+  }
+#pragma omp taskwait
+  return 1 + left + right;
+}
+
+static int count_serial(int depth) {
+  if (depth == 0)
+    return 1;
+  int n = 1 + count_serial(depth - 1);
+  if (depth % 3 != 0)
+    n += count_serial(depth - 2 > 0 ? depth - 2 : 0);
+  return n;
+}
+
+int main() {
+  int i;
+  int expected = count_serial(DEPTH);
+  int failed = 0;
+
+  for (i = 0; i < NUM_ROUNDS; ++i) {
+    int result = 0;
+#pragma omp parallel shared(result)
+#pragma omp single
+    result = count_tasks(DEPTH);
+    if (result != expected) {
+      fprintf(stderr, "round %d: expected %d tasks, got %d\n", i, expected,
+              result);
+      failed = 1;
+    }
+  }
+  return failed;
+}